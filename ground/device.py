@@ -39,6 +39,9 @@ class Device(GObject.GObject):
 		self.state = self.State.STOP
 		self.id = -1
 		self.recv_cb = {}
+		self.stats = None
+		self.prof = {}
+		self.version = 0
 
 		# Open the device
 		self.smi = SerialMessagesInterface(self.on_recv, self.on_disconnect, False, port, 115200, 'usbrf')
@@ -59,6 +62,10 @@ class Device(GObject.GObject):
 		data_len = len(data)
 		offset = 0
 
+		# Both radio chips can run a protocol at once, so stop the previous one ourselves
+		if self.is_running() and prot != self.prot:
+			self.stop_prot()
+
 		# Split in messages of data length 200 maximum
 		while offset < data_len+1:
 			offset_end = offset+200 if offset+200 < data_len else data_len
@@ -77,6 +84,14 @@ class Device(GObject.GObject):
 		self.state = state
 		self.dm.on_update()
 
+	def set_filter(self, action, chip_id, ids=[]):
+		"""Change the transmitter ID filter of a radio chip (action 0 clear, 1 allow, 2 deny or 3 remove)"""
+		msg = PprzMessage('usbrf', 'TX_FILTER')
+		msg['action'] = int(action)
+		msg['chip_id'] = int(chip_id)
+		msg['ids'] = list(ids)
+		self.smi.send(msg, 0)
+
 	def is_scanning(self):
 		"""Whether the device is in one of the scanning protocols"""
 		return (self.state == self.State.START and (self.prot == self.Prot.CYRF_SCANNER or self.prot == self.Prot.CC_SCANNER))
@@ -102,6 +117,14 @@ class Device(GObject.GObject):
 		"""When the device received a valid PPRZLINK message handle it"""
 		if msg._name == 'INFO':
 			self.on_msg_info(msg)
+		elif msg._name == 'STATS':
+			self.on_msg_stats(msg)
+		elif msg._name == 'PROF_STATS':
+			self.on_msg_prof_stats(msg)
+		elif msg._name == 'RECV_DATA_BATCH':
+			self.on_msg_recv_data_batch(msg)
+		elif msg._name == 'RECV_DATA':
+			self.on_msg_recv_data(msg)
 		elif msg._name in self.recv_cb:
 			self.recv_cb[msg._name](msg)
 
@@ -118,6 +141,38 @@ class Device(GObject.GObject):
 		self.chips = self.get_chips()
 		self.dm.on_info(self)
 
+	def on_msg_stats(self, msg):
+		"""Keep the transmit statistics, the drops are per message id"""
+		self.stats = {'msgs': msg.msgs, 'dropped': msg.dropped, 'raw_dropped': msg.raw_dropped, 'drops': list(msg.drops)}
+
+	def on_msg_prof_stats(self, msg):
+		"""Keep the execution time statistics per site in cycles, the histogram is per log2 bucket"""
+		self.prof[msg.site] = {'count': msg.count, 'min': msg.min, 'max': msg.max, 'mean': msg.mean, 'hist': list(msg.hist)}
+
+	def on_msg_recv_data(self, msg):
+		"""Split the receive time in microseconds from the packet (since firmware 1001)"""
+		if 'RECV_DATA' not in self.recv_cb:
+			return
+
+		msg.rx_time = None
+		if self.version >= 1001:
+			data = list(msg.data)
+			msg.rx_time = data[-4] | (data[-3] << 8) | (data[-2] << 16) | (data[-1] << 24)
+			msg['data'] = data[:-4]
+		self.recv_cb['RECV_DATA'](msg)
+
+	def on_msg_recv_data_batch(self, msg):
+		"""Split a batch into RECV_DATA messages, each packet is a chip id, length and data"""
+		data = list(msg.data)
+		i = 0
+		while i + 2 <= len(data):
+			length = data[i+1]
+			recv = PprzMessage('usbrf', 'RECV_DATA')
+			recv['chip_id'] = data[i]
+			recv['data'] = data[i+2:i+2+length]
+			self.on_msg_recv_data(recv)
+			i += 2 + length
+
 	def get_chips(self):
 		"""Get the chips that are available on the board based on the hardware ID"""
 		if self.board <= 1:
@@ -38,6 +38,8 @@ class DSMX(Protocol):
 	CHAN_SEARCH_AVG = 24									# Scan the lowest range where at least 8 channels must occur
 	CHAN_SEARCH_MAX = CHAN_MAX-CHAN_MIN		# Amount of channels to search when searching all channels
 	DATA_CODES = 8												# Amount of data codes per channels to search
+	CHANNEL_CACHE_SIZE = 64								# Amount of IDs to remember the channels of
+	channel_cache = {}
 
 	def __init__(self):
 		Protocol.__init__(self, "DSMX")
@@ -84,7 +86,17 @@ class DSMX(Protocol):
 
 	@staticmethod
 	def calc_channels(mfg_id):
-		"""Calculate the channels based on the chip ID"""
+		"""Calculate the channels based on the chip ID, remembering the recently used IDs"""
+		key = tuple(mfg_id)
+		if key not in DSMX.channel_cache:
+			if len(DSMX.channel_cache) >= DSMX.CHANNEL_CACHE_SIZE:
+				DSMX.channel_cache.clear()
+			DSMX.channel_cache[key] = DSMX.generate_channels(mfg_id)
+		return list(DSMX.channel_cache[key])
+
+	@staticmethod
+	def generate_channels(mfg_id):
+		"""Generate the channels based on the chip ID"""
 		channels = []
 		cnt_3_27 = 0
 		cnt_28_51 = 0
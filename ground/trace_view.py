@@ -0,0 +1,208 @@
+#!/usr/bin/env python
+# Copyright (C) 2018 Freek van Tienen <freek.v.tienen@gmail.com>
+"""Record the event trace of the dongle and render it as an SVG timeline
+
+Record live from the data port for 2 seconds:
+	./trace_view.py /dev/ttyACM0 -t 2 -o trace.svg
+Or save the raw events and render them later:
+	./trace_view.py /dev/ttyACM0 -t 2 --save trace.bin
+	./trace_view.py --load trace.bin -o trace.svg
+"""
+import argparse
+import struct
+import sys
+import time
+
+# The events of src/modules/trace.h
+HOP, RX_START, RX, TX, TX_DONE, TIMER_SET, TIMEOUT, STATE = range(1, 9)
+EVENT_SIZE = 8
+
+CHIPS = {0: 'CYRF6936', 1: 'CC2500'}
+PROT_CHIP = {1: 0, 3: 1, 4: 1, 5: 1}
+PROT_STATES = {
+	1: ('DSM hack', ['SYNC', 'RECV_A', 'RECV_B', 'SEND_A', 'SEND_B']),
+	3: ('FrSky hack', ['SYNC', 'RECV', 'SEND']),
+	4: ('FrSky receiver', ['TUNE', 'FINETUNE', 'BIND', 'SYNC', 'RECV']),
+	5: ('FrSky transmitter', ['SEND']),
+}
+STATE_COLORS = ['#d0e4f5', '#d5f0d0', '#f5e6c8', '#f0d0e4', '#e0d8f5']
+
+def parse_events(data):
+	"""Split the raw trace into (time, event, arg, val) tuples, the time unwrapped in microseconds"""
+	events = []
+	offset = 0
+	last = None
+	for i in range(0, len(data) - EVENT_SIZE + 1, EVENT_SIZE):
+		t, event, arg, val = struct.unpack_from('<IBBH', data, i)
+		if last is not None and t < last and last - t > 0x80000000:
+			offset += 1 << 32
+		last = t
+		events.append((t + offset, event, arg, val))
+	return events
+
+def record(port, duration):
+	"""Stream the trace from the dongle for an amount of seconds"""
+	sys.path.append('../lib/pprzlink/lib/v1.0/python')
+	from pprzlink.serial import SerialMessagesInterface
+	from pprzlink.message import PprzMessage
+
+	data = bytearray()
+	dropped = [0]
+	def on_msg(sender_id, msg):
+		if msg._name == 'TRACE':
+			data.extend(bytearray(msg.events))
+			dropped[0] = msg.dropped
+
+	smi = SerialMessagesInterface(on_msg, None, False, port, 115200, 'usbrf')
+	smi.start()
+	msg = PprzMessage('usbrf', 'TRACE_CTRL')
+	msg['stream'] = 1
+	smi.send(msg, 0)
+	time.sleep(duration)
+	msg['stream'] = 0
+	smi.send(msg, 0)
+	time.sleep(0.1)
+	smi.stop()
+
+	if dropped[0]:
+		print('Dongle dropped %d events' % dropped[0])
+	return bytes(data)
+
+class Timeline(object):
+	"""Draws the events in lanes per radio chip, timer channel and protocol state"""
+	LANE_HEIGHT = 40
+	LABEL_WIDTH = 130
+
+	def __init__(self, events, scale):
+		self.events = events
+		self.scale = scale
+		self.start = events[0][0] if events else 0
+		self.end = events[-1][0] if events else 0
+		self.lanes = []
+		self.items = []
+
+	def x(self, t):
+		"""Position of a time in microseconds"""
+		return self.LABEL_WIDTH + (t - self.start) * self.scale / 1000.0
+
+	def lane(self, name):
+		"""Get the vertical position of a lane, adding it when needed"""
+		if name not in self.lanes:
+			self.lanes.append(name)
+		return 20 + self.lanes.index(name) * self.LANE_HEIGHT
+
+	def bar(self, lane, t0, t1, color, title):
+		y = self.lane(lane)
+		w = max(self.x(t1) - self.x(t0), 1)
+		self.items.append('<rect x="%.1f" y="%d" width="%.1f" height="%d" fill="%s"><title>%s</title></rect>'
+			% (self.x(t0), y + 8, w, self.LANE_HEIGHT - 16, color, title))
+
+	def tick(self, lane, t, color, title, label=None):
+		y = self.lane(lane)
+		self.items.append('<line x1="%.1f" y1="%d" x2="%.1f" y2="%d" stroke="%s"><title>%s</title></line>'
+			% (self.x(t), y + 2, self.x(t), y + self.LANE_HEIGHT - 2, color, title))
+		if label is not None:
+			self.items.append('<text x="%.1f" y="%d" font-size="9">%s</text>' % (self.x(t) + 1, y + 9, label))
+
+	def build(self):
+		"""Turn the events into bars and ticks"""
+		rx_start = {}
+		tx_start = {}
+		state_start = {}
+		for t, event, arg, val in self.events:
+			chip = CHIPS.get(arg, 'chip %d' % arg)
+			if event == HOP:
+				self.tick(chip, t, '#888888', 'hop to channel %d' % val, str(val))
+			elif event == RX_START:
+				rx_start[arg] = t
+			elif event == RX:
+				if arg in rx_start:
+					self.bar(chip, rx_start.pop(arg), t, '#8cb4e0', 'RX window')
+				error = (arg == 0 and val != 0)
+				self.tick(chip, t, '#d03030' if error else '#20a020', 'RX error' if error else 'RX packet (%d)' % val)
+			elif event == TX:
+				if arg in rx_start:
+					self.bar(chip, rx_start.pop(arg), t, '#8cb4e0', 'RX window')
+				tx_start[arg] = (t, val)
+			elif event == TX_DONE:
+				if arg in tx_start:
+					t0, length = tx_start.pop(arg)
+					self.bar(chip, t0, t, '#f0a040', 'TX slot (%d bytes, %d us)' % (length, t - t0))
+			elif event == TIMER_SET:
+				self.bar('timer ch%d' % (arg + 1), t, t + val * 10, '#e8e8e8', 'timer set to %d us' % (val * 10))
+			elif event == TIMEOUT:
+				self.tick('timer ch%d' % (arg + 1), t, '#d03030', 'timeout')
+			elif event == STATE:
+				name, states = PROT_STATES.get(arg, ('protocol %d' % arg, []))
+				if arg in state_start:
+					t0, old = state_start[arg]
+					self.state_bar(name, t0, t, old, states)
+				state_start[arg] = (t, val)
+
+		# Close the open windows and states at the end of the trace
+		for arg, t0 in rx_start.items():
+			self.bar(CHIPS.get(arg, 'chip %d' % arg), t0, self.end, '#8cb4e0', 'RX window')
+		for arg, (t0, old) in state_start.items():
+			name, states = PROT_STATES.get(arg, ('protocol %d' % arg, []))
+			self.state_bar(name, t0, self.end, old, states)
+
+	def state_bar(self, lane, t0, t1, state, states):
+		name = states[state] if state < len(states) else str(state)
+		self.bar(lane, t0, t1, STATE_COLORS[state % len(STATE_COLORS)], name)
+		self.items.append('<text x="%.1f" y="%d" font-size="10">%s</text>' % (self.x(t0) + 2, self.lane(lane) + 24, name))
+
+	def svg(self):
+		"""Render the timeline, with a time axis in milliseconds"""
+		self.build()
+		width = int(self.x(self.end)) + 20
+		height = 40 + len(self.lanes) * self.LANE_HEIGHT
+		out = ['<svg xmlns="http://www.w3.org/2000/svg" width="%d" height="%d" font-family="sans-serif">' % (width, height)]
+
+		# Time axis
+		for ms in range(0, int((self.end - self.start) / 1000) + 1):
+			x = self.x(self.start + ms * 1000)
+			out.append('<line x1="%.1f" y1="10" x2="%.1f" y2="%d" stroke="#f0f0f0"/>' % (x, x, height - 20))
+			if ms % 5 == 0:
+				out.append('<text x="%.1f" y="%d" font-size="10">%d ms</text>' % (x, height - 6, ms))
+
+		for i, name in enumerate(self.lanes):
+			y = 20 + i * self.LANE_HEIGHT
+			out.append('<text x="4" y="%d" font-size="12">%s</text>' % (y + self.LANE_HEIGHT / 2 + 4, name))
+			out.append('<line x1="0" y1="%d" x2="%d" y2="%d" stroke="#cccccc"/>' % (y + self.LANE_HEIGHT, width, y + self.LANE_HEIGHT))
+		out.extend(self.items)
+		out.append('</svg>')
+		return '\n'.join(out)
+
+def main():
+	parser = argparse.ArgumentParser(description='Render the event trace of the dongle as a timeline')
+	parser.add_argument('port', nargs='?', help='The data port of the dongle')
+	parser.add_argument('-t', '--time', type=float, default=1.0, help='Seconds to record')
+	parser.add_argument('-o', '--output', default='trace.svg', help='The SVG file to write')
+	parser.add_argument('-s', '--scale', type=float, default=20.0, help='Pixels per millisecond')
+	parser.add_argument('--save', help='Save the raw events to a file')
+	parser.add_argument('--load', help='Render the raw events from a file instead of recording')
+	args = parser.parse_args()
+
+	if args.load:
+		with open(args.load, 'rb') as f:
+			data = f.read()
+	elif args.port:
+		data = record(args.port, args.time)
+	else:
+		parser.error('either a port or --load is needed')
+
+	if args.save:
+		with open(args.save, 'wb') as f:
+			f.write(data)
+
+	events = parse_events(data)
+	if not events:
+		print('No events traced')
+		return
+
+	with open(args.output, 'w') as f:
+		f.write(Timeline(events, args.scale).svg())
+	print('Wrote %d events (%.1f ms) to %s' % (len(events), (events[-1][0] - events[0][0]) / 1000.0, args.output))
+
+if __name__ == '__main__':
+	main()
@@ -0,0 +1,38 @@
+/*
+ * This file is part of the superbitrf project.
+ *
+ * Copyright (C) 2018 Freek van Tienen <freek.v.tienen@gmail.com>
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "modules/ant_switch.h"
+
+static bool ant_switch_state[2];		/**< The current state of the switching pins */
+
+/**
+ * Initialize the antenna switcher
+ */
+void ant_switch_init(void) {
+	ant_switch_state[0] = false;
+	ant_switch_state[1] = false;
+}
+
+/**
+ * Set the antenna switching pins
+ */
+void ant_switch(bool *state) {
+	ant_switch_state[0] = state[0];
+	ant_switch_state[1] = state[1];
+}
@@ -0,0 +1,281 @@
+/*
+ * This file is part of the superbitrf project.
+ *
+ * Copyright (C) 2018 Freek van Tienen <freek.v.tienen@gmail.com>
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * The host replacement of the USB CDC ACM ports. The data port is exposed as
+ * a pseudo terminal (or a file/null with USBRF_DATA) so the ground station can
+ * connect to it. The console is connected to stdin/stdout and can be fed with
+ * commands from USBRF_CMDS (separated by ';'). With USBRF_VENDOR set the host
+ * streams the raw packet interface into that file.
+ */
+
+#define _DEFAULT_SOURCE
+#define _XOPEN_SOURCE 600
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <termios.h>
+
+#include "modules/cdcacm.h"
+#include "modules/fifo.h"
+#include "modules/sched.h"
+#include "modules/prof.h"
+#include "sim.h"
+
+#define CDCACM_PACKET_SIZE 64					/**< The size of one bulk packet */
+#define CDCACM_PACKET_NS 50000				/**< The time one bulk packet takes on the bus */
+#define CDCACM_FRAME_NS 1000000				/**< The host polls the OUT endpoints once per USB frame */
+
+/* Input and output FIFOs for the two virtual serial ports (size a power of two). */
+#define CDCACM_IO_BUFFER_SIZE 256
+uint8_t cdcacm_data_tx_buffer[CDCACM_IO_BUFFER_SIZE];
+uint8_t cdcacm_data_rx_buffer[CDCACM_IO_BUFFER_SIZE];
+struct fifo_t cdcacm_data_tx;
+struct fifo_t cdcacm_data_rx;
+uint8_t cdcacm_console_tx_buffer[CDCACM_IO_BUFFER_SIZE];
+uint8_t cdcacm_console_rx_buffer[CDCACM_IO_BUFFER_SIZE];
+struct fifo_t cdcacm_console_tx;
+struct fifo_t cdcacm_console_rx;
+
+/* A double buffered bulk IN endpoint */
+struct cdcacm_tx_ep {
+	int fd;												/**< The host file descriptor (-1 discards) */
+	struct fifo_t *fifo;					/**< The transmit FIFO */
+	uint8_t pending;							/**< Packets queued in the endpoint buffers */
+	uint64_t end;									/**< When the last queued packet is sent */
+	struct sim_event event;				/**< The USB interrupt when a packet was sent */
+};
+
+static struct cdcacm_tx_ep cdcacm_tx_data;		/**< The data IN endpoint */
+static struct cdcacm_tx_ep cdcacm_tx_console;	/**< The console IN endpoint */
+static struct cdcacm_tx_ep cdcacm_tx_vendor;	/**< The raw packet IN endpoint */
+static struct sim_event cdcacm_frame_event;		/**< The USB interrupt at every frame where the host polls the OUT endpoints */
+static uint32_t cdcacm_tx_dropped;			/**< The amount of packets the host did not accept */
+static const char *cdcacm_cmds;					/**< The remaining startup console commands */
+
+static int cdcacm_open_data(const char *name);
+static void cdcacm_open_vendor(const char *name);
+static bool cdcacm_rx(int fd, struct fifo_t *fifo);
+static void cdcacm_tx_init(struct cdcacm_tx_ep *tx, int fd, struct fifo_t *fifo);
+static void cdcacm_tx_fill(struct cdcacm_tx_ep *tx);
+static bool cdcacm_next_cmd(void);
+static void cdcacm_frame(void *arg);
+static void cdcacm_tx_done(void *arg);
+
+/**
+ * Initialize the host ports
+ */
+void cdcacm_init(void) {
+	/* Initialize IO FIFOs. */
+	fifo_init(&cdcacm_data_rx, cdcacm_data_rx_buffer, CDCACM_IO_BUFFER_SIZE);
+	fifo_init(&cdcacm_data_tx, cdcacm_data_tx_buffer, CDCACM_IO_BUFFER_SIZE);
+	fifo_init(&cdcacm_console_rx, cdcacm_console_rx_buffer, CDCACM_IO_BUFFER_SIZE);
+	fifo_init(&cdcacm_console_tx, cdcacm_console_tx_buffer, CDCACM_IO_BUFFER_SIZE);
+
+	cdcacm_tx_init(&cdcacm_tx_data, cdcacm_open_data(getenv("USBRF_DATA")), &cdcacm_data_tx);
+	cdcacm_tx_init(&cdcacm_tx_console, STDOUT_FILENO, &cdcacm_console_tx);
+	cdcacm_vendor_init();
+	cdcacm_open_vendor(getenv("USBRF_VENDOR"));
+	fcntl(STDIN_FILENO, F_SETFL, fcntl(STDIN_FILENO, F_GETFL) | O_NONBLOCK);
+
+	/* Startup console commands are typed one by one */
+	cdcacm_cmds = getenv("USBRF_CMDS");
+
+	sim_event_init(&cdcacm_frame_event, SIM_PRIO_USB, cdcacm_frame, NULL);
+	sim_event_schedule(&cdcacm_frame_event, sim_get_time() + CDCACM_FRAME_NS);
+}
+
+/**
+ * Start sending the transmit FIFOs on idle endpoints, the completion interrupts
+ * keep them going until the FIFOs are empty
+ */
+void cdcacm_run(void) {
+	sim_irq_disable();
+	cdcacm_tx_fill(&cdcacm_tx_data);
+	cdcacm_tx_fill(&cdcacm_tx_console);
+	cdcacm_tx_fill(&cdcacm_tx_vendor);
+	sim_irq_enable();
+}
+
+/**
+ * The host polls the OUT endpoints once per frame, reading the file descriptors
+ * only then also keeps the system calls out of the simulation loop
+ */
+static void cdcacm_frame(void *arg __attribute__((unused))) {
+	if(cdcacm_rx(cdcacm_tx_data.fd, &cdcacm_data_rx))
+		sched_event(SCHED_EV_DATA_RX);
+	if(cdcacm_rx(STDIN_FILENO, &cdcacm_console_rx) || cdcacm_next_cmd())
+		sched_event(SCHED_EV_CONSOLE_RX);
+
+	sim_event_schedule(&cdcacm_frame_event, cdcacm_frame_event.time + CDCACM_FRAME_NS);
+}
+
+/**
+ * An IN endpoint sent a packet, refill it straight from the FIFO
+ */
+static void cdcacm_tx_done(void *arg) {
+	struct cdcacm_tx_ep *tx = arg;
+	uint64_t next = tx->end;
+	bool queued = (--tx->pending > 0);
+	PROF_START(start);
+
+	cdcacm_tx_fill(tx);
+	if(queued)
+		sim_event_schedule(&tx->event, next);
+	PROF_END(PROF_USB_IRQ, start);
+}
+
+/**
+ * Open the data port
+ * @param[in] name A path, "null" to discard or empty for a pseudo terminal
+ * @return The file descriptor or -1 when discarding
+ */
+static int cdcacm_open_data(const char *name) {
+	int fd;
+
+	if(name != NULL && strcmp(name, "null") == 0)
+		return -1;
+
+	if(name != NULL && *name != '\0') {
+		fd = open(name, O_RDWR | O_CREAT | O_NONBLOCK, 0644);
+		if(fd < 0)
+			perror("usbrf: data port");
+		return fd;
+	}
+
+	// Create a raw pseudo terminal
+	fd = posix_openpt(O_RDWR | O_NOCTTY | O_NONBLOCK);
+	if(fd < 0 || grantpt(fd) != 0 || unlockpt(fd) != 0) {
+		perror("usbrf: data pty");
+		return -1;
+	}
+
+	struct termios tio;
+	if(tcgetattr(fd, &tio) == 0) {
+		cfmakeraw(&tio);
+		tcsetattr(fd, TCSANOW, &tio);
+	}
+
+	fprintf(stderr, "usbrf: data port on %s\n", ptsname(fd));
+	return fd;
+}
+
+/**
+ * Open the file the host streams the raw packet interface into
+ * @param[in] name A path or NULL when the host does not use the interface
+ */
+static void cdcacm_open_vendor(const char *name) {
+	int fd = -1;
+
+	if(name != NULL && *name != '\0') {
+		fd = open(name, O_WRONLY | O_CREAT | O_TRUNC | O_NONBLOCK, 0644);
+		if(fd < 0)
+			perror("usbrf: raw packet stream");
+	}
+
+	cdcacm_tx_init(&cdcacm_tx_vendor, fd, &cdcacm_vendor_tx);
+	cdcacm_vendor_streaming = (fd >= 0);
+}
+
+/**
+ * Type the next startup command once the previous answer is sent
+ * @return Whether a command was typed
+ */
+static bool cdcacm_next_cmd(void) {
+	if(cdcacm_cmds == NULL || !fifo_empty(&cdcacm_console_rx) || !fifo_empty(&cdcacm_console_tx))
+		return false;
+
+	for(; *cdcacm_cmds != '\0' && *cdcacm_cmds != ';'; cdcacm_cmds++)
+		fifo_write_ch(&cdcacm_console_rx, *cdcacm_cmds);
+	fifo_write_ch(&cdcacm_console_rx, '\r');
+
+	if(*cdcacm_cmds == '\0')
+		cdcacm_cmds = NULL;
+	else
+		cdcacm_cmds++;
+	return true;
+}
+
+/**
+ * Read from a file descriptor directly into a FIFO
+ * @param[in] fd The file descriptor
+ * @param[in] fifo The receive FIFO
+ * @return Whether data was received
+ */
+static bool cdcacm_rx(int fd, struct fifo_t *fifo) {
+	uint8_t *ptr;
+	uint32_t span = fifo_write_span(fifo, &ptr);
+
+	if(fd < 0 || span == 0)
+		return false;
+
+	ssize_t len = read(fd, ptr, (span < CDCACM_PACKET_SIZE)? span : CDCACM_PACKET_SIZE);
+	if(len <= 0)
+		return false;
+
+	fifo_write_commit(fifo, len);
+	return true;
+}
+
+/**
+ * Initialize an IN endpoint
+ * @param[in] tx The endpoint
+ * @param[in] fd The host file descriptor (-1 discards)
+ * @param[in] fifo The transmit FIFO
+ */
+static void cdcacm_tx_init(struct cdcacm_tx_ep *tx, int fd, struct fifo_t *fifo) {
+	tx->fd = fd;
+	tx->fifo = fifo;
+	tx->pending = 0;
+	tx->end = 0;
+	sim_event_init(&tx->event, SIM_PRIO_USB, cdcacm_tx_done, tx);
+}
+
+/**
+ * Queue bulk packets from the FIFO into the two endpoint buffers
+ * The packets are sent straight from the FIFO unless they wrap around the end
+ * and go out back-to-back on the bus.
+ * @param[in] tx The endpoint
+ */
+static void cdcacm_tx_fill(struct cdcacm_tx_ep *tx) {
+	uint8_t buf[CDCACM_PACKET_SIZE];
+	const uint8_t *ptr;
+	uint32_t tx_len;
+
+	while(tx->pending < 2 && (tx_len = fifo_used(tx->fifo)) != 0) {
+		if(tx_len > CDCACM_PACKET_SIZE)
+			tx_len = CDCACM_PACKET_SIZE;
+		if(fifo_read_span(tx->fifo, &ptr) < tx_len) {
+			fifo_read(tx->fifo, buf, tx_len);
+			ptr = buf;
+		}
+
+		// A pty nobody reads from drops the packet like an absent USB host would
+		if(tx->fd >= 0 && write(tx->fd, ptr, tx_len) < 0)
+			cdcacm_tx_dropped++;
+		if(ptr != buf)
+			fifo_read_commit(tx->fifo, tx_len);
+
+		tx->end = ((tx->end > sim_get_time())? tx->end : sim_get_time()) + CDCACM_PACKET_NS;
+		if(++tx->pending == 1)
+			sim_event_schedule(&tx->event, tx->end);
+	}
+}
@@ -0,0 +1,88 @@
+/*
+ * This file is part of the superbitrf project.
+ *
+ * Copyright (C) 2018 Freek van Tienen <freek.v.tienen@gmail.com>
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * The systick counter on the host is driven by the virtual clock.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "modules/counter.h"
+#include "sim.h"
+
+/* Configuration */
+#define COUNTER_FREQ 25000 /* Counter interval of 0.04ms */
+
+/* Status of the counter module. */
+struct counter_status counter_status = {
+  .init = false,
+  .frequency = COUNTER_FREQ,
+  .fine_frequency = 0,
+  .ticks = 0
+};
+
+static struct sim_event counter_event;		/**< The simulated systick interrupt */
+static void counter_tick(void *arg);
+
+/**
+ * Initialize the counter module.
+ */
+void counter_init(void)
+{
+  counter_status.init = false;
+  counter_status.frequency = COUNTER_FREQ;
+  counter_status.fine_frequency = 72000000 / 8;
+  counter_status.ticks = 0;
+
+  sim_event_init(&counter_event, SIM_PRIO_SYSTICK, counter_tick, NULL);
+  sim_event_schedule(&counter_event, sim_get_time() + 1000000000ULL / COUNTER_FREQ);
+
+  counter_status.init = true;
+}
+
+/**
+ * Get the ticks, polling also advances the virtual time
+ */
+uint32_t counter_get_ticks(void) {
+  sim_poll();
+  return counter_status.ticks;
+}
+
+/**
+ * Get the time in microseconds straight from the virtual clock
+ */
+uint32_t counter_get_us(void) {
+  return sim_get_time() / 1000;
+}
+
+/**
+ * The simulated systick interrupt
+ */
+static void counter_tick(void *arg __attribute__((unused)))
+{
+  counter_status.ticks++;
+  sim_event_schedule(&counter_event, counter_event.time + 1000000000ULL / COUNTER_FREQ);
+}
+
+/* Busy sleep just advances the virtual time */
+void _usleep(uint32_t x) {
+  sim_advance((uint64_t)x * 1000);
+}
@@ -0,0 +1,29 @@
+/*
+ * This file is part of the superbitrf project.
+ *
+ * Copyright (C) 2018 Freek van Tienen <freek.v.tienen@gmail.com>
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ARCH_LINUX_LED_ARCH_H_
+#define ARCH_LINUX_LED_ARCH_H_
+
+/* There are no leds on the host */
+#define LED_ON(i)			do { (void)(i); } while(0)
+#define LED_OFF(i)		do { (void)(i); } while(0)
+#define LED_TOGGLE(i)	do { (void)(i); } while(0)
+#define LED_INIT(i)		do { (void)(i); } while(0)
+
+#endif /* ARCH_LINUX_LED_ARCH_H_ */
@@ -0,0 +1,125 @@
+/*
+ * This file is part of the superbitrf project.
+ *
+ * Copyright (C) 2018 Freek van Tienen <freek.v.tienen@gmail.com>
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "modules/mcu.h"
+#include "sim.h"
+
+/* The emulated STM32F103 flash (128 * 1kb pages) */
+#define MCU_FLASH_BASE				0x08000000			/**< The start address of the flash */
+#define MCU_FLASH_SIZE				(128 * 1024)		/**< The size of the flash */
+#define MCU_FLASH_PAGE_SIZE		1024						/**< The size of one flash page */
+#define MCU_FLASH_ERASE_NS		20000000				/**< The time the CPU stalls on a page erase */
+#define MCU_FLASH_PROGRAM_NS	52500						/**< The time the CPU stalls on programming a half word */
+
+static uint8_t mcu_flash[MCU_FLASH_SIZE];		/**< The flash contents */
+static const char *mcu_flash_file = NULL;		/**< The file to persist the flash in (optional) */
+
+/**
+ * Initialize the simulation and load the flash from a file (USBRF_FLASH)
+ */
+void mcu_init(void) {
+	sim_init();
+	memset(mcu_flash, 0xFF, sizeof(mcu_flash));
+
+	mcu_flash_file = getenv("USBRF_FLASH");
+	if(mcu_flash_file != NULL) {
+		FILE *f = fopen(mcu_flash_file, "rb");
+		if(f != NULL) {
+			if(fread(mcu_flash, 1, sizeof(mcu_flash), f) == 0)
+				memset(mcu_flash, 0xFF, sizeof(mcu_flash));
+			fclose(f);
+		}
+	}
+}
+
+/**
+ * Get a fixed unique identifier (can be changed with USBRF_ID)
+ * @param[out] id The 3 words of the unique identifier
+ */
+void mcu_get_unique_id(uint32_t *id) {
+	id[0] = 0x55534252;
+	id[1] = 0x484F5354;
+	id[2] = sim_getenv_int("USBRF_ID", 1);
+}
+
+/**
+ * Unlock the flash for writing
+ */
+void mcu_flash_unlock(void) {
+}
+
+/**
+ * Lock the flash and write it to the file
+ */
+void mcu_flash_lock(void) {
+	if(mcu_flash_file == NULL)
+		return;
+
+	FILE *f = fopen(mcu_flash_file, "wb");
+	if(f != NULL) {
+		fwrite(mcu_flash, 1, sizeof(mcu_flash), f);
+		fclose(f);
+	}
+}
+
+/**
+ * Erase a flash page, the CPU stalls while erasing
+ * @param[in] addr The address of the page
+ */
+void mcu_flash_erase_page(uint32_t addr) {
+	uint32_t offset = (addr - MCU_FLASH_BASE) & ~(MCU_FLASH_PAGE_SIZE - 1);
+	if(offset >= MCU_FLASH_SIZE)
+		return;
+
+	memset(&mcu_flash[offset], 0xFF, MCU_FLASH_PAGE_SIZE);
+
+	sim_irq_disable();
+	sim_advance(MCU_FLASH_ERASE_NS);
+	sim_irq_enable();
+}
+
+/**
+ * Program a half word in flash (bits can only be cleared)
+ * @param[in] addr The address to program
+ * @param[in] data The half word to write
+ */
+void mcu_flash_program_half_word(uint32_t addr, uint16_t data) {
+	uint32_t offset = addr - MCU_FLASH_BASE;
+	if(offset + 1 >= MCU_FLASH_SIZE)
+		return;
+
+	mcu_flash[offset] &= data & 0xFF;
+	mcu_flash[offset + 1] &= data >> 8;
+
+	sim_irq_disable();
+	sim_advance(MCU_FLASH_PROGRAM_NS);
+	sim_irq_enable();
+}
+
+/**
+ * Get a pointer to read from the flash memory
+ * @param[in] addr The flash address
+ */
+const void *mcu_flash_ptr(uint32_t addr) {
+	return &mcu_flash[addr - MCU_FLASH_BASE];
+}
@@ -0,0 +1,62 @@
+/*
+ * This file is part of the superbitrf project.
+ *
+ * Copyright (C) 2018 Freek van Tienen <freek.v.tienen@gmail.com>
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ARCH_LINUX_MCU_ARCH_H_
+#define ARCH_LINUX_MCU_ARCH_H_
+
+#include "sim.h"
+
+/**
+ * Disable all (simulated) interrupts
+ */
+static inline void mcu_irq_disable(void) {
+	sim_irq_disable();
+}
+
+/**
+ * Enable all (simulated) interrupts
+ */
+static inline void mcu_irq_enable(void) {
+	sim_irq_enable();
+}
+
+/**
+ * Disable all (simulated) interrupts, the simulation counts the nesting
+ * @return The previous interrupt mask for mcu_irq_restore
+ */
+static inline uint32_t mcu_irq_save(void) {
+	sim_irq_disable();
+	return 0;
+}
+
+/**
+ * Restore the (simulated) interrupts from before mcu_irq_save
+ * @param[in] mask The previous interrupt mask
+ */
+static inline void mcu_irq_restore(uint32_t mask __attribute__((unused))) {
+	sim_irq_enable();
+}
+
+static inline void mcu_sleep(void) {
+	sim_sleep();
+}
+
+const void *mcu_flash_ptr(uint32_t addr);
+
+#endif /* ARCH_LINUX_MCU_ARCH_H_ */
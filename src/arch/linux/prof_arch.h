@@ -0,0 +1,46 @@
+/*
+ * This file is part of the superbitrf project.
+ *
+ * Copyright (C) 2018 Freek van Tienen <freek.v.tienen@gmail.com>
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ARCH_LINUX_PROF_ARCH_H_
+#define ARCH_LINUX_PROF_ARCH_H_
+
+#include "sim.h"
+
+/* The simulated cycles follow the virtual time at the 72MHz of the dongle, so
+ * only the modelled costs like the SPI transfers are measured */
+#define PROF_SIM_FREQUENCY 72000000
+
+static inline void prof_arch_init(void) {
+}
+
+/**
+ * Get the CPU cycles from the virtual time
+ */
+static inline uint32_t prof_get_cycles(void) {
+	return sim_get_time() * (PROF_SIM_FREQUENCY / 1000000) / 1000;
+}
+
+/**
+ * Get the amount of CPU cycles per microsecond
+ */
+static inline uint32_t prof_get_cycles_per_us(void) {
+	return PROF_SIM_FREQUENCY / 1000000;
+}
+
+#endif /* ARCH_LINUX_PROF_ARCH_H_ */
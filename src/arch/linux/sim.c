@@ -0,0 +1,259 @@
+/*
+ * This file is part of the superbitrf project.
+ *
+ * Copyright (C) 2018 Freek van Tienen <freek.v.tienen@gmail.com>
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * The host build runs the firmware against a deterministic virtual clock.
+ * Time only moves when the firmware polls the counter, busy waits or spends
+ * time on a peripheral (SPI bytes, flash erases). Simulated interrupts are
+ * dispatched in time order and may only preempt lower priority contexts,
+ * just like the NVIC. With USBRF_REALTIME=1 the virtual clock is paced to
+ * the wall clock so a ground station can be attached.
+ */
+
+#define _DEFAULT_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "sim.h"
+
+static uint64_t sim_time = 0;							/**< The current virtual time in ns */
+static uint64_t sim_end_time = 0;					/**< Stop the simulation at this time (0 is never) */
+static uint32_t sim_poll_ns = 1000;				/**< The virtual time one main loop poll takes */
+static bool sim_realtime = false;					/**< Pace the virtual time to the wall clock */
+static struct timespec sim_realtime_start;	/**< The wall clock time at start */
+static uint32_t sim_irq_lock = 0;					/**< Interrupt disable nesting */
+static uint8_t sim_cur_prio = SIM_PRIO_THREAD;	/**< Priority of the running context */
+static struct sim_event *sim_events = NULL;		/**< The time ordered scheduled events */
+
+static void sim_dispatch(uint64_t until);
+static void sim_pace(void);
+static void sim_exit(void);
+
+/**
+ * Initialize the simulation from the environment options
+ */
+void sim_init(void) {
+	sim_time = 0;
+	sim_end_time = (uint64_t)(sim_getenv_float("USBRF_SIM_TIME", 0) * 1e9);
+	sim_poll_ns = sim_getenv_int("USBRF_POLL_NS", 1000);
+	sim_realtime = sim_getenv_int("USBRF_REALTIME", 0);
+	clock_gettime(CLOCK_MONOTONIC, &sim_realtime_start);
+	atexit(sim_exit);
+}
+
+/**
+ * Get the current virtual time
+ * @return The virtual time in nanoseconds
+ */
+uint64_t sim_get_time(void) {
+	return sim_time;
+}
+
+/**
+ * Advance the virtual time and fire all interrupts which are due
+ * @param[in] ns The amount of nanoseconds to advance
+ */
+void sim_advance(uint64_t ns) {
+	uint64_t target = sim_time + ns;
+	sim_dispatch(target);
+	if(target > sim_time)
+		sim_time = target;
+
+	if(sim_end_time != 0 && sim_time >= sim_end_time)
+		exit(EXIT_SUCCESS);
+}
+
+/**
+ * One poll of the main loop, which takes a bit of virtual time
+ */
+void sim_poll(void) {
+	sim_advance(sim_poll_ns);
+	if(sim_realtime)
+		sim_pace();
+}
+
+/**
+ * Sleep until the next interrupt (WFI), the hardware models keep running
+ * An interrupt wakes up the CPU even when it is masked, it only fires once enabled.
+ */
+void sim_sleep(void) {
+	while(sim_events != NULL) {
+		uint64_t time = sim_events->time;
+		bool wake = (sim_events->prio != SIM_PRIO_HW);
+
+		sim_advance((time > sim_time)? time - sim_time : 0);
+		if(wake)
+			break;
+	}
+
+	if(sim_realtime)
+		sim_pace();
+}
+
+/**
+ * Disable the simulated interrupts
+ */
+void sim_irq_disable(void) {
+	sim_irq_lock++;
+}
+
+/**
+ * Enable the simulated interrupts and handle the ones that were pending
+ */
+void sim_irq_enable(void) {
+	if(sim_irq_lock > 0)
+		sim_irq_lock--;
+	sim_dispatch(sim_time);
+}
+
+/**
+ * Initialize an event
+ * @param[in] ev The event
+ * @param[in] prio The interrupt priority of the event
+ * @param[in] cb The callback when the event fires
+ * @param[in] arg The argument given to the callback
+ */
+void sim_event_init(struct sim_event *ev, uint8_t prio, sim_event_cb cb, void *arg) {
+	ev->time = 0;
+	ev->prio = prio;
+	ev->pending = false;
+	ev->cb = cb;
+	ev->arg = arg;
+	ev->next = NULL;
+}
+
+/**
+ * Schedule (or reschedule) an event at an absolute virtual time
+ * @param[in] ev The event
+ * @param[in] time The absolute time in nanoseconds
+ */
+void sim_event_schedule(struct sim_event *ev, uint64_t time) {
+	struct sim_event **prev = &sim_events;
+	sim_event_cancel(ev);
+
+	// Keep the list ordered, events at the same time fire in order of scheduling
+	while(*prev != NULL && (*prev)->time <= time)
+		prev = &(*prev)->next;
+
+	ev->time = time;
+	ev->pending = true;
+	ev->next = *prev;
+	*prev = ev;
+}
+
+/**
+ * Cancel a scheduled event
+ * @param[in] ev The event
+ */
+void sim_event_cancel(struct sim_event *ev) {
+	struct sim_event **prev = &sim_events;
+	if(!ev->pending)
+		return;
+
+	while(*prev != NULL && *prev != ev)
+		prev = &(*prev)->next;
+
+	if(*prev == ev)
+		*prev = ev->next;
+	ev->pending = false;
+	ev->next = NULL;
+}
+
+/**
+ * Get an integer option from the environment
+ * @param[in] name The environment variable
+ * @param[in] def The default value
+ */
+uint32_t sim_getenv_int(const char *name, uint32_t def) {
+	const char *val = getenv(name);
+	if(val == NULL || *val == '\0')
+		return def;
+	return strtoul(val, NULL, 0);
+}
+
+/**
+ * Get a floating point option from the environment
+ * @param[in] name The environment variable
+ * @param[in] def The default value
+ */
+double sim_getenv_float(const char *name, double def) {
+	const char *val = getenv(name);
+	if(val == NULL || *val == '\0')
+		return def;
+	return strtod(val, NULL);
+}
+
+/**
+ * Fire all events up to a time which are allowed to preempt the running context
+ * @param[in] until The absolute time in nanoseconds
+ */
+static void sim_dispatch(uint64_t until) {
+	struct sim_event **prev, *ev;
+
+	while(true) {
+		// Find the first due event with a higher priority than the running context
+		for(prev = &sim_events; (ev = *prev) != NULL; prev = &ev->next) {
+			if(ev->time > until) {
+				ev = NULL;
+				break;
+			}
+			// Hardware runs in parallel with the CPU, so it isn't masked
+			if(ev->prio == SIM_PRIO_HW || (sim_irq_lock == 0 && ev->prio < sim_cur_prio))
+				break;
+		}
+		if(ev == NULL)
+			break;
+
+		*prev = ev->next;
+		ev->pending = false;
+		ev->next = NULL;
+		if(ev->time > sim_time)
+			sim_time = ev->time;
+
+		// Run the handler at the priority of the event
+		uint8_t prio = sim_cur_prio;
+		sim_cur_prio = ev->prio;
+		ev->cb(ev->arg);
+		sim_cur_prio = prio;
+	}
+}
+
+/**
+ * Sleep until the wall clock catches up with the virtual time
+ */
+static void sim_pace(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	int64_t wall = (int64_t)(now.tv_sec - sim_realtime_start.tv_sec) * 1000000000LL
+			+ (now.tv_nsec - sim_realtime_start.tv_nsec);
+	int64_t ahead = (int64_t)sim_time - wall;
+
+	if(ahead > 1000000) {
+		struct timespec ts = {ahead / 1000000000LL, ahead % 1000000000LL};
+		nanosleep(&ts, NULL);
+	}
+}
+
+/**
+ * Print the simulated time when stopping
+ */
+static void sim_exit(void) {
+	fprintf(stderr, "usbrf: simulated %.6f s\n", sim_time / 1e9);
+}
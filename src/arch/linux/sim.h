@@ -0,0 +1,81 @@
+/*
+ * This file is part of the superbitrf project.
+ *
+ * Copyright (C) 2018 Freek van Tienen <freek.v.tienen@gmail.com>
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ARCH_LINUX_SIM_H_
+#define ARCH_LINUX_SIM_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "modules/spi.h"
+
+/* Interrupt priorities of the simulated peripherals (lower preempts higher) */
+#define SIM_PRIO_HW					0					/**< Hardware model events (air traffic), never masked */
+#define SIM_PRIO_DMA				1					/**< The end of SPI DMA transfers */
+#define SIM_PRIO_SYSTICK		2					/**< The systick counter */
+#define SIM_PRIO_TIMER			3					/**< The timer compare interrupts */
+#define SIM_PRIO_EXTI				4					/**< External (radio) interrupts */
+#define SIM_PRIO_USB				5					/**< The USB device interrupt */
+#define SIM_PRIO_THREAD			0xFF			/**< The main loop */
+
+/* A simulated interrupt or model event at an absolute virtual time */
+typedef void (*sim_event_cb)(void *arg);
+struct sim_event {
+	uint64_t time;							/**< The absolute virtual time in ns */
+	uint8_t prio;								/**< The interrupt priority */
+	bool pending;								/**< Whether the event is scheduled */
+	sim_event_cb cb;						/**< The function called when the event fires */
+	void *arg;									/**< The argument for the callback */
+	struct sim_event *next;			/**< The next scheduled event */
+};
+
+/* A register level model of a chip connected to the SPI bus */
+struct sim_spi_model {
+	void (*select)(void *arg);										/**< Chip select went low */
+	void (*deselect)(void *arg);									/**< Chip select went high */
+	uint8_t (*xfer)(void *arg, uint8_t data);			/**< Transfer one byte */
+	void (*reset)(void *arg, bool active);				/**< The reset pin changed (optional) */
+	void *arg;																		/**< The model state */
+};
+
+/* Virtual time */
+void sim_init(void);
+uint64_t sim_get_time(void);
+void sim_advance(uint64_t ns);
+void sim_poll(void);
+void sim_sleep(void);
+void sim_irq_disable(void);
+void sim_irq_enable(void);
+
+/* Events */
+void sim_event_init(struct sim_event *ev, uint8_t prio, sim_event_cb cb, void *arg);
+void sim_event_schedule(struct sim_event *ev, uint64_t time);
+void sim_event_cancel(struct sim_event *ev);
+
+/* Device models */
+void sim_spi_register(enum spi_dev_t dev, const struct sim_spi_model *model);
+void sim_spi_irq(enum spi_dev_t dev);
+void sim_cyrf_init(void);
+void sim_cc_init(void);
+
+/* Options from the environment */
+uint32_t sim_getenv_int(const char *name, uint32_t def);
+double sim_getenv_float(const char *name, double def);
+
+#endif /* ARCH_LINUX_SIM_H_ */
@@ -0,0 +1,809 @@
+/*
+ * This file is part of the superbitrf project.
+ *
+ * Copyright (C) 2018 Freek van Tienen <freek.v.tienen@gmail.com>
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Register level model of the CC2500 together with a FrSkyX transmitter
+ * which generates the air traffic. The model has the strobes and radio
+ * states (MARCSTATE, calibration, RX/TX off modes), 64 byte FIFOs which are
+ * filled byte by byte while a packet is on air, RX FIFO overflow (0x11), TX
+ * FIFO underflow (0x16), variable packet length with PKTLEN filtering,
+ * address filtering, CRC autoflush and the appended status bytes.
+ * A packet is only heard in RX on the same channel with the same data rate,
+ * when FSCTRL0 is close enough to the transmitter offset and FSCAL1 holds the
+ * calibration of the channel.
+ *
+ * The transmitter is enabled by setting USBRF_FRSKY_TXID (for example 0x1A2B)
+ * and is configured with:
+ *  USBRF_FRSKY_PROTOCOL  The frsky_protocol_t (2 FrSkyX, default 3 FrSkyX EU)
+ *  USBRF_FRSKY_BIND      The seconds it sends bind packets before data
+ *  USBRF_FRSKY_START     The time in seconds the transmitter is switched on
+ *  USBRF_FRSKY_OFFSET    The FSCTRL0 the receiver needs to hear it (default 0)
+ *  USBRF_FRSKY_CHANSKIP  The channel skip (default from the ID)
+ *  USBRF_FRSKY_LOSS      The percentage of packets which is lost on air
+ *  USBRF_FRSKY_CRC_ERR   The percentage of packets received with a bad CRC
+ *  USBRF_FRSKY_SEED      The seed of the packet loss
+ *  USBRF_FRSKY_LOCK      The amount of packets in a row to count as locked
+ * The hop following and FIFO drain latency are printed when the simulation
+ * stops. There is no simulated telemetry from a receiver.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "modules/cc2500.h"
+#include "helper/frsky.h"
+#include "sim.h"
+
+#define CC_SIM_FIFO_SIZE				64				/**< The size of the RX and TX FIFO */
+#define CC_SIM_REG_NB						0x30			/**< The amount of configuration registers */
+#define CC_SIM_OVERHEAD					8					/**< Preamble and sync word bytes on air */
+#define CC_SIM_CAL_NS						720000		/**< The time a calibration takes */
+#define CC_SIM_TUNE_WINDOW			24				/**< The FSCTRL0 distance at which packets are still heard */
+#define CC_SIM_XTAL							26000000	/**< The crystal frequency */
+
+/* The MARCSTATE values used */
+#define CC_MARC_IDLE						0x01
+#define CC_MARC_CALIBRATE				0x08
+#define CC_MARC_RX							0x0D
+#define CC_MARC_RX_OVERFLOW			0x11
+#define CC_MARC_FSTXON					0x12
+#define CC_MARC_TX							0x13
+#define CC_MARC_TX_UNDERFLOW		0x16
+
+/* A packet on air */
+struct cc_sim_packet_t {
+	uint8_t channel;											/**< The channel number */
+	uint8_t mdmcfg4;											/**< The data rate exponent (lower nibble) */
+	uint8_t mdmcfg3;											/**< The data rate mantissa */
+	int8_t offset;												/**< The FSCTRL0 the receiver needs */
+	bool crc_ok;													/**< Whether the CRC is received correctly */
+	uint8_t length;												/**< The length byte */
+	uint8_t data[CC_SIM_FIFO_SIZE];				/**< The length byte and the payload */
+};
+
+/* The chip state */
+static uint8_t cc_regs[CC_SIM_REG_NB];									/**< The configuration registers */
+static uint8_t cc_patable;															/**< The first PA table entry */
+static uint8_t cc_marcstate;														/**< The radio state */
+static uint8_t cc_rx_fifo[CC_SIM_FIFO_SIZE];						/**< The RX FIFO */
+static uint8_t cc_rx_read, cc_rx_count;									/**< RX FIFO read index and amount of bytes */
+static uint8_t cc_tx_fifo[CC_SIM_FIFO_SIZE];						/**< The TX FIFO */
+static uint8_t cc_tx_count;															/**< The amount of bytes in the TX FIFO */
+static uint8_t cc_rssi, cc_lqi;													/**< The status of the last packet */
+static bool cc_rx_busy;																	/**< A packet is being received */
+static bool cc_gdo0;																		/**< The state of the GDO0 pin */
+static struct cc_sim_packet_t cc_rx_pkt;								/**< The packet being received */
+static uint8_t cc_rx_pushed;														/**< The bytes of the packet in the FIFO */
+static struct sim_event cc_rx_event;										/**< The next received byte */
+static struct sim_event cc_state_event;									/**< The end of a calibration or transmission */
+static uint8_t cc_state_next;														/**< The state after the state event */
+
+/* The SPI transaction state */
+static uint8_t cc_spi_addr;															/**< The register address */
+static bool cc_spi_first;																/**< The next byte is the header byte */
+static bool cc_spi_read;																/**< The transaction reads */
+static bool cc_spi_burst;																/**< The transaction is a burst */
+
+/* The FrSkyX transmitter generating the air traffic */
+static bool frsky_tx_enabled;														/**< Whether there is a transmitter */
+static uint8_t frsky_tx_id[2];													/**< The transmitter ID */
+static enum frsky_protocol_t frsky_tx_protocol;					/**< The protocol */
+static uint8_t frsky_tx_hop_table[FRSKY_HOP_TABLE_LENGTH];	/**< The hop table */
+static uint8_t frsky_tx_hop_idx;												/**< The current index in the hop table */
+static uint8_t frsky_tx_chanskip;												/**< The channel skip */
+static uint8_t frsky_tx_bind_idx;												/**< The next bind table index */
+static uint64_t frsky_tx_bind_end;											/**< Until when it sends bind packets */
+static int8_t frsky_tx_offset;													/**< The FSCTRL0 the receiver needs */
+static uint32_t frsky_tx_loss;													/**< The loss threshold of the random number */
+static uint32_t frsky_tx_crc_err;												/**< The CRC error threshold of the random number */
+static uint32_t frsky_tx_rand;													/**< The state of the loss generator */
+static uint64_t frsky_tx_start;													/**< The time the transmitter was switched on */
+static uint64_t frsky_tx_frame_ns;											/**< The time between two packets */
+static uint64_t frsky_tx_last;													/**< The time the last data packet started */
+static uint64_t frsky_tx_air_ns;												/**< The air time of a data packet */
+static struct sim_event frsky_tx_event;									/**< The next packet on air */
+
+/* The statistics */
+static uint32_t frsky_stat_tx;													/**< Data packets sent by the transmitter */
+static uint32_t frsky_stat_bind;												/**< Bind packets sent by the transmitter */
+static uint32_t cc_stat_ok;															/**< Packets received with a correct CRC */
+static uint32_t cc_stat_crc;														/**< Packets received with a bad CRC */
+static uint32_t cc_stat_filtered;												/**< Packets dropped by length or address filter */
+static uint32_t cc_stat_overflow;												/**< RX FIFO overflows */
+static uint32_t cc_stat_underflow;											/**< TX FIFO underflows */
+static uint32_t cc_stat_sent;														/**< Packets sent by the firmware */
+static uint32_t cc_stat_sends;													/**< Packets the firmware started to send during the transmitter */
+static uint32_t cc_stat_slot;														/**< Packets sent over a transmitter packet on its channel */
+static uint32_t cc_stat_slot_run;												/**< Packets sent in a slot in a row */
+static uint32_t cc_stat_slot_best;											/**< The longest run of packets sent in a slot */
+static uint64_t cc_stat_slot_sum;												/**< The summed offset to the transmitter packets */
+static uint64_t cc_stat_slot_max;												/**< The maximum offset to the transmitter packets */
+static uint64_t cc_stat_done_time;											/**< The time the last packet was complete in the FIFO */
+static uint64_t cc_stat_drain_sum;											/**< The summed FIFO drain latency */
+static uint64_t cc_stat_drain_max;											/**< The maximum FIFO drain latency */
+static uint32_t cc_stat_drain_nb;												/**< The amount of drain measurements */
+static uint32_t frsky_stat_ok;													/**< Data packets received without errors */
+static uint32_t frsky_stat_lock_len;										/**< Packets in a row needed for lock */
+static uint32_t frsky_stat_streak;											/**< Packets received in a row */
+static bool frsky_stat_last_ok;													/**< The last data packet was received */
+static uint64_t frsky_stat_lock_time;										/**< The time of lock (0 is never) */
+static uint32_t frsky_stat_lock_tx;											/**< The transmitted packets at lock */
+static uint32_t frsky_stat_lock_ok;											/**< The received packets at lock */
+
+static void cc_sim_select(void *arg);
+static uint8_t cc_sim_xfer(void *arg, uint8_t data);
+static uint8_t cc_sim_status(void);
+static void cc_sim_reset(void);
+static void cc_sim_strobe(uint8_t cmd);
+static void cc_sim_write(uint8_t addr, uint8_t data);
+static uint8_t cc_sim_read(uint8_t addr);
+static void cc_sim_set_state(uint8_t marcstate);
+static void cc_sim_state_end(void *arg);
+static void cc_sim_start_tx(void);
+static uint64_t cc_sim_byte_ns(uint8_t mdmcfg4, uint8_t mdmcfg3);
+static uint8_t cc_sim_fscal1(uint8_t channel);
+static void cc_sim_rx_start(const struct cc_sim_packet_t *pkt);
+static void cc_sim_rx_byte(void *arg);
+static void cc_sim_rx_drop(void);
+static void cc_sim_gdo0(bool active);
+static void frsky_tx_init(void);
+static void frsky_tx_send(void *arg);
+static void frsky_tx_build(struct cc_sim_packet_t *pkt, bool bind);
+static void frsky_stat_takeover(void);
+static void cc_sim_exit(void);
+
+/* The SPI bus model */
+static const struct sim_spi_model cc_sim_model = {
+	.select = cc_sim_select,
+	.deselect = NULL,
+	.xfer = cc_sim_xfer,
+	.reset = NULL,
+	.arg = NULL
+};
+
+/**
+ * Register the CC2500 model on the SPI bus and start the transmitter
+ */
+void sim_cc_init(void) {
+	sim_event_init(&cc_rx_event, SIM_PRIO_HW, cc_sim_rx_byte, NULL);
+	sim_event_init(&cc_state_event, SIM_PRIO_HW, cc_sim_state_end, NULL);
+	cc_sim_reset();
+	sim_spi_register(SPI_DEV_CC, &cc_sim_model);
+
+	frsky_tx_init();
+	atexit(cc_sim_exit);
+}
+
+/**
+ * Chip select starts a new transaction
+ */
+static void cc_sim_select(void *arg __attribute__((unused))) {
+	cc_spi_first = true;
+}
+
+/**
+ * Transfer one byte, the first byte is the header which returns the status
+ */
+static uint8_t cc_sim_xfer(void *arg __attribute__((unused)), uint8_t data) {
+	uint8_t ret = 0;
+
+	if(cc_spi_first) {
+		cc_spi_first = false;
+		cc_spi_addr = data & 0x3F;
+		cc_spi_read = (data & CC2500_READ_SINGLE) != 0;
+		cc_spi_burst = (data & CC2500_WRITE_BURST) != 0;
+
+		// Status registers are read as burst, otherwise it is a strobe which is followed by a new header
+		ret = cc_sim_status();
+		if(cc_spi_addr >= CC2500_SRES && cc_spi_addr <= CC2500_SNOP && !cc_spi_burst) {
+			cc_sim_strobe(cc_spi_addr);
+			cc_spi_first = true;
+		}
+		return ret;
+	}
+
+	if(cc_spi_read)
+		ret = cc_sim_read(cc_spi_addr);
+	else
+		cc_sim_write(cc_spi_addr, data);
+
+	// Bursts increment the configuration address, single accesses expect a new header
+	if(!cc_spi_burst)
+		cc_spi_first = true;
+	else if(cc_spi_addr < CC_SIM_REG_NB)
+		cc_spi_addr++;
+	return ret;
+}
+
+/**
+ * The chip status byte
+ */
+static uint8_t cc_sim_status(void) {
+	uint8_t state, bytes;
+
+	switch(cc_marcstate) {
+		case CC_MARC_IDLE:					state = CC2500_STATE_IDLE; break;
+		case CC_MARC_RX:						state = CC2500_STATE_RX; break;
+		case CC_MARC_TX:						state = CC2500_STATE_TX; break;
+		case CC_MARC_FSTXON:				state = CC2500_STATE_FSTXON; break;
+		case CC_MARC_CALIBRATE:			state = CC2500_STATE_CALIBRATE; break;
+		case CC_MARC_RX_OVERFLOW:		state = CC2500_STATE_RX_OVERFLOW; break;
+		case CC_MARC_TX_UNDERFLOW:	state = CC2500_STATE_TX_UNDERFLOW; break;
+		default:										state = CC2500_STATE_SETTLING; break;
+	}
+
+	// Available bytes in the RX FIFO on read, free bytes in the TX FIFO on write
+	bytes = cc_spi_read? cc_rx_count : (CC_SIM_FIFO_SIZE - 1 - cc_tx_count);
+	if(bytes > 15)
+		bytes = 15;
+	return state | bytes;
+}
+
+/**
+ * Reset the chip to the default register values
+ */
+static void cc_sim_reset(void) {
+	static const uint8_t cc_defaults[CC_SIM_REG_NB] = {
+		0x29, 0x2E, 0x3F, 0x07, 0xD3, 0x91, 0xFF, 0x04, 0x45, 0x00, 0x00, 0x0F, 0x00, 0x5D, 0xC4, 0xEC,
+		0x8C, 0x22, 0x02, 0x22, 0xF8, 0x47, 0x07, 0x30, 0x04, 0x36, 0x6C, 0x03, 0x40, 0x91, 0x87, 0x6B,
+		0xF8, 0x56, 0x10, 0xA9, 0x0A, 0x20, 0x0D, 0x41, 0x00, 0x59, 0x7F, 0x3F, 0x88, 0x31, 0x0B, 0x00
+	};
+
+	memcpy(cc_regs, cc_defaults, sizeof(cc_regs));
+	cc_patable = 0xC6;
+	cc_rx_read = 0;
+	cc_rx_count = 0;
+	cc_tx_count = 0;
+	cc_rx_busy = false;
+	cc_gdo0 = false;
+	sim_event_cancel(&cc_rx_event);
+	sim_event_cancel(&cc_state_event);
+	cc_marcstate = CC_MARC_IDLE;
+}
+
+/**
+ * Execute a command strobe
+ * @param[in] cmd The strobe
+ */
+static void cc_sim_strobe(uint8_t cmd) {
+	switch(cmd) {
+		case CC2500_SRES:
+			cc_sim_reset();
+			break;
+
+		case CC2500_SCAL:
+			if(cc_marcstate == CC_MARC_IDLE) {
+				cc_sim_set_state(CC_MARC_CALIBRATE);
+				cc_state_next = CC_MARC_IDLE;
+				sim_event_schedule(&cc_state_event, sim_get_time() + CC_SIM_CAL_NS);
+			}
+			break;
+
+		case CC2500_SRX:
+			// Calibrate first when coming from IDLE with FS_AUTOCAL=1
+			if(cc_marcstate == CC_MARC_IDLE && ((cc_regs[CC2500_MCSM0] >> 4) & 0x3) == 1) {
+				cc_sim_set_state(CC_MARC_CALIBRATE);
+				cc_state_next = CC_MARC_RX;
+				sim_event_schedule(&cc_state_event, sim_get_time() + CC_SIM_CAL_NS);
+			} else if(cc_marcstate == CC_MARC_IDLE || cc_marcstate == CC_MARC_FSTXON || cc_marcstate == CC_MARC_TX) {
+				cc_sim_set_state(CC_MARC_RX);
+			}
+			break;
+
+		case CC2500_STX:
+			if(cc_marcstate == CC_MARC_IDLE || cc_marcstate == CC_MARC_RX || cc_marcstate == CC_MARC_FSTXON)
+				cc_sim_start_tx();
+			break;
+
+		case CC2500_SFSTXON:
+			if(cc_marcstate == CC_MARC_IDLE || cc_marcstate == CC_MARC_RX)
+				cc_sim_set_state(CC_MARC_FSTXON);
+			break;
+
+		case CC2500_SIDLE:
+		case CC2500_SXOFF:
+		case CC2500_SPWD:
+			cc_sim_set_state(CC_MARC_IDLE);
+			break;
+
+		case CC2500_SFRX:
+			cc_rx_read = 0;
+			cc_rx_count = 0;
+			cc_rx_pushed = 0;
+			if(cc_marcstate == CC_MARC_RX_OVERFLOW)
+				cc_sim_set_state(CC_MARC_IDLE);
+			break;
+
+		case CC2500_SFTX:
+			cc_tx_count = 0;
+			if(cc_marcstate == CC_MARC_TX_UNDERFLOW)
+				cc_sim_set_state(CC_MARC_IDLE);
+			break;
+
+		default:
+			break;
+	}
+}
+
+/**
+ * Write a register or the TX FIFO
+ */
+static void cc_sim_write(uint8_t addr, uint8_t data) {
+	if(addr == CC2500_TXFIFO) {
+		if(cc_tx_count < CC_SIM_FIFO_SIZE)
+			cc_tx_fifo[cc_tx_count++] = data;
+		else
+			cc_sim_set_state(CC_MARC_TX_UNDERFLOW);
+	}
+	else if(addr == CC2500_PATABLE)
+		cc_patable = data;
+	else if(addr < CC_SIM_REG_NB)
+		cc_regs[addr] = data;
+}
+
+/**
+ * Read a register, status register or the RX FIFO
+ */
+static uint8_t cc_sim_read(uint8_t addr) {
+	uint8_t ret;
+
+	if(addr == CC2500_RXFIFO) {
+		if(cc_rx_count == 0)
+			return 0;
+		ret = cc_rx_fifo[cc_rx_read];
+		cc_rx_read = (cc_rx_read + 1) % CC_SIM_FIFO_SIZE;
+		cc_rx_count--;
+		if(cc_rx_pushed > cc_rx_count)
+			cc_rx_pushed = cc_rx_count;
+
+		// Measure how long a complete packet stayed in the FIFO
+		if(cc_rx_count == 0 && cc_stat_done_time != 0) {
+			uint64_t latency = sim_get_time() - cc_stat_done_time;
+			cc_stat_drain_sum += latency;
+			cc_stat_drain_nb++;
+			if(latency > cc_stat_drain_max)
+				cc_stat_drain_max = latency;
+			cc_stat_done_time = 0;
+		}
+		return ret;
+	}
+	if(addr == CC2500_PATABLE)
+		return cc_patable;
+	if(!cc_spi_burst || addr < CC_SIM_REG_NB)
+		return (addr < CC_SIM_REG_NB)? cc_regs[addr] : 0;
+
+	// The status registers are defined with the burst bit
+	switch(addr | CC2500_WRITE_BURST) {
+		case CC2500_PARTNUM:		return 0x80;
+		case CC2500_VERSION:		return 0x03;
+		case CC2500_LQI:				return cc_lqi;
+		case CC2500_RSSI:				return cc_rssi;
+		case CC2500_MARCSTATE:	return cc_marcstate;
+		case CC2500_TXBYTES:		return ((cc_marcstate == CC_MARC_TX_UNDERFLOW)? 0x80 : 0) | cc_tx_count;
+		case CC2500_RXBYTES:		return ((cc_marcstate == CC_MARC_RX_OVERFLOW)? 0x80 : 0) | cc_rx_count;
+		default:								return 0;
+	}
+}
+
+/**
+ * Change the radio state, leaving RX aborts the packet being received
+ * @param[in] marcstate The new state
+ */
+static void cc_sim_set_state(uint8_t marcstate) {
+	if(marcstate != CC_MARC_RX && cc_rx_busy) {
+		cc_rx_busy = false;
+		cc_sim_gdo0(false);
+		sim_event_cancel(&cc_rx_event);
+	}
+	if(marcstate != CC_MARC_TX && cc_marcstate == CC_MARC_TX)
+		cc_sim_gdo0(false);
+	if(marcstate != CC_MARC_CALIBRATE && marcstate != CC_MARC_TX)
+		sim_event_cancel(&cc_state_event);
+	cc_marcstate = marcstate;
+}
+
+/**
+ * The end of a calibration or transmission
+ */
+static void cc_sim_state_end(void *arg __attribute__((unused))) {
+	uint8_t next = cc_state_next;
+
+	if(cc_marcstate == CC_MARC_CALIBRATE) {
+		cc_regs[CC2500_FSCAL1] = cc_sim_fscal1(cc_regs[CC2500_CHANNR]);
+		cc_regs[CC2500_FSCAL2] = 0x0A;
+		cc_regs[CC2500_FSCAL3] = 0xEA;
+	}
+	else if(cc_marcstate == CC_MARC_TX) {
+		cc_tx_count = 0;
+		cc_stat_sent++;
+	}
+
+	if(next == CC_MARC_TX)
+		cc_sim_start_tx();
+	else
+		cc_sim_set_state(next);
+}
+
+/**
+ * Start transmitting the TX FIFO
+ */
+static void cc_sim_start_tx(void) {
+	static const uint8_t txoff_mode[] = {CC_MARC_IDLE, CC_MARC_FSTXON, CC_MARC_TX, CC_MARC_RX};
+
+	if(cc_tx_count == 0) {
+		cc_stat_underflow++;
+		cc_sim_set_state(CC_MARC_TX_UNDERFLOW);
+		return;
+	}
+
+	cc_sim_set_state(CC_MARC_TX);
+	cc_sim_gdo0(true);
+	frsky_stat_takeover();
+	cc_state_next = txoff_mode[cc_regs[CC2500_MCSM1] & 0x3];
+	if(cc_state_next == CC_MARC_TX)
+		cc_state_next = CC_MARC_IDLE;
+	sim_event_schedule(&cc_state_event, sim_get_time()
+		+ (CC_SIM_OVERHEAD + cc_tx_count + 2) * cc_sim_byte_ns(cc_regs[CC2500_MDMCFG4], cc_regs[CC2500_MDMCFG3]));
+}
+
+/**
+ * The air time of one byte at a data rate
+ * @param[in] mdmcfg4 The MDMCFG4 register with the exponent in the lower nibble
+ * @param[in] mdmcfg3 The MDMCFG3 register with the mantissa
+ */
+static uint64_t cc_sim_byte_ns(uint8_t mdmcfg4, uint8_t mdmcfg3) {
+	uint64_t rate = ((uint64_t)(256 + mdmcfg3) << (mdmcfg4 & 0xF)) * CC_SIM_XTAL;
+	return (8000000000ULL << 28) / rate;
+}
+
+/**
+ * The FSCAL1 value a calibration gives for a channel
+ * @param[in] channel The channel
+ */
+static uint8_t cc_sim_fscal1(uint8_t channel) {
+	return 0x10 + channel / 8;
+}
+
+/**
+ * A packet starts on air, check if the receiver hears it
+ * @param[in] pkt The packet
+ */
+static void cc_sim_rx_start(const struct cc_sim_packet_t *pkt) {
+	int offset = (int8_t)cc_regs[CC2500_FSCTRL0] - pkt->offset;
+
+	if(cc_marcstate != CC_MARC_RX || cc_rx_busy || cc_regs[CC2500_CHANNR] != pkt->channel)
+		return;
+	if((cc_regs[CC2500_MDMCFG4] & 0xF) != (pkt->mdmcfg4 & 0xF) || cc_regs[CC2500_MDMCFG3] != pkt->mdmcfg3)
+		return;
+	if(offset < -CC_SIM_TUNE_WINDOW || offset > CC_SIM_TUNE_WINDOW)
+		return;
+	if(cc_regs[CC2500_FSCAL1] != cc_sim_fscal1(pkt->channel))
+		return;
+
+	cc_rx_busy = true;
+	cc_sim_gdo0(true);
+	cc_rx_pkt = *pkt;
+	cc_rx_pushed = 0;
+	cc_rssi = 0x40 - abs(offset);
+	cc_lqi = 0x10 + abs(offset);
+
+	// The first byte arrives after the preamble and sync word
+	uint64_t byte_ns = cc_sim_byte_ns(pkt->mdmcfg4, pkt->mdmcfg3);
+	sim_event_schedule(&cc_rx_event, sim_get_time() + (CC_SIM_OVERHEAD + 1) * byte_ns);
+}
+
+/**
+ * Push the next byte of the packet being received in the RX FIFO
+ */
+static void cc_sim_rx_byte(void *arg __attribute__((unused))) {
+	static const uint8_t rxoff_mode[] = {CC_MARC_IDLE, CC_MARC_FSTXON, CC_MARC_TX, CC_MARC_RX};
+	uint64_t byte_ns = cc_sim_byte_ns(cc_rx_pkt.mdmcfg4, cc_rx_pkt.mdmcfg3);
+	uint8_t idx = cc_rx_pushed;
+	uint8_t adr_chk = cc_regs[CC2500_PKTCTRL1] & 0x3;
+
+	// Length filtering in variable packet length mode
+	if(idx == 0 && (cc_regs[CC2500_PKTCTRL0] & 0x3) == 1 && cc_rx_pkt.length > cc_regs[CC2500_PKTLEN]) {
+		cc_stat_filtered++;
+		cc_rx_busy = false;
+		cc_sim_gdo0(false);
+		return;
+	}
+
+	// Address filtering on the first payload byte
+	if(idx == 1 && adr_chk != 0) {
+		uint8_t addr = cc_rx_pkt.data[1];
+		if(addr != cc_regs[CC2500_ADDR] && !(adr_chk >= 2 && addr == 0x00) && !(adr_chk == 3 && addr == 0xFF)) {
+			cc_stat_filtered++;
+			cc_sim_rx_drop();
+			return;
+		}
+	}
+
+	// Put the byte in the FIFO or overflow
+	if(idx <= cc_rx_pkt.length) {
+		if(cc_rx_count >= CC_SIM_FIFO_SIZE) {
+			cc_stat_overflow++;
+			cc_sim_set_state(CC_MARC_RX_OVERFLOW);
+			return;
+		}
+		cc_rx_fifo[(cc_rx_read + cc_rx_count) % CC_SIM_FIFO_SIZE] = cc_rx_pkt.data[idx];
+		cc_rx_count++;
+		cc_rx_pushed++;
+
+		// Wait for the next byte, after the last also for the CRC
+		sim_event_schedule(&cc_rx_event, sim_get_time() + ((idx == cc_rx_pkt.length)? 2 : 1) * byte_ns);
+		return;
+	}
+
+	// The CRC is received, drop the packet on a CRC error with autoflush
+	if(!cc_rx_pkt.crc_ok) {
+		cc_stat_crc++;
+		if(cc_regs[CC2500_PKTCTRL1] & CC2500_PKTCTRL1_CRC_AUTOFLUSH) {
+			cc_sim_rx_drop();
+			return;
+		}
+	} else {
+		cc_stat_ok++;
+	}
+
+	// Append the RSSI and LQI with CRC OK
+	if(cc_regs[CC2500_PKTCTRL1] & CC2500_PKTCTRL1_APPEND_STATUS) {
+		if(cc_rx_count + 2 > CC_SIM_FIFO_SIZE) {
+			cc_stat_overflow++;
+			cc_sim_set_state(CC_MARC_RX_OVERFLOW);
+			return;
+		}
+		cc_rx_fifo[(cc_rx_read + cc_rx_count) % CC_SIM_FIFO_SIZE] = cc_rssi;
+		cc_rx_fifo[(cc_rx_read + cc_rx_count + 1) % CC_SIM_FIFO_SIZE] = (cc_rx_pkt.crc_ok? CC2500_LQI_CRC_OK_BM : 0) | cc_lqi;
+		cc_rx_count += 2;
+	}
+	cc_stat_done_time = sim_get_time();
+
+	// Keep track of the data packets from the transmitter in a row
+	if(cc_rx_pkt.crc_ok && cc_rx_pkt.data[1] == frsky_tx_id[0] && cc_rx_pkt.data[2] == frsky_tx_id[1]) {
+		frsky_stat_ok++;
+		frsky_stat_last_ok = true;
+		if(++frsky_stat_streak == frsky_stat_lock_len && frsky_stat_lock_time == 0) {
+			frsky_stat_lock_time = sim_get_time();
+			frsky_stat_lock_tx = frsky_stat_tx;
+			frsky_stat_lock_ok = frsky_stat_ok;
+		}
+	}
+
+	// Go to the RXOFF_MODE state
+	cc_rx_busy = false;
+	cc_sim_gdo0(false);
+	if(rxoff_mode[(cc_regs[CC2500_MCSM1] >> 2) & 0x3] == CC_MARC_TX)
+		cc_sim_start_tx();
+	else
+		cc_sim_set_state(rxoff_mode[(cc_regs[CC2500_MCSM1] >> 2) & 0x3]);
+}
+
+/**
+ * Drop the bytes of the packet being received from the FIFO
+ */
+static void cc_sim_rx_drop(void) {
+	uint8_t drop = (cc_rx_pushed < cc_rx_count)? cc_rx_pushed : cc_rx_count;
+	cc_rx_count -= drop;
+	cc_rx_pushed = 0;
+	cc_rx_busy = false;
+	cc_sim_gdo0(false);
+	sim_event_cancel(&cc_rx_event);
+}
+
+/**
+ * Drive the GDO0 pin, which is connected to an interrupt. Only the sync word output (IOCFG0 0x06) is
+ * modelled, it asserts after the sync word and de-asserts at the end or the drop of a packet.
+ * @param[in] active The new state of the signal
+ */
+static void cc_sim_gdo0(bool active) {
+	bool falling = cc_gdo0 && !active;
+	cc_gdo0 = active;
+
+	if(falling && (cc_regs[CC2500_IOCFG0] & 0x7F) == CC2500_IOCFG_SYNC_WORD)
+		sim_spi_irq(SPI_DEV_CC);
+}
+
+/**
+ * Configure the FrSkyX transmitter from the environment
+ */
+static void frsky_tx_init(void) {
+	static const uint8_t steps[] = {5, 7, 11, 17, 19, 23, 25, 29};
+	uint32_t id = sim_getenv_int("USBRF_FRSKY_TXID", 0);
+	uint8_t i;
+
+	frsky_stat_lock_len = sim_getenv_int("USBRF_FRSKY_LOCK", 16);
+	frsky_tx_enabled = (id != 0);
+	if(!frsky_tx_enabled)
+		return;
+
+	frsky_tx_id[0] = id >> 8;
+	frsky_tx_id[1] = id & 0xFF;
+	frsky_tx_protocol = sim_getenv_int("USBRF_FRSKY_PROTOCOL", FRSKYX_EU);
+	if(frsky_tx_protocol != FRSKYX)
+		frsky_tx_protocol = FRSKYX_EU;
+
+	// Generate a hop table of unique channels (the step is coprime with 234)
+	for(i = 0; i < FRSKY_HOP_TABLE_LENGTH; i++)
+		frsky_tx_hop_table[i] = ((id + i * steps[id % sizeof(steps)]) % (FRSKY_MAX_CHANNEL - 1)) + 1;
+
+	frsky_tx_chanskip = sim_getenv_int("USBRF_FRSKY_CHANSKIP", 1 + id % (FRSKY_HOP_TABLE_LENGTH - 1));
+	frsky_tx_hop_idx = 0;
+	frsky_tx_bind_idx = 0;
+	frsky_tx_offset = sim_getenv_int("USBRF_FRSKY_OFFSET", 0);
+	frsky_tx_loss = sim_getenv_float("USBRF_FRSKY_LOSS", 0) / 100.0 * 0xFFFFFFFFU;
+	frsky_tx_crc_err = sim_getenv_float("USBRF_FRSKY_CRC_ERR", 0) / 100.0 * 0xFFFFFFFFU;
+	frsky_tx_rand = sim_getenv_int("USBRF_FRSKY_SEED", 1);
+	if(frsky_tx_rand == 0)
+		frsky_tx_rand = 1;
+	frsky_tx_start = (uint64_t)(sim_getenv_float("USBRF_FRSKY_START", 0.1) * 1e9);
+	frsky_tx_bind_end = frsky_tx_start + (uint64_t)(sim_getenv_float("USBRF_FRSKY_BIND", 0) * 1e9);
+
+	// The crystal of the transmitter is off by USBRF_FRSKY_PPM
+	frsky_tx_frame_ns = (uint64_t)(FRSKY_SEND_TIME * 10000 * (1.0 + sim_getenv_float("USBRF_FRSKY_PPM", 0) / 1e6));
+	frsky_tx_air_ns = (CC_SIM_OVERHEAD + ((frsky_tx_protocol == FRSKYX_EU)? FRSKY_PACKET_LENGTH_EU : FRSKY_PACKET_LENGTH) + 3)
+			* cc_sim_byte_ns(0x7B, (frsky_tx_protocol == FRSKYX_EU)? 0xF8 : 0x61);
+
+	sim_event_init(&frsky_tx_event, SIM_PRIO_HW, frsky_tx_send, NULL);
+	sim_event_schedule(&frsky_tx_event, frsky_tx_start);
+}
+
+/**
+ * Send the next packet and schedule the one after
+ */
+static void frsky_tx_send(void *arg __attribute__((unused))) {
+	struct cc_sim_packet_t pkt;
+	bool bind = (sim_get_time() < frsky_tx_bind_end);
+
+	if(bind) {
+		frsky_stat_bind++;
+	} else {
+		// The previous packet was missed by the receiver
+		if(!frsky_stat_last_ok)
+			frsky_stat_streak = 0;
+		frsky_stat_last_ok = false;
+		frsky_stat_tx++;
+	}
+	frsky_tx_build(&pkt, bind);
+
+	// Xorshift for a reproducible packet loss and CRC errors
+	frsky_tx_rand ^= frsky_tx_rand << 13;
+	frsky_tx_rand ^= frsky_tx_rand >> 17;
+	frsky_tx_rand ^= frsky_tx_rand << 5;
+	pkt.crc_ok = (frsky_tx_rand >= frsky_tx_loss + frsky_tx_crc_err);
+	if(frsky_tx_rand >= frsky_tx_loss)
+		cc_sim_rx_start(&pkt);
+	if(!bind)
+		frsky_tx_last = frsky_tx_event.time;
+
+	sim_event_schedule(&frsky_tx_event, frsky_tx_event.time + frsky_tx_frame_ns);
+}
+
+/**
+ * Build the next bind or data packet
+ * @param[out] pkt The packet to send
+ * @param[in] bind Whether to send a bind packet
+ */
+static void frsky_tx_build(struct cc_sim_packet_t *pkt, bool bind) {
+	uint8_t len = (frsky_tx_protocol == FRSKYX_EU)? FRSKY_PACKET_LENGTH_EU : FRSKY_PACKET_LENGTH;
+	uint8_t *data = pkt->data;
+	uint8_t i;
+
+	memset(pkt->data, 0, sizeof(pkt->data));
+	pkt->mdmcfg4 = 0x7B;
+	pkt->mdmcfg3 = (frsky_tx_protocol == FRSKYX_EU)? 0xF8 : 0x61;
+	pkt->offset = frsky_tx_offset;
+	pkt->length = len;
+	data[0] = len;
+
+	if(bind) {
+		// Bind packets send 5 entries of the hop table each
+		pkt->channel = FRSKY_BIND_CHAN;
+		data[1] = FRSKY_BIND_ADDR;
+		data[2] = 0x01;
+		data[3] = frsky_tx_id[0];
+		data[4] = frsky_tx_id[1];
+		data[5] = frsky_tx_bind_idx;
+		for(i = 0; i < 5; i++)
+			data[6 + i] = (frsky_tx_bind_idx + i < FRSKY_HOP_TABLE_LENGTH)? frsky_tx_hop_table[frsky_tx_bind_idx + i] : 0;
+		data[11] = 0x02;
+		frsky_tx_bind_idx = (frsky_tx_bind_idx + 5) % (5 * FRSKY_HOP_TABLE_PKTS);
+	} else {
+		// Data packets have the hop index and channel skip
+		frsky_tx_hop_idx = (frsky_tx_hop_idx + frsky_tx_chanskip) % FRSKY_HOP_TABLE_LENGTH;
+		pkt->channel = frsky_tx_hop_table[frsky_tx_hop_idx];
+		data[1] = frsky_tx_id[0];
+		data[2] = frsky_tx_id[1];
+		data[3] = 0x02;
+		data[4] = (frsky_tx_chanskip << 6) | frsky_tx_hop_idx;
+		data[5] = frsky_tx_chanskip >> 2;
+		for(i = 0; i < 12; i += 3) {
+			data[9 + i] = 0x00;
+			data[10 + i] = 0x04;
+			data[11 + i] = 0x40;
+		}
+		data[21] = 0x08;														// No telemetry, so the send sequence stays 8
+	}
+
+	// The inner CRC
+	uint16_t crc = frskyx_crc(&data[3], len - 4);
+	data[len - 1] = crc >> 8;
+	data[len] = crc & 0xFF;
+}
+
+/**
+ * Check if a packet the firmware starts to send overlaps a transmitter data packet on the same channel
+ */
+static void frsky_stat_takeover(void) {
+	uint64_t now = sim_get_time();
+	uint8_t next_idx = (frsky_tx_hop_idx + frsky_tx_chanskip) % FRSKY_HOP_TABLE_LENGTH;
+	uint64_t offset = UINT64_MAX;
+
+	if(!frsky_tx_enabled || frsky_tx_last == 0)
+		return;
+	cc_stat_sends++;
+
+	// The closest of the last and the next transmitter packet on the same channel
+	if(frsky_tx_hop_table[frsky_tx_hop_idx] == cc_regs[CC2500_CHANNR])
+		offset = now - frsky_tx_last;
+	if(frsky_tx_hop_table[next_idx] == cc_regs[CC2500_CHANNR] && frsky_tx_event.time >= now && frsky_tx_event.time - now < offset)
+		offset = frsky_tx_event.time - now;
+
+	if(offset >= frsky_tx_air_ns) {
+		cc_stat_slot_run = 0;
+		return;
+	}
+
+	cc_stat_slot++;
+	cc_stat_slot_sum += offset;
+	if(offset > cc_stat_slot_max)
+		cc_stat_slot_max = offset;
+	if(++cc_stat_slot_run > cc_stat_slot_best)
+		cc_stat_slot_best = cc_stat_slot_run;
+}
+
+/**
+ * Print the statistics when the simulation stops
+ */
+static void cc_sim_exit(void) {
+	if(!frsky_tx_enabled && cc_stat_sent == 0)
+		return;
+
+	fprintf(stderr, "cc: frsky tx %u (bind %u), received %u, crc errors %u, filtered %u, overflows %u, underflows %u, sent %u\n",
+			frsky_stat_tx, frsky_stat_bind, cc_stat_ok, cc_stat_crc, cc_stat_filtered, cc_stat_overflow, cc_stat_underflow, cc_stat_sent);
+	if(cc_stat_sends > 0)
+		fprintf(stderr, "cc: takeover %u of %u sent in a slot (best run %u), offset avg %.1f us, max %.1f us\n",
+				cc_stat_slot, cc_stat_sends, cc_stat_slot_best,
+				(cc_stat_slot > 0)? cc_stat_slot_sum / 1e3 / cc_stat_slot : 0.0, cc_stat_slot_max / 1e3);
+	if(cc_stat_drain_nb > 0)
+		fprintf(stderr, "cc: fifo drain latency avg %.1f us, max %.1f us\n",
+				cc_stat_drain_sum / 1e3 / cc_stat_drain_nb, cc_stat_drain_max / 1e3);
+
+	if(frsky_stat_lock_time == 0) {
+		fprintf(stderr, "cc: no lock (%u packets in a row)\n", frsky_stat_lock_len);
+		return;
+	}
+
+	// The packets before lock are counted as lock-on time, the rest as loss
+	uint32_t tx = frsky_stat_tx - frsky_stat_lock_tx;
+	uint32_t ok = frsky_stat_ok - frsky_stat_lock_ok;
+	fprintf(stderr, "cc: lock after %.3f s, loss after lock %.2f %% (%u/%u)\n",
+			(frsky_stat_lock_time - frsky_tx_start) / 1e9, (tx > 0)? 100.0 * (tx - ok) / tx : 0.0, tx - ok, tx);
+}
@@ -0,0 +1,598 @@
+/*
+ * This file is part of the superbitrf project.
+ *
+ * Copyright (C) 2018 Freek van Tienen <freek.v.tienen@gmail.com>
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Register level model of the CYRF6936 together with a DSM2/DSMX transmitter
+ * which generates the air traffic. The receiver only hears a packet when it
+ * was started on the same channel with the same SOP code before the packet
+ * begins and it is not aborted before the packet ends. A wrong CRC seed or
+ * data code is reported like the real chip does.
+ *
+ * The transmitter is enabled by setting USBRF_DSM_TXID (for example
+ * 0xA1B2C3D4) and is configured with:
+ *  USBRF_DSM_PROTOCOL   The dsm_protocol byte (default 0xB2, DSMX 2 packets)
+ *  USBRF_DSM2_CHANNELS  The two DSM2 channels as 0xAABB (default from the ID)
+ *  USBRF_DSM_FRAME_US   The time between two channel A packets (default 22000)
+ *  USBRF_DSM_START      The time in seconds the transmitter is switched on
+ *  USBRF_DSM_LOSS       The percentage of packets which is lost on air
+ *  USBRF_DSM_SEED       The seed of the packet loss
+ *  USBRF_DSM_RSSI       The RSSI of the received packets (0-31)
+ *  USBRF_DSM_LOCK       The amount of packets in a row to count as locked
+ * The lock-on time and packet loss are printed when the simulation stops.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "modules/cyrf6936.h"
+#include "helper/dsm.h"
+#include "helper/crc.h"
+#include "sim.h"
+
+#define CYRF_SIM_BYTE_NS			64000			/**< Air time of one byte in 8DR mode with 64 chip codes */
+#define CYRF_SIM_OVERHEAD			6					/**< Preamble, SOP, length and CRC bytes on air */
+#define CYRF_SIM_PKT_SIZE			16				/**< The size of the TX and RX buffers */
+#define CYRF_SIM_REG_NB				0x40			/**< The amount of registers */
+#define CYRF_SIM_ADDR_MASK		0x3F			/**< The address part of the first SPI byte */
+#define CYRF_SIM_INC					(1<<6)		/**< Auto increment the address */
+
+/* A packet on air */
+struct cyrf_sim_packet_t {
+	uint8_t channel;											/**< The RF channel */
+	const uint8_t *sop_code;							/**< The 8 byte SOP code */
+	const uint8_t *data_code;							/**< The 8 byte data code */
+	uint16_t crc_seed;										/**< The CRC seed */
+	uint8_t length;												/**< The length of the data */
+	uint8_t data[CYRF_SIM_PKT_SIZE];			/**< The packet data */
+};
+
+/* The chip state */
+static uint8_t cyrf_regs[CYRF_SIM_REG_NB];					/**< The register file */
+static uint8_t cyrf_tx_buf[CYRF_SIM_PKT_SIZE];			/**< The TX buffer */
+static uint8_t cyrf_rx_buf[CYRF_SIM_PKT_SIZE];			/**< The RX buffer */
+static uint8_t cyrf_sop_code[8];										/**< The SOP code */
+static uint8_t cyrf_data_code[16];									/**< The data code */
+static uint8_t cyrf_preamble[3];										/**< The preamble */
+static uint8_t cyrf_mfg_id[6];											/**< The manufacturer ID */
+static uint8_t cyrf_tx_irq;													/**< The TX IRQ status */
+static uint8_t cyrf_rx_irq;													/**< The RX IRQ status */
+static bool cyrf_rx_armed;													/**< The receiver is started (RX_GO) */
+static bool cyrf_rx_busy;														/**< A packet is being received */
+static struct cyrf_sim_packet_t cyrf_rx_pkt;				/**< The packet being received */
+static struct sim_event cyrf_rx_event;							/**< The end of the packet being received */
+static struct sim_event cyrf_tx_event;							/**< The end of the packet being transmitted */
+
+/* The SPI transaction state */
+static uint8_t cyrf_spi_addr;												/**< The register address */
+static bool cyrf_spi_first;													/**< The next byte is the address byte */
+static bool cyrf_spi_write;													/**< The transaction writes */
+static bool cyrf_spi_inc;														/**< The address auto increments */
+static uint8_t cyrf_spi_idx;												/**< The index in a buffer register */
+
+/* The DSM transmitter generating the air traffic */
+static bool dsm_tx_enabled;													/**< Whether there is a transmitter */
+static uint8_t dsm_tx_id[4];												/**< The transmitter ID */
+static bool dsm_tx_is_dsmx;													/**< Whether it is transmitting DSMX */
+static bool dsm_tx_is_11bit;												/**< Whether the channels are 11 bit */
+static uint8_t dsm_tx_channels[DSM_MAX_USED_CHANNELS];	/**< The hop sequence */
+static uint8_t dsm_tx_chan_idx;											/**< The current index in the hop sequence */
+static uint8_t dsm_tx_sop_col;											/**< The SOP code column */
+static uint8_t dsm_tx_data_col;											/**< The data code column */
+static uint16_t dsm_tx_crc_seed;										/**< The current CRC seed */
+static uint64_t dsm_tx_frame_ns;										/**< The time between two channel A packets */
+static uint64_t dsm_tx_ab_ns;												/**< The time between channel A and B */
+static uint64_t dsm_tx_last;												/**< The time the last packet started */
+static uint64_t dsm_tx_start;												/**< The time the transmitter was switched on */
+static uint32_t dsm_tx_frame;												/**< The amount of frames sent */
+static bool dsm_tx_chan_b;													/**< The next packet is channel B */
+static uint32_t dsm_tx_loss;												/**< The loss threshold of the random number */
+static uint32_t dsm_tx_rand;												/**< The state of the loss generator */
+static uint8_t dsm_tx_rssi;													/**< The RSSI of received packets */
+static struct sim_event dsm_tx_event;								/**< The next packet on air */
+
+/* The statistics */
+static uint32_t dsm_stat_tx;												/**< Packets sent by the transmitter */
+static uint32_t dsm_stat_ok;												/**< Packets received without errors */
+static uint32_t dsm_stat_err;												/**< Packets received with errors */
+static uint32_t dsm_stat_lock_len;									/**< Packets in a row needed for lock */
+static uint32_t dsm_stat_streak;										/**< Packets received in a row */
+static bool dsm_stat_last_ok;												/**< The last packet was received */
+static uint64_t dsm_stat_lock_time;									/**< The time of lock (0 is never) */
+static uint32_t dsm_stat_lock_tx;										/**< The transmitted packets at lock */
+static uint32_t dsm_stat_lock_ok;										/**< The received packets at lock */
+static uint32_t cyrf_stat_tx;												/**< Packets sent by the firmware */
+static uint32_t cyrf_stat_sends;										/**< Packets the firmware started to send during the transmitter */
+static uint32_t cyrf_stat_slot;											/**< Packets sent over a transmitter packet on its channel */
+static uint32_t cyrf_stat_slot_run;									/**< Packets sent in a slot in a row */
+static uint32_t cyrf_stat_slot_best;								/**< The longest run of packets sent in a slot */
+static uint64_t cyrf_stat_slot_sum;									/**< The summed offset to the transmitter packets */
+static uint64_t cyrf_stat_slot_max;									/**< The maximum offset to the transmitter packets */
+
+static void cyrf_sim_select(void *arg);
+static uint8_t cyrf_sim_xfer(void *arg, uint8_t data);
+static void cyrf_sim_reset(void *arg, bool active);
+static void cyrf_sim_write(uint8_t addr, uint8_t data);
+static uint8_t cyrf_sim_read(uint8_t addr);
+static void cyrf_sim_rx_start(const struct cyrf_sim_packet_t *pkt);
+static void cyrf_sim_rx_end(void *arg);
+static void cyrf_sim_tx_end(void *arg);
+static void dsm_tx_init(void);
+static void dsm_tx_send(void *arg);
+static void dsm_tx_build(struct cyrf_sim_packet_t *pkt);
+static void dsm_stat_takeover(void);
+static void cyrf_sim_exit(void);
+
+/* The SPI bus model */
+static const struct sim_spi_model cyrf_sim_model = {
+	.select = cyrf_sim_select,
+	.deselect = NULL,
+	.xfer = cyrf_sim_xfer,
+	.reset = cyrf_sim_reset,
+	.arg = NULL
+};
+
+/**
+ * Register the CYRF6936 model on the SPI bus and start the transmitter
+ */
+void sim_cyrf_init(void) {
+	uint32_t id = sim_getenv_int("USBRF_ID", 1);
+	cyrf_mfg_id[0] = 0x55;
+	cyrf_mfg_id[1] = 0x42;
+	cyrf_mfg_id[2] = id >> 24;
+	cyrf_mfg_id[3] = id >> 16;
+	cyrf_mfg_id[4] = id >> 8;
+	cyrf_mfg_id[5] = id;
+
+	sim_event_init(&cyrf_rx_event, SIM_PRIO_HW, cyrf_sim_rx_end, NULL);
+	sim_event_init(&cyrf_tx_event, SIM_PRIO_HW, cyrf_sim_tx_end, NULL);
+	cyrf_sim_reset(NULL, true);
+	sim_spi_register(SPI_DEV_CYRF, &cyrf_sim_model);
+
+	dsm_tx_init();
+	atexit(cyrf_sim_exit);
+}
+
+/**
+ * Chip select starts a new transaction
+ */
+static void cyrf_sim_select(void *arg __attribute__((unused))) {
+	cyrf_spi_first = true;
+}
+
+/**
+ * Transfer one byte, the first byte is the address
+ */
+static uint8_t cyrf_sim_xfer(void *arg __attribute__((unused)), uint8_t data) {
+	uint8_t ret = 0;
+
+	if(cyrf_spi_first) {
+		cyrf_spi_first = false;
+		cyrf_spi_addr = data & CYRF_SIM_ADDR_MASK;
+		cyrf_spi_write = (data & CYRF_DIR) != 0;
+		cyrf_spi_inc = (data & CYRF_SIM_INC) != 0;
+		cyrf_spi_idx = 0;
+		return 0;
+	}
+
+	if(cyrf_spi_write)
+		cyrf_sim_write(cyrf_spi_addr, data);
+	else
+		ret = cyrf_sim_read(cyrf_spi_addr);
+
+	// Buffer registers advance inside the buffer, others only on auto increment
+	if(cyrf_spi_addr >= CYRF_TX_BUFFER && cyrf_spi_addr <= CYRF_MFG_ID)
+		cyrf_spi_idx++;
+	else if(cyrf_spi_inc)
+		cyrf_spi_addr = (cyrf_spi_addr + 1) & CYRF_SIM_ADDR_MASK;
+	return ret;
+}
+
+/**
+ * The reset pin or the software reset puts the registers back to default
+ */
+static void cyrf_sim_reset(void *arg __attribute__((unused)), bool active) {
+	if(!active)
+		return;
+
+	memset(cyrf_regs, 0, sizeof(cyrf_regs));
+	cyrf_regs[CYRF_XACT_CFG] = CYRF_MODE_IDLE;
+	cyrf_tx_irq = 0;
+	cyrf_rx_irq = 0;
+	cyrf_rx_armed = false;
+	cyrf_rx_busy = false;
+	sim_event_cancel(&cyrf_rx_event);
+	sim_event_cancel(&cyrf_tx_event);
+}
+
+/**
+ * Write a register
+ */
+static void cyrf_sim_write(uint8_t addr, uint8_t data) {
+	switch(addr) {
+		case CYRF_TX_BUFFER:
+			if(cyrf_spi_idx < sizeof(cyrf_tx_buf))
+				cyrf_tx_buf[cyrf_spi_idx] = data;
+			return;
+		case CYRF_SOP_CODE:
+			if(cyrf_spi_idx < sizeof(cyrf_sop_code))
+				cyrf_sop_code[cyrf_spi_idx] = data;
+			return;
+		case CYRF_DATA_CODE:
+			if(cyrf_spi_idx < sizeof(cyrf_data_code))
+				cyrf_data_code[cyrf_spi_idx] = data;
+			return;
+		case CYRF_PREAMBLE:
+			if(cyrf_spi_idx < sizeof(cyrf_preamble))
+				cyrf_preamble[cyrf_spi_idx] = data;
+			return;
+		case CYRF_RX_BUFFER:
+			return;
+
+		case CYRF_MODE_OVERRIDE:
+			if(data & CYRF_RST) {
+				cyrf_sim_reset(NULL, true);
+				return;
+			}
+			break;
+
+		case CYRF_CHANNEL:
+			// Retuning loses the packet being received
+			cyrf_rx_busy = false;
+			sim_event_cancel(&cyrf_rx_event);
+			break;
+
+		case CYRF_XACT_CFG:
+			// Forcing the end state aborts the receive
+			if(data & CYRF_FRC_END) {
+				cyrf_rx_armed = false;
+				cyrf_rx_busy = false;
+				sim_event_cancel(&cyrf_rx_event);
+				data &= ~CYRF_FRC_END;
+			}
+			break;
+
+		case CYRF_RX_CTRL:
+			if(data & CYRF_RX_GO) {
+				cyrf_rx_armed = true;
+				cyrf_rx_busy = false;
+				sim_event_cancel(&cyrf_rx_event);
+			}
+			break;
+
+		case CYRF_TX_CTRL:
+			if(data & CYRF_TX_GO) {
+				uint8_t len = cyrf_regs[CYRF_TX_LENGTH];
+				cyrf_rx_armed = false;
+				cyrf_rx_busy = false;
+				sim_event_cancel(&cyrf_rx_event);
+				sim_event_schedule(&cyrf_tx_event, sim_get_time() + (uint64_t)(len + CYRF_SIM_OVERHEAD) * CYRF_SIM_BYTE_NS);
+				cyrf_stat_tx++;
+				dsm_stat_takeover();
+			}
+			data &= ~(CYRF_TX_GO | CYRF_TX_CLR);
+			break;
+
+		case CYRF_RX_IRQ_STATUS:
+		case CYRF_TX_IRQ_STATUS:
+			// Only the overwrite bit can be written, which isn't modelled
+			return;
+
+		default:
+			break;
+	}
+
+	cyrf_regs[addr] = data;
+}
+
+/**
+ * Read a register, the IRQ status is cleared on read
+ */
+static uint8_t cyrf_sim_read(uint8_t addr) {
+	uint8_t ret;
+
+	switch(addr) {
+		case CYRF_RX_BUFFER:
+			return (cyrf_spi_idx < sizeof(cyrf_rx_buf))? cyrf_rx_buf[cyrf_spi_idx] : 0;
+		case CYRF_TX_BUFFER:
+			return (cyrf_spi_idx < sizeof(cyrf_tx_buf))? cyrf_tx_buf[cyrf_spi_idx] : 0;
+		case CYRF_SOP_CODE:
+			return (cyrf_spi_idx < sizeof(cyrf_sop_code))? cyrf_sop_code[cyrf_spi_idx] : 0;
+		case CYRF_DATA_CODE:
+			return (cyrf_spi_idx < sizeof(cyrf_data_code))? cyrf_data_code[cyrf_spi_idx] : 0;
+		case CYRF_PREAMBLE:
+			return (cyrf_spi_idx < sizeof(cyrf_preamble))? cyrf_preamble[cyrf_spi_idx] : 0;
+		case CYRF_MFG_ID:
+			if(cyrf_regs[CYRF_MFG_ID] != 0xFF || cyrf_spi_idx >= sizeof(cyrf_mfg_id))
+				return 0;
+			return cyrf_mfg_id[cyrf_spi_idx];
+
+		case CYRF_RX_IRQ_STATUS:
+			ret = cyrf_rx_irq | (cyrf_rx_busy? CYRF_SOPDET_IRQ : 0);
+			cyrf_rx_irq &= ~(CYRF_RXC_IRQ | CYRF_RXE_IRQ);
+			return ret;
+		case CYRF_TX_IRQ_STATUS:
+			ret = cyrf_tx_irq;
+			cyrf_tx_irq &= ~(CYRF_TXC_IRQ | CYRF_TXE_IRQ);
+			return ret;
+
+		case CYRF_RSSI:
+			return (cyrf_rx_busy? 0x80 : 0) | cyrf_regs[CYRF_RSSI];
+
+		default:
+			return cyrf_regs[addr];
+	}
+}
+
+/**
+ * A packet starts on air, check if the receiver hears it
+ * @param[in] pkt The packet
+ */
+static void cyrf_sim_rx_start(const struct cyrf_sim_packet_t *pkt) {
+	if(!cyrf_rx_armed || cyrf_rx_busy || cyrf_regs[CYRF_CHANNEL] != pkt->channel)
+		return;
+
+	// The SOP correlator needs the same code
+	if((cyrf_regs[CYRF_FRAMING_CFG] & CYRF_SOP_EN) && memcmp(cyrf_sop_code, pkt->sop_code, 8) != 0)
+		return;
+
+	cyrf_rx_busy = true;
+	cyrf_rx_pkt = *pkt;
+	sim_event_schedule(&cyrf_rx_event, sim_get_time() + (uint64_t)(pkt->length + CYRF_SIM_OVERHEAD) * CYRF_SIM_BYTE_NS);
+}
+
+/**
+ * The packet being received has ended
+ */
+static void cyrf_sim_rx_end(void *arg __attribute__((unused))) {
+	bool code_ok = (memcmp(cyrf_data_code, cyrf_rx_pkt.data_code, 8) == 0);
+	uint16_t seed = (cyrf_regs[CYRF_CRC_SEED_MSB] << 8) | cyrf_regs[CYRF_CRC_SEED_LSB];
+	uint16_t crc = crc16(cyrf_rx_pkt.crc_seed, cyrf_rx_pkt.data, cyrf_rx_pkt.length);
+	uint8_t status = CYRF_RX_DATA_MODE_8DR;
+	uint8_t i;
+
+	// A wrong data code decodes garbage
+	for(i = 0; i < cyrf_rx_pkt.length; i++)
+		cyrf_rx_buf[i] = code_ok? cyrf_rx_pkt.data[i] : (cyrf_rx_pkt.data[i] ^ 0x5A);
+
+	if(!code_ok)
+		status |= CYRF_PKT_ERR | CYRF_BAD_CRC;
+	else if(seed != cyrf_rx_pkt.crc_seed && !(cyrf_regs[CYRF_RX_OVERRIDE] & CYRF_DIS_RXCRC))
+		status |= CYRF_BAD_CRC;
+
+	cyrf_regs[CYRF_RX_COUNT] = cyrf_rx_pkt.length;
+	cyrf_regs[CYRF_RX_LENGTH] = cyrf_rx_pkt.length;
+	cyrf_regs[CYRF_RX_STATUS] = status;
+	cyrf_regs[CYRF_RX_CRC_LSB] = crc & 0xFF;
+	cyrf_regs[CYRF_RX_CRC_MSB] = crc >> 8;
+	cyrf_regs[CYRF_RSSI] = dsm_tx_rssi & 0x1F;
+	cyrf_regs[CYRF_RX_CTRL] &= ~CYRF_RX_GO;
+	cyrf_rx_irq |= CYRF_RXC_IRQ;
+	if(status & (CYRF_PKT_ERR | CYRF_BAD_CRC))
+		cyrf_rx_irq |= CYRF_RXE_IRQ;
+	cyrf_rx_armed = false;
+	cyrf_rx_busy = false;
+
+	// Keep track of the packets from the transmitter in a row
+	if(status & (CYRF_PKT_ERR | CYRF_BAD_CRC)) {
+		dsm_stat_err++;
+		return;
+	}
+
+	dsm_stat_ok++;
+	dsm_stat_last_ok = true;
+	if(++dsm_stat_streak == dsm_stat_lock_len && dsm_stat_lock_time == 0) {
+		dsm_stat_lock_time = sim_get_time();
+		dsm_stat_lock_tx = dsm_stat_tx;
+		dsm_stat_lock_ok = dsm_stat_ok;
+	}
+}
+
+/**
+ * The packet being transmitted has ended
+ */
+static void cyrf_sim_tx_end(void *arg __attribute__((unused))) {
+	cyrf_tx_irq |= CYRF_TXC_IRQ;
+}
+
+/**
+ * Configure the DSM transmitter from the environment
+ */
+static void dsm_tx_init(void) {
+	uint32_t id = sim_getenv_int("USBRF_DSM_TXID", 0);
+	uint8_t protocol = sim_getenv_int("USBRF_DSM_PROTOCOL", DSM_DSMX_2);
+
+	dsm_stat_lock_len = sim_getenv_int("USBRF_DSM_LOCK", 16);
+	dsm_tx_enabled = (id != 0);
+	if(!dsm_tx_enabled)
+		return;
+
+	dsm_tx_id[0] = id >> 24;
+	dsm_tx_id[1] = id >> 16;
+	dsm_tx_id[2] = id >> 8;
+	dsm_tx_id[3] = id;
+	dsm_tx_is_dsmx = (protocol == DSM_DSMX_1 || protocol == DSM_DSMX_2);
+	dsm_tx_is_11bit = (protocol != DSM_DSM2_1);
+
+	// Generate the hop sequence
+	if(dsm_tx_is_dsmx) {
+		dsm_generate_channels_dsmx(dsm_tx_id, dsm_tx_channels);
+		dsm_tx_chan_idx = DSM_MAX_USED_CHANNELS - 1;
+	} else {
+		uint32_t chans = sim_getenv_int("USBRF_DSM2_CHANNELS", ((3 + dsm_tx_id[3] % 37) << 8) | (40 + dsm_tx_id[2] % 37));
+		dsm_tx_channels[0] = chans >> 8;
+		dsm_tx_channels[1] = chans & 0xFF;
+		dsm_tx_chan_idx = 1;
+	}
+
+	// The codes and seed are calculated the same as the receiver does
+	dsm_tx_crc_seed = ~((dsm_tx_id[0] << 8) + dsm_tx_id[1]);
+	dsm_tx_sop_col = (dsm_tx_id[0] + dsm_tx_id[1] + dsm_tx_id[2] + 2) & 0x07;
+	dsm_tx_data_col = 7 - dsm_tx_sop_col;
+
+	// The crystal of the transmitter is off by USBRF_DSM_PPM
+	double scale = 1.0 + sim_getenv_float("USBRF_DSM_PPM", 0) / 1e6;
+	dsm_tx_frame_ns = (uint64_t)(sim_getenv_int("USBRF_DSM_FRAME_US", DSM_SEND_TIME * 10) * 1000 * scale);
+	dsm_tx_ab_ns = (uint64_t)(DSM_CHA_CHB_SEND_TIME * 10000 * scale);
+	dsm_tx_loss = sim_getenv_float("USBRF_DSM_LOSS", 0) / 100.0 * 0xFFFFFFFFU;
+	dsm_tx_rand = sim_getenv_int("USBRF_DSM_SEED", 1);
+	if(dsm_tx_rand == 0)
+		dsm_tx_rand = 1;
+	dsm_tx_rssi = sim_getenv_int("USBRF_DSM_RSSI", 20);
+	dsm_tx_start = (uint64_t)(sim_getenv_float("USBRF_DSM_START", 0.1) * 1e9);
+	dsm_tx_frame = 0;
+	dsm_tx_chan_b = false;
+
+	sim_event_init(&dsm_tx_event, SIM_PRIO_HW, dsm_tx_send, NULL);
+	sim_event_schedule(&dsm_tx_event, dsm_tx_start);
+}
+
+/**
+ * Send the next packet and schedule the one after
+ */
+static void dsm_tx_send(void *arg __attribute__((unused))) {
+	struct cyrf_sim_packet_t pkt;
+	uint64_t next;
+
+	// Hop to the next channel
+	dsm_tx_chan_idx = dsm_tx_is_dsmx? (dsm_tx_chan_idx + 1) % DSM_MAX_USED_CHANNELS : (dsm_tx_chan_idx + 1) % 2;
+	dsm_tx_crc_seed = ~dsm_tx_crc_seed;
+	dsm_tx_build(&pkt);
+
+	// The previous packet was missed by the receiver
+	if(!dsm_stat_last_ok)
+		dsm_stat_streak = 0;
+	dsm_stat_last_ok = false;
+	dsm_stat_tx++;
+
+	// Xorshift for a reproducible packet loss
+	dsm_tx_rand ^= dsm_tx_rand << 13;
+	dsm_tx_rand ^= dsm_tx_rand >> 17;
+	dsm_tx_rand ^= dsm_tx_rand << 5;
+	if(dsm_tx_rand >= dsm_tx_loss)
+		cyrf_sim_rx_start(&pkt);
+	dsm_tx_last = dsm_tx_event.time;
+
+	// Channel B follows channel A, the next frame starts after the frame time
+	if(!dsm_tx_chan_b) {
+		next = dsm_tx_event.time + dsm_tx_ab_ns;
+	} else {
+		next = dsm_tx_start + (uint64_t)(dsm_tx_frame + 1) * dsm_tx_frame_ns;
+		dsm_tx_frame++;
+	}
+	dsm_tx_chan_b = !dsm_tx_chan_b;
+	sim_event_schedule(&dsm_tx_event, next);
+}
+
+/**
+ * Build the packet for the current channel
+ * @param[out] pkt The packet to send
+ */
+static void dsm_tx_build(struct cyrf_sim_packet_t *pkt) {
+	uint8_t channel = dsm_tx_channels[dsm_tx_chan_idx];
+	uint8_t pn_row = dsm_tx_is_dsmx? (channel - 2) % 5 : channel % 5;
+	uint8_t shift = dsm_tx_is_11bit? 11 : 10;
+	uint16_t center = dsm_tx_is_11bit? 1024 : 512;
+	uint8_t i;
+
+	pkt->channel = channel;
+	pkt->sop_code = pn_codes[pn_row][dsm_tx_sop_col];
+	pkt->data_code = pn_codes[pn_row][dsm_tx_data_col];
+	pkt->crc_seed = dsm_tx_crc_seed;
+	pkt->length = 16;
+
+	if(dsm_tx_is_dsmx) {
+		pkt->data[0] = dsm_tx_id[2];
+		pkt->data[1] = dsm_tx_id[3];
+	} else {
+		pkt->data[0] = ~dsm_tx_id[2];
+		pkt->data[1] = ~dsm_tx_id[3];
+	}
+
+	// Channel A has the first 7 RC channels and channel B the next, the first one sweeps
+	for(i = 0; i < 7; i++) {
+		uint8_t rc_chan = dsm_tx_chan_b? i + 7 : i;
+		uint16_t value = center;
+		if(rc_chan == 0)
+			value = center - center / 2 + (dsm_tx_frame * 4) % center;
+
+		uint16_t word = (rc_chan << shift) | value;
+		pkt->data[i*2 + 2] = word >> 8;
+		pkt->data[i*2 + 3] = word & 0xFF;
+	}
+}
+
+/**
+ * Check if a packet the firmware starts to send overlaps a transmitter packet on the same channel
+ */
+static void dsm_stat_takeover(void) {
+	uint64_t now = sim_get_time();
+	uint64_t air = (uint64_t)(CYRF_SIM_PKT_SIZE + CYRF_SIM_OVERHEAD) * CYRF_SIM_BYTE_NS;
+	uint8_t next_idx = dsm_tx_is_dsmx? (dsm_tx_chan_idx + 1) % DSM_MAX_USED_CHANNELS : (dsm_tx_chan_idx + 1) % 2;
+	uint8_t channel = cyrf_regs[CYRF_CHANNEL];
+	uint64_t offset = UINT64_MAX;
+
+	if(!dsm_tx_enabled || dsm_tx_last == 0)
+		return;
+	cyrf_stat_sends++;
+
+	// The closest of the last and the next transmitter packet on the same channel
+	if(dsm_tx_channels[dsm_tx_chan_idx] == channel)
+		offset = now - dsm_tx_last;
+	if(dsm_tx_channels[next_idx] == channel && dsm_tx_event.time >= now && dsm_tx_event.time - now < offset)
+		offset = dsm_tx_event.time - now;
+
+	if(offset >= air) {
+		cyrf_stat_slot_run = 0;
+		return;
+	}
+
+	cyrf_stat_slot++;
+	cyrf_stat_slot_sum += offset;
+	if(offset > cyrf_stat_slot_max)
+		cyrf_stat_slot_max = offset;
+	if(++cyrf_stat_slot_run > cyrf_stat_slot_best)
+		cyrf_stat_slot_best = cyrf_stat_slot_run;
+}
+
+/**
+ * Print the statistics when the simulation stops
+ */
+static void cyrf_sim_exit(void) {
+	if(!dsm_tx_enabled && cyrf_stat_tx == 0)
+		return;
+
+	fprintf(stderr, "cyrf: dsm tx %u, received %u, errors %u, sent %u\n",
+			dsm_stat_tx, dsm_stat_ok, dsm_stat_err, cyrf_stat_tx);
+	if(cyrf_stat_sends > 0)
+		fprintf(stderr, "cyrf: takeover %u of %u sent in a slot (best run %u), offset avg %.1f us, max %.1f us\n",
+				cyrf_stat_slot, cyrf_stat_sends, cyrf_stat_slot_best,
+				(cyrf_stat_slot > 0)? cyrf_stat_slot_sum / 1e3 / cyrf_stat_slot : 0.0, cyrf_stat_slot_max / 1e3);
+
+	if(dsm_stat_lock_time == 0) {
+		fprintf(stderr, "cyrf: no lock (%u packets in a row)\n", dsm_stat_lock_len);
+		return;
+	}
+
+	// The packets before lock are counted as lock-on time, the rest as loss
+	uint32_t tx = dsm_stat_tx - dsm_stat_lock_tx;
+	uint32_t ok = dsm_stat_ok - dsm_stat_lock_ok;
+	fprintf(stderr, "cyrf: lock after %.3f s, loss after lock %.2f %% (%u/%u)\n",
+			(dsm_stat_lock_time - dsm_tx_start) / 1e9, (tx > 0)? 100.0 * (tx - ok) / tx : 0.0, tx - ok, tx);
+}
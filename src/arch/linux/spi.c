@@ -0,0 +1,242 @@
+/*
+ * This file is part of the superbitrf project.
+ *
+ * Copyright (C) 2018 Freek van Tienen <freek.v.tienen@gmail.com>
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "modules/spi.h"
+#include "sim.h"
+
+/* The time one byte takes on the bus (SPI2 at 36MHz / 16 and 36MHz / 8 like the v2.0 board) */
+#define SPI_CYRF_BYTE_NS 3556
+#define SPI_CC_BYTE_NS 1778
+
+static const struct sim_spi_model *spi_models[SPI_DEV_NB];	/**< The chip models on the bus */
+static uint32_t spi_byte_ns[SPI_DEV_NB];										/**< The time one byte transfer takes per device */
+
+/* The simulated DMA of the shared bus */
+static bool spi_busy;																				/**< A device is selected */
+static bool spi_dma;																				/**< A DMA transfer is running */
+static uint32_t spi_dma_done;																/**< The amount of finished DMA transfers */
+static enum spi_dev_t spi_dma_dev;													/**< The device of the DMA transfer */
+static spi_dev_cb spi_dma_cb;																/**< The callback of the DMA transfer */
+static struct sim_event spi_dma_event;											/**< The end of the DMA transfer */
+
+/* The simulated interrupt lines of the devices */
+static spi_dev_cb spi_irq_cb[SPI_DEV_NB];										/**< The interrupt callback per device */
+static struct sim_event spi_irq_event[SPI_DEV_NB];					/**< The external interrupt per device */
+
+static void spi_claim(void);
+static void spi_dma_end(void *arg);
+static void spi_irq(void *arg);
+
+/**
+ * Initialize the simulated SPI bus (USBRF_SPI_NS overrides the byte time) and the chip models
+ */
+void spi_init(void) {
+	spi_byte_ns[SPI_DEV_CYRF] = sim_getenv_int("USBRF_SPI_NS", SPI_CYRF_BYTE_NS);
+	spi_byte_ns[SPI_DEV_CC] = sim_getenv_int("USBRF_SPI_NS", SPI_CC_BYTE_NS);
+	spi_busy = false;
+	spi_dma = false;
+	sim_event_init(&spi_dma_event, SIM_PRIO_DMA, spi_dma_end, NULL);
+	for(uint8_t i = 0; i < SPI_DEV_NB; i++) {
+		spi_irq_cb[i] = NULL;
+		sim_event_init(&spi_irq_event[i], SIM_PRIO_EXTI, spi_irq, (void *)(uintptr_t)i);
+	}
+
+	sim_cyrf_init();
+	sim_cc_init();
+}
+
+/**
+ * Register a chip model for a device
+ * @param[in] dev The device
+ * @param[in] model The register level model of the chip
+ */
+void sim_spi_register(enum spi_dev_t dev, const struct sim_spi_model *model) {
+	spi_models[dev] = model;
+}
+
+/**
+ * A chip model signals a falling edge on the interrupt line of a device
+ * @param[in] dev The device
+ */
+void sim_spi_irq(enum spi_dev_t dev) {
+	if(spi_irq_cb[dev] != NULL)
+		sim_event_schedule(&spi_irq_event[dev], sim_get_time());
+}
+
+/**
+ * Initialize the pins of a device on the SPI bus
+ * @param[in] dev The device to initialize
+ */
+void spi_dev_init(enum spi_dev_t dev __attribute__((unused))) {
+}
+
+/**
+ * Select a device
+ * @param[in] dev The device to select
+ */
+void spi_dev_select(enum spi_dev_t dev) {
+	spi_claim();
+	if(spi_models[dev] != NULL && spi_models[dev]->select != NULL)
+		spi_models[dev]->select(spi_models[dev]->arg);
+}
+
+/**
+ * Deselect a device
+ * @param[in] dev The device to deselect
+ */
+void spi_dev_deselect(enum spi_dev_t dev) {
+	if(spi_models[dev] != NULL && spi_models[dev]->deselect != NULL)
+		spi_models[dev]->deselect(spi_models[dev]->arg);
+	spi_busy = false;
+}
+
+/**
+ * Transfer one byte with a (selected) device, which takes bus time
+ * @param[in] dev The device to transfer with
+ * @param[in] data The byte to send
+ * @return The byte received (0 without a model)
+ */
+uint8_t spi_dev_xfer(enum spi_dev_t dev, uint8_t data) {
+	sim_advance(spi_byte_ns[dev]);
+
+	if(spi_models[dev] == NULL || spi_models[dev]->xfer == NULL)
+		return 0;
+	return spi_models[dev]->xfer(spi_models[dev]->arg, data);
+}
+
+/**
+ * Enable the interrupt line of a device, the CC2500 GDO0 is connected unless USBRF_CC_IRQ=0 and
+ * the CYRF6936 IRQ is not connected like on the v2.0 board
+ * @param[in] dev The device
+ * @param[in] cb The callback on a falling edge
+ * @return Whether the device has an interrupt line
+ */
+bool spi_dev_irq_init(enum spi_dev_t dev, spi_dev_cb cb) {
+	if(dev != SPI_DEV_CC || !sim_getenv_int("USBRF_CC_IRQ", 1))
+		return false;
+
+	spi_irq_cb[dev] = cb;
+	return true;
+}
+
+/**
+ * Drive the reset pin of a device
+ * @param[in] dev The device to reset
+ * @param[in] active Whether the reset pin should be active
+ */
+void spi_dev_reset(enum spi_dev_t dev, bool active) {
+	if(spi_models[dev] != NULL && spi_models[dev]->reset != NULL)
+		spi_models[dev]->reset(spi_models[dev]->arg, active);
+}
+
+/**
+ * Transfer a header byte followed by a block as one transaction with the simulated DMA.
+ * The model sees all bytes directly, the bus stays busy for the transfer time.
+ * @param[in] dev The device to transfer with
+ * @param[in] header The first byte (address) which is sent without DMA
+ * @param[in] tx The bytes to send (NULL sends zeros)
+ * @param[out] rx The received bytes (NULL ignores them)
+ * @param[in] len The amount of bytes after the header
+ * @param[in] cb The callback when the transfer is done (NULL for blocking)
+ * @return The byte received during the header
+ */
+uint8_t spi_dev_transfer(enum spi_dev_t dev, uint8_t header, const uint8_t *tx, uint8_t *rx, uint16_t len, spi_dev_cb cb) {
+	sim_irq_disable();
+	spi_dev_select(dev);
+	uint8_t status = spi_dev_xfer(dev, header);
+
+	// Only a header
+	if(len == 0) {
+		spi_dev_deselect(dev);
+		sim_irq_enable();
+		if(cb != NULL)
+			cb(dev);
+		return status;
+	}
+
+	for(uint16_t i = 0; i < len; i++) {
+		uint8_t data = 0;
+		if(spi_models[dev] != NULL && spi_models[dev]->xfer != NULL)
+			data = spi_models[dev]->xfer(spi_models[dev]->arg, (tx != NULL)? tx[i] : 0);
+		if(rx != NULL)
+			rx[i] = data;
+	}
+
+	spi_dma = true;
+	spi_dma_dev = dev;
+	spi_dma_cb = cb;
+	sim_event_schedule(&spi_dma_event, sim_get_time() + (uint64_t)len * spi_byte_ns[dev]);
+	sim_irq_enable();
+
+	if(cb == NULL)
+		spi_dev_wait(dev);
+	return status;
+}
+
+/**
+ * Wait until a running DMA transfer on the bus is done
+ * @param[in] dev The device
+ */
+void spi_dev_wait(enum spi_dev_t dev __attribute__((unused))) {
+	uint32_t done = spi_dma_done;
+	if(!spi_dma)
+		return;
+
+	// Let the time pass, the interrupt can be masked so finish it when it didn't fire
+	if(spi_dma_event.time > sim_get_time())
+		sim_advance(spi_dma_event.time - sim_get_time());
+	if(spi_dma && spi_dma_done == done) {
+		sim_event_cancel(&spi_dma_event);
+		spi_dma_end(NULL);
+	}
+}
+
+/**
+ * Claim the bus, finishes a running DMA transfer first
+ */
+static void spi_claim(void) {
+	while(spi_busy && spi_dma)
+		spi_dev_wait(spi_dma_dev);
+	spi_busy = true;
+}
+
+/**
+ * The end of the DMA transfer
+ */
+static void spi_dma_end(void *arg __attribute__((unused))) {
+	spi_dev_cb cb = spi_dma_cb;
+
+	spi_dma = false;
+	spi_dma_done++;
+	spi_dev_deselect(spi_dma_dev);
+	if(cb != NULL)
+		cb(spi_dma_dev);
+}
+
+/**
+ * The simulated external interrupt of a device
+ */
+static void spi_irq(void *arg) {
+	enum spi_dev_t dev = (enum spi_dev_t)(uintptr_t)arg;
+	if(spi_irq_cb[dev] != NULL)
+		spi_irq_cb[dev](dev);
+}
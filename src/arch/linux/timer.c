@@ -0,0 +1,127 @@
+/*
+ * This file is part of the superbitrf project.
+ *
+ * Copyright (C) 2018 Freek van Tienen <freek.v.tienen@gmail.com>
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "modules/timer.h"
+#include "modules/prof.h"
+#include "modules/trace.h"
+#include "sim.h"
+
+#define TIMER_TICK_NS 10000					/**< The timer runs at 10 microseconds per tick */
+
+/* The timer callbacks */
+static timer_on_event timer_ch_on_event[TIMER_CH_NB];
+static uint32_t timer_ch_deadline[TIMER_CH_NB];		/**< The absolute deadline of each compare channel */
+static struct sim_event timer_ch_event[TIMER_CH_NB];	/**< The simulated compare interrupts */
+static uint64_t timer_start;					/**< The virtual time the time base started */
+
+static void timer_ch_isr(void *arg);
+
+/**
+ * Initialize the timers
+ */
+void timer_init(void) {
+	uint8_t i;
+	timer_start = sim_get_time();
+	for(i = 0; i < TIMER_CH_NB; i++)
+		sim_event_init(&timer_ch_event[i], SIM_PRIO_TIMER, timer_ch_isr, (void *)(uintptr_t)i);
+}
+
+/**
+ * Get the 32-bit time base
+ * @return The amount of ticks of 10 microseconds since boot
+ */
+uint32_t timer_get_ticks(void) {
+	return (sim_get_time() - timer_start) / TIMER_TICK_NS;
+}
+
+/**
+ * Set a compare channel to interrupt at an absolute deadline
+ * When the deadline already passed the interrupt is generated immediately.
+ * @param[in] ch The compare channel
+ * @param[in] deadline The time base ticks to interrupt at
+ */
+void timer_ch_set_at(enum timer_ch_t ch, uint32_t deadline) {
+	uint64_t now = sim_get_time();
+	int32_t delta = deadline - timer_get_ticks();
+
+	timer_ch_deadline[ch] = deadline;
+	if(delta <= 0)
+		sim_event_schedule(&timer_ch_event[ch], now);
+	else
+		sim_event_schedule(&timer_ch_event[ch], timer_start + (now - timer_start) / TIMER_TICK_NS * TIMER_TICK_NS
+			+ (uint64_t)delta * TIMER_TICK_NS);
+}
+
+/**
+ * Set a compare channel to interrupt relative to now
+ * @param[in] ch The compare channel
+ * @param[in] ticks The time in microseconds times 10
+ */
+void timer_ch_set(enum timer_ch_t ch, uint32_t ticks) {
+	timer_ch_set_at(ch, timer_get_ticks() + ticks);
+}
+
+/**
+ * Get the last deadline of a compare channel
+ * @param[in] ch The compare channel
+ */
+uint32_t timer_ch_get_deadline(enum timer_ch_t ch) {
+	return timer_ch_deadline[ch];
+}
+
+/**
+ * Stop the interrupts of a compare channel
+ * @param[in] ch The compare channel
+ */
+void timer_ch_stop(enum timer_ch_t ch) {
+	sim_event_cancel(&timer_ch_event[ch]);
+}
+
+/**
+ * Register a compare channel callback
+ * @param[in] ch The compare channel
+ * @param[in] callback The callback function when an interrupt occurs
+ */
+void timer_ch_register_callback(enum timer_ch_t ch, timer_on_event callback) {
+	timer_ch_on_event[ch] = callback;
+}
+
+/**
+ * The simulated timer interrupt handler
+ */
+static void timer_ch_isr(void *arg) {
+	enum timer_ch_t ch = (uintptr_t)arg;
+	PROF_START(irq_start);
+
+	// Stop the channel
+	timer_ch_stop(ch);
+
+	// Callback
+	trace_add(TRACE_TIMEOUT, ch, 0);
+	if(timer_ch_on_event[ch] != NULL) {
+		PROF_START(cb_start);
+		timer_ch_on_event[ch]();
+		PROF_END(PROF_TIMER_CH1 + ch, cb_start);
+	}
+
+	PROF_END(PROF_TIMER_IRQ, irq_start);
+}
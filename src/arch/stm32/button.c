@@ -23,7 +23,7 @@
 #include <libopencm3/stm32/rcc.h>
 #include <libopencm3/stm32/f1/nvic.h>
 
-#include "button.h"
+#include "modules/button.h"
 #include "modules/config.h"
 
 // Bind button pressed callback
@@ -0,0 +1,682 @@
+/*
+ * This file is part of the superbitrf project.
+ *
+ * Copyright (C) 2013 Freek van Tienen <freek.v.tienen@gmail.com>
+ * Copyright (C) 2014 Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <libopencm3/stm32/gpio.h>
+#include <libopencm3/cm3/nvic.h>
+#include <libopencm3/cm3/cortex.h>
+#include <libopencm3/usb/usbd.h>
+#include <libopencm3/usb/cdc.h>
+#include <libopencm3/cm3/scb.h>
+#include <libopencm3/usb/dfu.h>
+#include <libopencm3/stm32/rcc.h>
+#include <libopencm3/stm32/exti.h>
+#include <libopencm3/stm32/st_usbfs.h>
+
+#include "modules/cdcacm.h"
+#include "modules/fifo.h"
+#include "modules/sched.h"
+#include "modules/prof.h"
+#include "helper/usb_struct_templates.h"
+
+
+// The usbd device
+usbd_device *cdcacm_usbd_dev = NULL;
+
+// The usbd console buffer
+uint8_t cdcacm_usbd_control_buffer[256];
+
+static int configured;
+static int cdcacm_data_dtr = 1;
+static int cdcacm_console_dtr = 1;
+
+/* CDCACM status struct. It stores error counts on the interfaces. */
+struct cdcacm_status {
+	uint32_t data_rx_ring_full;
+	uint32_t console_rx_ring_full;
+} cdcacm_status;
+
+/* Input and output FIFOs for the two virtual serial ports (size a power of two). */
+#define CDCACM_IO_BUFFER_SIZE 256
+uint8_t cdcacm_data_tx_buffer[CDCACM_IO_BUFFER_SIZE];
+uint8_t cdcacm_data_rx_buffer[CDCACM_IO_BUFFER_SIZE];
+struct fifo_t cdcacm_data_tx;
+struct fifo_t cdcacm_data_rx;
+uint8_t cdcacm_console_tx_buffer[CDCACM_IO_BUFFER_SIZE];
+uint8_t cdcacm_console_rx_buffer[CDCACM_IO_BUFFER_SIZE];
+struct fifo_t cdcacm_console_tx;
+struct fifo_t cdcacm_console_rx;
+
+/* Bulk packet sizes. The 512 bytes of packet memory only fit the second transmit
+ * buffers of the raw packet and console IN endpoints when the control endpoint
+ * and console use smaller packets. */
+#define CDCACM_DATA_PACKET_SIZE 64
+#define CDCACM_CONSOLE_PACKET_SIZE 32
+#define CDCACM_VENDOR_PACKET_SIZE 64
+#define CDCACM_PMA_SIZE 512
+
+/* Transmit state of a bulk IN endpoint. The endpoint is double buffered when
+ * there is packet memory left, so the next packet is already waiting in the
+ * peripheral while the current one is on the bus. */
+struct cdcacm_tx_ep {
+	uint8_t ep;									/**< The IN endpoint address */
+	uint8_t size;								/**< The maximum packet size */
+	struct fifo_t *fifo;				/**< The transmit FIFO */
+	bool dbl_buf;								/**< Whether the endpoint is double buffered */
+	uint8_t pending;						/**< Packets handed to the peripheral and not yet sent */
+	uint8_t sw_buf;							/**< The buffer the next packet is written to */
+	uint16_t dtog;							/**< DTOG_TX after the last handled completion */
+	uint16_t buf_addr[2];				/**< Packet memory addresses of the two buffers */
+};
+
+static struct cdcacm_tx_ep cdcacm_tx_data = {
+	.ep = 0x81,
+	.size = CDCACM_DATA_PACKET_SIZE,
+	.fifo = &cdcacm_data_tx,
+};
+static struct cdcacm_tx_ep cdcacm_tx_console = {
+	.ep = 0x83,
+	.size = CDCACM_CONSOLE_PACKET_SIZE,
+	.fifo = &cdcacm_console_tx,
+};
+static struct cdcacm_tx_ep cdcacm_tx_vendor = {
+	.ep = CDCACM_VENDOR_EP,
+	.size = CDCACM_VENDOR_PACKET_SIZE,
+	.fifo = &cdcacm_vendor_tx,
+};
+
+/**
+ * Misc device descriptor with most of the settings preset. Only adjustment we
+ * do is to provide the variable name and the vendor and product id, as this is
+ * the most common change between implementations...
+ */
+USB_DEVICE_DESCRIPTOR_MISC(dev, 0x0484, 0x5741, 32);
+
+/** Data CDCACM **/
+USB_CDCACM_COMMAND_EP_DESCRIPTOR(data_comm_endp, 0x82);
+
+USB_CDCACM_DATA_EP_DESCRIPTOR(data_data_endp, 0x01, 0x81, CDCACM_DATA_PACKET_SIZE);
+
+USB_CDCACM_FUNCTIONAL_DESCRIPTORS(data_cdcacm_functional_descriptors, 1, 0, 1);
+
+USB_CDCACM_COMMAND_INTERFACE(data_comm_iface, 0, 4, data_comm_endp, data_cdcacm_functional_descriptors);
+
+USB_CDCACM_DATA_INTERFACE(data_data_iface, 1, data_data_endp);
+
+USB_CDCACM_ASSOCIATION_DESCRIPTOR(data_assoc, 0);
+
+/** Console CDCACM **/
+USB_CDCACM_COMMAND_EP_DESCRIPTOR(console_comm_endp, 0x84);
+
+USB_CDCACM_DATA_EP_DESCRIPTOR(console_data_endp, 0x03, 0x83, CDCACM_CONSOLE_PACKET_SIZE);
+
+/* This is probably redundant with the other previously defined
+ * data_cdcacm_functional_descriptors.
+ */
+USB_CDCACM_FUNCTIONAL_DESCRIPTORS(console_cdcacm_functional_descriptors, 3, 2, 3);
+
+USB_CDCACM_COMMAND_INTERFACE(console_comm_iface, 2, 5, console_comm_endp, console_cdcacm_functional_descriptors);
+
+USB_CDCACM_DATA_INTERFACE(console_data_iface, 3, console_data_endp);
+
+USB_CDCACM_ASSOCIATION_DESCRIPTOR(console_assoc, 2);
+
+/** DFU CDCACM **/
+
+static const struct usb_dfu_descriptor dfu_function = {
+	.bLength = sizeof(struct usb_dfu_descriptor),
+	.bDescriptorType = DFU_FUNCTIONAL,
+	.bmAttributes = USB_DFU_CAN_DOWNLOAD | USB_DFU_WILL_DETACH,
+	.wDetachTimeout = 255,
+	.wTransferSize = 1024,
+	.bcdDFUVersion = 0x011A,
+};
+
+static const struct usb_interface_descriptor dfu_iface = {
+	.bLength = USB_DT_INTERFACE_SIZE,
+	.bDescriptorType = USB_DT_INTERFACE,
+	.bInterfaceNumber = 4,
+	.bAlternateSetting = 0,
+	.bNumEndpoints = 0,
+	.bInterfaceClass = 0xFE,
+	.bInterfaceSubClass = 1,
+	.bInterfaceProtocol = 1,
+	.iInterface = 6,
+
+	.extra = &dfu_function,
+	.extralen = sizeof(dfu_function),
+};
+
+static const struct usb_iface_assoc_descriptor dfu_assoc = {
+	.bLength = USB_DT_INTERFACE_ASSOCIATION_SIZE,
+	.bDescriptorType = USB_DT_INTERFACE_ASSOCIATION,
+	.bFirstInterface = 4,
+	.bInterfaceCount = 1,
+	.bFunctionClass = 0xFE,
+	.bFunctionSubClass = 1,
+	.bFunctionProtocol = 1,
+	.iFunction = 6,
+};
+
+/** Raw packet interface **/
+
+static const struct usb_endpoint_descriptor vendor_endp[] = {{
+	.bLength = USB_DT_ENDPOINT_SIZE,
+	.bDescriptorType = USB_DT_ENDPOINT,
+	.bEndpointAddress = CDCACM_VENDOR_EP,
+	.bmAttributes = USB_ENDPOINT_ATTR_BULK,
+	.wMaxPacketSize = CDCACM_VENDOR_PACKET_SIZE,
+	.bInterval = 1,
+}};
+
+static const struct usb_interface_descriptor vendor_iface = {
+	.bLength = USB_DT_INTERFACE_SIZE,
+	.bDescriptorType = USB_DT_INTERFACE,
+	.bInterfaceNumber = CDCACM_VENDOR_IFACE,
+	.bAlternateSetting = 0,
+	.bNumEndpoints = 1,
+	.bInterfaceClass = 0xFF,
+	.bInterfaceSubClass = 0,
+	.bInterfaceProtocol = 0,
+	.iInterface = 7,
+
+	.endpoint = vendor_endp,
+};
+
+/** Main CDCACM **/
+
+static const struct usb_interface ifaces[] = {{
+	.num_altsetting = 1,
+	.iface_assoc = &data_assoc,
+	.altsetting = data_comm_iface,
+}, {
+	.num_altsetting = 1,
+	.altsetting = data_data_iface,
+}, {
+	.num_altsetting = 1,
+	.iface_assoc = &console_assoc,
+	.altsetting = console_comm_iface,
+}, {
+	.num_altsetting = 1,
+	.altsetting = console_data_iface,
+}, {
+	.num_altsetting = 1,
+	.iface_assoc = &dfu_assoc,
+	.altsetting = &dfu_iface,
+}, {
+	.num_altsetting = 1,
+	.altsetting = &vendor_iface,
+}};
+
+static const struct usb_config_descriptor config = {
+	.bLength = USB_DT_CONFIGURATION_SIZE,
+	.bDescriptorType = USB_DT_CONFIGURATION,
+	.wTotalLength = 0,
+	.bNumInterfaces = 6,
+	.bConfigurationValue = 1,
+	.iConfiguration = 0,
+	.bmAttributes = 0x80,
+	.bMaxPower = 0x32,
+
+	.interface = ifaces,
+};
+
+// The usb strings
+static const char *usb_strings[] = {
+	"1 BIT SQUARED",
+	"Superbit USBRF",
+	(const char *)0x8001FF0, /* The serial number is stored in the bootloader. */
+	"SuperbitRF data port",
+	"SuperbitRF console interface",
+	"SuperbitRF DFU",
+	"SuperbitRF raw packets",
+};
+
+#ifdef USB_DETACH_PORT
+/**
+ * When there is a successfull DFU detach
+ */
+static void dfu_detach_complete(usbd_device *usbd_dev, struct usb_setup_data *req) {
+	(void)usbd_dev;
+	(void)req;
+
+	/* Disconnect USB cable */
+	gpio_set_mode(USB_DETACH_PORT, GPIO_MODE_INPUT, 0, USB_DETACH_PIN);
+
+	/* Assert boot-request pin */
+  //assert_boot_pin();???
+
+	/* Reset core to enter bootloader */
+	scb_reset_core();
+}
+#endif
+
+
+/**
+ * CDCACM control request received
+ */
+static int cdcacm_control_request(usbd_device *usbd_dev,
+		struct usb_setup_data *req, uint8_t **buf, uint16_t *len,
+		void (**complete)(usbd_device *usbd_dev, struct usb_setup_data *req)) {
+	(void)usbd_dev;
+#ifndef USB_DETACH_PORT
+	(void)complete;
+#endif
+
+	switch(req->bRequest) {
+	case USB_CDC_REQ_SET_CONTROL_LINE_STATE:
+		/* Ignore if not for GDB interface */
+		if(req->wIndex == 0)
+			cdcacm_data_dtr = req->wValue & 1;
+		else if(req->wIndex == 2)
+			cdcacm_console_dtr = req->wValue & 1;
+
+		return 1;
+	case USB_CDC_REQ_SET_LINE_CODING:
+		if(*len < sizeof(struct usb_cdc_line_coding))
+			return 0;
+
+		return 1;
+	case DFU_GETSTATUS:
+		if(req->wIndex == 4) {
+			(*buf)[0] = DFU_STATUS_OK;
+			(*buf)[1] = 0;
+			(*buf)[2] = 0;
+			(*buf)[3] = 0;
+			(*buf)[4] = STATE_APP_IDLE;
+			(*buf)[5] = 0;	/* iString not used here */
+			*len = 6;
+
+			return 1;
+		}
+#ifdef USB_DETACH_PORT
+	case DFU_DETACH:
+		if(req->wIndex == 4) {
+			*complete = dfu_detach_complete;
+			return 1;
+		}
+		return 0;
+#endif
+	}
+	return 0;
+}
+
+/**
+ * Read a received packet, straight into the FIFO when it fits without wrapping
+ * @param[in] usbd_dev The USB device
+ * @param[in] ep The OUT endpoint
+ * @param[in] fifo The receive FIFO
+ * @return The length of the packet, negative when it did not fully fit
+ */
+static int cdcacm_rx_packet(usbd_device *usbd_dev, uint8_t ep, struct fifo_t *fifo) {
+	uint8_t buf[64], *ptr;
+	int len;
+
+	if (fifo_write_span(fifo, &ptr) >= 64) {
+		len = usbd_ep_read_packet(usbd_dev, ep, ptr, 64);
+		fifo_write_commit(fifo, len);
+		return len;
+	}
+
+	len = usbd_ep_read_packet(usbd_dev, ep, buf, 64);
+	if ((int)fifo_write(fifo, buf, len) < len)
+		return -len;
+	return len;
+}
+
+/**
+ * Copy a packet into the packet memory
+ * The F1 packet memory is 16 bits wide and every half word takes 32 bits of
+ * address space.
+ * @param[in] addr The packet memory address of the buffer
+ * @param[in] buf The packet
+ * @param[in] len The length of the packet
+ */
+static void cdcacm_pm_write(uint16_t addr, const uint8_t *buf, uint16_t len) {
+	volatile uint32_t *pm = (volatile uint32_t *)(USB_PMA_BASE + addr * 2);
+
+	for (; len > 1; len -= 2, buf += 2)
+		*pm++ = buf[0] | (buf[1] << 8);
+	if (len)
+		*pm = buf[0];
+}
+
+/**
+ * Hand one packet to an IN endpoint
+ * @param[in] tx The endpoint
+ * @param[in] buf The packet
+ * @param[in] len The length of the packet
+ */
+static void cdcacm_tx_write(struct cdcacm_tx_ep *tx, const uint8_t *buf, uint16_t len) {
+	uint8_t num = tx->ep & 0x7F;
+
+	if (!tx->dbl_buf) {
+		usbd_ep_write_packet(cdcacm_usbd_dev, tx->ep, buf, len);
+		return;
+	}
+
+	cdcacm_pm_write(tx->buf_addr[tx->sw_buf], buf, len);
+	if (tx->sw_buf)
+		SET_REG(USB_EP_RX_COUNT(num), len);
+	else
+		USB_SET_EP_TX_COUNT(num, len);
+
+	/* Toggle SW_BUF (DTOG_RX) to give the buffer to the peripheral, writing 1
+	 * to the CTR bits leaves them untouched */
+	SET_REG(USB_EP_REG(num), (GET_REG(USB_EP_REG(num)) & (USB_EP_TYPE | USB_EP_KIND | USB_EP_ADDR))
+			| USB_EP_RX_CTR | USB_EP_TX_CTR | USB_EP_RX_DTOG);
+	tx->sw_buf ^= 1;
+}
+
+/**
+ * Fill the free buffers of an IN endpoint from its FIFO
+ * Packets are sent straight from the FIFO unless they wrap around the end. This
+ * must run in the USB interrupt or with interrupts masked.
+ * @param[in] tx The endpoint
+ */
+static void cdcacm_tx_fill(struct cdcacm_tx_ep *tx) {
+	uint8_t buf[64];
+	const uint8_t *ptr;
+	uint32_t len;
+
+	while (tx->pending < (tx->dbl_buf? 2 : 1) && (len = fifo_used(tx->fifo)) != 0) {
+		if (len > tx->size)
+			len = tx->size;
+
+		if (fifo_read_span(tx->fifo, &ptr) >= len) {
+			cdcacm_tx_write(tx, ptr, len);
+			fifo_read_commit(tx->fifo, len);
+		} else {
+			fifo_read(tx->fifo, buf, len);
+			cdcacm_tx_write(tx, buf, len);
+		}
+		tx->pending++;
+	}
+}
+
+/**
+ * Switch an IN endpoint to double buffering
+ * The second buffer takes the place of the receive buffer and is allocated
+ * after the buffers of libopencm3.
+ * @param[in] tx The endpoint
+ * @param[in,out] pm_top The first free packet memory address
+ */
+static void cdcacm_tx_setup(struct cdcacm_tx_ep *tx, uint16_t *pm_top) {
+	uint8_t num = tx->ep & 0x7F;
+
+	tx->pending = 0;
+	tx->sw_buf = 0;
+	tx->dtog = 0;
+	tx->dbl_buf = (*pm_top + tx->size <= CDCACM_PMA_SIZE);
+	if (!tx->dbl_buf)
+		return;
+
+	tx->buf_addr[0] = GET_REG(USB_EP_TX_ADDR(num));
+	tx->buf_addr[1] = *pm_top;
+	USB_SET_EP_RX_ADDR(num, *pm_top);
+	*pm_top += tx->size;
+
+	/* Both pointers on buffer 0 means no packet is ready, the endpoint stays
+	 * valid and NAKs until SW_BUF toggles */
+	USB_SET_EP_KIND(num);
+	USB_CLR_EP_TX_DTOG(num);
+	USB_CLR_EP_RX_DTOG(num);
+	USB_SET_EP_TX_STAT(num, USB_EP_TX_STAT_VALID);
+}
+
+/**
+ * CDCACM data recieve callback
+ */
+static void cdcacm_data_rx_cb(usbd_device *usbd_dev, uint8_t ep) {
+	usbd_ep_nak_set(usbd_dev, ep, 1);
+
+	int len = cdcacm_rx_packet(usbd_dev, ep, &cdcacm_data_rx);
+
+	if (len) {
+		/* Record rx buffer overflow event. */
+		if (len < 0) {
+			cdcacm_status.data_rx_ring_full++;
+		}
+		sched_event(SCHED_EV_DATA_RX);
+	}
+
+	usbd_ep_nak_set(usbd_dev, ep, 0);
+}
+
+/**
+ * CDCACM console recieve callback
+ */
+static void cdcacm_console_rx_cb(usbd_device *usbd_dev, uint8_t ep) {
+	usbd_ep_nak_set(usbd_dev, ep, 1);
+
+	int len = cdcacm_rx_packet(usbd_dev, ep, &cdcacm_console_rx);
+
+	if (len) {
+		/* Record rx buffer overflow event. */
+		if (len < 0) {
+			cdcacm_status.console_rx_ring_full++;
+		}
+		sched_event(SCHED_EV_CONSOLE_RX);
+	}
+
+	usbd_ep_nak_set(usbd_dev, ep, 0);
+}
+
+/**
+ * CDCACM transmit complete callback, refills the endpoint straight from the FIFO
+ */
+static void cdcacm_tx_cb(usbd_device *usbd_dev __attribute__((unused)), uint8_t ep) {
+	struct cdcacm_tx_ep *tx;
+
+	if (ep == (cdcacm_tx_data.ep & 0x7F))
+		tx = &cdcacm_tx_data;
+	else if (ep == (cdcacm_tx_console.ep & 0x7F))
+		tx = &cdcacm_tx_console;
+	else
+		tx = &cdcacm_tx_vendor;
+	uint16_t dtog = GET_REG(USB_EP_REG(ep)) & USB_EP_TX_DTOG;
+
+	/* DTOG_TX toggles per sent packet, when it did not move both buffers went
+	 * out before this interrupt was handled */
+	if (tx->dbl_buf && tx->pending > 1 && dtog == tx->dtog)
+		tx->pending = 0;
+	else if (tx->pending > 0)
+		tx->pending--;
+	tx->dtog = dtog;
+
+	cdcacm_tx_fill(tx);
+}
+
+/**
+ * Raw packet interface control request received
+ */
+static int cdcacm_vendor_request(usbd_device *usbd_dev,
+		struct usb_setup_data *req, uint8_t **buf, uint16_t *len,
+		void (**complete)(usbd_device *usbd_dev, struct usb_setup_data *req)) {
+	(void)usbd_dev;
+	(void)buf;
+	(void)len;
+	(void)complete;
+
+	if (req->wIndex != CDCACM_VENDOR_IFACE)
+		return 0;
+
+	switch(req->bRequest) {
+	case CDCACM_VENDOR_REQ_STREAM:
+		cdcacm_vendor_streaming = req->wValue & 1;
+		return 1;
+	}
+	return 0;
+}
+
+/**
+ * CDCACM set config
+ */
+static void cdcacm_set_config_callback(usbd_device *usbd_dev, uint16_t wValue) {
+	configured = wValue;
+
+	/* Data interface */
+	usbd_ep_setup(usbd_dev, 0x01, USB_ENDPOINT_ATTR_BULK,
+					64, cdcacm_data_rx_cb);
+	usbd_ep_setup(usbd_dev, 0x81, USB_ENDPOINT_ATTR_BULK,
+					CDCACM_DATA_PACKET_SIZE, cdcacm_tx_cb);
+	usbd_ep_setup(usbd_dev, 0x82, USB_ENDPOINT_ATTR_INTERRUPT, 16, NULL);
+
+	/* Control interface */
+	usbd_ep_setup(usbd_dev, 0x03, USB_ENDPOINT_ATTR_BULK,
+					CDCACM_CONSOLE_PACKET_SIZE, cdcacm_console_rx_cb);
+	usbd_ep_setup(usbd_dev, 0x83, USB_ENDPOINT_ATTR_BULK,
+					CDCACM_CONSOLE_PACKET_SIZE, cdcacm_tx_cb);
+	usbd_ep_setup(usbd_dev, 0x84, USB_ENDPOINT_ATTR_INTERRUPT, 16, NULL);
+
+	/* Raw packet interface */
+	usbd_ep_setup(usbd_dev, CDCACM_VENDOR_EP, USB_ENDPOINT_ATTR_BULK,
+					CDCACM_VENDOR_PACKET_SIZE, cdcacm_tx_cb);
+	cdcacm_vendor_streaming = false;
+
+	/* Double buffer the IN endpoints behind the last buffer, in order of
+	 * importance as the packet memory does not fit all of them */
+	uint16_t pm_top = GET_REG(USB_EP_TX_ADDR(CDCACM_VENDOR_EP & 0x7F)) + CDCACM_VENDOR_PACKET_SIZE;
+	cdcacm_tx_setup(&cdcacm_tx_vendor, &pm_top);
+	cdcacm_tx_setup(&cdcacm_tx_console, &pm_top);
+	cdcacm_tx_setup(&cdcacm_tx_data, &pm_top);
+
+	usbd_register_control_callback(usbd_dev,
+			USB_REQ_TYPE_CLASS | USB_REQ_TYPE_INTERFACE,
+			USB_REQ_TYPE_TYPE | USB_REQ_TYPE_RECIPIENT,
+			cdcacm_control_request);
+	usbd_register_control_callback(usbd_dev,
+			USB_REQ_TYPE_VENDOR | USB_REQ_TYPE_INTERFACE,
+			USB_REQ_TYPE_TYPE | USB_REQ_TYPE_RECIPIENT,
+			cdcacm_vendor_request);
+
+	/* Notify the host that DCD is asserted.
+	 * Allows the use of /dev/tty* devices on *BSD/MacOS
+	 */
+	char buf[10];
+	struct usb_cdc_notification *notif = (void*)buf;
+	/* We echo signals back to host as notification */
+	notif->bmRequestType = 0xA1;
+	notif->bNotification = USB_CDC_NOTIFY_SERIAL_STATE;
+	notif->wValue = 0;
+	notif->wIndex = 0;
+	notif->wLength = 2;
+	buf[8] = 3; /* DCD | DSR */
+	buf[9] = 0;
+	usbd_ep_write_packet(usbd_dev, 0x82, buf, 10);
+	notif->wIndex = 2;
+	usbd_ep_write_packet(usbd_dev, 0x84, buf, 10);
+}
+
+#ifdef USB_VBUS_PORT
+void exti15_10_isr(void)
+{
+	if (gpio_get(USB_VBUS_PORT, USB_VBUS_PIN)) {
+		/* Drive pull-up high if VBUS connected */
+		gpio_set_mode(USB_DETACH_PORT, GPIO_MODE_OUTPUT_10_MHZ,
+				GPIO_CNF_OUTPUT_PUSHPULL, USB_DETACH_PIN);
+	} else {
+		/* Allow pull-up to float if VBUS disconnected */
+		gpio_set_mode(USB_DETACH_PORT, GPIO_MODE_INPUT,
+				GPIO_CNF_INPUT_FLOAT, USB_DETACH_PIN);
+	}
+
+	exti_reset_request(USB_VBUS_PIN);
+}
+
+/**
+ * Initialize the VBUS
+ */
+static void cdcacm_init_vbus(void) {
+	rcc_peripheral_enable_clock(&RCC_APB2ENR, USB_DETACH_CLK);
+	rcc_peripheral_enable_clock(&RCC_APB2ENR, USB_VBUS_CLK);
+
+	nvic_set_priority(USB_VBUS_IRQ, 3);
+	nvic_enable_irq(USB_VBUS_IRQ);
+
+	gpio_set(USB_VBUS_PORT, USB_VBUS_PIN);
+	gpio_set(USB_DETACH_PORT, USB_DETACH_PIN);
+
+	gpio_set_mode(USB_VBUS_PORT, GPIO_MODE_INPUT,
+			GPIO_CNF_INPUT_PULL_UPDOWN, USB_VBUS_PIN);
+
+	/* Configure EXTI for USB VBUS monitor */
+	exti_select_source(USB_VBUS_PIN, USB_VBUS_PORT);
+	exti_set_trigger(USB_VBUS_PIN, EXTI_TRIGGER_BOTH);
+	exti_enable_request(USB_VBUS_PIN);
+
+	exti15_10_isr();
+}
+#endif
+
+/**
+ * Initialize the CDCACM
+ */
+void cdcacm_init(void) {
+
+	/* Initialize IO FIFOs. */
+	fifo_init(&cdcacm_data_rx, cdcacm_data_rx_buffer, CDCACM_IO_BUFFER_SIZE);
+	fifo_init(&cdcacm_data_tx, cdcacm_data_tx_buffer, CDCACM_IO_BUFFER_SIZE);
+	fifo_init(&cdcacm_console_rx, cdcacm_console_rx_buffer, CDCACM_IO_BUFFER_SIZE);
+	fifo_init(&cdcacm_console_tx, cdcacm_console_tx_buffer, CDCACM_IO_BUFFER_SIZE);
+	cdcacm_vendor_init();
+
+	/* Reset cdcacm_status struct entries. */
+	cdcacm_status.data_rx_ring_full = 0;
+	cdcacm_status.console_rx_ring_full = 0;
+
+	/* Initialize the USB stack. */
+	cdcacm_usbd_dev = usbd_init(&st_usbfs_v1_usb_driver, &dev, &config, usb_strings, 7,
+			    cdcacm_usbd_control_buffer, sizeof(cdcacm_usbd_control_buffer));
+
+	usbd_register_set_config_callback(cdcacm_usbd_dev, cdcacm_set_config_callback);
+
+	nvic_set_priority(NVIC_USB_LP_CAN_RX0_IRQ, 3);
+	nvic_enable_irq(NVIC_USB_LP_CAN_RX0_IRQ);
+
+#ifdef USB_VBUS_PORT
+	cdcacm_init_vbus();
+#endif
+}
+
+/**
+ * Run the CDCACM ISR
+ */
+void usb_lp_can_rx0_isr(void) {
+	PROF_START(start);
+	usbd_poll(cdcacm_usbd_dev);
+	PROF_END(PROF_USB_IRQ, start);
+}
+
+/**
+ * Start sending the output FIFOs on idle endpoints. Once running the endpoint
+ * completion interrupts keep the endpoints busy until the FIFOs are empty.
+ */
+void cdcacm_run(void)
+{
+	if (!configured)
+		return;
+
+	uint32_t mask = cm_mask_interrupts(1);
+	cdcacm_tx_fill(&cdcacm_tx_data);
+	cdcacm_tx_fill(&cdcacm_tx_console);
+	cdcacm_tx_fill(&cdcacm_tx_vendor);
+	cm_mask_interrupts(mask);
+}
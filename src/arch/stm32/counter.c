@@ -26,10 +26,12 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include <libopencm3/cm3/nvic.h>
+#include <libopencm3/cm3/scb.h>
+#include <libopencm3/cm3/cortex.h>
 #include <libopencm3/stm32/rcc.h>
 #include <libopencm3/cm3/systick.h>
 
-#include "counter.h"
+#include "modules/counter.h"
 
 /* Configuration */
 #define COUNTER_FREQ 25000 /* Counter interval of 0.04ms */
@@ -76,6 +78,26 @@ void counter_init(void)
   counter_status.init = true;
 }
 
+/**
+ * Get the time in microseconds by extending the ticks with the systick value.
+ * This wraps around after about 71 minutes and can be called from interrupts.
+ */
+uint32_t counter_get_us(void)
+{
+  uint32_t mask = cm_mask_interrupts(1);
+  uint32_t ticks = counter_status.ticks;
+  uint32_t reload = systick_get_reload();
+  uint32_t value = systick_get_value();
+
+  /* The counter reloaded but the tick is not handled yet, the value is only
+   * from before the reload when it is still low */
+  if ((SCB_ICSR & SCB_ICSR_PENDSTSET) && value > reload / 2)
+    ticks++;
+  cm_mask_interrupts(mask);
+
+  return ticks * (1000000 / COUNTER_FREQ) + (reload - value) / (counter_status.fine_frequency / 1000000);
+}
+
 /* Interrupt handlers */
 void sys_tick_handler(void)
 {
@@ -0,0 +1,30 @@
+/*
+ * This file is part of the superbitrf project.
+ *
+ * Copyright (C) 2018 Freek van Tienen <freek.v.tienen@gmail.com>
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ARCH_STM32_COUNTER_ARCH_H_
+#define ARCH_STM32_COUNTER_ARCH_H_
+
+/**
+ * Get the amount of systick ticks since the counter was initialized
+ */
+static inline uint32_t counter_get_ticks(void) {
+	return counter_status.ticks;
+}
+
+#endif /* ARCH_STM32_COUNTER_ARCH_H_ */
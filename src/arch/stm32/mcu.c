@@ -0,0 +1,75 @@
+/*
+ * This file is part of the superbitrf project.
+ *
+ * Copyright (C) 2018 Freek van Tienen <freek.v.tienen@gmail.com>
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <libopencm3/stm32/rcc.h>
+#include <libopencm3/stm32/desig.h>
+#include <libopencm3/stm32/flash.h>
+
+#include "modules/mcu.h"
+#include "board.h"
+
+/**
+ * Initialize the microcontroller clocks
+ */
+void mcu_init(void) {
+#ifndef BOARD_V2_0
+	rcc_clock_setup_in_hse_12mhz_out_72mhz();
+#else
+	rcc_clock_setup_in_hse_8mhz_out_72mhz();
+#endif
+}
+
+/**
+ * Get the 96-bit unique identifier of the microcontroller
+ * @param[out] id The 3 words of the unique identifier
+ */
+void mcu_get_unique_id(uint32_t *id) {
+	desig_get_unique_id(id);
+}
+
+/**
+ * Unlock the flash for writing
+ */
+void mcu_flash_unlock(void) {
+	flash_unlock();
+}
+
+/**
+ * Lock the flash for writing
+ */
+void mcu_flash_lock(void) {
+	flash_lock();
+}
+
+/**
+ * Erase a flash page
+ * @param[in] addr The address of the page
+ */
+void mcu_flash_erase_page(uint32_t addr) {
+	flash_erase_page(addr);
+}
+
+/**
+ * Program a half word in flash
+ * @param[in] addr The address to program
+ * @param[in] data The half word to write
+ */
+void mcu_flash_program_half_word(uint32_t addr, uint16_t data) {
+	flash_program_half_word(addr, data);
+}
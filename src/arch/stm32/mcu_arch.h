@@ -0,0 +1,68 @@
+/*
+ * This file is part of the superbitrf project.
+ *
+ * Copyright (C) 2018 Freek van Tienen <freek.v.tienen@gmail.com>
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ARCH_STM32_MCU_ARCH_H_
+#define ARCH_STM32_MCU_ARCH_H_
+
+#include <libopencm3/cm3/cortex.h>
+
+/**
+ * Disable all interrupts
+ */
+static inline void mcu_irq_disable(void) {
+	cm_disable_interrupts();
+}
+
+/**
+ * Enable all interrupts
+ */
+static inline void mcu_irq_enable(void) {
+	cm_enable_interrupts();
+}
+
+/**
+ * Disable all interrupts, also from within an interrupt or another disabled section
+ * @return The previous interrupt mask for mcu_irq_restore
+ */
+static inline uint32_t mcu_irq_save(void) {
+	return cm_mask_interrupts(1);
+}
+
+/**
+ * Restore the interrupt mask from before mcu_irq_save
+ * @param[in] mask The previous interrupt mask
+ */
+static inline void mcu_irq_restore(uint32_t mask) {
+	cm_mask_interrupts(mask);
+}
+
+/**
+ * Get a pointer to read from the flash memory
+ * @param[in] addr The flash address
+ */
+/* Sleep until the next interrupt, also wakes when interrupts are disabled */
+static inline void mcu_sleep(void) {
+	__asm__ volatile("wfi");
+}
+
+static inline const void *mcu_flash_ptr(uint32_t addr) {
+	return (const void *)addr;
+}
+
+#endif /* ARCH_STM32_MCU_ARCH_H_ */
@@ -0,0 +1,47 @@
+/*
+ * This file is part of the superbitrf project.
+ *
+ * Copyright (C) 2018 Freek van Tienen <freek.v.tienen@gmail.com>
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ARCH_STM32_PROF_ARCH_H_
+#define ARCH_STM32_PROF_ARCH_H_
+
+#include <libopencm3/cm3/dwt.h>
+#include <libopencm3/stm32/rcc.h>
+
+/**
+ * Enable the DWT cycle counter
+ */
+static inline void prof_arch_init(void) {
+	dwt_enable_cycle_counter();
+}
+
+/**
+ * Get the CPU cycles from the DWT cycle counter
+ */
+static inline uint32_t prof_get_cycles(void) {
+	return DWT_CYCCNT;
+}
+
+/**
+ * Get the amount of CPU cycles per microsecond
+ */
+static inline uint32_t prof_get_cycles_per_us(void) {
+	return rcc_ahb_frequency / 1000000;
+}
+
+#endif /* ARCH_STM32_PROF_ARCH_H_ */
@@ -0,0 +1,477 @@
+/*
+ * This file is part of the superbitrf project.
+ *
+ * Copyright (C) 2018 Freek van Tienen <freek.v.tienen@gmail.com>
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stddef.h>
+#include <libopencm3/cm3/cortex.h>
+#include <libopencm3/cm3/nvic.h>
+#include <libopencm3/stm32/rcc.h>
+#include <libopencm3/stm32/gpio.h>
+#include <libopencm3/stm32/spi.h>
+#include <libopencm3/stm32/dma.h>
+#include <libopencm3/stm32/exti.h>
+
+#include "modules/spi.h"
+
+/* The default prescaler of a device when the board doesn't define it */
+#ifndef CYRF_DEV_SPI_BR
+#define CYRF_DEV_SPI_BR SPI_CR1_BR_FPCLK_DIV_64
+#endif
+#ifndef CC_DEV_SPI_BR
+#define CC_DEV_SPI_BR SPI_CR1_BR_FPCLK_DIV_64
+#endif
+
+/* The SPI bus and chip select pin of each device */
+struct spi_dev_pins_t {
+	uint32_t spi;								/**< The SPI bus the device is connected to */
+	uint32_t ss_port;						/**< The chip select GPIO port */
+	uint16_t ss_pin;						/**< The chip select GPIO pin */
+	uint8_t br;									/**< The fastest baudrate prescaler the device tolerates */
+};
+
+static const struct spi_dev_pins_t spi_devs[SPI_DEV_NB] = {
+#ifdef CYRF_DEV_SPI
+	[SPI_DEV_CYRF] = {CYRF_DEV_SPI, CYRF_DEV_SS_PORT, CYRF_DEV_SS_PIN, CYRF_DEV_SPI_BR},
+#endif
+#ifdef CC_DEV_SPI
+	[SPI_DEV_CC] = {CC_DEV_SPI, CC_DEV_SS_PORT, CC_DEV_SS_PIN, CC_DEV_SPI_BR},
+#endif
+};
+
+/* The DMA state of an SPI bus, which is shared between the devices */
+struct spi_bus_t {
+	uint32_t spi;								/**< The SPI bus */
+	uint8_t rx_chan;						/**< The DMA1 channel of the SPI RX */
+	uint8_t tx_chan;						/**< The DMA1 channel of the SPI TX */
+	uint8_t nvic;								/**< The NVIC of the RX DMA channel */
+	volatile bool busy;					/**< A device is selected */
+	volatile bool dma;					/**< A DMA transfer is running */
+	volatile uint32_t done;			/**< The amount of finished DMA transfers */
+	enum spi_dev_t dev;					/**< The device of the DMA transfer */
+	spi_dev_cb cb;							/**< The callback of the DMA transfer */
+	uint8_t dummy;							/**< Source of the zero bytes and sink of the ignored bytes */
+};
+
+static struct spi_bus_t spi_buses[] = {
+	{SPI1, DMA_CHANNEL2, DMA_CHANNEL3, NVIC_DMA1_CHANNEL2_IRQ, false, false, 0, SPI_DEV_NB, NULL, 0},
+	{SPI2, DMA_CHANNEL4, DMA_CHANNEL5, NVIC_DMA1_CHANNEL4_IRQ, false, false, 0, SPI_DEV_NB, NULL, 0},
+};
+
+#ifdef CYRF_DEV_IRQ_PORT
+static spi_dev_cb spi_cyrf_irq_cb = NULL;		/**< The callback on the CYRF6936 IRQ interrupt */
+#endif
+#ifdef CC_DEV_IRQ_PORT
+static spi_dev_cb spi_cc_irq_cb = NULL;			/**< The callback on the CC2500 GDO interrupt */
+#endif
+
+static struct spi_bus_t *spi_dev_bus(enum spi_dev_t dev);
+static uint32_t spi_bus_claim(enum spi_dev_t dev);
+static void spi_bus_start_dma(struct spi_bus_t *bus, const uint8_t *tx, uint8_t *rx, uint16_t len);
+static void spi_bus_finish(struct spi_bus_t *bus);
+
+#ifdef USE_SPI1
+/**
+ * Initialize the first SPI bus
+ */
+static void spi1_init(void) {
+	/* Initialize the clock */
+	rcc_periph_clock_enable(RCC_SPI1);
+
+	/* Initialize the GPIO */                  
+	gpio_set_mode(GPIO_BANK_SPI1_MISO, GPIO_MODE_INPUT, GPIO_CNF_INPUT_FLOAT, GPIO_SPI1_MISO);
+	gpio_set_mode(GPIO_BANK_SPI1_MOSI, GPIO_MODE_OUTPUT_50_MHZ, GPIO_CNF_OUTPUT_ALTFN_PUSHPULL, GPIO_SPI1_MOSI);
+	gpio_set_mode(GPIO_BANK_SPI1_SCK, GPIO_MODE_OUTPUT_50_MHZ, GPIO_CNF_OUTPUT_ALTFN_PUSHPULL, GPIO_SPI1_SCK);
+
+	/* Reset SPI, SPI_CR1 register cleared, SPI is disabled */
+	spi_reset(SPI1);
+
+	/* Set up SPI in Master mode with:
+	 * Clock baud rate: 1/64 of peripheral clock frequency (changed per device on select)
+	 * Clock polarity: Idle High
+	 * Clock phase: Data valid on 2nd clock pulse
+	 * Data frame format: 8-bit
+	 * Frame format: MSB First
+	 */
+	spi_init_master(SPI1, SPI_CR1_BAUDRATE_FPCLK_DIV_64,
+			SPI_CR1_CPOL_CLK_TO_0_WHEN_IDLE, SPI_CR1_CPHA_CLK_TRANSITION_1,
+			SPI_CR1_DFF_8BIT, SPI_CR1_MSBFIRST);
+
+	/* Set NSS management to software. */
+	spi_enable_software_slave_management(SPI1);
+	spi_set_nss_high(SPI1);
+
+	/* Enable SPI periph. */
+	spi_enable(SPI1);
+
+	/* Enable the RX DMA interrupt for the end of the transfers */
+	nvic_set_priority(spi_buses[0].nvic, 1);
+	nvic_enable_irq(spi_buses[0].nvic);
+}
+#endif
+
+#ifdef USE_SPI2
+/**
+ * Initialize the second SPI bus
+ */
+static void spi2_init(void) {
+	/* Initialize the clock */
+	rcc_periph_clock_enable(RCC_SPI2);
+
+	/* Initialize the GPIO */
+	gpio_set_mode(GPIO_BANK_SPI2_MISO, GPIO_MODE_INPUT, GPIO_CNF_INPUT_FLOAT, GPIO_SPI2_MISO);
+	gpio_set_mode(GPIO_BANK_SPI2_MOSI, GPIO_MODE_OUTPUT_50_MHZ, GPIO_CNF_OUTPUT_ALTFN_PUSHPULL, GPIO_SPI2_MOSI);
+	gpio_set_mode(GPIO_BANK_SPI2_SCK, GPIO_MODE_OUTPUT_50_MHZ, GPIO_CNF_OUTPUT_ALTFN_PUSHPULL, GPIO_SPI2_SCK);
+
+	/* Reset SPI, SPI_CR1 register cleared, SPI is disabled */
+	spi_reset(SPI2);
+
+	/* Set up SPI in Master mode with:
+	 * Clock baud rate: 1/64 of peripheral clock frequency (changed per device on select)
+	 * Clock polarity: Idle High
+	 * Clock phase: Data valid on 2nd clock pulse
+	 * Data frame format: 8-bit
+	 * Frame format: MSB First
+	 */
+	spi_init_master(SPI2, SPI_CR1_BAUDRATE_FPCLK_DIV_64,
+			SPI_CR1_CPOL_CLK_TO_0_WHEN_IDLE, SPI_CR1_CPHA_CLK_TRANSITION_1,
+			SPI_CR1_DFF_8BIT, SPI_CR1_MSBFIRST);
+
+	/* Set NSS management to software. */
+	spi_enable_software_slave_management(SPI2);
+	spi_set_nss_high(SPI2);
+
+	/* Enable SPI periph. */
+	spi_enable(SPI2);
+
+	/* Enable the RX DMA interrupt for the end of the transfers */
+	nvic_set_priority(spi_buses[1].nvic, 1);
+	nvic_enable_irq(spi_buses[1].nvic);
+}
+#endif
+
+/**
+ * Initialize the SPI busses
+ */
+void spi_init(void) {
+	rcc_periph_clock_enable(RCC_DMA1);
+
+#ifdef USE_SPI1
+	spi1_init();
+#endif
+#ifdef USE_SPI2
+	spi2_init();
+#endif
+}
+
+/**
+ * Initialize the pins of a device on the SPI bus
+ * @param[in] dev The device to initialize
+ */
+void spi_dev_init(enum spi_dev_t dev) {
+	if(spi_devs[dev].spi == 0)
+		return;
+
+	gpio_set_mode(spi_devs[dev].ss_port, GPIO_MODE_OUTPUT_50_MHZ, GPIO_CNF_OUTPUT_PUSHPULL, spi_devs[dev].ss_pin);
+
+#ifdef CYRF_DEV_RST_PORT
+	if(dev == SPI_DEV_CYRF) {
+		rcc_periph_clock_enable(CYRF_DEV_RST_CLK);
+		gpio_set_mode(CYRF_DEV_RST_PORT, GPIO_MODE_OUTPUT_50_MHZ, GPIO_CNF_OUTPUT_PUSHPULL, CYRF_DEV_RST_PIN);
+	}
+#endif
+}
+
+/**
+ * Enable the interrupt line (falling edge) of a device when the board has it connected
+ * @param[in] dev The device
+ * @param[in] cb The callback on a falling edge, called from the interrupt
+ * @return Whether the device has an interrupt line
+ */
+bool spi_dev_irq_init(enum spi_dev_t dev, spi_dev_cb cb) {
+#ifdef CYRF_DEV_IRQ_PORT
+	if(dev == SPI_DEV_CYRF) {
+		spi_cyrf_irq_cb = cb;
+		rcc_periph_clock_enable(CYRF_DEV_IRQ_CLK);
+		gpio_set_mode(CYRF_DEV_IRQ_PORT, GPIO_MODE_INPUT, GPIO_CNF_INPUT_FLOAT, CYRF_DEV_IRQ_PIN);
+		exti_select_source(CYRF_DEV_IRQ_EXTI, CYRF_DEV_IRQ_PORT);
+		exti_set_trigger(CYRF_DEV_IRQ_EXTI, EXTI_TRIGGER_FALLING);
+		exti_enable_request(CYRF_DEV_IRQ_EXTI);
+
+		nvic_set_priority(CYRF_DEV_IRQ_NVIC, 2);
+		nvic_enable_irq(CYRF_DEV_IRQ_NVIC);
+		return true;
+	}
+#endif
+#ifdef CC_DEV_IRQ_PORT
+	if(dev == SPI_DEV_CC) {
+		spi_cc_irq_cb = cb;
+		rcc_periph_clock_enable(CC_DEV_IRQ_CLK);
+		gpio_set_mode(CC_DEV_IRQ_PORT, GPIO_MODE_INPUT, GPIO_CNF_INPUT_FLOAT, CC_DEV_IRQ_PIN);
+		exti_select_source(CC_DEV_IRQ_EXTI, CC_DEV_IRQ_PORT);
+		exti_set_trigger(CC_DEV_IRQ_EXTI, EXTI_TRIGGER_FALLING);
+		exti_enable_request(CC_DEV_IRQ_EXTI);
+
+		// Same priority as the CYRF interrupt
+		nvic_set_priority(CC_DEV_IRQ_NVIC, 2);
+		nvic_enable_irq(CC_DEV_IRQ_NVIC);
+		return true;
+	}
+#endif
+	(void)dev;
+	(void)cb;
+	return false;
+}
+
+#ifdef CYRF_DEV_IRQ_ISR
+/**
+ * The CYRF6936 IRQ interrupt, cleared first so an edge while processing isn't lost
+ */
+void CYRF_DEV_IRQ_ISR(void) {
+	exti_reset_request(CYRF_DEV_IRQ_EXTI);
+	if(spi_cyrf_irq_cb != NULL)
+		spi_cyrf_irq_cb(SPI_DEV_CYRF);
+}
+#endif
+
+#ifdef CC_DEV_IRQ_ISR
+/**
+ * The CC2500 GDO interrupt, cleared first so an edge while processing isn't lost
+ */
+void CC_DEV_IRQ_ISR(void) {
+	exti_reset_request(CC_DEV_IRQ_EXTI);
+	if(spi_cc_irq_cb != NULL)
+		spi_cc_irq_cb(SPI_DEV_CC);
+}
+#endif
+
+/**
+ * Select a device by pulling its chip select low, waits for a running DMA transfer on the bus
+ * @param[in] dev The device to select
+ */
+void spi_dev_select(enum spi_dev_t dev) {
+	cm_mask_interrupts(spi_bus_claim(dev));
+}
+
+/**
+ * Deselect a device by pulling its chip select high and release the bus
+ * @param[in] dev The device to deselect
+ */
+void spi_dev_deselect(enum spi_dev_t dev) {
+	gpio_set(spi_devs[dev].ss_port, spi_devs[dev].ss_pin);
+	spi_dev_bus(dev)->busy = false;
+}
+
+/**
+ * Transfer one byte with a (selected) device
+ * @param[in] dev The device to transfer with
+ * @param[in] data The byte to send
+ * @return The byte received
+ */
+uint8_t spi_dev_xfer(enum spi_dev_t dev, uint8_t data) {
+	return spi_xfer(spi_devs[dev].spi, data);
+}
+
+/**
+ * Drive the reset pin of a device (if it has one)
+ * @param[in] dev The device to reset
+ * @param[in] active Whether the reset pin should be active
+ */
+void spi_dev_reset(enum spi_dev_t dev, bool active) {
+	(void) active;
+#ifdef CYRF_DEV_RST_PORT
+	if(dev == SPI_DEV_CYRF) {
+		if(active)
+			gpio_set(CYRF_DEV_RST_PORT, CYRF_DEV_RST_PIN);
+		else
+			gpio_clear(CYRF_DEV_RST_PORT, CYRF_DEV_RST_PIN);
+	}
+#else
+	(void) dev;
+#endif
+}
+
+/**
+ * Transfer a header byte followed by a block with DMA as one transaction.
+ * Without callback it waits until the transfer is done, with interrupts enabled.
+ * With a callback it returns directly and the callback is called from the DMA interrupt
+ * (or from the next user of the bus), tx and rx need to stay valid until then.
+ * @param[in] dev The device to transfer with
+ * @param[in] header The first byte (address) which is sent without DMA
+ * @param[in] tx The bytes to send (NULL sends zeros)
+ * @param[out] rx The received bytes (NULL ignores them)
+ * @param[in] len The amount of bytes after the header
+ * @param[in] cb The callback when the transfer is done (NULL for blocking)
+ * @return The byte received during the header
+ */
+uint8_t spi_dev_transfer(enum spi_dev_t dev, uint8_t header, const uint8_t *tx, uint8_t *rx, uint16_t len, spi_dev_cb cb) {
+	struct spi_bus_t *bus = spi_dev_bus(dev);
+	uint32_t mask = spi_bus_claim(dev);
+	uint8_t status = spi_xfer(bus->spi, header);
+
+	// Only a header
+	if(len == 0) {
+		spi_dev_deselect(dev);
+		cm_mask_interrupts(mask);
+		if(cb != NULL)
+			cb(dev);
+		return status;
+	}
+
+	uint32_t done = bus->done;
+	bus->dev = dev;
+	bus->cb = cb;
+	bus->dma = true;
+	spi_bus_start_dma(bus, tx, rx, len);
+	cm_mask_interrupts(mask);
+
+	// Poll for the end, this also works when called from a higher priority interrupt
+	if(cb == NULL) {
+		while(bus->done == done)
+			spi_bus_finish(bus);
+	}
+	return status;
+}
+
+/**
+ * Wait until a running DMA transfer on the bus of the device is done
+ * @param[in] dev The device
+ */
+void spi_dev_wait(enum spi_dev_t dev) {
+	struct spi_bus_t *bus = spi_dev_bus(dev);
+	while(bus->dma)
+		spi_bus_finish(bus);
+}
+
+/**
+ * Get the bus of a device
+ * @param[in] dev The device
+ */
+static struct spi_bus_t *spi_dev_bus(enum spi_dev_t dev) {
+	return (spi_devs[dev].spi == SPI1)? &spi_buses[0] : &spi_buses[1];
+}
+
+/**
+ * Claim the bus and select the device with its prescaler
+ * @param[in] dev The device to select
+ * @return The previous interrupt mask, the interrupts are masked on return
+ */
+static uint32_t spi_bus_claim(enum spi_dev_t dev) {
+	struct spi_bus_t *bus = spi_dev_bus(dev);
+	uint32_t mask;
+
+	while(true) {
+		mask = cm_mask_interrupts(1);
+		if(!bus->busy)
+			break;
+
+		// A DMA transfer is running, finish it when it is done
+		cm_mask_interrupts(mask);
+		spi_bus_finish(bus);
+	}
+
+	bus->busy = true;
+	spi_set_baudrate_prescaler(bus->spi, spi_devs[dev].br);
+	gpio_clear(spi_devs[dev].ss_port, spi_devs[dev].ss_pin);
+	return mask;
+}
+
+/**
+ * Start the DMA transfer (RX and TX channel) on the bus
+ * @param[in] bus The bus
+ * @param[in] tx The bytes to send (NULL sends zeros)
+ * @param[out] rx The received bytes (NULL ignores them)
+ * @param[in] len The amount of bytes
+ */
+static void spi_bus_start_dma(struct spi_bus_t *bus, const uint8_t *tx, uint8_t *rx, uint16_t len) {
+	bus->dummy = 0;
+
+	// The RX channel ends the transfer, when all bytes are clocked in
+	dma_channel_reset(DMA1, bus->rx_chan);
+	dma_set_peripheral_address(DMA1, bus->rx_chan, (uint32_t)&SPI_DR(bus->spi));
+	dma_set_memory_address(DMA1, bus->rx_chan, (uint32_t)((rx != NULL)? rx : &bus->dummy));
+	dma_set_number_of_data(DMA1, bus->rx_chan, len);
+	dma_set_read_from_peripheral(DMA1, bus->rx_chan);
+	if(rx != NULL)
+		dma_enable_memory_increment_mode(DMA1, bus->rx_chan);
+	dma_set_peripheral_size(DMA1, bus->rx_chan, DMA_CCR_PSIZE_8BIT);
+	dma_set_memory_size(DMA1, bus->rx_chan, DMA_CCR_MSIZE_8BIT);
+	dma_set_priority(DMA1, bus->rx_chan, DMA_CCR_PL_VERY_HIGH);
+	dma_enable_transfer_complete_interrupt(DMA1, bus->rx_chan);
+
+	dma_channel_reset(DMA1, bus->tx_chan);
+	dma_set_peripheral_address(DMA1, bus->tx_chan, (uint32_t)&SPI_DR(bus->spi));
+	dma_set_memory_address(DMA1, bus->tx_chan, (uint32_t)((tx != NULL)? tx : &bus->dummy));
+	dma_set_number_of_data(DMA1, bus->tx_chan, len);
+	dma_set_read_from_memory(DMA1, bus->tx_chan);
+	if(tx != NULL)
+		dma_enable_memory_increment_mode(DMA1, bus->tx_chan);
+	dma_set_peripheral_size(DMA1, bus->tx_chan, DMA_CCR_PSIZE_8BIT);
+	dma_set_memory_size(DMA1, bus->tx_chan, DMA_CCR_MSIZE_8BIT);
+	dma_set_priority(DMA1, bus->tx_chan, DMA_CCR_PL_HIGH);
+
+	dma_enable_channel(DMA1, bus->rx_chan);
+	dma_enable_channel(DMA1, bus->tx_chan);
+	spi_enable_rx_dma(bus->spi);
+	spi_enable_tx_dma(bus->spi);
+}
+
+/**
+ * Finish the DMA transfer on the bus if it is done and call the callback
+ * @param[in] bus The bus
+ */
+static void spi_bus_finish(struct spi_bus_t *bus) {
+	uint32_t mask = cm_mask_interrupts(1);
+	if(!bus->dma || !dma_get_interrupt_flag(DMA1, bus->rx_chan, DMA_TCIF)) {
+		cm_mask_interrupts(mask);
+		return;
+	}
+
+	dma_clear_interrupt_flags(DMA1, bus->rx_chan, DMA_TCIF);
+	spi_disable_rx_dma(bus->spi);
+	spi_disable_tx_dma(bus->spi);
+	dma_disable_channel(DMA1, bus->rx_chan);
+	dma_disable_channel(DMA1, bus->tx_chan);
+
+	enum spi_dev_t dev = bus->dev;
+	spi_dev_cb cb = bus->cb;
+	bus->dma = false;
+	bus->done++;
+	spi_dev_deselect(dev);
+	cm_mask_interrupts(mask);
+
+	if(cb != NULL)
+		cb(dev);
+}
+
+#ifdef USE_SPI1
+/**
+ * The end of a DMA transfer on SPI1
+ */
+void dma1_channel2_isr(void) {
+	spi_bus_finish(&spi_buses[0]);
+}
+#endif
+
+#ifdef USE_SPI2
+/**
+ * The end of a DMA transfer on SPI2
+ */
+void dma1_channel4_isr(void) {
+	spi_bus_finish(&spi_buses[1]);
+}
+#endif
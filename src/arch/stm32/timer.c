@@ -0,0 +1,200 @@
+/*
+ * This file is part of the superbitrf project.
+ *
+ * Copyright (C) 2013 Freek van Tienen <freek.v.tienen@gmail.com>
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <unistd.h>
+#include <libopencm3/cm3/cortex.h>
+#include <libopencm3/cm3/nvic.h>
+#include <libopencm3/stm32/timer.h>
+#include <libopencm3/stm32/gpio.h>
+#include <libopencm3/stm32/rcc.h>
+
+#include "modules/timer.h"
+#include "modules/prof.h"
+#include "modules/trace.h"
+
+/* The register bits of each compare channel */
+static const enum tim_oc_id timer_oc[TIMER_CH_NB] = {TIM_OC1, TIM_OC2, TIM_OC3, TIM_OC4};
+static const uint32_t timer_dier[TIMER_CH_NB] = {TIM_DIER_CC1IE, TIM_DIER_CC2IE, TIM_DIER_CC3IE, TIM_DIER_CC4IE};
+static const uint32_t timer_sr[TIMER_CH_NB] = {TIM_SR_CC1IF, TIM_SR_CC2IF, TIM_SR_CC3IF, TIM_SR_CC4IF};
+static const uint32_t timer_egr[TIMER_CH_NB] = {TIM_EGR_CC1G, TIM_EGR_CC2G, TIM_EGR_CC3G, TIM_EGR_CC4G};
+
+/* The timer callbacks */
+static timer_on_event timer_ch_on_event[TIMER_CH_NB];
+static uint32_t timer_ch_deadline[TIMER_CH_NB];		/**< The absolute deadline of each compare channel */
+static volatile uint16_t timer_overflows = 0;			/**< The upper half of the 32-bit time base */
+
+/**
+ * Initialize timer1 as a free running 32-bit time base
+ */
+static void timer1_init(void) {
+	uint8_t i;
+	rcc_peripheral_enable_clock(&RCC_APB1ENR, RCC_APB1ENR_TIM2EN);
+
+	// Enable the timer NVIC
+	nvic_enable_irq(TIMER1_NVIC);
+	nvic_set_priority(TIMER1_NVIC, 1);
+
+	// Setup the timer
+	timer_disable_counter(TIMER1);
+	timer_reset(TIMER1);
+	timer_set_mode(TIMER1, TIM_CR1_CKD_CK_INT, TIM_CR1_CMS_EDGE, TIM_CR1_DIR_UP);
+	timer_disable_preload(TIMER1);
+	timer_continuous_mode(TIMER1);
+
+	// Setup all the compare channels as frozen outputs without interrupts
+	for(i = 0; i < TIMER_CH_NB; i++) {
+		timer_disable_irq(TIMER1, timer_dier[i]);
+		timer_disable_oc_clear(TIMER1, timer_oc[i]);
+		timer_disable_oc_preload(TIMER1, timer_oc[i]);
+		timer_set_oc_slow_mode(TIMER1, timer_oc[i]);
+		timer_set_oc_mode(TIMER1, timer_oc[i], TIM_OCM_FROZEN);
+	}
+
+	// Set timer updates each 10 microseconds
+	timer_set_prescaler(TIMER1, 720 - 1);
+	timer_set_period(TIMER1, 65535);
+
+	// Count the overflows for the upper half of the time base
+	timer_clear_flag(TIMER1, TIM_SR_UIF);
+	timer_enable_irq(TIMER1, TIM_DIER_UIE);
+
+	// Start the timer
+	timer_enable_counter(TIMER1);
+}
+
+/**
+ * Initialize the timers
+ */
+void timer_init(void) {
+	// Initialize the DSM timer
+	timer1_init();
+}
+
+/**
+ * Get the 32-bit time base
+ * @return The amount of ticks of 10 microseconds since boot
+ */
+uint32_t timer_get_ticks(void) {
+	uint32_t hi, lo;
+	uint32_t mask = cm_mask_interrupts(1);
+
+	hi = timer_overflows;
+	lo = timer_get_counter(TIMER1);
+
+	// An overflow which isn't handled yet
+	if(timer_get_flag(TIMER1, TIM_SR_UIF) && lo < 0x8000)
+		hi++;
+
+	cm_mask_interrupts(mask);
+	return (hi << 16) | lo;
+}
+
+/**
+ * Set a compare channel to interrupt at an absolute deadline
+ * When the deadline already passed the interrupt is generated immediately.
+ * @param[in] ch The compare channel
+ * @param[in] deadline The time base ticks to interrupt at
+ */
+void timer_ch_set_at(enum timer_ch_t ch, uint32_t deadline) {
+	timer_ch_deadline[ch] = deadline;
+
+	// Update the timer compare value
+	timer_set_oc_value(TIMER1, timer_oc[ch], deadline & 0xFFFF);
+
+	// Clear the interrupt flag and enable the interrupt of the compare
+	timer_clear_flag(TIMER1, timer_sr[ch]);
+	timer_enable_irq(TIMER1, timer_dier[ch]);
+
+	// The deadline could have passed while setting it up
+	if((int32_t)(timer_get_ticks() - deadline) >= 0)
+		timer_generate_event(TIMER1, timer_egr[ch]);
+}
+
+/**
+ * Set a compare channel to interrupt relative to now
+ * @param[in] ch The compare channel
+ * @param[in] ticks The time in microseconds times 10
+ */
+void timer_ch_set(enum timer_ch_t ch, uint32_t ticks) {
+	timer_ch_set_at(ch, timer_get_ticks() + ticks);
+}
+
+/**
+ * Get the last deadline of a compare channel
+ * @param[in] ch The compare channel
+ */
+uint32_t timer_ch_get_deadline(enum timer_ch_t ch) {
+	return timer_ch_deadline[ch];
+}
+
+/**
+ * Stop the interrupts of a compare channel
+ * @param[in] ch The compare channel
+ */
+void timer_ch_stop(enum timer_ch_t ch) {
+	// Clear the interrupt flag and disable the interrupt of the compare
+	timer_clear_flag(TIMER1, timer_sr[ch]);
+	timer_disable_irq(TIMER1, timer_dier[ch]);
+}
+
+/**
+ * Register a compare channel callback
+ * @param[in] ch The compare channel
+ * @param[in] callback The callback function when an interrupt occurs
+ */
+void timer_ch_register_callback(enum timer_ch_t ch, timer_on_event callback) {
+	timer_ch_on_event[ch] = callback;
+}
+
+/**
+ * The timer interrupt handler
+ */
+void TIMER1_IRQ(void) {
+	uint8_t i;
+	PROF_START(irq_start);
+
+	// Extend the time base before checking the deadlines
+	if(timer_get_flag(TIMER1, TIM_SR_UIF)) {
+		timer_clear_flag(TIMER1, TIM_SR_UIF);
+		timer_overflows++;
+	}
+
+	for(i = 0; i < TIMER_CH_NB; i++) {
+		if(!(TIM_DIER(TIMER1) & timer_dier[i]) || !timer_get_flag(TIMER1, timer_sr[i]))
+			continue;
+		timer_clear_flag(TIMER1, timer_sr[i]);
+
+		// Only the lower half matched, wait for the upper half
+		if((int32_t)(timer_get_ticks() - timer_ch_deadline[i]) < 0)
+			continue;
+
+		// Stop the channel
+		timer_ch_stop(i);
+
+		// Callback
+		trace_add(TRACE_TIMEOUT, i, 0);
+		if(timer_ch_on_event[i] != NULL) {
+			PROF_START(cb_start);
+			timer_ch_on_event[i]();
+			PROF_END(PROF_TIMER_CH1 + i, cb_start);
+		}
+	}
+
+	PROF_END(PROF_TIMER_IRQ, irq_start);
+}
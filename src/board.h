@@ -24,6 +24,8 @@
 #include "boards/board_v1.0.h"
 #elif defined(BOARD_V2_0)
 #include "boards/board_v2.0.h"
+#elif defined(BOARD_HOST)
+#include "boards/board_host.h"
 #else
 #include "boards/board_v0.1.h"
 #endif
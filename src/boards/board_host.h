@@ -0,0 +1,40 @@
+/*
+ * This file is part of the superbitrf project.
+ *
+ * Copyright (C) 2018 Freek van Tienen <freek.v.tienen@gmail.com>
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef BOARD_HOST_H_
+#define BOARD_HOST_H_
+
+/* The host (Linux) build emulates a v2.0 board with both radio chips */
+#define BOARD_ID 2
+
+/* Define the LEDS (optional) */
+#define LED_BIND					NO_LED 					/**< Define the Binding led number */
+#define LED_RX						1								/**< define the Receive led number */
+#define LED_TX						NO_LED					/**< define the Transmit led number */
+#define USE_LED_1					1								/**< If the board has the frist led */
+
+/* Define the CYRF6936 chip */
+#define CYRF_DEV_ANT					{true, true}			/**< The antenna switcher state */
+
+/* Define the CC2500 chip */
+#define CC_DEV_ANT					{false, true}			/**< The antenna switcher state */
+
+#define CLOSEBY_SCAN 1
+
+#endif /* BOARD_HOST_H_ */
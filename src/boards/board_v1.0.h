@@ -65,6 +65,7 @@
 
 /* Define the CYRF6936 chip */
 #define CYRF_DEV_SPI					SPI1							/**< The SPI bus with underscore */
+#define CYRF_DEV_SPI_BR				SPI_CR1_BR_FPCLK_DIV_32		/**< The SPI prescaler (72MHz / 32, max 4MHz) */
 #define CYRF_DEV_SS_PORT			GPIOA							/**< The SPI SS port */
 #define CYRF_DEV_SS_PIN				GPIO4							/**< The SPI SS pin */
 #define CYRF_DEV_RST_PORT			GPIOB							/**< The RST GPIO port*/
@@ -72,7 +73,7 @@
 #define CYRF_DEV_RST_CLK			RCC_APB2ENR_IOPBEN				/**< The RST GPIO clock */
 #define CYRF_DEV_IRQ_PORT			GPIOA							/**< The IRQ GPIO port*/
 #define CYRF_DEV_IRQ_PIN			GPIO3							/**< The IRQ GPIO pin */
-#define CYRF_DEV_IRQ_CLK			RCC_APB2ENR_IOPAEN				/**< The IRQ GPIO clock */
+#define CYRF_DEV_IRQ_CLK			RCC_GPIOA									/**< The IRQ GPIO clock */
 #define CYRF_DEV_IRQ_EXTI			EXTI3							/**< The IRQ EXTI for the interrupt */
 #define CYRF_DEV_IRQ_ISR			exti3_isr						/**< The IRQ ISR function for the interrupt */
 #define CYRF_DEV_IRQ_NVIC			NVIC_EXTI3_IRQ					/**< The IRQ NVIC for the interrupt */
@@ -55,6 +55,7 @@
 
 /* Define the CYRF6936 chip */
 #define CYRF_DEV_SPI					SPI2							/**< The SPI connection number */
+#define CYRF_DEV_SPI_BR				SPI_CR1_BR_FPCLK_DIV_16		/**< The SPI prescaler (36MHz / 16, max 4MHz) */
 #define CYRF_DEV_ANT					{true, true}			/**< The antenna switcher state */
 #define CYRF_DEV_SS_PORT			GPIOB							/**< The SPI SS port */
 #define CYRF_DEV_SS_PIN				GPIO12						/**< The SPI SS pin */
@@ -64,9 +65,17 @@
 
 /* Define the CC2500 chip */
 #define CC_DEV_SPI					SPI2							/**< The SPI connection number */
+#define CC_DEV_SPI_BR				SPI_CR1_BR_FPCLK_DIV_8		/**< The SPI prescaler (36MHz / 8, max 6.5MHz in burst) */
 #define CC_DEV_ANT					{false, true}			/**< The antenna switcher state */
 #define CC_DEV_SS_PORT			GPIOB							/**< The SPI SS port */
 #define CC_DEV_SS_PIN				GPIO6							/**< The SPI SS pin */
+//#define CC_DEV_IRQ_IOCFG		CC2500_IOCFG0			/**< The GDO pin connected to the IRQ (the others control the PA/LNA) */
+//#define CC_DEV_IRQ_PORT			GPIOB							/**< The IRQ GPIO port */
+//#define CC_DEV_IRQ_PIN			GPIO7							/**< The IRQ GPIO pin */
+//#define CC_DEV_IRQ_CLK			RCC_GPIOB					/**< The IRQ GPIO clock */
+//#define CC_DEV_IRQ_EXTI			EXTI7							/**< The IRQ EXTI for the interrupt */
+//#define CC_DEV_IRQ_ISR			exti9_5_isr				/**< The IRQ ISR function for the interrupt */
+//#define CC_DEV_IRQ_NVIC			NVIC_EXTI9_5_IRQ	/**< The IRQ NVIC for the interrupt */
 
 /* Define the DSM timer */
 #define TIMER1					  TIM2							/**< The DSM timer */
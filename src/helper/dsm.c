@@ -17,10 +17,14 @@
  * along with this library.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <string.h>
 #include "dsm.h"
 #include "modules/cyrf6936.h"
 #include "modules/config.h"
 
+_Static_assert(sizeof(config.dsm_cache_id) == DSM_CACHE_SIZE * 4, "DSMX cache ID size mismatch");
+_Static_assert(sizeof(config.dsm_cache_channels) == DSM_CACHE_SIZE * DSM_MAX_USED_CHANNELS, "DSMX cache channels size mismatch");
+
 /* The PN codes */
 const uint8_t pn_codes[5][9][8] = {
 { /* Row 0 */
@@ -188,6 +192,45 @@ void dsm_generate_channels_dsmx(uint8_t mfg_id[], uint8_t *channels) {
 			channels[20], channels[21], channels[22]);
 }
 
+/**
+ * Get the DSMX channels of a manufacturer ID from the cache in the config, or generate them
+ * The cache keeps the most recently used transmitters first. A generated table is inserted at
+ * the front (dropping the least recently used) and both arrays are stored to flash when they changed.
+ * @param[in] mfg_id The manufacturer ID where the DSMX channels should be calculated for
+ * @param[out] The channels for the manufacturer ID
+ * @return Whether the channels were found in the cache
+ */
+bool dsm_get_channels_dsmx(uint8_t mfg_id[], uint8_t *channels) {
+	uint8_t *ids = config.dsm_cache_id;
+	uint8_t *tables = config.dsm_cache_channels;
+	uint8_t idx;
+
+	// Find the transmitter, an empty slot has channel 0 which DSMX never uses
+	for(idx = 0; idx < DSM_CACHE_SIZE; idx++) {
+		if(tables[idx * DSM_MAX_USED_CHANNELS] != 0 && !memcmp(&ids[idx * 4], mfg_id, 4))
+			break;
+	}
+
+	bool hit = (idx < DSM_CACHE_SIZE);
+	if(hit)
+		memcpy(channels, &tables[idx * DSM_MAX_USED_CHANNELS], DSM_MAX_USED_CHANNELS);
+	else {
+		dsm_generate_channels_dsmx(mfg_id, channels);
+		idx = DSM_CACHE_SIZE - 1;
+	}
+
+	// Move the entry to the front
+	if(idx > 0) {
+		memmove(&ids[4], ids, idx * 4);
+		memmove(&tables[DSM_MAX_USED_CHANNELS], tables, idx * DSM_MAX_USED_CHANNELS);
+		memcpy(ids, mfg_id, 4);
+		memcpy(tables, channels, DSM_MAX_USED_CHANNELS);
+	}
+	config_store_item(config.dsm_cache_id);
+	config_store_item(config.dsm_cache_channels);
+	return hit;
+}
+
 /**
  * Set the current channel with SOP, CRC and data code
  * @param[in] channel The channel that needs to be set
@@ -223,6 +266,24 @@ void dsm_set_channel(uint8_t channel, bool is_dsm2, uint8_t sop_col, uint8_t dat
 	dsm_set_chan(channel, pn_row, sop_col, data_col, crc_seed);
 }
 
+/**
+ * Precompile the hop descriptors for a list of channels
+ * @param[out] *hops The hop descriptors, one for each channel
+ * @param[in] *channels The channels that the transmitter uses
+ * @param[in] length The amount of channels
+ * @param[in] is_dsm2 Whether the channels are DSM2 channels
+ * @param[in] sop_col The SOP code column number
+ * @param[in] data_col The DATA code column number
+ */
+void dsm_init_hops(struct cyrf_hop_t *hops, const uint8_t *channels, uint8_t length, bool is_dsm2, uint8_t sop_col, uint8_t data_col) {
+	for(uint8_t i = 0; i < length; i++) {
+		uint8_t pn_row = is_dsm2? channels[i] % 5 : (channels[i]-2) % 5;
+		hops[i].channel = channels[i];
+		hops[i].sop_code = pn_codes[pn_row][sop_col];
+		hops[i].data_code = pn_codes[pn_row][data_col];
+	}
+}
+
 /**
  * Convert normal radio transmitter to channel outputs
  * @param[in] data The data from the RC packet
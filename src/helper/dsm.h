@@ -22,6 +22,7 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include "modules/cyrf6936.h"
 
 /* All times are in microseconds divided by 10 */
 #define DSM_BIND_RECV_TIME			1000		/**< Time before timeout when receiving bind packets */
@@ -35,11 +36,13 @@
 #define DSM_SEND_TIME_SHORT			1100		/**< Time between sending both Channel A and Channel B */
 #define DSM_CHA_CHB_SEND_TIME		400			/**< Time between Channel A and Channel B send */
 #define DSM_CHB_CHA_SEND_TIME		700			/**< Time between Channel B and Channel A send */
+#define DSM_PACKET_TIME					141			/**< Air time of a 16 byte packet in 8DR mode */
 
 /* The maximum channekl number for DSM2 and DSMX */
 #define DSM_MAX_CHANNEL				  0x4F		/**< Maximum channel number used for DSM2 and DSMX */
 #define DSM_MAX_USED_CHANNELS		23			/**< Maximum amunt of used channels when using DSMX */
 #define DSM_BIND_PACKETS			  300			/**< The amount of bind packets to send */
+#define DSM_CACHE_SIZE				  4				/**< The amount of DSMX channel tables kept in the config */
 
 /* The different kind of protocol definitions DSM2 and DSMX with 1 and 2 packets of data */
 enum dsm_protocol {
@@ -69,8 +72,10 @@ void dsm_set_config(void);
 void dsm_set_config_bind(void);
 void dsm_set_config_transfer(void);
 void dsm_generate_channels_dsmx(uint8_t mfg_id[], uint8_t *channels);
+bool dsm_get_channels_dsmx(uint8_t mfg_id[], uint8_t *channels);
 void dsm_set_chan(uint8_t channel, uint8_t pn_row, uint8_t sop_col, uint8_t data_col, uint16_t crc_seed);
 void dsm_set_channel(uint8_t channel, bool is_dsm2, uint8_t sop_col, uint8_t data_col, uint16_t crc_seed);
+void dsm_init_hops(struct cyrf_hop_t *hops, const uint8_t *channels, uint8_t length, bool is_dsm2, uint8_t sop_col, uint8_t data_col);
 void dsm_radio_to_channels(uint8_t* data, uint8_t nb_channels, bool is_11bit, int16_t* channels);
 
 #endif /* HELPER_DSM_H_ */
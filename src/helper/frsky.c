@@ -17,15 +17,39 @@
  * along with this library.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <string.h>
+
 #include "frsky.h"
 
 #include "modules/cc2500.h"
 #include "modules/counter.h"
+#include "modules/config.h"
 
 /* External variables which are used in multiple protocols */
 uint8_t frsky_fscal1[FRSKY_HOP_TABLE_LENGTH+1];							/**< The FSCAL1 values for each of the channels in the hopping table + 1 for the binding channel */
 uint8_t frsky_fscal2 = 0;																		/**< The calibration value for FSCAL2 */
 uint8_t frsky_fscal3 = 0;																		/**< The calibration value for FSCAL3 */
+struct cc_hop_t frsky_hops[FRSKY_HOP_TABLE_LENGTH];								/**< The precompiled hop sequences for each of the channels in the hopping table */
+
+/* Lazy recalibration of the hopping channels */
+static const uint8_t *frsky_hop_channels;												/**< The hopping table of the precompiled hops */
+static uint8_t frsky_hop_misses[FRSKY_HOP_TABLE_LENGTH];						/**< The amount of packets missed in a row per hopping table index */
+static uint64_t frsky_hop_stale;																/**< Hopping table indexes which need to be recalibrated (bitmask) */
+static int8_t frsky_hop_recal = -1;															/**< The hopping table index which is being recalibrated or -1 */
+static uint8_t frsky_hop_mcsm0;																	/**< The MCSM0 to restore after the recalibration */
+
+/* Tuning the channels in the background */
+static const uint8_t *frsky_tune_chans;													/**< The channels which are being tuned */
+static uint8_t frsky_tune_len;																	/**< The amount of channels to tune */
+static uint8_t frsky_tune_idx;																	/**< The next channel to tune */
+static bool frsky_tune_new;																			/**< Whether a channel was calibrated by the CC2500 */
+static bool frsky_tune_active = false;													/**< Whether the channels are being tuned */
+static frsky_on_tuned frsky_tune_done;													/**< Called when all channels are tuned */
+
+/* Internal functions */
+static void frsky_cal_check(void);
+static void frsky_tune_next(void);
+static void frsky_tune_calibrated(bool success, uint8_t fscal1);
 
 /* The common starting register addresses */
 static const uint8_t frsky_conf_addr[]= {
@@ -232,35 +256,173 @@ void frsky_set_config(enum frsky_protocol_t protocol) {
  * @param[in] ch The channel to tune
  */
 void frsky_tune_channel(uint8_t ch) {
-	cc_strobe(CC2500_SIDLE);
-	cc_write_register(CC2500_CHANNR, ch);
-	cc_strobe(CC2500_SCAL);
-
-	// Wait for calibration to end (busy sleep, because can be called in interrupt)
-	while (cc_read_register(CC2500_MARCSTATE) != 0x01)
-		usleep(100);
+	cc_calibrate_start(ch, NULL);
+	cc_wait_ready();
 }
 
 /**
- * Tune multiple channels and fetch the output
- * @param[in] *channels An array of channels that needs to be tuned
+ * Start tuning multiple channels in the background, the results are in frsky_fscal1, frsky_fscal2
+ * and frsky_fscal3. Channels which are in the calibration cache for the current FSCTRL0 and base
+ * frequency are not tuned again, the others are calibrated one at a time while cc_run keeps the
+ * main loop running.
+ * @param[in] *channels An array of channels that needs to be tuned (at most FRSKY_HOP_TABLE_LENGTH)
  * @param[in] length The amount of channels in the channels array
- * @param[out] *fscal1 An output array of the same size as the channels with the FSCAL1 values per channel
- * @param[out] *fscal2 The FSCAL2 value (only a single value, not an array)
- * @param[out] *fscal3 The FSCAL2 value (only a single value, not an array)
+ * @param[in] done Called when all channels are tuned (can be NULL)
+ */
+void frsky_tune_channels(const uint8_t *channels, uint8_t length, frsky_on_tuned done) {
+	frsky_cal_check();
+
+	frsky_tune_chans = channels;
+	frsky_tune_len = length;
+	frsky_tune_idx = 0;
+	frsky_tune_new = false;
+	frsky_tune_done = done;
+	frsky_tune_active = true;
+	frsky_tune_next();
+}
+
+/**
+ * Abort tuning the channels, the done callback will not be called
+ */
+void frsky_tune_abort(void) {
+	frsky_tune_active = false;
+}
+
+/**
+ * Clear the calibration cache when it was made with another FSCTRL0 or base frequency (FREQ2/1/0)
+ * than the one in the CC2500, since the FrSky variants use different base frequencies
+ */
+static void frsky_cal_check(void) {
+	int8_t fsctrl0 = cc_read_register(CC2500_FSCTRL0);
+	uint8_t freq[3] = {cc_read_register(CC2500_FREQ2), cc_read_register(CC2500_FREQ1), cc_read_register(CC2500_FREQ0)};
+	if(config.cal_valid && config.cal_fsctrl0 == fsctrl0 && memcmp(config.cal_freq, freq, sizeof(freq)) == 0)
+		return;
+
+	memset(config.cal_fscal1, 0, sizeof(config.cal_fscal1));
+	config.cal_fsctrl0 = fsctrl0;
+	memcpy(config.cal_freq, freq, sizeof(freq));
+	config.cal_valid = false;
+}
+
+/**
+ * Take the cached channels and start calibrating the next channel which is not cached
  */
-void frsky_tune_channels(uint8_t *channels, uint8_t length, uint8_t *fscal1, uint8_t *fscal2, uint8_t *fscal3) {
-	for(uint8_t i = 0; i < length; i++) {
-		frsky_tune_channel(channels[i]);
+static void frsky_tune_next(void) {
+	while(frsky_tune_idx < frsky_tune_len) {
+		uint8_t ch = frsky_tune_chans[frsky_tune_idx];
+		if(ch >= sizeof(config.cal_fscal1) || !(config.cal_fscal1[ch] & FRSKY_CAL_VALID)) {
+			cc_calibrate_start(ch, frsky_tune_calibrated);
+			return;
+		}
 
-		fscal1[i] = cc_read_register(CC2500_FSCAL1);
+		frsky_fscal1[frsky_tune_idx++] = config.cal_fscal1[ch] & ~FRSKY_CAL_VALID;
 	}
 
 	// FSCAL2 and FSCAL3 only need to be read out once
-	*fscal2 = cc_read_register(CC2500_FSCAL2);
-	*fscal3 = cc_read_register(CC2500_FSCAL3);
-
+	if(frsky_tune_new || !config.cal_valid) {
+		config.cal_fscal2 = cc_read_register(CC2500_FSCAL2);
+		config.cal_fscal3 = cc_read_register(CC2500_FSCAL3);
+		config.cal_valid = true;
+	}
+	frsky_fscal2 = config.cal_fscal2;
+	frsky_fscal3 = config.cal_fscal3;
 	cc_strobe(CC2500_SIDLE);
+
+	// Save the calibration cache in the background
+	config_store_item(&config.cal_valid);
+	config_store_item(&config.cal_fsctrl0);
+	config_store_item(config.cal_freq);
+	config_store_item(&config.cal_fscal2);
+	config_store_item(&config.cal_fscal3);
+	config_store_item(config.cal_fscal1);
+
+	frsky_tune_active = false;
+	if(frsky_tune_done != NULL)
+		frsky_tune_done();
+}
+
+/**
+ * A channel is calibrated by the CC2500, a failed calibration is used but not cached
+ * @param[in] success Whether the calibration finished
+ * @param[in] fscal1 The resulting FSCAL1 of the channel
+ */
+static void frsky_tune_calibrated(bool success, uint8_t fscal1) {
+	if(!frsky_tune_active)
+		return;
+
+	uint8_t ch = frsky_tune_chans[frsky_tune_idx];
+	frsky_fscal1[frsky_tune_idx++] = fscal1;
+	if(success && ch < sizeof(config.cal_fscal1)) {
+		config.cal_fscal1[ch] = fscal1 | FRSKY_CAL_VALID;
+		frsky_tune_new = true;
+	}
+	frsky_tune_next();
+}
+
+/**
+ * Precompile the hop sequences of the hopping table after the channels are tuned
+ * @param[in] *channels The hopping table with FRSKY_HOP_TABLE_LENGTH channels
+ */
+void frsky_init_hops(const uint8_t *channels) {
+	for(uint8_t i = 0; i < FRSKY_HOP_TABLE_LENGTH; i++) {
+		cc_hop_init(&frsky_hops[i], channels[i], frsky_fscal1[i], frsky_fscal2, frsky_fscal3);
+		frsky_hop_misses[i] = 0;
+	}
+
+	frsky_hop_channels = channels;
+	frsky_hop_stale = 0;
+	frsky_hop_recal = -1;
+}
+
+/**
+ * Hop to a channel of the hopping table
+ * A channel which keeps failing is recalibrated by the automatic calibration of the CC2500 on
+ * the next SRX or STX strobe, its new FSCAL1 is read back on the next hop.
+ * @param[in] idx The hopping table index
+ */
+void frsky_hop(uint8_t idx) {
+	// Fetch the result of the previous recalibration
+	if(frsky_hop_recal >= 0) {
+		uint8_t marc_state = cc_read_register(CC2500_MARCSTATE) & 0x1F;
+		if(marc_state >= CC2500_MARC_RX && marc_state <= CC2500_MARC_TXFIFO_UNDERFLOW) {
+			uint8_t ch = frsky_hop_channels[frsky_hop_recal];
+			frsky_fscal1[frsky_hop_recal] = cc_read_register(CC2500_FSCAL1);
+			cc_hop_init(&frsky_hops[frsky_hop_recal], ch, frsky_fscal1[frsky_hop_recal], frsky_fscal2, frsky_fscal3);
+			frsky_hop_stale &= ~(1ULL << frsky_hop_recal);
+
+			if(ch < sizeof(config.cal_fscal1)) {
+				config.cal_fscal1[ch] = frsky_fscal1[frsky_hop_recal] | FRSKY_CAL_VALID;
+				config_store_item(config.cal_fscal1);
+			}
+		}
+		cc_write_register(CC2500_MCSM0, frsky_hop_mcsm0);
+		frsky_hop_recal = -1;
+	}
+
+	cc_hop(&frsky_hops[idx]);
+
+	// Let the CC2500 calibrate when entering RX or TX
+	if(frsky_hop_stale & (1ULL << idx)) {
+		frsky_hop_mcsm0 = cc_read_register(CC2500_MCSM0);
+		cc_write_register(CC2500_MCSM0, (frsky_hop_mcsm0 & ~CC2500_MCSM0_FS_AUTOCAL_MASK) | CC2500_MCSM0_FS_AUTOCAL_FROM_IDLE);
+		frsky_hop_recal = idx;
+	}
+}
+
+/**
+ * Report whether a packet was received on a channel of the hopping table
+ * After FRSKY_CAL_MISSES missed packets in a row the channel is recalibrated on the next visit.
+ * @param[in] idx The hopping table index
+ * @param[in] received Whether a packet was received
+ */
+void frsky_hop_result(uint8_t idx, bool received) {
+	if(received) {
+		frsky_hop_misses[idx] = 0;
+	}
+	else if(++frsky_hop_misses[idx] >= FRSKY_CAL_MISSES) {
+		frsky_hop_misses[idx] = 0;
+		frsky_hop_stale |= (1ULL << idx);
+	}
 }
 
 /**
@@ -22,12 +22,15 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include "modules/cc2500.h"
 
 /* All times are in microseconds divided by 10 */
 #define FRSKY_RECV_TIME			1100				/**< Time to wait for an FrSky packet */
 #define FRSKY_TLMR_TIME     500					/**< Time to wait for a telemetry message */
 #define FRSKY_SEND_TIME			900					/**< Time between 2 consecutive data packets */ 
 #define FRSKY_TLMS_TIME			350					/**< Time between data and telemetry packet */
+#define FRSKY_PACKET_TIME		457					/**< Air time of a data packet with preamble and sync word */
+#define FRSKY_PACKET_TIME_EU	344					/**< Air time of an EU/LBT data packet with preamble and sync word */
 #define FRSKYX_USED_CHAN		47					/**< Amount of channels used by FrSkyX */
 
 /* General defines */
@@ -39,6 +42,8 @@
 #define FRSKY_TELEM_LENGTH				14		/**< Packet length for FrSky telemetry packets from the receiver */
 #define FRSKY_HOP_TABLE_PKTS			10 		/**< Amount of hopping table packets */
 #define FRSKY_HOP_TABLE_LENGTH		47		/**< Amount of channels used in the hopping table */
+#define FRSKY_CAL_VALID						0x80	/**< Marks a cached FSCAL1 as valid (FSCAL1 is only 6 bits) */
+#define FRSKY_CAL_MISSES					3			/**< Packets missed in a row before a channel is recalibrated */
 
 /* The different FrSky protocols */
 enum frsky_protocol_t {
@@ -52,11 +57,17 @@ enum frsky_protocol_t {
 extern uint8_t frsky_fscal1[FRSKY_HOP_TABLE_LENGTH+1];
 extern uint8_t frsky_fscal2;
 extern uint8_t frsky_fscal3;
+extern struct cc_hop_t frsky_hops[FRSKY_HOP_TABLE_LENGTH];
 
 /* External functions */
 void frsky_set_config(enum frsky_protocol_t protocol);
 void frsky_tune_channel(uint8_t ch);
-void frsky_tune_channels(uint8_t *channels, uint8_t length, uint8_t *fscal1, uint8_t *fscal2, uint8_t *fscal3);
+typedef void (*frsky_on_tuned)(void);
+void frsky_tune_channels(const uint8_t *channels, uint8_t length, frsky_on_tuned done);
+void frsky_tune_abort(void);
+void frsky_init_hops(const uint8_t *channels);
+void frsky_hop(uint8_t idx);
+void frsky_hop_result(uint8_t idx, bool received);
 uint16_t frskyx_crc(const uint8_t *data, uint8_t length);
 
 #endif /* HELPER_FRSKY_H_ */
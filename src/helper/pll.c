@@ -0,0 +1,197 @@
+/*
+ * This file is part of the superbitrf project.
+ *
+ * Copyright (C) 2018 Freek van Tienen <freek.v.tienen@gmail.com>
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "pll.h"
+
+static void pll_start(struct pll_t *pll, uint32_t start);
+static void pll_advance(struct pll_t *pll, int32_t frames, int32_t correction);
+static int32_t pll_frames(const struct pll_t *pll, uint32_t time, int32_t *rem);
+
+/**
+ * Initialize the PLL without a phase
+ * @param[out] *pll The PLL
+ * @param[in] nominal The nominal frame period in microseconds
+ * @param[in] window The maximum phase error in microseconds of a packet which belongs to the transmitter
+ */
+void pll_init(struct pll_t *pll, uint32_t nominal, uint16_t window) {
+	pll->nominal = nominal;
+	pll->period = nominal << 8;
+	pll->window = window;
+	pll_start(pll, 0);
+	pll_unlock(pll);
+}
+
+/**
+ * Update the PLL with the arrival of a packet
+ * The phase error to the closest predicted frame corrects both the phase and the period. While
+ * acquiring the loop tracks fast and once locked it filters out the jitter of the arrival times.
+ * After a longer lock the period is measured over all frames since the phase was started, which
+ * keeps the prediction accurate while the caller is not receiving for a long time.
+ * A packet outside the window restarts the phase while acquiring. Once locked it is ignored, until
+ * PLL_MISS_MAX packets in a row were outside the window and the phase is restarted at the last one.
+ * Only 32 bit math is used, since this runs in the receive interrupt.
+ * @param[in,out] *pll The PLL
+ * @param[in] arrival The arrival time of the packet in microseconds (counter_get_us)
+ * @param[in] offset The offset of the packet from the start of its frame in microseconds
+ * @return Whether the packet was within the window
+ */
+bool pll_update(struct pll_t *pll, uint32_t arrival, uint32_t offset) {
+	uint32_t start = arrival - offset;
+	int32_t max_error = (int32_t)pll->window << 8;
+	int32_t error;
+	uint8_t kp, ki;
+
+	// The first packet only gives the phase
+	if(pll->locked == 0) {
+		pll_start(pll, start);
+		return true;
+	}
+
+	// The phase error to the closest frame
+	int32_t frames = pll_frames(pll, start, &error);
+	if(error > (int32_t)(pll->period >> 1)) {
+		frames++;
+		error -= pll->period;
+	}
+	if(error > max_error || error < -max_error) {
+		bool locked = pll_locked(pll);
+		if(locked && ++pll->misses < PLL_MISS_MAX)
+			return false;
+
+		pll_start(pll, start);
+		return !locked;
+	}
+
+	// Gear shift the loop gains down as the lock gets longer
+	if(pll->locked < PLL_LOCK_CNT) {
+		kp = 1;
+		ki = 3;
+	} else if(pll->locked < 4 * PLL_LOCK_CNT) {
+		kp = 2;
+		ki = 5;
+	} else {
+		kp = 3;
+		ki = 7;
+	}
+
+	// Move the epoch to the frame of the packet and correct the phase and the period
+	pll_advance(pll, frames, error >> kp);
+	if(frames > 0) {
+		int32_t max_dev = (pll->nominal << 8) / (1000000 / PLL_MAX_PPM);
+		int32_t dev;
+		if(pll->span >= PLL_SPAN_MIN) {
+			// The average period over the span as a 32 bit quotient with an 8 bit fraction
+			uint32_t span = start - pll->anchor;
+			uint32_t period = ((span / pll->span) << 8) + ((span % pll->span) << 8) / pll->span;
+			dev = (int32_t)(period - (pll->nominal << 8));
+		}
+		else
+			dev = (int32_t)(pll->period - (pll->nominal << 8)) + ((error / frames) >> ki);
+		if(dev > max_dev)
+			dev = max_dev;
+		else if(dev < -max_dev)
+			dev = -max_dev;
+		pll->period = (pll->nominal << 8) + dev;
+
+		// Start measuring again before the span gets too long for 32 bits
+		if(pll->span >= PLL_SPAN_MAX) {
+			pll->anchor = start;
+			pll->span = 0;
+		}
+	}
+
+	pll->error = error;
+	pll->misses = 0;
+	if(pll->locked < 255)
+		pll->locked++;
+	return true;
+}
+
+/**
+ * Predict the first time after a moment a packet with an offset in the frame arrives
+ * The epoch is moved along, so the PLL keeps working while no packets are received.
+ * @param[in,out] *pll The PLL
+ * @param[in] after The moment in microseconds (counter_get_us)
+ * @param[in] offset The offset of the packet from the start of its frame in microseconds
+ * @return The predicted arrival time in microseconds
+ */
+uint32_t pll_next(struct pll_t *pll, uint32_t after, uint32_t offset) {
+	int32_t rem;
+	int32_t frames = pll_frames(pll, after - offset, &rem) + 1;
+	if(frames > 1) {
+		pll_advance(pll, frames - 1, 0);
+		frames = 1;
+	}
+
+	int32_t frac = frames * (int32_t)(pll->period & 0xFF) + pll->epoch_frac;
+	return pll->epoch + (uint32_t)frames * (pll->period >> 8) + (frac >> 8) + offset;
+}
+
+/**
+ * Start the phase at a frame
+ * @param[out] *pll The PLL
+ * @param[in] start The start of the frame in microseconds
+ */
+static void pll_start(struct pll_t *pll, uint32_t start) {
+	pll->epoch = start;
+	pll->epoch_frac = 0;
+	pll->anchor = start;
+	pll->span = 0;
+	pll->error = 0;
+	pll->locked = 1;
+	pll->misses = 0;
+}
+
+/**
+ * Move the epoch an amount of frames and a correction
+ * The whole and fractional microseconds of the period are stepped separately to stay in 32 bits.
+ * @param[in,out] *pll The PLL
+ * @param[in] frames The amount of frames
+ * @param[in] correction The correction in 1/256 microseconds
+ */
+static void pll_advance(struct pll_t *pll, int32_t frames, int32_t correction) {
+	int32_t frac = frames * (int32_t)(pll->period & 0xFF) + pll->epoch_frac + correction;
+	pll->epoch += (uint32_t)frames * (pll->period >> 8) + (frac >> 8);
+	pll->epoch_frac = frac & 0xFF;
+	pll->span += frames;
+}
+
+/**
+ * The amount of whole frames from the epoch to a time
+ * The frames are first estimated from the whole microseconds of the period. The remainder of
+ * that estimate is small, so it is exact in wrapping 32 bit math and corrects the estimate.
+ * @param[in] *pll The PLL
+ * @param[in] time The time in microseconds
+ * @param[out] *rem The time from the start of the frame in 1/256 microseconds
+ * @return The amount of frames rounded down (negative before the epoch)
+ */
+static int32_t pll_frames(const struct pll_t *pll, uint32_t time, int32_t *rem) {
+	int32_t diff = (int32_t)(time - pll->epoch);
+	int32_t frames = diff / (int32_t)(pll->period >> 8);
+	int32_t r = (int32_t)(((uint32_t)diff << 8) - pll->epoch_frac - (uint32_t)frames * pll->period);
+
+	frames += r / (int32_t)pll->period;
+	r %= (int32_t)pll->period;
+	if(r < 0) {
+		frames--;
+		r += pll->period;
+	}
+	*rem = r;
+	return frames;
+}
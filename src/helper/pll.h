@@ -0,0 +1,77 @@
+/*
+ * This file is part of the superbitrf project.
+ *
+ * Copyright (C) 2018 Freek van Tienen <freek.v.tienen@gmail.com>
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef HELPER_PLL_H_
+#define HELPER_PLL_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define PLL_LOCK_CNT			8				/**< The amount of packets in a row within the window before it is locked */
+#define PLL_SETTLE_CNT		64			/**< The amount of packets in a row within the window before the period is accurate */
+#define PLL_MAX_PPM				2000		/**< The maximum deviation of the period from the nominal period */
+#define PLL_SPAN_MIN			16			/**< The amount of frames since the lock started before the period is measured over them */
+#define PLL_SPAN_MAX			65536		/**< The amount of frames after which the period measurement is started again */
+#define PLL_MISS_MAX			4				/**< The amount of packets in a row outside the window before the lock is lost */
+
+/* Recovers the frame timing of a transmitter from the arrival times of its packets */
+struct pll_t {
+	uint32_t nominal;						/**< The nominal frame period in microseconds */
+	uint32_t period;						/**< The estimated frame period in 1/256 microseconds */
+	uint32_t epoch;							/**< The estimated start of a recent frame in microseconds */
+	uint8_t epoch_frac;					/**< The fraction of the epoch in 1/256 microseconds */
+	uint32_t anchor;						/**< The start of the frame where the period measurement started in microseconds */
+	uint32_t span;							/**< The amount of frames from the anchor to the epoch */
+	uint16_t window;						/**< The maximum phase error of a packet in microseconds */
+	uint8_t locked;							/**< The amount of packets in a row within the window */
+	uint8_t misses;							/**< The amount of packets in a row outside the window while locked */
+	int32_t error;							/**< The phase error of the last packet in 1/256 microseconds */
+};
+
+/* External functions */
+void pll_init(struct pll_t *pll, uint32_t nominal, uint16_t window);
+bool pll_update(struct pll_t *pll, uint32_t arrival, uint32_t offset);
+uint32_t pll_next(struct pll_t *pll, uint32_t after, uint32_t offset);
+
+/**
+ * Whether the timing is recovered well enough to schedule against
+ * @param[in] *pll The PLL
+ */
+static inline bool pll_locked(const struct pll_t *pll) {
+	return pll->locked >= PLL_LOCK_CNT;
+}
+
+/**
+ * Whether the period is measured long enough to schedule against without receiving
+ * @param[in] *pll The PLL
+ */
+static inline bool pll_settled(const struct pll_t *pll) {
+	return pll->locked >= PLL_SETTLE_CNT;
+}
+
+/**
+ * Start acquiring the phase again at the next packet, keeping the estimated period
+ * @param[in] *pll The PLL
+ */
+static inline void pll_unlock(struct pll_t *pll) {
+	pll->locked = 0;
+	pll->misses = 0;
+}
+
+#endif /* HELPER_PLL_H_ */
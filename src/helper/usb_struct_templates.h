@@ -25,7 +25,7 @@
  * The usb device descriptor preset for a misc device with composite
  * functions.
  */
-#define USB_DEVICE_DESCRIPTOR_MISC(DEV_NAME, ID_VENDOR, ID_PRODUCT)			\
+#define USB_DEVICE_DESCRIPTOR_MISC(DEV_NAME, ID_VENDOR, ID_PRODUCT, EP0_SIZE)	\
 static const struct usb_device_descriptor DEV_NAME = {						\
 	.bLength = USB_DT_DEVICE_SIZE,											\
 	.bDescriptorType = USB_DT_DEVICE,										\
@@ -36,7 +36,7 @@ static const struct usb_device_descriptor DEV_NAME = {						\
 	/* ^ Protocol: Together with Class and SubClass results in: 			\
 	 * Interface Association Descriptor.									\
      */																		\
-	.bMaxPacketSize0 = 64,													\
+	.bMaxPacketSize0 = (EP0_SIZE),											\
 	.idVendor = (ID_VENDOR), /*0x0484,*/									\
 	.idProduct = (ID_PRODUCT), /*0x5741,*/									\
 	.bcdDevice = 0x0200,													\
@@ -63,20 +63,20 @@ static const struct usb_endpoint_descriptor EP_NAME[] = {{					\
 	.bInterval = 255,														\
 }}
 
-#define USB_CDCACM_DATA_EP_DESCRIPTOR(EP_NAME, EP_RX_ADDRESS, EP_TX_ADDRESS) \
+#define USB_CDCACM_DATA_EP_DESCRIPTOR(EP_NAME, EP_RX_ADDRESS, EP_TX_ADDRESS, EP_SIZE) \
 static const struct usb_endpoint_descriptor EP_NAME[] = {{					\
 	.bLength = USB_DT_ENDPOINT_SIZE,										\
 	.bDescriptorType = USB_DT_ENDPOINT,										\
 	.bEndpointAddress = (EP_RX_ADDRESS),									\
 	.bmAttributes = USB_ENDPOINT_ATTR_BULK,									\
-	.wMaxPacketSize = 64,													\
+	.wMaxPacketSize = (EP_SIZE),											\
 	.bInterval = 1,															\
 }, {																		\
 	.bLength = USB_DT_ENDPOINT_SIZE,										\
 	.bDescriptorType = USB_DT_ENDPOINT,										\
 	.bEndpointAddress = (EP_TX_ADDRESS),									\
 	.bmAttributes = USB_ENDPOINT_ATTR_BULK,									\
-	.wMaxPacketSize = 64,													\
+	.wMaxPacketSize = (EP_SIZE),											\
 	.bInterval = 1,															\
 }}
 
@@ -1,7 +1,7 @@
 /*
  * This file is part of the superbitrf project.
  *
- * Copyright (C) 2017 Freek van Tienen <freek.v.tienen@gmail.com>
+ * Copyright (C) 2018 Freek van Tienen <freek.v.tienen@gmail.com>
  *
  * This library is free software: you can redistribute it and/or modify
  * it under the terms of the GNU Lesser General Public License as published by
@@ -16,45 +16,73 @@
  * You should have received a copy of the GNU Lesser General Public License
  * along with this library.  If not, see <http://www.gnu.org/licenses/>.
  */
-#include <libopencm3/stm32/rcc.h>
-#include <libopencm3/stm32/gpio.h>
- 
-#include "ant_switch.h"
-#include "board.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "modules/ant_switch.h"
+
+/* A claim of one of the radio chips on the antenna */
+struct ant_switch_claim_t {
+	bool active;								/**< Whether the chip claimed the antenna */
+	bool tx;										/**< Whether the chip needs the antenna for transmitting */
+	bool state[2];							/**< The antenna switcher state for this chip */
+};
+
+static struct ant_switch_claim_t ant_switch_claims[ANT_SWITCH_USER_NB];
+static enum ant_switch_user_t ant_switch_cur = ANT_SWITCH_NONE;	/**< The chip currently connected to the antenna */
+
+static void ant_switch_arbitrate(void);
+
+/**
+ * Claim the antenna for one of the radio chips
+ * A transmitting chip always wins the antenna, else the current owner keeps it.
+ * @param[in] user The radio chip claiming the antenna
+ * @param[in] state The antenna switcher state for this chip
+ * @param[in] tx Whether the chip is going to transmit
+ */
+void ant_switch_claim(enum ant_switch_user_t user, bool *state, bool tx) {
+	ant_switch_claims[user].active = true;
+	ant_switch_claims[user].tx = tx;
+	ant_switch_claims[user].state[0] = state[0];
+	ant_switch_claims[user].state[1] = state[1];
+	ant_switch_arbitrate();
+}
+
+/**
+ * Release the antenna claim of a radio chip
+ * @param[in] user The radio chip releasing the antenna
+ */
+void ant_switch_release(enum ant_switch_user_t user) {
+	ant_switch_claims[user].active = false;
+	if(ant_switch_cur == user)
+		ant_switch_cur = ANT_SWITCH_NONE;
+	ant_switch_arbitrate();
+}
 
 /**
- * Initialize the antenna switcher
+ * Get the radio chip currently connected to the antenna
  */
-void ant_switch_init(void) {
-#ifdef ANTENNA_SW1_PORT
-	rcc_periph_clock_enable(ANTENNA_SW1_CLK);
-	gpio_set_mode(ANTENNA_SW1_PORT, GPIO_MODE_OUTPUT_50_MHZ, GPIO_CNF_OUTPUT_PUSHPULL, ANTENNA_SW1_PIN);
-	gpio_clear(ANTENNA_SW1_PORT, ANTENNA_SW1_PIN);
-#endif
-
-#ifdef ANTENNA_SW2_PORT
-	rcc_periph_clock_enable(ANTENNA_SW2_CLK);
-	gpio_set_mode(ANTENNA_SW2_PORT, GPIO_MODE_OUTPUT_50_MHZ, GPIO_CNF_OUTPUT_PUSHPULL, ANTENNA_SW2_PIN);
-	gpio_clear(ANTENNA_SW2_PORT, ANTENNA_SW2_PIN);
-#endif
+enum ant_switch_user_t ant_switch_owner(void) {
+	return ant_switch_cur;
 }
 
 /**
- * Set the antenna switching pins
+ * Give the antenna to the claim with the highest priority
  */
-void ant_switch(bool *state) {
-	(void) state;
-#ifdef ANTENNA_SW1_PORT
-	if(state[0])
-		gpio_set(ANTENNA_SW1_PORT, ANTENNA_SW1_PIN);
-	else
-		gpio_clear(ANTENNA_SW1_PORT, ANTENNA_SW1_PIN);
-#endif
-
-#ifdef ANTENNA_SW2_PORT
-	if(state[1])
-		gpio_set(ANTENNA_SW2_PORT, ANTENNA_SW2_PIN);
-	else
-		gpio_clear(ANTENNA_SW2_PORT, ANTENNA_SW2_PIN);
-#endif
-}
\ No newline at end of file
+static void ant_switch_arbitrate(void) {
+	enum ant_switch_user_t best = ant_switch_cur;
+	uint8_t i;
+
+	for(i = 0; i < ANT_SWITCH_USER_NB; i++) {
+		if(!ant_switch_claims[i].active)
+			continue;
+		if(best == ANT_SWITCH_NONE || (ant_switch_claims[i].tx && !ant_switch_claims[best].tx))
+			best = i;
+	}
+
+	// Always write the pins, the owner could have changed its state
+	ant_switch_cur = best;
+	if(best != ANT_SWITCH_NONE)
+		ant_switch(ant_switch_claims[best].state);
+}
@@ -22,8 +22,21 @@
 
 #include <stdbool.h>
 
+/* The radio chips sharing the antenna */
+enum ant_switch_user_t {
+	ANT_SWITCH_CYRF = 0,				/**< The CYRF6936 chip */
+	ANT_SWITCH_CC,							/**< The CC2500 chip */
+	ANT_SWITCH_USER_NB,					/**< The amount of antenna users */
+	ANT_SWITCH_NONE = ANT_SWITCH_USER_NB	/**< Nobody claimed the antenna */
+};
+
 /* External functions for the antenna swither */
 void ant_switch_init(void);
 void ant_switch(bool *state);
 
+/* Arbitration of the antenna between the radio chips */
+void ant_switch_claim(enum ant_switch_user_t user, bool *state, bool tx);
+void ant_switch_release(enum ant_switch_user_t user);
+enum ant_switch_user_t ant_switch_owner(void);
+
 #endif /* MODULES_ANT_SWITCH_H_ */
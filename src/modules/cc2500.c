@@ -18,26 +18,57 @@
  */
 
 #include <unistd.h>
-#include <libopencm3/cm3/cortex.h>
-#include <libopencm3/stm32/gpio.h>
+#include <stddef.h>
+#include <string.h>
 
 #include "cc2500.h"
+#include "modules/mcu.h"
 #include "modules/counter.h"
 #include "modules/config.h"
 #include "modules/spi.h"
+#include "modules/prof.h"
+#include "modules/trace.h"
 
 /* The CC2500 receive and send callbacks */
 cc_on_event _cc_recv_callback = NULL;
 cc_on_event _cc_send_callback = NULL;
 
+/* The GDO pin connected to the interrupt line, the other GDO pins control the PA/LNA */
+#ifndef CC_DEV_IRQ_IOCFG
+#define CC_DEV_IRQ_IOCFG CC2500_IOCFG0
+#endif
+
 /* The pin for selecting the device */
-#define CC_CS_HI() gpio_set(CC_DEV_SS_PORT, CC_DEV_SS_PIN)
-#define CC_CS_LO() gpio_clear(CC_DEV_SS_PORT, CC_DEV_SS_PIN)
+#define CC_CS_HI() spi_dev_deselect(SPI_DEV_CC)
+#define CC_CS_LO() spi_dev_select(SPI_DEV_CC)
+
+/* The maximum time of a calibration in milliseconds, it normally takes ~0.8ms */
+#define CC_CALIBRATE_TIMEOUT 5
 
 /* Internal functions and settings */
-static void cc_process(void);
+static void cc_process(uint32_t time);
+static void cc_write_data_done(enum spi_dev_t dev);
+static void cc_irq(enum spi_dev_t dev);
+static void cc_set_gdo(uint8_t iocfg, uint8_t cfg);
+static bool cc_shadow_match(const uint8_t address, const uint8_t data[], const int length);
+static void cc_shadow_set(const uint8_t address, const uint8_t data[], const int length);
+
+/* The configuration registers and the first PATABLE entry, which only change when written */
+#define CC_SHADOW_MASK ((1ULL << (CC2500_TEST0 + 1)) - 1 + (1ULL << CC2500_PATABLE))
+/* The registers the chip overwrites when it calibrates */
+#define CC_SHADOW_FSCAL ((1ULL << CC2500_FSCAL3) | (1ULL << CC2500_FSCAL2) | (1ULL << CC2500_FSCAL1))
+static bool cc_irq_enabled = false;		/**< A GDO pin is connected to an interrupt */
 static uint8_t cc_tx_bytes = 0;
 static uint8_t cc_status = 0x0;
+static uint8_t cc_tx_buf[64];					/**< The TX FIFO data which is written with DMA */
+static uint32_t cc_rx_time = 0;				/**< The time in microseconds of the last received packet */
+static enum cc2500_busy_t cc_busy = CC2500_BUSY_NONE;	/**< The operation running in the background */
+static uint32_t cc_busy_ticks = 0;		/**< The start of the background operation in ticks */
+static bool cc_reset_irq = false;			/**< Whether the interrupt was enabled before the reset */
+static cc_on_ready cc_reset_callback = NULL;					/**< Called when the reset is done */
+static cc_on_calibrated cc_calibrate_callback = NULL;	/**< Called when the calibration is done */
+static uint8_t cc_shadow[0x40];												/**< The last values written to the registers */
+static uint64_t cc_shadow_valid = 0;									/**< The registers of which the shadow equals the chip (bitmask) */
 
 /**
  * Initialize the CC2500
@@ -45,26 +76,49 @@ static uint8_t cc_status = 0x0;
 void cc_init(void) {
 	DEBUG(cc, "Initializing");
 
-	/* Initialize the GPIO */
-	gpio_set_mode(CC_DEV_SS_PORT, GPIO_MODE_OUTPUT_50_MHZ, GPIO_CNF_OUTPUT_PUSHPULL, CC_DEV_SS_PIN);
+	/* Initialize the chip select GPIO */
+	spi_dev_init(SPI_DEV_CC);
+
+	/* Handle the packets on the GDO interrupt if it is connected */
+	cc_irq_enabled = spi_dev_irq_init(SPI_DEV_CC, cc_irq);
 
-	/* Also a software reset */
-	cc_reset();
+	/* Also a software reset, this finishes in the background */
+	cc_reset_start(NULL);
 	DEBUG(cc, "Initializing done");
 }
 
 /**
- * Poll the status registers to check if packet is end/received
+ * Continue the background operations and poll the status registers to check if packet is end/received
  */
 void cc_run(void) {
-	cc_process();
+	if(!cc_poll())
+		return;
+
+	if(!cc_irq_enabled) {
+		PROF_START(start);
+		cc_process(counter_get_us());
+		PROF_END(PROF_CC_IRQ, start);
+	}
+}
+
+/**
+ * The GDO interrupt at the end of a received or sent packet
+ */
+static void cc_irq(enum spi_dev_t dev __attribute__((unused))) {
+	if(cc_irq_enabled) {
+		PROF_START(start);
+		cc_process(counter_get_us());
+		PROF_END(PROF_CC_IRQ, start);
+	}
 }
 
 /**
  * Process the CC2500 requests
  * We assume variable packet length mode and appended status, which means 3 extra bytes
+ * @param[in] time The time in microseconds of the end of packet interrupt, or
+ * of the poll when the GDO pin is not connected
  */
-static void cc_process(void) {
+static void cc_process(uint32_t time) {
 	cc_handle_overflows();
 
 	/* Handle RX callback */
@@ -72,6 +126,8 @@ static void cc_process(void) {
 	if(len && len != 1) {
 		uint8_t len2 = cc_read_register(CC2500_RXBYTES) & 0x7F;
 		if(len == len2 && _cc_recv_callback != NULL) {
+			cc_rx_time = time;
+			trace_add(TRACE_RX, TRACE_CHIP_CC, len);
 			_cc_recv_callback(len);
 		}
 	}
@@ -83,6 +139,7 @@ static void cc_process(void) {
 			txlen = cc_read_register(CC2500_TXBYTES) & 0x7F;
 			if(txlen == 0) {
 				cc_tx_bytes = 0;
+				trace_add(TRACE_TX_DONE, TRACE_CHIP_CC, 0);
 				_cc_send_callback(0);
 			}
 		}
@@ -97,6 +154,14 @@ void cc_register_recv_callback(cc_on_event callback) {
 	_cc_recv_callback = callback;
 }
 
+/**
+ * Get the time of the packet being received
+ * @return The time in microseconds of the end of packet interrupt
+ */
+uint32_t cc_get_rx_time(void) {
+	return cc_rx_time;
+}
+
 /**
  * Register the send callback
  * @param[in] callback The callback when it receives an interrupt for send
@@ -111,12 +176,19 @@ void cc_register_send_callback(cc_on_event callback) {
  * @param[in] data The one byte data that needs to be written to the address
  */
 void cc_write_register(const uint8_t address, const uint8_t data) {
-	cm_disable_interrupts();
-	CC_CS_LO();
-	spi_xfer(CC_DEV_SPI, address);
-	spi_xfer(CC_DEV_SPI, data);
-	CC_CS_HI();
-	cm_enable_interrupts();
+	uint32_t irq = mcu_irq_save();
+	// Skip writing configuration which is already in the chip
+	if(!cc_shadow_match(address, &data, 1)) {
+		CC_CS_LO();
+		spi_dev_xfer(SPI_DEV_CC, address);
+		spi_dev_xfer(SPI_DEV_CC, data);
+		CC_CS_HI();
+		cc_shadow_set(address, &data, 1);
+	}
+	mcu_irq_restore(irq);
+
+	if(address == CC2500_CHANNR)
+		trace_add(TRACE_HOP, TRACE_CHIP_CC, data);
 }
 
 /**
@@ -126,16 +198,56 @@ void cc_write_register(const uint8_t address, const uint8_t data) {
  * @param[in] length The length in bytes of the data that needs to be written
  */
 void cc_write_block(const uint8_t address, const uint8_t data[], const int length) {
-	int i;
-	cm_disable_interrupts();
-	CC_CS_LO();
-	cc_status = spi_xfer(CC_DEV_SPI, CC2500_WRITE_BURST | address);
+	cc_status = spi_dev_transfer(SPI_DEV_CC, CC2500_WRITE_BURST | address, data, NULL, length, NULL);
+
+	// A PATABLE burst fills more entries than are shadowed
+	if(address == CC2500_PATABLE)
+		cc_shadow_valid &= ~(1ULL << CC2500_PATABLE);
+	else
+		cc_shadow_set(address, data, length);
+}
 
-	for (i = 0; i < length; i++)
-		spi_xfer(CC_DEV_SPI, data[i]);
+/**
+ * Forget the register values which are known to be in the chip, so the next writes go through
+ */
+void cc_shadow_invalidate(void) {
+	cc_shadow_valid = 0;
+}
 
-	CC_CS_HI();
-	cm_enable_interrupts();
+/**
+ * Check if registers are known to already hold the data
+ * @param[in] address The first register
+ * @param[in] data The data for the consecutive registers
+ * @param[in] length The amount of registers
+ */
+static bool cc_shadow_match(const uint8_t address, const uint8_t data[], const int length) {
+	for(int i = 0; i < length; i++) {
+		uint8_t reg = (address + i) & 0x3F;
+		if(!((CC_SHADOW_MASK & cc_shadow_valid) & (1ULL << reg)) || cc_shadow[reg] != data[i])
+			return false;
+	}
+	return true;
+}
+
+/**
+ * Remember the data written to consecutive registers
+ * The calibration registers are only remembered while MCSM0 is known to disable the automatic calibration.
+ * @param[in] address The first register
+ * @param[in] data The data written to the consecutive registers
+ * @param[in] length The amount of registers
+ */
+static void cc_shadow_set(const uint8_t address, const uint8_t data[], const int length) {
+	for(int i = 0; i < length; i++) {
+		uint8_t reg = (address + i) & 0x3F;
+		cc_shadow[reg] = data[i];
+		cc_shadow_valid |= (1ULL << reg);
+
+		if(reg == CC2500_MCSM0 && (data[i] & CC2500_MCSM0_FS_AUTOCAL_MASK))
+			cc_shadow_valid &= ~CC_SHADOW_FSCAL;
+	}
+
+	if(!(cc_shadow_valid & (1ULL << CC2500_MCSM0)) || (cc_shadow[CC2500_MCSM0] & CC2500_MCSM0_FS_AUTOCAL_MASK))
+		cc_shadow_valid &= ~CC_SHADOW_FSCAL;
 }
 
 /**
@@ -145,12 +257,12 @@ void cc_write_block(const uint8_t address, const uint8_t data[], const int lengt
  */
 uint8_t cc_read_register(const uint8_t address) {
 	uint8_t data;
-	cm_disable_interrupts();
+	uint32_t irq = mcu_irq_save();
 	CC_CS_LO();
-	cc_status = spi_xfer(CC_DEV_SPI, CC2500_READ_SINGLE | address);
-	data = spi_xfer(CC_DEV_SPI, 0);
+	cc_status = spi_dev_xfer(SPI_DEV_CC, CC2500_READ_SINGLE | address);
+	data = spi_dev_xfer(SPI_DEV_CC, 0);
 	CC_CS_HI();
-	cm_enable_interrupts();
+	mcu_irq_restore(irq);
 	return data;
 }
 
@@ -161,26 +273,103 @@ uint8_t cc_read_register(const uint8_t address) {
  * @param[in] length The length in bytes what needs to be read
  */
 void cc_read_block(const uint8_t address, uint8_t data[], const int length) {
-	int i;
-	cm_disable_interrupts();
-	CC_CS_LO();
-	cc_status = spi_xfer(CC_DEV_SPI, CC2500_READ_BURST | address);
+	cc_status = spi_dev_transfer(SPI_DEV_CC, CC2500_READ_BURST | address, NULL, data, length, NULL);
+}
+
+/**
+ * Start a software reset of the CC2500, cc_run finishes it after 1ms
+ * @param[in] callback Called from the main loop with whether the reset was successful (can be NULL)
+ */
+void cc_reset_start(cc_on_ready callback) {
+	// The GDO pins output a clock until they are configured again, which are no packets
+	if(cc_busy != CC2500_BUSY_RESET)
+		cc_reset_irq = cc_irq_enabled;
+	cc_irq_enabled = false;
+
+	cc_reset_callback = callback;
+	cc_busy_ticks = counter_get_ticks();
+	cc_busy = CC2500_BUSY_RESET;
+	cc_strobe(CC2500_SRES);
+}
 
-	for (i = 0; i < length; i++)
-		data[i] = spi_xfer(CC_DEV_SPI, 0);
+/**
+ * Start calibrating the frequency synthesizer on a channel, cc_run finishes it
+ * @param[in] channel The channel to calibrate
+ * @param[in] callback Called from the main loop with the resulting FSCAL1 (can be NULL), the
+ *                     calibration failed when the chip did not return to IDLE within CC_CALIBRATE_TIMEOUT
+ */
+void cc_calibrate_start(uint8_t channel, cc_on_calibrated callback) {
+	cc_strobe(CC2500_SIDLE);
+	cc_write_register(CC2500_CHANNR, channel);
+	cc_strobe(CC2500_SCAL);
+
+	cc_calibrate_callback = callback;
+	cc_busy_ticks = counter_get_ticks();
+	cc_busy = CC2500_BUSY_CALIBRATE;
+}
 
-	CC_CS_HI();
-	cm_enable_interrupts();
+/**
+ * Continue the reset or calibration running in the background
+ * @return Whether the CC2500 is ready
+ */
+bool cc_poll(void) {
+	bool done;
+
+	switch(cc_busy) {
+		case CC2500_BUSY_RESET:
+			if(counter_get_ticks() - cc_busy_ticks < counter_get_ticks_of_ms(1))
+				return false;
+
+			cc_busy = CC2500_BUSY_NONE;
+			cc_irq_enabled = cc_reset_irq;
+			cc_set_mode(CC2500_TXRX_OFF);
+			if(cc_reset_callback != NULL)
+				cc_reset_callback(cc_read_register(CC2500_FREQ1) == 0xC4);
+			break;
+
+		case CC2500_BUSY_CALIBRATE:
+			done = (cc_read_register(CC2500_MARCSTATE) & 0x1F) == CC2500_MARC_IDLE;
+			if(!done && counter_get_ticks() - cc_busy_ticks < counter_get_ticks_of_ms(CC_CALIBRATE_TIMEOUT))
+				return false;
+
+			// A chip which does not return to IDLE (brown-out, SPI glitch or missing) fails the calibration
+			cc_busy = CC2500_BUSY_NONE;
+			if(!done) {
+				DEBUG(cc, "Calibration timeout");
+				cc_strobe(CC2500_SIDLE);
+			}
+			if(cc_calibrate_callback != NULL)
+				cc_calibrate_callback(done, cc_read_register(CC2500_FSCAL1));
+			break;
+
+		default:
+			break;
+	}
+
+	return (cc_busy == CC2500_BUSY_NONE);
+}
+
+/**
+ * Whether the CC2500 has no reset or calibration running
+ */
+bool cc_is_ready(void) {
+	return (cc_busy == CC2500_BUSY_NONE);
 }
 
 /**
- * Reset the CC2500 chip
+ * Wait for the reset or calibration running in the background
+ */
+void cc_wait_ready(void) {
+	while(!cc_poll());
+}
+
+/**
+ * Reset the CC2500 chip and wait for it
  * @return Wheter it was reset succesfull
  */
 bool cc_reset(void) {
-	cc_strobe(CC2500_SRES);
-	counter_wait_poll(counter_get_ticks_of_ms(1));
-	cc_set_mode(CC2500_TXRX_OFF);
+	cc_reset_start(NULL);
+	cc_wait_ready();
 
 	return cc_read_register(CC2500_FREQ1) == 0xC4;
 }
@@ -200,11 +389,18 @@ void cc_get_mfg_id(uint8_t *mfg_id) {
  * @param[in] cmd The command to execute
  */
 void cc_strobe(uint8_t cmd) {
-	cm_disable_interrupts();
+	uint32_t irq = mcu_irq_save();
 	CC_CS_LO();
-  cc_status = spi_xfer(CC_DEV_SPI, cmd);
+  cc_status = spi_dev_xfer(SPI_DEV_CC, cmd);
 	CC_CS_HI();
-	cm_enable_interrupts();
+	if(cmd == CC2500_SRES)
+		cc_shadow_valid = 0;
+	else if(cmd == CC2500_SCAL)
+		cc_shadow_valid &= ~CC_SHADOW_FSCAL;
+	mcu_irq_restore(irq);
+
+	if(cmd == CC2500_SRX)
+		trace_add(TRACE_RX_START, TRACE_CHIP_CC, 0);
 }
 
 /**
@@ -213,10 +409,22 @@ void cc_strobe(uint8_t cmd) {
  * @param[in] length The packet length
  */
 void cc_write_data(uint8_t *packet, uint8_t length) {
+	uint8_t len = (length > sizeof(cc_tx_buf))? sizeof(cc_tx_buf) : length;
 	cc_strobe(CC2500_SFTX);
-	cc_write_block(CC2500_TXFIFO, packet, length);
-	cc_tx_bytes = length;
-	cc_strobe(CC2500_STX);
+
+	// Fill the TX FIFO with DMA and start sending when it is done
+	spi_dev_wait(SPI_DEV_CC);
+	memcpy(cc_tx_buf, packet, len);
+	cc_tx_bytes = len;
+	cc_status = spi_dev_transfer(SPI_DEV_CC, CC2500_WRITE_BURST | CC2500_TXFIFO, cc_tx_buf, NULL, len, cc_write_data_done);
+	trace_add(TRACE_TX, TRACE_CHIP_CC, len);
+}
+
+/**
+ * Start sending when the TX FIFO is filled (can be called from the DMA interrupt)
+ */
+static void cc_write_data_done(enum spi_dev_t dev) {
+	cc_status = spi_dev_transfer(dev, CC2500_STX, NULL, NULL, 0, NULL);
 }
 
 /**
@@ -234,17 +442,28 @@ void cc_read_data(uint8_t *packet, uint8_t length) {
  */
 void cc_set_mode(enum cc2500_mode_t mode) {
 	if(mode == CC2500_TXRX_TX) {
-		cc_write_register(CC2500_IOCFG2, 0x2F);
-		cc_write_register(CC2500_IOCFG0, 0x2F | 0x40);
+		cc_set_gdo(CC2500_IOCFG2, 0x2F);
+		cc_set_gdo(CC2500_IOCFG0, 0x2F | 0x40);
 	} else if (mode == CC2500_TXRX_RX) {
-		cc_write_register(CC2500_IOCFG0, 0x2F);
-		cc_write_register(CC2500_IOCFG2, 0x2F | 0x40);
+		cc_set_gdo(CC2500_IOCFG0, 0x2F);
+		cc_set_gdo(CC2500_IOCFG2, 0x2F | 0x40);
 	} else {
-		cc_write_register(CC2500_IOCFG0, 0x2F);
-		cc_write_register(CC2500_IOCFG2, 0x2F);
+		cc_set_gdo(CC2500_IOCFG0, 0x2F);
+		cc_set_gdo(CC2500_IOCFG2, 0x2F);
 	}
 }
 
+/**
+ * Configure a GDO pin, the pin connected to the interrupt keeps signalling the packets
+ * @param[in] iocfg The IOCFG register of the pin
+ * @param[in] cfg The pin configuration
+ */
+static void cc_set_gdo(uint8_t iocfg, uint8_t cfg) {
+	if(cc_irq_enabled && iocfg == CC_DEV_IRQ_IOCFG)
+		cfg = CC2500_IOCFG_SYNC_WORD;
+	cc_write_register(iocfg, cfg);
+}
+
 /**
  * Set the output power of the chip
  * @param[in] power The ouput power to set
@@ -276,4 +495,48 @@ void cc_handle_overflows(void) {
         cc_strobe(CC2500_SFRX);
     else if (marc_state == 0x16)
         cc_strobe(CC2500_SFTX);
-}
\ No newline at end of file
+}
+
+/**
+ * Precompile a channel hop into a single SPI transaction
+ * The strobe and the single write are both followed by a new header, FSCAL3 to FSCAL1 are
+ * consecutive registers and written with one burst. The short sequence only writes FSCAL1, for
+ * when FSCAL3 and FSCAL2 are already in the chip.
+ * @param[out] *hop The hop descriptor to fill
+ * @param[in] channel The channel number
+ * @param[in] fscal1 The FSCAL1 calibration value of the channel
+ * @param[in] fscal2 The FSCAL2 calibration value
+ * @param[in] fscal3 The FSCAL3 calibration value
+ */
+void cc_hop_init(struct cc_hop_t *hop, uint8_t channel, uint8_t fscal1, uint8_t fscal2, uint8_t fscal3) {
+	hop->seq[0] = CC2500_SIDLE;
+	hop->seq[1] = CC2500_WRITE_SINGLE | CC2500_CHANNR;
+	hop->seq[2] = channel;
+	hop->seq[3] = CC2500_WRITE_BURST | CC2500_FSCAL3;
+	hop->seq[4] = fscal3;
+	hop->seq[5] = fscal2;
+	hop->seq[6] = fscal1;
+
+	hop->seq_short[0] = CC2500_SIDLE;
+	hop->seq_short[1] = CC2500_WRITE_SINGLE | CC2500_CHANNR;
+	hop->seq_short[2] = channel;
+	hop->seq_short[3] = CC2500_WRITE_SINGLE | CC2500_FSCAL1;
+	hop->seq_short[4] = fscal1;
+}
+
+/**
+ * Go to idle and hop to a new channel with a precompiled hop descriptor
+ * @param[in] *hop The hop descriptor
+ */
+void cc_hop(const struct cc_hop_t *hop) {
+	if(cc_shadow_match(CC2500_FSCAL3, &hop->seq[4], 2)) {
+		cc_status = spi_dev_transfer(SPI_DEV_CC, hop->seq_short[0], &hop->seq_short[1], NULL, CC_HOP_SHORT_LEN-1, NULL);
+		cc_shadow_set(CC2500_CHANNR, &hop->seq_short[2], 1);
+		cc_shadow_set(CC2500_FSCAL1, &hop->seq_short[4], 1);
+	} else {
+		cc_status = spi_dev_transfer(SPI_DEV_CC, hop->seq[0], &hop->seq[1], NULL, CC_HOP_LEN-1, NULL);
+		cc_shadow_set(CC2500_CHANNR, &hop->seq[2], 1);
+		cc_shadow_set(CC2500_FSCAL3, &hop->seq[4], 3);
+	}
+	trace_add(TRACE_HOP, TRACE_CHIP_CC, hop->seq[2]);
+}
@@ -20,6 +20,9 @@
 #ifndef MODULES_CC2500_H_
 #define MODULES_CC2500_H_
 
+#include <stdint.h>
+#include <stdbool.h>
+
 // Include the board specifications for the CC2500 defines
 #include "board.h"
 
@@ -155,19 +158,55 @@ enum {
 #define CC2500_PKTCTRL1_APPEND_STATUS     (1<<2)
 #define CC2500_PKTCTRL1_CRC_AUTOFLUSH     (1<<3)
 
+// automatic calibration
+#define CC2500_MCSM0_FS_AUTOCAL_MASK      (3<<4)
+#define CC2500_MCSM0_FS_AUTOCAL_FROM_IDLE (1<<4)
+
+// MARCSTATE values, the RX and TX states (after calibration) are in between these
+#define CC2500_MARC_IDLE                  0x01
+#define CC2500_MARC_RX                    0x0D
+#define CC2500_MARC_TXFIFO_UNDERFLOW      0x16
+
+// GDOx output configurations
+#define CC2500_IOCFG_SYNC_WORD            0x06      // Asserts on the sync word, de-asserts at the end of the packet
+
+/* A precompiled channel hop, SIDLE + CHANNR + burst FSCAL3..FSCAL1 in one transaction */
+#define CC_HOP_LEN                        7
+#define CC_HOP_SHORT_LEN                  5
+struct cc_hop_t {
+	uint8_t seq[CC_HOP_LEN];               /**< The raw SPI bytes of the hop sequence */
+	uint8_t seq_short[CC_HOP_SHORT_LEN];   /**< SIDLE + CHANNR + FSCAL1, when FSCAL3 and FSCAL2 are already in the chip */
+};
+
 enum cc2500_mode_t {
     CC2500_TXRX_OFF = 0,
     CC2500_TXRX_TX,
     CC2500_TXRX_RX
 };
 
+/* The background operations of the CC2500 */
+enum cc2500_busy_t {
+    CC2500_BUSY_NONE = 0,                   // Ready
+    CC2500_BUSY_RESET,                      // Waiting for the software reset
+    CC2500_BUSY_CALIBRATE                   // Calibrating the frequency synthesizer
+};
+
 /* External functions and variables */
 void cc_init(void);
 void cc_run(void);
 
+typedef void (*cc_on_ready)(bool success);
+typedef void (*cc_on_calibrated)(bool success, uint8_t fscal1);
+void cc_reset_start(cc_on_ready callback);
+void cc_calibrate_start(uint8_t channel, cc_on_calibrated callback);
+bool cc_poll(void);
+bool cc_is_ready(void);
+void cc_wait_ready(void);
+
 typedef void (*cc_on_event)(uint8_t len);
 void cc_register_recv_callback(cc_on_event callback);
 void cc_register_send_callback(cc_on_event callback);
+uint32_t cc_get_rx_time(void);
 
 void cc_write_register(const uint8_t address, const uint8_t data);
 void cc_write_block(const uint8_t address, const uint8_t data[], const int length);
@@ -182,5 +221,8 @@ void cc_read_data(uint8_t *packet, uint8_t length);
 void cc_set_mode(enum cc2500_mode_t mode);
 void cc_set_power(uint8_t power);
 void cc_handle_overflows(void);
+void cc_hop_init(struct cc_hop_t *hop, uint8_t channel, uint8_t fscal1, uint8_t fscal2, uint8_t fscal3);
+void cc_hop(const struct cc_hop_t *hop);
+void cc_shadow_invalidate(void);
 
 #endif /* MODULES_CC2500_H_ */
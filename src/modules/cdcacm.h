@@ -20,18 +20,37 @@
 #ifndef MODULES_CDCACM_H_
 #define MODULES_CDCACM_H_
 
+#include <stdint.h>
+#include <stdbool.h>
+
 // Include the board specifications for the USB define
 #include "board.h"
 
-extern struct ring cdcacm_data_tx;
-extern struct ring cdcacm_data_rx;
-extern struct ring cdcacm_console_tx;
-extern struct ring cdcacm_console_rx;
+/* Vendor specific raw packet interface next to the CDC ACM ports. Once the host
+ * enables streaming with the CDCACM_VENDOR_REQ_STREAM control request (wValue 1
+ * on, 0 off) radio packets are sent over its bulk IN endpoint as a stream of
+ * frames: a little endian uint16 length of the rest of the frame, the chip id,
+ * the little endian uint32 receive time in microseconds and the packet. Frames
+ * span as many bulk packets as they need. */
+#define CDCACM_VENDOR_IFACE				5				/**< The interface number of the raw packet interface */
+#define CDCACM_VENDOR_EP					0x85		/**< The bulk IN endpoint of the raw packet interface */
+#define CDCACM_VENDOR_REQ_STREAM	0x01		/**< Vendor request to enable or disable the packet stream */
+#define CDCACM_VENDOR_HDR_LEN			7				/**< The length of a frame header */
+
+extern struct fifo_t cdcacm_data_tx;
+extern struct fifo_t cdcacm_data_rx;
+extern struct fifo_t cdcacm_console_tx;
+extern struct fifo_t cdcacm_console_rx;
+extern struct fifo_t cdcacm_vendor_tx;
+extern volatile bool cdcacm_vendor_streaming;
+extern uint32_t cdcacm_vendor_dropped;
 
 typedef void (*cdcacm_receive_callback) (char *data, int size);
 
 void cdcacm_init(void);
 void cdcacm_register_receive_callback(cdcacm_receive_callback callback);
 void cdcacm_run(void);
+void cdcacm_vendor_init(void);
+bool cdcacm_vendor_send(uint8_t chip_id, uint32_t rx_time, const uint8_t *data, uint16_t len);
 
 #endif /* MODULES_CDCACM_H_ */
@@ -20,11 +20,13 @@
 
 #include <stdio.h>
 #include <string.h>
-#include <libopencm3/stm32/flash.h>
+#include <strings.h>
 
 #include "config.h"
+#include "modules/mcu.h"
 #include "modules/console.h"
 #include "modules/cdcacm.h"
+#include "modules/protocol.h"
 #include "helper/crc.h"
 
 /* console commands */
@@ -37,10 +39,21 @@ static void config_cmd_reset(char *cmdLine);
 
 /* We are assuming we are using the STM32F103TBU6.
  * Flash: 128 * 1kb pages
- * We want to store the config in the last flash sector.
+ * The config is stored as a log of records in the last flash pages. Every record holds one
+ * config item and is appended behind the previous ones, so a save only programs the items
+ * which changed. When the active page is full the latest values are compacted into the next
+ * page and the old page is erased once no protocol is running anymore.
+ *
+ * Page:   [seq:16] [magic:16] [record] [record] ... [0xFFFF]
+ * Record: [key:8] [len:8] [data:len] (padded to half words) [crc:16]
  */
-#define CONFIG_ADDR 0x0801FC00
-#define CONFIG_SEED 0x1221					 //*< The config CRC seed */
+#define CONFIG_PAGE_SIZE		1024				/**< The size of one flash page */
+#define CONFIG_PAGE_CNT			2						/**< The amount of pages used for the config log */
+#define CONFIG_ADDR					(0x08020000 - CONFIG_PAGE_CNT * CONFIG_PAGE_SIZE)	/**< Kept out of the rom region in stm32f103cbt6.ld */
+#define CONFIG_SEED					0x1221			/**< The config CRC seed */
+#define CONFIG_MAGIC				0xC0F1			/**< Marks a completely written page header */
+#define CONFIG_HDR_SIZE			4						/**< The size of the page header */
+#define CONFIG_WRITE_BURST	4						/**< Half words programmed per run while idle (~50us each) */
 
 /* Default configuration settings.
  * The version allways needs to be at the first place
@@ -62,6 +75,36 @@ static struct config_link_t config_links[] = {
 #undef CONFIG_ARRAY
 static uint16_t config_links_cnt = sizeof(config_links) / sizeof(config_links[0]);
 
+static float config_version;									/**< The version of the default configuration */
+
+/* The state of the config log in flash */
+static struct config_t config_flash;					/**< The config values as they are stored in flash */
+static bool config_dirty[sizeof(config_links) / sizeof(config_links[0])];	/**< Items which still need to be written */
+static uint8_t config_page;										/**< The active page */
+static uint16_t config_seq;										/**< The sequence number of the active page */
+static uint16_t config_offset;								/**< The next free offset in the active page */
+static uint8_t config_erase;									/**< Pages which need to be erased (bitmask) */
+static int16_t config_compact_idx = -1;				/**< The next item to compact or -1 when not compacting */
+static uint16_t config_compact_offset;				/**< The next free offset in the compaction page */
+
+/* The record which is currently being programmed */
+static struct {
+	uint16_t data[(sizeof(struct config_t) + 5) / 2];	/**< The half words of the record */
+	uint16_t len;																			/**< The amount of half words */
+	uint16_t pos;																			/**< The amount of half words already programmed */
+	uint32_t addr;																		/**< The flash address of the record */
+	int16_t key;																			/**< The item which gets written or -1 */
+} config_wr;
+
+/* Internal functions */
+static uint32_t config_page_addr(uint8_t page);
+static bool config_page_blank(uint8_t page);
+static uint16_t config_record_size(uint16_t key);
+static bool config_scan(struct config_t *cfg, uint8_t *page, uint16_t *seq, uint16_t *offset);
+static void config_write_record(uint32_t addr, uint16_t key, const uint8_t *value);
+static void config_write_header(uint32_t addr, uint16_t seq);
+static void config_format(void);
+
 /**
  * Initializes the configuration
  * When the version of the 'Default configuration' is different the one from flash gets updated.
@@ -69,15 +112,25 @@ static uint16_t config_links_cnt = sizeof(config_links) / sizeof(config_links[0]
  */
 void config_init(void) {
 	struct config_t flash_cfg;
-	bool valid_cfg = config_load(&flash_cfg);
+	config_version = config.version;
+	bool valid_cfg = config_scan(&flash_cfg, &config_page, &config_seq, &config_offset);
 
 	/* Check if the version stored in flash is the same as the one we have set
 	   by default. Otherwise the config is very likely outdated and we will have to
 	   discard it. */
-	if (valid_cfg && flash_cfg.version == config.version) {
+	if (valid_cfg && flash_cfg.version == config_version) {
 		memcpy(&config, &flash_cfg, sizeof(struct config_t));
+		memcpy(&config_flash, &flash_cfg, sizeof(struct config_t));
+
+		/* Erase the left overs of an interrupted compaction or erase, no protocol is running yet */
+		mcu_flash_unlock();
+		for(uint8_t i = 0; i < CONFIG_PAGE_CNT; i++) {
+			if(i != config_page && !config_page_blank(i))
+				mcu_flash_erase_page(config_page_addr(i));
+		}
+		mcu_flash_lock();
 	} else {
-		config_store();
+		config_format();
 	}
 
 	/* Add some commands to the console */
@@ -90,79 +143,295 @@ void config_init(void) {
 }
 
 /**
- * Stores the current config in flash
+ * Stores the items of the current config which differ from flash
+ * The records are appended in the background by config_run, so this is safe to call
+ * while a protocol is running.
  */
 void config_store(void) {
-	uint16_t size = sizeof(struct config_t);
-	uint32_t addr = CONFIG_ADDR;
-	uint8_t  *byte_config = (uint8_t *)&config;
-
-	/* Unlock flash. */
-	flash_unlock();
-
-	/* Erase the config storage page. */
-	flash_erase_page(CONFIG_ADDR);
-
-	/* Write config struct to flash. */
-	uint16_t write_word = 0xFFFF;
-	for (uint16_t i = 0; i < size; i++) {
-		write_word = (write_word << 8) | (*(byte_config++));
-		if ((i % 2) == 1) {
-			flash_program_half_word(addr, write_word);
-			addr += 2;
+	for(uint16_t i = 0; i < config_links_cnt; i++)
+		config_store_item(config_links[i].value);
+}
+
+/**
+ * Store a single config item when it differs from flash
+ * @param[in] value Pointer to the item in the config (e.g. config.frsky_hop_table)
+ */
+void config_store_item(const void *value) {
+	for(uint16_t i = 0; i < config_links_cnt; i++) {
+		if(config_links[i].value != value)
+			continue;
+
+		uint16_t offset = (uint8_t *)config_links[i].value - (uint8_t *)&config;
+		if(memcmp(value, (uint8_t *)&config_flash + offset, config_links[i].bytes_cnt * config_links[i].cnt))
+			config_dirty[i] = true;
+		return;
+	}
+}
+
+/**
+ * Whether there are still config items waiting to be written to flash
+ */
+bool config_pending(void) {
+	if(config_wr.pos < config_wr.len || config_compact_idx >= 0)
+		return true;
+
+	for(uint16_t i = 0; i < config_links_cnt; i++) {
+		if(config_dirty[i])
+			return true;
+	}
+	return false;
+}
+
+/**
+ * Write the config log in the background
+ * While a protocol is running only a single half word is programmed per run, so the worst case
+ * stall is one half word program (~50-70us) every 10ms. Otherwise CONFIG_WRITE_BURST half words
+ * are programmed per run. Pages are only erased when no protocol is running, since an erase
+ * stalls the CPU for ~20ms.
+ */
+void config_run(void) {
+	/* Continue programming the current record */
+	if(config_wr.pos < config_wr.len) {
+		uint8_t burst = protocol_is_running()? 1 : CONFIG_WRITE_BURST;
+		mcu_flash_unlock();
+		for(uint8_t i = 0; i < burst && config_wr.pos < config_wr.len; i++, config_wr.pos++)
+			mcu_flash_program_half_word(config_wr.addr + config_wr.pos * 2, config_wr.data[config_wr.pos]);
+		mcu_flash_lock();
+
+		if(config_wr.pos < config_wr.len)
+			return;
+
+		/* The record is completely written, so it is now the value in flash */
+		if(config_wr.key >= 0) {
+			uint16_t offset = (uint8_t *)config_links[config_wr.key].value - (uint8_t *)&config;
+			memcpy((uint8_t *)&config_flash + offset, (uint8_t *)&config_wr.data[1], config_links[config_wr.key].bytes_cnt * config_links[config_wr.key].cnt);
 		}
+		return;
 	}
 
-	/* Write last byte if the size is uneven */
-	if ((size % 2) == 1) {
-		write_word = (write_word << 8) | 0xFF;
-		flash_program_half_word(addr, write_word);
-		addr += 2;
+	/* Copy the latest values into the next page, the header is written last to mark it valid */
+	uint8_t next = (config_page + 1) % CONFIG_PAGE_CNT;
+	if(config_compact_idx >= 0) {
+		if(config_compact_idx < config_links_cnt) {
+			uint16_t offset = (uint8_t *)config_links[config_compact_idx].value - (uint8_t *)&config;
+			config_write_record(config_page_addr(next) + config_compact_offset, config_compact_idx, (uint8_t *)&config_flash + offset);
+			config_wr.key = -1;
+			config_compact_offset += config_record_size(config_compact_idx);
+			config_compact_idx++;
+		}
+		else {
+			config_write_header(config_page_addr(next), config_seq + 1);
+			config_erase |= (1 << config_page);
+			config_page = next;
+			config_seq++;
+			config_offset = config_compact_offset;
+			config_compact_idx = -1;
+		}
+		return;
 	}
 
-	/* Write config CRC to flash. */
-	uint16_t crc = crc16(CONFIG_SEED, (uint8_t *)&config, size);
-	flash_program_half_word(addr, crc);
+	/* Append the next changed item */
+	for(uint16_t i = 0; i < config_links_cnt; i++) {
+		if(!config_dirty[i])
+			continue;
+
+		/* Start compacting when the page is full and the next page is erased */
+		if(config_offset + config_record_size(i) > CONFIG_PAGE_SIZE) {
+			if(!(config_erase & (1 << next))) {
+				config_compact_idx = 0;
+				config_compact_offset = CONFIG_HDR_SIZE;
+			}
+			break;
+		}
+
+		config_dirty[i] = false;
+		config_write_record(config_page_addr(config_page) + config_offset, i, config_links[i].value);
+		config_offset += config_record_size(i);
+		return;
+	}
 
-	/* Lock flash. */
-	flash_lock();
+	/* Erase the old pages when it can't disturb the timing of a protocol */
+	if(config_erase && !protocol_is_running()) {
+		for(uint8_t i = 0; i < CONFIG_PAGE_CNT; i++) {
+			if(config_erase & (1 << i)) {
+				mcu_flash_unlock();
+				mcu_flash_erase_page(config_page_addr(i));
+				mcu_flash_lock();
+				config_erase &= ~(1 << i);
+				return;
+			}
+		}
+	}
 }
 
 /**
- * Load the config from flash.
- * This is definitely not the most efficient way of reading out the data. But
- * as we do it only once it probably does not matter much. (esden)
+ * Load the config from flash
+ * @param[out] cfg The config which gets filled with the values from flash
+ * @return Whether a valid config log was found
  */
 bool config_load(struct config_t *cfg) {
-	uint16_t size = sizeof(struct config_t);
-	uint16_t *flash_data = (uint16_t *)CONFIG_ADDR;
-	uint8_t *byte_config = (uint8_t *)cfg;
-
-	/* Read the config data from the flash */
-	for (uint16_t i = 0; i < size; i++) {
-		if ((i % 2) == 0) {
-			*byte_config = (*flash_data) >> 8;
-			byte_config++;
-		} else {
-			*byte_config = (*flash_data) & 0xFF;
-			byte_config++;
-			flash_data++;
-		}
+	uint8_t page;
+	uint16_t seq, offset;
+	return config_scan(cfg, &page, &seq, &offset);
+}
+
+/**
+ * Get the flash address of a config page
+ * @param[in] page The index of the page
+ */
+static uint32_t config_page_addr(uint8_t page) {
+	return CONFIG_ADDR + page * CONFIG_PAGE_SIZE;
+}
+
+/**
+ * Check if a config page is completely erased
+ * @param[in] page The index of the page
+ */
+static bool config_page_blank(uint8_t page) {
+	const uint16_t *data = mcu_flash_ptr(config_page_addr(page));
+	for(uint16_t i = 0; i < CONFIG_PAGE_SIZE / 2; i++) {
+		if(data[i] != 0xFFFF)
+			return false;
 	}
+	return true;
+}
 
-	/* Go to next word if we ended uneven */
-	if ((size % 2) == 1)
-		flash_data++;
+/**
+ * The size of the record of an item in flash
+ * @param[in] key The index of the item
+ */
+static uint16_t config_record_size(uint16_t key) {
+	uint16_t len = config_links[key].bytes_cnt * config_links[key].cnt;
+	return 2 + ((len + 1) & ~1) + 2;
+}
 
-	/* Check the CRC from flash */
-	uint16_t flash_crc = *flash_data;
-	uint16_t calc_crc = crc16(CONFIG_SEED, (uint8_t *)cfg, size);
-	if(flash_crc != calc_crc)
+/**
+ * Find the newest page and replay its records
+ * The defaults are used for items without a record and the version is cleared, so a log
+ * without a version record is never accepted.
+ * @param[out] cfg The config which gets filled with the values from flash
+ * @param[out] page The newest valid page
+ * @param[out] seq The sequence number of the newest page
+ * @param[out] offset The first free offset in the newest page
+ * @return Whether a valid page was found
+ */
+static bool config_scan(struct config_t *cfg, uint8_t *page, uint16_t *seq, uint16_t *offset) {
+	bool found = false;
+
+	/* Find the newest page with a completely written header */
+	for(uint8_t i = 0; i < CONFIG_PAGE_CNT; i++) {
+		const uint16_t *hdr = mcu_flash_ptr(config_page_addr(i));
+		if(hdr[1] != CONFIG_MAGIC)
+			continue;
+
+		if(!found || (int16_t)(hdr[0] - *seq) > 0) {
+			*page = i;
+			*seq = hdr[0];
+			found = true;
+		}
+	}
+
+	if(!found)
 		return false;
 
+	/* Replay the records, a later record overwrites an earlier one */
+	memcpy(cfg, &config, sizeof(struct config_t));
+	cfg->version = 0;
+	const uint8_t *data = mcu_flash_ptr(config_page_addr(*page));
+	*offset = CONFIG_HDR_SIZE;
+	while(*offset + 4 <= CONFIG_PAGE_SIZE) {
+		uint8_t key = data[*offset];
+		uint8_t len = data[*offset + 1];
+		if(key == 0xFF && len == 0xFF)
+			return true;
+
+		/* The record is damaged so we can't find the next one, the page gets compacted on the next save */
+		if(key >= config_links_cnt || len != config_links[key].bytes_cnt * config_links[key].cnt
+				|| *offset + config_record_size(key) > CONFIG_PAGE_SIZE) {
+			*offset = CONFIG_PAGE_SIZE;
+			return true;
+		}
+
+		/* Only use records which were completely written */
+		uint16_t size = config_record_size(key);
+		uint16_t crc = data[*offset + size - 2] | (data[*offset + size - 1] << 8);
+		if(crc == crc16(CONFIG_SEED, (uint8_t *)&data[*offset], len + 2)) {
+			uint16_t item_offset = (uint8_t *)config_links[key].value - (uint8_t *)&config;
+			memcpy((uint8_t *)cfg + item_offset, &data[*offset + 2], len);
+		}
+		*offset += size;
+	}
+
 	return true;
 }
 
+/**
+ * Prepare a record to be programmed by config_run
+ * @param[in] addr The flash address of the record
+ * @param[in] key The index of the item
+ * @param[in] value The value of the item
+ */
+static void config_write_record(uint32_t addr, uint16_t key, const uint8_t *value) {
+	uint8_t *bytes = (uint8_t *)config_wr.data;
+	uint16_t len = config_links[key].bytes_cnt * config_links[key].cnt;
+	uint16_t size = config_record_size(key);
+
+	memset(bytes, 0xFF, size);
+	bytes[0] = key;
+	bytes[1] = len;
+	memcpy(&bytes[2], value, len);
+	uint16_t crc = crc16(CONFIG_SEED, bytes, len + 2);
+	bytes[size - 2] = crc & 0xFF;
+	bytes[size - 1] = crc >> 8;
+
+	/* The half words are stored little endian, like they are read back */
+	for(uint16_t i = 0; i < size / 2; i++)
+		config_wr.data[i] = bytes[i * 2] | (bytes[i * 2 + 1] << 8);
+
+	config_wr.addr = addr;
+	config_wr.len = size / 2;
+	config_wr.pos = 0;
+	config_wr.key = key;
+}
+
+/**
+ * Prepare the page header to be programmed, the magic is programmed after the sequence number
+ * @param[in] addr The flash address of the page
+ * @param[in] seq The sequence number of the page
+ */
+static void config_write_header(uint32_t addr, uint16_t seq) {
+	config_wr.data[0] = seq;
+	config_wr.data[1] = CONFIG_MAGIC;
+	config_wr.addr = addr;
+	config_wr.len = 2;
+	config_wr.pos = 0;
+	config_wr.key = -1;
+}
+
+/**
+ * Erase the config log and write all the current values, only used at startup
+ */
+static void config_format(void) {
+	mcu_flash_unlock();
+	for(uint8_t i = 0; i < CONFIG_PAGE_CNT; i++) {
+		if(!config_page_blank(i))
+			mcu_flash_erase_page(config_page_addr(i));
+	}
+	mcu_flash_lock();
+
+	config_page = 0;
+	config_seq = 0;
+	config_offset = CONFIG_HDR_SIZE;
+	config_erase = 0;
+	config_compact_idx = -1;
+	config_write_header(config_page_addr(0), config_seq);
+
+	for(uint16_t i = 0; i < config_links_cnt; i++)
+		config_dirty[i] = true;
+	while(config_pending())
+		config_run();
+}
+
 /**
  * Show the current version and information
  */
@@ -180,9 +449,11 @@ static void config_cmd_load(char *cmdLine __attribute((unused))) {
 	bool valid = config_load(&flash_cfg);
 
 	/* Check if the version is the same, else show error */
-	if (valid && flash_cfg.version == flash_cfg.version) {
+	if (valid && flash_cfg.version == config_version) {
 		memcpy(&config, &flash_cfg, sizeof(struct config_t));
 		console_print("\r\nSuccessfully loaded config from the memory!");
+	} else if (valid) {
+		console_print("\r\nThe config in memory has version %.3f instead of %.3f.", flash_cfg.version, config_version);
 	} else {
 		console_print("\r\nThere is no loadable config found.");
 	}
@@ -193,7 +464,10 @@ static void config_cmd_load(char *cmdLine __attribute((unused))) {
  */
 static void config_cmd_save(char *cmdLine __attribute((unused))) {
 	config_store();
-	console_print("\r\nSuccessfully saved config to the memory!");
+	if(config_pending())
+		console_print("\r\nSaving the changed config items in the background.");
+	else
+		console_print("\r\nThe config in memory is already up to date.");
 }
 
 
@@ -20,7 +20,8 @@
 #ifndef MODULES_CONFIG_H_
 #define MODULES_CONFIG_H_
 
-#include <libopencm3/cm3/common.h>
+#include <stdint.h>
+#include <stdbool.h>
 
 #ifndef DEBUG
 #define DEBUG(a ,...) if(false){};
@@ -52,6 +53,9 @@ struct config_link_t {
  */
 void config_init(void);
 void config_store(void);
+void config_store_item(const void *value);
+bool config_pending(void);
+void config_run(void);
 bool config_load(struct config_t *cfg);
 
 #endif /* MODULES_CONFIG_H_ */
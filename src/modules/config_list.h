@@ -26,16 +26,34 @@
 #define _A(...) __VA_ARGS__
 
 // General items
-CONFIG_ITEM(version, float, "%0.3f", 2.001)
+CONFIG_ITEM(version, float, "%0.3f", 2.007)
 CONFIG_ITEM(debug, bool, "%d", false)
 
+// Link items
+CONFIG_ITEM(batch_packets, uint8_t, "%hhu", 1)
+CONFIG_ITEM(batch_window_ms, uint8_t, "%hhu", 5)
+CONFIG_ITEM(filter_rate, uint8_t, "%hhu", 10)
+CONFIG_ITEM(filter_burst, uint8_t, "%hhu", 2)
+
 // CYRF6936 items
 CONFIG_ARRAY(spektrum_bind_id, uint8_t, 4, "%02X", _A({0, 0, 0, 0}))
 
+// DSMX channel cache, the TX IDs and 23 channels of the last 4 transmitters (most recent first)
+CONFIG_ARRAY(dsm_cache_id, uint8_t, 16, "%02X", _A({0}))
+CONFIG_ARRAY(dsm_cache_channels, uint8_t, 92, "%02d ", _A({0}))
+
 // CC2500 items
 CONFIG_ITEM(cc_tuned, bool, "%d", false)
 CONFIG_ITEM(cc_fsctrl0, int8_t, "%d", 0)
 CONFIG_ARRAY(frsky_bind_id, uint8_t, 2, "%02X", _A({0, 0}))
 CONFIG_ARRAY(frsky_hop_table, uint8_t, 50, "%03d ", _A({0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0}))
 CONFIG_ITEM(frsky_bound, bool, "%d", false)
-CONFIG_ITEM(frsky_offset, uint8_t, "%d", 200)
\ No newline at end of file
+CONFIG_ITEM(frsky_offset, uint8_t, "%d", 200)
+
+// FrSky calibration cache, FSCAL1 per channel (0x80 marks it valid) for one FSCTRL0 and FREQ2/1/0
+CONFIG_ITEM(cal_valid, bool, "%d", false)
+CONFIG_ITEM(cal_fsctrl0, int8_t, "%d", 0)
+CONFIG_ARRAY(cal_freq, uint8_t, 3, "%02X", _A({0, 0, 0}))
+CONFIG_ITEM(cal_fscal2, uint8_t, "%02X", 0)
+CONFIG_ITEM(cal_fscal3, uint8_t, "%02X", 0)
+CONFIG_ARRAY(cal_fscal1, uint8_t, 236, "%02X", _A({0}))
\ No newline at end of file
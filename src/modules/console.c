@@ -18,12 +18,15 @@
  */
 
 #include "console.h"
-#include "modules/ring.h"
+#include "modules/fifo.h"
+#include "modules/mcu.h"
 #include "modules/cdcacm.h"
+#include "modules/sched.h"
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 #include <stdarg.h>
 
 #define CONSOLE_SIZE 128
@@ -45,6 +48,20 @@ static void console_print_help(char *cmdLine);
 static console_cmd_t console_cmds[CONSOLE_CMDS_SIZE];
 static int console_cmds_idx = 0;
 
+/* A deferred log entry */
+struct console_log_t {
+  const char *format;                   /**< The format string */
+  uint32_t args[CONSOLE_LOG_ARGS];      /**< The raw arguments */
+};
+
+static struct console_log_t console_log_ring[CONSOLE_LOG_SIZE];
+static volatile uint32_t console_log_head = 0;      /**< The write index, only changed with interrupts disabled */
+static volatile uint32_t console_log_tail = 0;      /**< The read index, only changed by console_run() */
+static volatile uint32_t console_log_dropped = 0;   /**< The amount of entries dropped because the ring was full */
+static uint32_t console_log_reported = 0;           /**< The amount of dropped entries already printed */
+
+static void console_log_flush(void);
+
 /**
  * Initialize the console
  */
@@ -59,14 +76,13 @@ void console_run(void) {
   uint8_t c;
 
   // Parse characters
-  while(!RING_EMPTY(&cdcacm_console_rx)) {
-    ring_read_ch(&cdcacm_console_rx, &c);
+  while(fifo_read_ch(&cdcacm_console_rx, &c)) {
 
     switch(c) {
       // If it is EOL
       case '\n':
       case '\r':
-        ring_write_ch(&cdcacm_console_tx, c);
+        fifo_write_ch(&cdcacm_console_tx, c);
 
         // Parse the command
         console_buf[console_idx++] = 0;
@@ -84,7 +100,7 @@ void console_run(void) {
       // If it is a backspace
       case 127:
         if(console_idx > 0) {
-          ring_write_ch(&cdcacm_console_tx, c);
+          fifo_write_ch(&cdcacm_console_tx, c);
           console_idx--;
         }
         break;
@@ -97,9 +113,15 @@ void console_run(void) {
         else
           console_buf[console_idx++] = c;
 
-        ring_write_ch(&cdcacm_console_tx, c);
+        fifo_write_ch(&cdcacm_console_tx, c);
     }
   }
+
+  // Format the deferred log entries
+  console_log_flush();
+
+  // Send the echo
+  sched_event(SCHED_EV_USB_TX);
 }
 
 /**
@@ -138,7 +160,48 @@ void console_print(const char *format, ...) {
   vsprintf(buf, format, argptr);
   va_end(argptr);
 
-  ring_write(&cdcacm_console_tx, (uint8_t*)buf, strlen(buf));
+  fifo_write(&cdcacm_console_tx, (uint8_t*)buf, strlen(buf));
+  sched_event(SCHED_EV_USB_TX);
+}
+
+/**
+ * Store a log entry to be printed later by console_run(), use console_log()
+ * This only copies the arguments so it can be used from any interrupt.
+ */
+void console_log_write(const char *format, uint32_t a, uint32_t b, uint32_t c, uint32_t d) {
+  uint32_t irq = mcu_irq_save();
+  if(console_log_head - console_log_tail >= CONSOLE_LOG_SIZE) {
+    console_log_dropped++;
+  } else {
+    struct console_log_t *entry = &console_log_ring[console_log_head & (CONSOLE_LOG_SIZE - 1)];
+    entry->format = format;
+    entry->args[0] = a;
+    entry->args[1] = b;
+    entry->args[2] = c;
+    entry->args[3] = d;
+    console_log_head++;
+  }
+  mcu_irq_restore(irq);
+
+  sched_event(SCHED_EV_CONSOLE_LOG);
+}
+
+/**
+ * Format the deferred log entries as long as they fit in the console FIFO
+ * The remaining entries are printed on the next (periodic) run of the console.
+ */
+static void console_log_flush(void) {
+  while(console_log_tail != console_log_head && fifo_free(&cdcacm_console_tx) >= CONSOLE_SIZE) {
+    struct console_log_t *entry = &console_log_ring[console_log_tail & (CONSOLE_LOG_SIZE - 1)];
+    console_print(entry->format, entry->args[0], entry->args[1], entry->args[2], entry->args[3]);
+    console_log_tail++;
+  }
+
+  uint32_t dropped = console_log_dropped;
+  if(dropped != console_log_reported && fifo_free(&cdcacm_console_tx) >= CONSOLE_SIZE) {
+    console_print("\r\n[%u log entries dropped]", dropped - console_log_reported);
+    console_log_reported = dropped;
+  }
 }
 
 /**
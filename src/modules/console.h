@@ -20,11 +20,24 @@
 #ifndef MODULES_CONSOLE_H_
 #define MODULES_CONSOLE_H_
 
+#include <stdint.h>
+
+/* Deferred logging for interrupts and other timing critical code. Only the
+ * format string pointer and up to CONSOLE_LOG_ARGS integer arguments are stored
+ * in a ring, the formatting is done later in console_run(). The format string
+ * must stay valid (a literal) and can not contain strings or floats.
+ */
+#define CONSOLE_LOG_SIZE 32				/**< The amount of log entries in the ring (power of two) */
+#define CONSOLE_LOG_ARGS 4				/**< The maximum amount of arguments of a log entry */
+#define console_log(...) _console_log(__VA_ARGS__, 0, 0, 0, 0, 0)
+#define _console_log(fmt, a, b, c, d, ...) console_log_write(fmt, (uint32_t)(a), (uint32_t)(b), (uint32_t)(c), (uint32_t)(d))
+
 /* External functions */
 void console_init(void);
 void console_run(void);
 void console_cmd_add(char *name, char *params, void (*cmdFunc)(char *cmdLine));
 void console_cmd_rm(char *name);
 void console_print(const char *format, ...);
+void console_log_write(const char *format, uint32_t a, uint32_t b, uint32_t c, uint32_t d);
 
 #endif /* MODULES_CONSOLE_H_ */
@@ -22,7 +22,7 @@
 
 /* Headers */
 #include <stdint.h>
-#include <libopencm3/cm3/systick.h>
+#include <stdbool.h>
 
 /* Type definitions. */
 typedef void (*counter_callback_t)(void *);
@@ -39,12 +39,12 @@ extern struct counter_status counter_status;
 
 /* API declarations. */
 void counter_init(void);
+uint32_t counter_get_us(void);
 void _usleep(uint32_t x);
 #define usleep _usleep
 
-static inline uint32_t counter_get_ticks(void) {
-	return counter_status.ticks;
-}
+// Include the architecture specific counter_get_ticks
+#include "counter_arch.h"
 
 static inline uint32_t counter_get_ticks_from_time(uint32_t t,
 	                                               uint32_t frequency,
@@ -18,88 +18,200 @@
  */
 
 #include <unistd.h>
-#include <libopencm3/cm3/common.h>
-#include <libopencm3/cm3/nvic.h>
-#include <libopencm3/cm3/cortex.h>
-#include <libopencm3/stm32/rcc.h>
-#include <libopencm3/stm32/gpio.h>
-#include <libopencm3/stm32/exti.h>
+#include <stddef.h>
+#include <string.h>
 
 #include "cyrf6936.h"
+#include "modules/mcu.h"
 #include "modules/counter.h"
 #include "modules/config.h"
 #include "modules/spi.h"
+#include "modules/prof.h"
+#include "modules/trace.h"
 
 /* The CYRF receive and send callbacks */
 cyrf_on_event _cyrf_recv_callback = NULL;
 cyrf_on_event _cyrf_send_callback = NULL;
 
 /* The pin for selecting the device */
-#define CYRF_CS_HI() gpio_set(CYRF_DEV_SS_PORT, CYRF_DEV_SS_PIN)
-#define CYRF_CS_LO() gpio_clear(CYRF_DEV_SS_PORT, CYRF_DEV_SS_PIN)
+#define CYRF_CS_HI() spi_dev_deselect(SPI_DEV_CYRF)
+#define CYRF_CS_LO() spi_dev_select(SPI_DEV_CYRF)
+
+/* Registers which only hold configuration, so after a write the value in the chip is known */
+#define CYRF_SHADOW_MASK ((1ULL << CYRF_CHANNEL) | (1ULL << CYRF_TX_LENGTH) | (1ULL << CYRF_TX_CFG) | \
+		(1ULL << CYRF_RX_CFG) | (1ULL << CYRF_PWR_CTRL) | (1ULL << CYRF_XTAL_CTRL) | (1ULL << CYRF_IO_CFG) | \
+		(1ULL << CYRF_GPIO_CTRL) | (1ULL << CYRF_FRAMING_CFG) | (1ULL << CYRF_DATA32_THOLD) | \
+		(1ULL << CYRF_DATA64_THOLD) | (1ULL << CYRF_EOP_CTRL) | (1ULL << CYRF_CRC_SEED_LSB) | \
+		(1ULL << CYRF_CRC_SEED_MSB) | (1ULL << CYRF_TX_OFFSET_LSB) | (1ULL << CYRF_TX_OFFSET_MSB) | \
+		(1ULL << CYRF_RX_OVERRIDE) | (1ULL << CYRF_TX_OVERRIDE) | (1ULL << CYRF_XTAL_CFG) | \
+		(1ULL << CYRF_CLK_OFFSET) | (1ULL << CYRF_CLK_EN) | (1ULL << CYRF_AUTO_CAL_TIME) | \
+		(1ULL << CYRF_AUTO_CAL_OFFSET) | (1ULL << CYRF_ANALOG_CTRL))
 
 /* Internal functions */
-static void cyrf_process(void);
+static void cyrf_process(uint32_t time);
+static void cyrf_irq(enum spi_dev_t dev);
+static void cyrf_send_done(enum spi_dev_t dev);
+static bool cyrf_shadow_match(const uint8_t address, const uint8_t data[], const int length);
+static void cyrf_shadow_set(const uint8_t address, const uint8_t data[], const int length);
+
+static uint8_t cyrf_tx_buf[16];																					/**< The TX buffer which is written with DMA */
+static const uint8_t cyrf_tx_go = CYRF_TX_GO | CYRF_TXC_IRQEN | CYRF_TXE_IRQEN;		/**< Start sending with the IRQs enabled */
+static const uint8_t *cyrf_sop_code = NULL;																/**< The SOP code currently in the chip (NULL if unknown) */
+static const uint8_t *cyrf_data_code = NULL;															/**< The 16 bytes data code currently in the chip (NULL if unknown) */
+static bool cyrf_irq_enabled = false;																		/**< The IRQ pin is connected to an interrupt */
+static uint32_t cyrf_rx_time = 0;																				/**< The time in microseconds of the last receive interrupt */
+static enum cyrf_reset_state_t cyrf_reset_state = CYRF_RESET_READY;			/**< The state of the reset */
+static uint32_t cyrf_reset_ticks = 0;																		/**< The start of the current reset state in ticks */
+static cyrf_on_ready cyrf_reset_callback = NULL;												/**< Called when the reset is done */
+static uint8_t cyrf_shadow[0x40];																				/**< The last values written to the registers */
+static uint64_t cyrf_shadow_valid = 0;																	/**< The registers of which the shadow equals the chip (bitmask) */
 
 /**
  * Initialize the CYRF6936
  */
 void cyrf_init(void) {
 	DEBUG(cyrf6936, "Initializing");
-	/* Initialize the clocks */
-	rcc_periph_clock_enable(CYRF_DEV_RST_CLK);
-
-	/* Initialize the GPIO */
-	gpio_set_mode(CYRF_DEV_RST_PORT, GPIO_MODE_OUTPUT_50_MHZ, GPIO_CNF_OUTPUT_PUSHPULL, CYRF_DEV_RST_PIN);
-	gpio_set_mode(CYRF_DEV_SS_PORT, GPIO_MODE_OUTPUT_50_MHZ, GPIO_CNF_OUTPUT_PUSHPULL, CYRF_DEV_SS_PIN);
-
-#ifdef CYRF_DEV_IRQ_PORT
-	/* Enable the IRQ */
-	rcc_peripheral_enable_clock(&RCC_APB2ENR, CYRF_DEV_IRQ_CLK); //IRQ
-	gpio_set_mode(CYRF_DEV_IRQ_PORT, GPIO_MODE_INPUT, GPIO_CNF_INPUT_FLOAT,
-			CYRF_DEV_IRQ_PIN);
-	exti_select_source(CYRF_DEV_IRQ_EXTI, CYRF_DEV_IRQ_PORT);
-	exti_set_trigger(CYRF_DEV_IRQ_EXTI, EXTI_TRIGGER_FALLING);
-	exti_enable_request(CYRF_DEV_IRQ_EXTI);
-
-	// Enable the IRQ NVIC
-	nvic_set_priority(CYRF_DEV_IRQ_NVIC, 2);
-	nvic_enable_irq(CYRF_DEV_IRQ_NVIC);
-#endif
-
-	/* Reset the CYRF chip */
-	gpio_set(CYRF_DEV_RST_PORT, CYRF_DEV_RST_PIN);
-	counter_wait_poll(counter_get_ticks_of_ms(150));
-	gpio_clear(CYRF_DEV_RST_PORT, CYRF_DEV_RST_PIN);
-	counter_wait_poll(counter_get_ticks_of_ms(300));
-
-	/* Also a software reset */
-	cyrf_write_register(CYRF_MODE_OVERRIDE, CYRF_RST);
+	/* Initialize the chip select and reset GPIO */
+	spi_dev_init(SPI_DEV_CYRF);
+
+	/* Handle the interrupts on the IRQ pin if it is connected */
+	cyrf_irq_enabled = spi_dev_irq_init(SPI_DEV_CYRF, cyrf_irq);
+
+	/* Reset the CYRF chip, this finishes in the background */
+	cyrf_reset_start(NULL);
 	DEBUG(cyrf6936, "Initializing done");
 }
 
 /**
- * Poll the status registers if the IRQ pin isn connected
+ * Start resetting the CYRF6936
+ * The reset pin is held for 150ms and the chip needs 300ms to start afterwards, cyrf_run
+ * continues the reset so the main loop keeps running meanwhile.
+ * @param[in] callback Called from the main loop when the chip is ready (can be NULL)
+ */
+void cyrf_reset_start(cyrf_on_ready callback) {
+	cyrf_reset_callback = callback;
+	cyrf_reset_ticks = counter_get_ticks();
+	cyrf_reset_state = CYRF_RESET_HOLD;
+	spi_dev_reset(SPI_DEV_CYRF, true);
+	cyrf_shadow_invalidate();
+}
+
+/**
+ * Continue the reset of the CYRF6936
+ * @return Whether the chip is ready
+ */
+bool cyrf_reset_poll(void) {
+	uint32_t ticks = counter_get_ticks();
+
+	switch(cyrf_reset_state) {
+		case CYRF_RESET_HOLD:
+			if(ticks - cyrf_reset_ticks < counter_get_ticks_of_ms(150))
+				return false;
+
+			spi_dev_reset(SPI_DEV_CYRF, false);
+			cyrf_reset_ticks = ticks;
+			cyrf_reset_state = CYRF_RESET_WAIT;
+			return false;
+
+		case CYRF_RESET_WAIT:
+			if(ticks - cyrf_reset_ticks < counter_get_ticks_of_ms(300))
+				return false;
+
+			/* Also a software reset */
+			cyrf_write_register(CYRF_MODE_OVERRIDE, CYRF_RST);
+			cyrf_shadow_invalidate();
+			cyrf_reset_state = CYRF_RESET_READY;
+			if(cyrf_reset_callback != NULL)
+				cyrf_reset_callback();
+			return true;
+
+		default:
+			return true;
+	}
+}
+
+/**
+ * Whether the CYRF6936 finished its reset
+ */
+bool cyrf_is_ready(void) {
+	return (cyrf_reset_state == CYRF_RESET_READY);
+}
+
+/**
+ * Wait until the CYRF6936 finished its reset, only needed when the chip is used right after boot
+ */
+void cyrf_wait_ready(void) {
+	while(!cyrf_reset_poll());
+}
+
+/**
+ * Forget the register values which are known to be in the chip, so the next writes go through
+ */
+void cyrf_shadow_invalidate(void) {
+	cyrf_shadow_valid = 0;
+	cyrf_sop_code = NULL;
+	cyrf_data_code = NULL;
+}
+
+/**
+ * Check if registers are known to already hold the data
+ * @param[in] address The first register
+ * @param[in] data The data for the consecutive registers
+ * @param[in] length The amount of registers
+ */
+static bool cyrf_shadow_match(const uint8_t address, const uint8_t data[], const int length) {
+	for(int i = 0; i < length; i++) {
+		uint8_t reg = (address + i) & 0x3F;
+		if(!((CYRF_SHADOW_MASK & cyrf_shadow_valid) & (1ULL << reg)) || cyrf_shadow[reg] != data[i])
+			return false;
+	}
+	return true;
+}
+
+/**
+ * Remember the data written to consecutive registers
+ * @param[in] address The first register
+ * @param[in] data The data written to the consecutive registers
+ * @param[in] length The amount of registers
+ */
+static void cyrf_shadow_set(const uint8_t address, const uint8_t data[], const int length) {
+	for(int i = 0; i < length; i++) {
+		uint8_t reg = (address + i) & 0x3F;
+		cyrf_shadow[reg] = data[i];
+		cyrf_shadow_valid |= (1ULL << reg);
+	}
+}
+
+/**
+ * Continue the reset and poll the status registers if the IRQ pin isn connected
  */
 void cyrf_run(void) {
-#ifndef CYRF_DEV_IRQ_ISR
-	cyrf_process();
-#endif
+	if(!cyrf_reset_poll())
+		return;
+
+	if(!cyrf_irq_enabled) {
+		PROF_START(start);
+		cyrf_process(counter_get_us());
+		PROF_END(PROF_CYRF_IRQ, start);
+	}
 }
 
-#ifdef CYRF_DEV_IRQ_ISR
 /**
  * On interrupt request do a process of the register
  */
-void CYRF_DEV_IRQ_ISR(void) {
-	cyrf_process();
-	exti_reset_request(CYRF_DEV_IRQ_EXTI);
+static void cyrf_irq(enum spi_dev_t dev __attribute__((unused))) {
+	PROF_START(start);
+	if(cyrf_reset_state == CYRF_RESET_READY)
+		cyrf_process(counter_get_us());
+	PROF_END(PROF_CYRF_IRQ, start);
 }
-#endif
 
 /**
- * Process the CYRF requests */
-static void cyrf_process(void) {
+ * Process the CYRF requests
+ * @param[in] time The time in microseconds of the interrupt, or of the poll
+ * when the IRQ pin is not connected
+ */
+static void cyrf_process(uint32_t time) {
 	uint8_t tx_irq_status, rx_irq_status;
 
 	// Read the transmit IRQ
@@ -108,6 +220,7 @@ static void cyrf_process(void) {
 		tx_irq_status |= cyrf_read_register(CYRF_TX_IRQ_STATUS);
 	if (((tx_irq_status & CYRF_TXC_IRQ))
 			&& _cyrf_send_callback != NULL) {
+		trace_add(TRACE_TX_DONE, TRACE_CHIP_CYRF, (tx_irq_status & CYRF_TXE_IRQ) > 0x0);
 		_cyrf_send_callback((tx_irq_status & CYRF_TXE_IRQ) > 0x0);
 	}
 
@@ -118,6 +231,8 @@ static void cyrf_process(void) {
 	if (((rx_irq_status & CYRF_RXC_IRQ))
 			&& _cyrf_recv_callback != NULL) {
 		cyrf_write_register(CYRF_RX_IRQ_STATUS, 0x80); // need to set RXOW before data read
+		cyrf_rx_time = time;
+		trace_add(TRACE_RX, TRACE_CHIP_CYRF, (rx_irq_status & CYRF_RXE_IRQ) > 0x0);
 		_cyrf_recv_callback((rx_irq_status & CYRF_RXE_IRQ) > 0x0);
 	}
 }
@@ -130,6 +245,14 @@ void cyrf_register_recv_callback(cyrf_on_event callback) {
 	_cyrf_recv_callback = callback;
 }
 
+/**
+ * Get the time of the packet being received
+ * @return The time in microseconds of the receive interrupt
+ */
+uint32_t cyrf_get_rx_time(void) {
+	return cyrf_rx_time;
+}
+
 /**
  * Register the send callback
  * @param[in] callback The callback when it receives an interrupt for send
@@ -144,12 +267,19 @@ void cyrf_register_send_callback(cyrf_on_event callback) {
  * @param[in] data The one byte data that needs to be written to the address
  */
 void cyrf_write_register(const uint8_t address, const uint8_t data) {
-	cm_disable_interrupts();
+	uint32_t irq = mcu_irq_save();
+	// Skip writing configuration which is already in the chip
+	if(cyrf_shadow_match(address, &data, 1)) {
+		mcu_irq_restore(irq);
+		return;
+	}
+
 	CYRF_CS_LO();
-	spi_xfer(CYRF_DEV_SPI, CYRF_DIR | address);
-	spi_xfer(CYRF_DEV_SPI, data);
+	spi_dev_xfer(SPI_DEV_CYRF, CYRF_DIR | address);
+	spi_dev_xfer(SPI_DEV_CYRF, data);
 	CYRF_CS_HI();
-	cm_enable_interrupts();
+	cyrf_shadow_set(address, &data, 1);
+	mcu_irq_restore(irq);
 }
 
 /**
@@ -159,16 +289,13 @@ void cyrf_write_register(const uint8_t address, const uint8_t data) {
  * @param[in] length The length in bytes of the data that needs to be written
  */
 void cyrf_write_block(const uint8_t address, const uint8_t data[], const int length) {
-	int i;
-	cm_disable_interrupts();
-	CYRF_CS_LO();
-	spi_xfer(CYRF_DEV_SPI, CYRF_DIR | address);
-
-	for (i = 0; i < length; i++)
-		spi_xfer(CYRF_DEV_SPI, data[i]);
+	spi_dev_transfer(SPI_DEV_CYRF, CYRF_DIR | address, data, NULL, length, NULL);
 
-	CYRF_CS_HI();
-	cm_enable_interrupts();
+	// Without auto increment the same register is written multiple times
+	if(address & CYRF_INC)
+		cyrf_shadow_set(address, data, length);
+	else if(length > 0)
+		cyrf_shadow_set(address, &data[length - 1], 1);
 }
 
 /**
@@ -178,12 +305,12 @@ void cyrf_write_block(const uint8_t address, const uint8_t data[], const int len
  */
 uint8_t cyrf_read_register(const uint8_t address) {
 	uint8_t data;
-	cm_disable_interrupts();
+	uint32_t irq = mcu_irq_save();
 	CYRF_CS_LO();
-	spi_xfer(CYRF_DEV_SPI, address);
-	data = spi_xfer(CYRF_DEV_SPI, 0);
+	spi_dev_xfer(SPI_DEV_CYRF, address);
+	data = spi_dev_xfer(SPI_DEV_CYRF, 0);
 	CYRF_CS_HI();
-	cm_enable_interrupts();
+	mcu_irq_restore(irq);
 	return data;
 }
 
@@ -194,16 +321,7 @@ uint8_t cyrf_read_register(const uint8_t address) {
  * @param[in] length The length in bytes what needs to be read
  */
 void cyrf_read_block(const uint8_t address, uint8_t data[], const int length) {
-	int i;
-	cm_disable_interrupts();
-	CYRF_CS_LO();
-	spi_xfer(CYRF_DEV_SPI, address);
-
-	for (i = 0; i < length; i++)
-		data[i] = spi_xfer(CYRF_DEV_SPI, 0);
-
-	CYRF_CS_HI();
-	cm_enable_interrupts();
+	spi_dev_transfer(SPI_DEV_CYRF, address, NULL, data, length, NULL);
 }
 
 /**
@@ -252,6 +370,7 @@ void cyrf_set_config_len(const uint8_t cfg[][2], const uint8_t length) {
  */
 void cyrf_set_channel(const uint8_t chan) {
 	cyrf_write_register(CYRF_CHANNEL, chan);
+	trace_add(TRACE_HOP, TRACE_CHIP_CYRF, chan);
 	DEBUG(cyrf6936, "WRITE CHANNEL: 0x%02X", chan);
 }
 
@@ -260,7 +379,8 @@ void cyrf_set_channel(const uint8_t chan) {
  * @param[in] power The power that needs to be set
  */
 void cyrf_set_power(const uint8_t power) {
-	uint8_t tx_cfg = cyrf_read_register(CYRF_TX_CFG) & (0xFF - CYRF_PA_4);
+	uint8_t tx_cfg = (cyrf_shadow_valid & (1ULL << CYRF_TX_CFG))? cyrf_shadow[CYRF_TX_CFG] : cyrf_read_register(CYRF_TX_CFG);
+	tx_cfg &= (0xFF - CYRF_PA_4);
 	cyrf_write_register(CYRF_TX_CFG, tx_cfg | power);
 	DEBUG(cyrf6936, "WRITE POWER: 0x%02X (0x%02X)", power, tx_cfg);
 }
@@ -295,7 +415,11 @@ void cyrf_set_crc_seed(const uint16_t crc) {
  * @param[in] sopcode The 8 bytes SOP code
  */
 void cyrf_set_sop_code(const uint8_t *sopcode) {
+	if(sopcode == cyrf_sop_code)
+		return;
+
 	cyrf_write_block(CYRF_SOP_CODE, sopcode, 8);
+	cyrf_sop_code = sopcode;
 
 	DEBUG(cyrf6936, "WRITE SOP_CODE: 0x%02X 0x%02X 0x%02X 0x%02X 0x%02X 0x%02X 0x%02X 0x%02X",
 			sopcode[0], sopcode[1], sopcode[2], sopcode[3], sopcode[4], sopcode[5], sopcode[6], sopcode[7]);
@@ -306,7 +430,11 @@ void cyrf_set_sop_code(const uint8_t *sopcode) {
  * @param[in] datacode The 16 bytes data code
  */
 void cyrf_set_data_code(const uint8_t *datacode) {
+	if(datacode == cyrf_data_code)
+		return;
+
 	cyrf_write_block(CYRF_DATA_CODE, datacode, 16);
+	cyrf_data_code = datacode;
 
 	DEBUG(cyrf6936, "WRITE DATA_CODE: 0x%02X 0x%02X 0x%02X 0x%02X 0x%02X 0x%02X 0x%02X 0x%02X 0x%02X 0x%02X 0x%02X 0x%02X 0x%02X 0x%02X 0x%02X 0x%02X",
 			datacode[0], datacode[1], datacode[2], datacode[3], datacode[4], datacode[5], datacode[6], datacode[7],
@@ -319,6 +447,7 @@ void cyrf_set_data_code(const uint8_t *datacode) {
  */
 void cyrf_set_data_code_small(const uint8_t *datacode) {
 	cyrf_write_block(CYRF_DATA_CODE, datacode, 8);
+	cyrf_data_code = NULL;
 	DEBUG(cyrf6936, "WRITE DATA_CODE: 0x%02X 0x%02X 0x%02X 0x%02X 0x%02X 0x%02X 0x%02X 0x%02X",
 			datacode[0], datacode[1], datacode[2], datacode[3], datacode[4], datacode[5], datacode[6], datacode[7]);
 }
@@ -378,16 +507,58 @@ void cyrf_set_tx_override(const uint8_t override) {
 	DEBUG(cyrf6936, "WRITE TX_OVERRIDE: 0x%02X", override);
 }
 
+/**
+ * Hop to a new channel with a precompiled hop descriptor
+ * The CRC seed registers are consecutive and written with one auto increment burst. The CRC seed, channel,
+ * SOP and data code are only rewritten when they differ from the values already in the chip.
+ * @param[in] *hop The hop descriptor
+ * @param[in] crc_seed The 16-bit CRC seed
+ */
+void cyrf_hop(const struct cyrf_hop_t *hop, const uint16_t crc_seed) {
+	uint8_t crc[2] = {crc_seed & 0xff, crc_seed >> 8};
+	if(!cyrf_shadow_match(CYRF_CRC_SEED_LSB, crc, 2)) {
+		spi_dev_transfer(SPI_DEV_CYRF, CYRF_DIR | CYRF_INC | CYRF_CRC_SEED_LSB, crc, NULL, 2, NULL);
+		cyrf_shadow_set(CYRF_CRC_SEED_LSB, crc, 2);
+	}
+
+	if(hop->sop_code != cyrf_sop_code) {
+		spi_dev_transfer(SPI_DEV_CYRF, CYRF_DIR | CYRF_SOP_CODE, hop->sop_code, NULL, 8, NULL);
+		cyrf_sop_code = hop->sop_code;
+	}
+	if(hop->data_code != cyrf_data_code) {
+		spi_dev_transfer(SPI_DEV_CYRF, CYRF_DIR | CYRF_DATA_CODE, hop->data_code, NULL, 16, NULL);
+		cyrf_data_code = hop->data_code;
+	}
+
+	if(!cyrf_shadow_match(CYRF_CHANNEL, &hop->channel, 1)) {
+		spi_dev_transfer(SPI_DEV_CYRF, CYRF_DIR | CYRF_CHANNEL, &hop->channel, NULL, 1, NULL);
+		cyrf_shadow_set(CYRF_CHANNEL, &hop->channel, 1);
+	}
+	trace_add(TRACE_HOP, TRACE_CHIP_CYRF, hop->channel);
+}
+
 /*
  * Send a data packet with length
  * @param[in] data The data of the packet
  * @param[in] length The length of the data
  */
 void cyrf_send_len(const uint8_t *data, const uint8_t length) {
-	cyrf_write_register(CYRF_TX_LENGTH, length);
+	uint8_t len = (length > sizeof(cyrf_tx_buf))? sizeof(cyrf_tx_buf) : length;
+	cyrf_write_register(CYRF_TX_LENGTH, len);
 	cyrf_write_register(CYRF_TX_CTRL, CYRF_TX_CLR);
-	cyrf_write_block(CYRF_TX_BUFFER, data, length);
-	cyrf_write_register(CYRF_TX_CTRL, CYRF_TX_GO | CYRF_TXC_IRQEN | CYRF_TXE_IRQEN);
+
+	// Write the buffer with DMA and start sending when it is done
+	spi_dev_wait(SPI_DEV_CYRF);
+	memcpy(cyrf_tx_buf, data, len);
+	spi_dev_transfer(SPI_DEV_CYRF, CYRF_DIR | CYRF_TX_BUFFER, cyrf_tx_buf, NULL, len, cyrf_send_done);
+	trace_add(TRACE_TX, TRACE_CHIP_CYRF, len);
+}
+
+/**
+ * Start sending when the TX buffer is written (can be called from the DMA interrupt)
+ */
+static void cyrf_send_done(enum spi_dev_t dev) {
+	spi_dev_transfer(dev, CYRF_DIR | CYRF_TX_CTRL, &cyrf_tx_go, NULL, 1, NULL);
 }
 
 /**
@@ -413,6 +584,7 @@ void cyrf_resend(void) {
 void cyrf_start_recv(void) {
 	cyrf_write_register(CYRF_RX_IRQ_STATUS, CYRF_RXOW_IRQ); // Clear the RX overwrite
 	cyrf_write_register(CYRF_RX_CTRL, CYRF_RX_GO | CYRF_RXC_IRQEN | CYRF_RXE_IRQEN); // Start receiving and set the IRQ
+	trace_add(TRACE_RX_START, TRACE_CHIP_CYRF, 0);
 	DEBUG(cyrf6936, "START RECEIVE");
 }
 
@@ -20,6 +20,9 @@
 #ifndef MODULES_CYRF6936_H_
 #define MODULES_CYRF6936_H_
 
+#include <stdint.h>
+#include <stdbool.h>
+
 /* The SPI interface defines */
 enum {
     CYRF_CHANNEL    		= 0x00,
@@ -69,6 +72,7 @@ enum {
     CYRF_ANALOG_CTRL    	= 0x39,
 };
 #define CYRF_DIR				(1<<7) /**< Bit for enabling writing */
+#define CYRF_INC				(1<<6) /**< Bit for auto incrementing the address */
 
 // CYRF_MODE_OVERRIDE
 #define CYRF_RST				(1<<0)
@@ -201,13 +205,35 @@ enum {
 };
 #define CYRF_DATA_CODE_LENGTH	(1<<5)
 
+/* A precompiled channel hop, the codes are only written when they change */
+struct cyrf_hop_t {
+	uint8_t channel;										/**< The RF channel */
+	const uint8_t *sop_code;						/**< The 8 bytes SOP code */
+	const uint8_t *data_code;						/**< The 16 bytes data code */
+};
+
+/* The states of the reset of the CYRF6936 */
+enum cyrf_reset_state_t {
+	CYRF_RESET_READY = 0,						/**< The chip is ready */
+	CYRF_RESET_HOLD,								/**< The reset pin is active */
+	CYRF_RESET_WAIT,								/**< Waiting for the chip to start after the reset pin is released */
+};
+
 /* The external functions */
 void cyrf_init(void);
 void cyrf_run(void);
 
+typedef void (*cyrf_on_ready)(void);
+void cyrf_reset_start(cyrf_on_ready callback);
+bool cyrf_reset_poll(void);
+bool cyrf_is_ready(void);
+void cyrf_wait_ready(void);
+void cyrf_shadow_invalidate(void);
+
 typedef void (*cyrf_on_event)(const bool error);
 void cyrf_register_recv_callback(cyrf_on_event callback);
 void cyrf_register_send_callback(cyrf_on_event callback);
+uint32_t cyrf_get_rx_time(void);
 
 void cyrf_write_register(const uint8_t address, const uint8_t data);
 void cyrf_write_block(const uint8_t address, const uint8_t data[], const int length);
@@ -231,6 +257,7 @@ void cyrf_set_rx_cfg(const uint8_t cfg);
 void cyrf_set_tx_cfg(const uint8_t cfg);
 void cyrf_set_rx_override(const uint8_t override);
 void cyrf_set_tx_override(const uint8_t override);
+void cyrf_hop(const struct cyrf_hop_t *hop, const uint16_t crc_seed);
 
 void cyrf_send_len(const uint8_t *data, const uint8_t length);
 void cyrf_send(const uint8_t *data);
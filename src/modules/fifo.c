@@ -0,0 +1,161 @@
+/*
+ * This file is part of the superbitrf project.
+ *
+ * Copyright (C) 2018 Freek van Tienen <freek.v.tienen@gmail.com>
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+
+#include "fifo.h"
+
+/**
+ * Initialize a FIFO on a buffer
+ * @param[in] fifo The FIFO
+ * @param[in] buf The buffer to store the data in
+ * @param[in] size The size of the buffer, which needs to be a power of two
+ */
+void fifo_init(struct fifo_t *fifo, uint8_t *buf, uint32_t size) {
+	fifo->data = buf;
+	fifo->mask = size - 1;
+	fifo->head = 0;
+	fifo->tail = 0;
+}
+
+/**
+ * Write as much data as fits, with at most two copies
+ * Only call this from the producer.
+ * @param[in] fifo The FIFO
+ * @param[in] data The data to write
+ * @param[in] len The length of the data
+ * @return The amount of bytes written
+ */
+uint32_t fifo_write(struct fifo_t *fifo, const uint8_t *data, uint32_t len) {
+	uint32_t head = fifo->head;
+	uint32_t space = fifo->mask + 1 - (head - __atomic_load_n(&fifo->tail, __ATOMIC_ACQUIRE));
+	uint32_t idx = head & fifo->mask;
+	uint32_t first;
+
+	if(len > space)
+		len = space;
+
+	// Copy until the end of the buffer and the rest from the start
+	first = fifo->mask + 1 - idx;
+	if(first > len)
+		first = len;
+	memcpy(&fifo->data[idx], data, first);
+	memcpy(fifo->data, data + first, len - first);
+
+	__atomic_store_n(&fifo->head, head + len, __ATOMIC_RELEASE);
+	return len;
+}
+
+/**
+ * Read as much data as available, with at most two copies
+ * Only call this from the consumer.
+ * @param[in] fifo The FIFO
+ * @param[out] data The buffer to read into
+ * @param[in] len The size of the buffer
+ * @return The amount of bytes read
+ */
+uint32_t fifo_read(struct fifo_t *fifo, uint8_t *data, uint32_t len) {
+	uint32_t tail = fifo->tail;
+	uint32_t used = __atomic_load_n(&fifo->head, __ATOMIC_ACQUIRE) - tail;
+	uint32_t idx = tail & fifo->mask;
+	uint32_t first;
+
+	if(len > used)
+		len = used;
+
+	// Copy until the end of the buffer and the rest from the start
+	first = fifo->mask + 1 - idx;
+	if(first > len)
+		first = len;
+	memcpy(data, &fifo->data[idx], first);
+	memcpy(data + first, fifo->data, len - first);
+
+	__atomic_store_n(&fifo->tail, tail + len, __ATOMIC_RELEASE);
+	return len;
+}
+
+/**
+ * Get the contiguous free space to write into without copying
+ * Only call this from the producer and finish with fifo_write_commit().
+ * @param[in] fifo The FIFO
+ * @param[out] ptr The start of the free space
+ * @return The amount of contiguous bytes which can be written
+ */
+uint32_t fifo_write_span(struct fifo_t *fifo, uint8_t **ptr) {
+	uint32_t head = fifo->head;
+	uint32_t space = fifo->mask + 1 - (head - __atomic_load_n(&fifo->tail, __ATOMIC_ACQUIRE));
+	uint32_t idx = head & fifo->mask;
+
+	*ptr = &fifo->data[idx];
+	return (space < fifo->mask + 1 - idx)? space : fifo->mask + 1 - idx;
+}
+
+/**
+ * Write data behind the published bytes without publishing it yet
+ * Only call this from the producer after checking fifo_free(), a frame written
+ * this way becomes readable at once with fifo_write_commit().
+ * @param[in] fifo The FIFO
+ * @param[in] offset The offset from the write index
+ * @param[in] data The data to write
+ * @param[in] len The length of the data
+ */
+void fifo_write_at(struct fifo_t *fifo, uint32_t offset, const uint8_t *data, uint32_t len) {
+	uint32_t idx = (fifo->head + offset) & fifo->mask;
+	uint32_t first = fifo->mask + 1 - idx;
+
+	if(first > len)
+		first = len;
+	memcpy(&fifo->data[idx], data, first);
+	memcpy(fifo->data, data + first, len - first);
+}
+
+/**
+ * Publish the bytes written into the span of fifo_write_span() or with
+ * fifo_write_at()
+ * @param[in] fifo The FIFO
+ * @param[in] len The amount of bytes written
+ */
+void fifo_write_commit(struct fifo_t *fifo, uint32_t len) {
+	__atomic_store_n(&fifo->head, fifo->head + len, __ATOMIC_RELEASE);
+}
+
+/**
+ * Get the contiguous data to read from without copying
+ * Only call this from the consumer and finish with fifo_read_commit().
+ * @param[in] fifo The FIFO
+ * @param[out] ptr The start of the data
+ * @return The amount of contiguous bytes which can be read
+ */
+uint32_t fifo_read_span(struct fifo_t *fifo, const uint8_t **ptr) {
+	uint32_t tail = fifo->tail;
+	uint32_t used = __atomic_load_n(&fifo->head, __ATOMIC_ACQUIRE) - tail;
+	uint32_t idx = tail & fifo->mask;
+
+	*ptr = &fifo->data[idx];
+	return (used < fifo->mask + 1 - idx)? used : fifo->mask + 1 - idx;
+}
+
+/**
+ * Free the bytes read from the span of fifo_read_span()
+ * @param[in] fifo The FIFO
+ * @param[in] len The amount of bytes read, at most the span length
+ */
+void fifo_read_commit(struct fifo_t *fifo, uint32_t len) {
+	__atomic_store_n(&fifo->tail, fifo->tail + len, __ATOMIC_RELEASE);
+}
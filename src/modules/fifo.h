@@ -0,0 +1,96 @@
+/*
+ * This file is part of the superbitrf project.
+ *
+ * Copyright (C) 2018 Freek van Tienen <freek.v.tienen@gmail.com>
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MODULES_FIFO_H_
+#define MODULES_FIFO_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* A lock-free byte FIFO for a single producer and a single consumer, for
+ * example an USB interrupt and the main loop. The size needs to be a power of
+ * two, the indexes run freely and are masked on access so all bytes are usable.
+ */
+struct fifo_t {
+	uint8_t *data;							/**< The buffer holding the data */
+	uint32_t mask;							/**< The size of the buffer minus one */
+	volatile uint32_t head;			/**< The write index, only changed by the producer */
+	volatile uint32_t tail;			/**< The read index, only changed by the consumer */
+};
+
+/* External functions */
+void fifo_init(struct fifo_t *fifo, uint8_t *buf, uint32_t size);
+uint32_t fifo_write(struct fifo_t *fifo, const uint8_t *data, uint32_t len);
+uint32_t fifo_read(struct fifo_t *fifo, uint8_t *data, uint32_t len);
+uint32_t fifo_write_span(struct fifo_t *fifo, uint8_t **ptr);
+void fifo_write_at(struct fifo_t *fifo, uint32_t offset, const uint8_t *data, uint32_t len);
+void fifo_write_commit(struct fifo_t *fifo, uint32_t len);
+uint32_t fifo_read_span(struct fifo_t *fifo, const uint8_t **ptr);
+void fifo_read_commit(struct fifo_t *fifo, uint32_t len);
+
+/**
+ * The amount of bytes which can be read
+ */
+static inline uint32_t fifo_used(const struct fifo_t *fifo) {
+	return __atomic_load_n(&fifo->head, __ATOMIC_ACQUIRE) - __atomic_load_n(&fifo->tail, __ATOMIC_ACQUIRE);
+}
+
+/**
+ * The amount of bytes which can be written
+ */
+static inline uint32_t fifo_free(const struct fifo_t *fifo) {
+	return fifo->mask + 1 - fifo_used(fifo);
+}
+
+/**
+ * Whether there is nothing to read
+ */
+static inline bool fifo_empty(const struct fifo_t *fifo) {
+	return fifo_used(fifo) == 0;
+}
+
+/**
+ * Write one byte
+ * @return Whether there was space for the byte
+ */
+static inline bool fifo_write_ch(struct fifo_t *fifo, uint8_t ch) {
+	uint32_t head = fifo->head;
+	if(head - __atomic_load_n(&fifo->tail, __ATOMIC_ACQUIRE) > fifo->mask)
+		return false;
+
+	fifo->data[head & fifo->mask] = ch;
+	__atomic_store_n(&fifo->head, head + 1, __ATOMIC_RELEASE);
+	return true;
+}
+
+/**
+ * Read one byte
+ * @return Whether there was a byte to read
+ */
+static inline bool fifo_read_ch(struct fifo_t *fifo, uint8_t *ch) {
+	uint32_t tail = fifo->tail;
+	if(__atomic_load_n(&fifo->head, __ATOMIC_ACQUIRE) == tail)
+		return false;
+
+	*ch = fifo->data[tail & fifo->mask];
+	__atomic_store_n(&fifo->tail, tail + 1, __ATOMIC_RELEASE);
+	return true;
+}
+
+#endif /* MODULES_FIFO_H_ */
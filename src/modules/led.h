@@ -20,9 +20,6 @@
 #ifndef MODULES_LED_H_
 #define MODULES_LED_H_
 
-#include <libopencm3/stm32/rcc.h>
-#include <libopencm3/stm32/gpio.h>
-
 // Include the board specifications for the leds
 #include "../board.h"
 
@@ -31,30 +28,8 @@
 #define LED_0_GPIO_PORT				0
 #define LED_0_GPIO_PIN				0
 
-/* Control the leds from the board */
-#define _(i)  i
-#define LED_GPIO_PORT(i)	_(LED_ ## i ## _GPIO_PORT)
-#define LED_GPIO_PIN(i)		_(LED_ ## i ## _GPIO_PIN)
-#define LED_GPIO_CLK(i)		_(LED_ ## i ## _GPIO_CLK)
-
-#ifdef LED_INV
-#define LED_ON(i)		if(i > 0) gpio_set(LED_GPIO_PORT(i), LED_GPIO_PIN(i))
-#define LED_OFF(i)	if(i > 0) gpio_clear(LED_GPIO_PORT(i), LED_GPIO_PIN(i))
-#else
-#define LED_ON(i)		if(i > 0) gpio_clear(LED_GPIO_PORT(i), LED_GPIO_PIN(i))
-#define LED_OFF(i)	if(i > 0) gpio_set(LED_GPIO_PORT(i), LED_GPIO_PIN(i))
-#endif
-#define LED_TOGGLE(i)	if(i > 0) gpio_toggle(LED_GPIO_PORT(i), LED_GPIO_PIN(i))
-
-#define LED_INIT(i) {                         \
-	rcc_periph_clock_enable(LED_GPIO_CLK(i));		\
-	gpio_set_mode(LED_GPIO_PORT(i),             \
-				  GPIO_MODE_OUTPUT_50_MHZ,          	\
-				  GPIO_CNF_OUTPUT_PUSHPULL,         	\
-				  LED_GPIO_PIN(i));                 	\
-	LED_OFF(i);																	\
-}
-
+// Include the architecture specific LED control (LED_ON, LED_OFF, LED_TOGGLE, LED_INIT)
+#include "led_arch.h"
 
 /* External functions for the leds */
 void led_init(void);
@@ -0,0 +1,39 @@
+/*
+ * This file is part of the superbitrf project.
+ *
+ * Copyright (C) 2018 Freek van Tienen <freek.v.tienen@gmail.com>
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MODULES_MCU_H_
+#define MODULES_MCU_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Include the architecture specific inline functions
+#include "mcu_arch.h"
+
+/* External functions for the microcontroller */
+void mcu_init(void);
+void mcu_get_unique_id(uint32_t *id);
+
+/* Flash programming */
+void mcu_flash_unlock(void);
+void mcu_flash_lock(void);
+void mcu_flash_erase_page(uint32_t addr);
+void mcu_flash_program_half_word(uint32_t addr, uint16_t data);
+
+#endif /* MODULES_MCU_H_ */
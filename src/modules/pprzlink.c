@@ -17,19 +17,29 @@
  * along with this library.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <string.h>
+
 #include "pprzlink.h"
 #include "modules/cdcacm.h"
-#include "modules/ring.h"
+#include "modules/console.h"
+#include "modules/config.h"
+#include "modules/counter.h"
+#include "modules/fifo.h"
 #include "modules/led.h"
+#include "modules/mcu.h"
+#include "modules/sched.h"
 
 struct pprzlink_t pprzlink;
 
-bool pprzlink_check_free_space(struct pprzlink_t *link, long *fd, uint16_t len);
+int pprzlink_check_free_space(struct pprzlink_t *link, long *fd, uint16_t len);
 void pprzlink_put_byte(struct pprzlink_t *link, long fd, uint8_t data);
 void pprzlink_put_buffer(struct pprzlink_t *link, long fd, const uint8_t *data, uint16_t len);
 void pprzlink_send_message(struct pprzlink_t *link, long fd);
-bool pprzlink_char_available(struct pprzlink_t *link);
+int pprzlink_char_available(struct pprzlink_t *link);
 uint8_t pprzlink_get_byte(struct pprzlink_t *link);
+static void pprzlink_frame_write(struct pprzlink_t *link, const uint8_t *data, uint16_t len);
+static void pprzlink_cmd_stats(char *cmdLine);
+static void pprzlink_batch_flush(void);
 
 /**
  * Initialize the pprzlink protocol and devices
@@ -50,6 +60,17 @@ void pprzlink_init(void) {
 
 	pprzlink.r_rx = &cdcacm_data_rx;
 	pprzlink.r_tx = &cdcacm_data_tx;
+
+	pprzlink.tx_size = 0;
+	pprzlink.tx_len = 0;
+	pprzlink.tx_msgs = 0;
+	pprzlink.tx_dropped = 0;
+	for(uint8_t i = 0; i < PPRZLINK_STATS_IDS; i++)
+		pprzlink.tx_drops[i] = 0;
+	pprzlink.batch_len = 0;
+	pprzlink.batch_cnt = 0;
+
+	console_cmd_add("stats", "", pprzlink_cmd_stats);
 }
 
 /**
@@ -67,6 +88,133 @@ void pprzlink_run(void) {
 
   	pprzlink.msg_received = false;
   }
+
+  // Only one message is parsed at a time
+  if(!fifo_empty(pprzlink.r_rx))
+  	sched_event(SCHED_EV_DATA_RX);
+}
+
+/**
+ * Send a received radio packet to the host, over the raw packet interface when
+ * the host is streaming and as a RECV_DATA message otherwise
+ * On the data port the receive time is appended to the packet as a little
+ * endian uint32.
+ * @param[in] chip_id The radio chip that received the packet
+ * @param[in] rx_time The time in microseconds the packet was received
+ * @param[in] len The length of the packet
+ * @param[in] data The packet
+ */
+void pprzlink_send_recv_data(uint8_t chip_id, uint32_t rx_time, uint8_t len, uint8_t *data) {
+	uint8_t time[4] = {rx_time & 0xFF, (rx_time >> 8) & 0xFF, (rx_time >> 16) & 0xFF, rx_time >> 24};
+
+	if(cdcacm_vendor_send(chip_id, rx_time, data, len))
+		return;
+
+	// Without batching or when the packet never fits a batch send it on its own
+	if(config.batch_packets <= 1 || len + 6 > PPRZLINK_BATCH_SIZE) {
+		uint8_t packet[len + 4];
+		memcpy(packet, data, len);
+		memcpy(&packet[len], time, 4);
+		pprz_msg_send_RECV_DATA(&pprzlink.tp.trans_tx, &pprzlink.dev, 1, &chip_id, len + 4, packet);
+		return;
+	}
+
+	// The batch is flushed from the main loop as well
+	uint32_t irq = mcu_irq_save();
+	if(pprzlink.batch_len + len + 6 > PPRZLINK_BATCH_SIZE)
+		pprzlink_batch_flush();
+
+	if(pprzlink.batch_cnt == 0)
+		pprzlink.batch_start = counter_get_ticks();
+	pprzlink.batch[pprzlink.batch_len++] = chip_id;
+	pprzlink.batch[pprzlink.batch_len++] = len + 4;
+	memcpy(&pprzlink.batch[pprzlink.batch_len], data, len);
+	memcpy(&pprzlink.batch[pprzlink.batch_len + len], time, 4);
+	pprzlink.batch_len += len + 4;
+
+	if(++pprzlink.batch_cnt >= config.batch_packets)
+		pprzlink_batch_flush();
+	mcu_irq_restore(irq);
+}
+
+/**
+ * Send the batch once its oldest packet waited for the batch window
+ */
+void pprzlink_batch_run(void) {
+	uint32_t now = counter_get_ticks();
+	uint32_t irq = mcu_irq_save();
+	if(pprzlink.batch_cnt != 0 &&
+			now - pprzlink.batch_start >= counter_get_ticks_of_ms(config.batch_window_ms))
+		pprzlink_batch_flush();
+	mcu_irq_restore(irq);
+}
+
+/**
+ * Send all packets in the batch as one message
+ * <message name="RECV_DATA_BATCH" id="7">
+ *   <field name="data" type="uint8[]">Packets, each as chip id, length and data</field>
+ * </message>
+ * Called with the interrupts disabled, as the radio interrupts append to the batch.
+ */
+static void pprzlink_batch_flush(void) {
+	struct transport_tx *trans = &pprzlink.tp.trans_tx;
+	struct link_device *dev = &pprzlink.dev;
+	uint8_t ac_id = 1;
+	uint8_t nb_data = pprzlink.batch_len;
+
+	if(pprzlink.batch_cnt == 0)
+		return;
+
+	long fd = 0; uint8_t size = trans->size_of(trans->impl, 0+1+nb_data+2);
+	if (trans->check_available_space(trans->impl, dev, &fd, size)) {
+		trans->count_bytes(trans->impl, dev, size);
+		trans->start_message(trans->impl, dev, fd, 0+1+nb_data+2);
+		trans->put_bytes(trans->impl, dev, fd, DL_TYPE_UINT8, DL_FORMAT_SCALAR, &ac_id, 1);
+		trans->put_named_byte(trans->impl, dev, fd, DL_TYPE_UINT8, DL_FORMAT_SCALAR, PPRZ_MSG_ID_RECV_DATA_BATCH, "RECV_DATA_BATCH");
+		trans->put_bytes(trans->impl, dev, fd, DL_TYPE_ARRAY_LENGTH, DL_FORMAT_SCALAR, (void *) &nb_data, 1);
+		trans->put_bytes(trans->impl, dev, fd, DL_TYPE_UINT8, DL_FORMAT_ARRAY, (void *) pprzlink.batch, nb_data);
+		trans->end_message(trans->impl, dev, fd);
+	} else trans->overrun(trans->impl, dev);
+
+	pprzlink.batch_len = 0;
+	pprzlink.batch_cnt = 0;
+}
+
+/**
+ * Send the transmit statistics
+ * <message name="STATS" id="6">
+ *   <field name="msgs" type="uint32">Messages sent on the data port</field>
+ *   <field name="dropped" type="uint32">Messages dropped on the data port</field>
+ *   <field name="raw_dropped" type="uint32">Frames dropped on the raw packet interface</field>
+ *   <field name="drops" type="uint32[]">Messages dropped on the data port per message id</field>
+ * </message>
+ */
+void pprzlink_send_stats(void) {
+	struct transport_tx *trans = &pprzlink.tp.trans_tx;
+	struct link_device *dev = &pprzlink.dev;
+	uint8_t ac_id = 1;
+	uint8_t nb_drops = PPRZLINK_STATS_IDS;
+	uint32_t msgs = pprzlink.tx_msgs;
+	uint32_t dropped = pprzlink.tx_dropped;
+	uint32_t raw_dropped = cdcacm_vendor_dropped;
+
+	// Only send the drop counters up to the highest message id which dropped
+	while(nb_drops > 0 && pprzlink.tx_drops[nb_drops-1] == 0)
+		nb_drops--;
+
+	long fd = 0; uint8_t size = trans->size_of(trans->impl, 0+4+4+4+1+nb_drops*4+2);
+	if (trans->check_available_space(trans->impl, dev, &fd, size)) {
+		trans->count_bytes(trans->impl, dev, size);
+		trans->start_message(trans->impl, dev, fd, 0+4+4+4+1+nb_drops*4+2);
+		trans->put_bytes(trans->impl, dev, fd, DL_TYPE_UINT8, DL_FORMAT_SCALAR, &ac_id, 1);
+		trans->put_named_byte(trans->impl, dev, fd, DL_TYPE_UINT8, DL_FORMAT_SCALAR, PPRZ_MSG_ID_STATS, "STATS");
+		trans->put_bytes(trans->impl, dev, fd, DL_TYPE_UINT32, DL_FORMAT_SCALAR, (void *) &msgs, 4);
+		trans->put_bytes(trans->impl, dev, fd, DL_TYPE_UINT32, DL_FORMAT_SCALAR, (void *) &dropped, 4);
+		trans->put_bytes(trans->impl, dev, fd, DL_TYPE_UINT32, DL_FORMAT_SCALAR, (void *) &raw_dropped, 4);
+		trans->put_bytes(trans->impl, dev, fd, DL_TYPE_ARRAY_LENGTH, DL_FORMAT_SCALAR, (void *) &nb_drops, 1);
+		trans->put_bytes(trans->impl, dev, fd, DL_TYPE_UINT32, DL_FORMAT_ARRAY, (void *) pprzlink.tx_drops, nb_drops*4);
+		trans->end_message(trans->impl, dev, fd);
+	} else trans->overrun(trans->impl, dev);
 }
 
 /**
@@ -76,26 +224,77 @@ void pprzlink_register_cb(uint8_t msg_id, msg_cb_t cb) {
 	pprzlink.msg_cb[msg_id] = cb;
 }
 
-bool pprzlink_check_free_space(struct pprzlink_t *link, long *fd __attribute__((unused)), uint16_t len) {
-	return RING_FREE_SPACE(link->r_tx) > len;
+/**
+ * Reserve a frame in the transmit FIFO
+ * The frame is written behind the published bytes and only becomes readable as
+ * a whole in pprzlink_send_message(). A frame which does not fit is still
+ * accepted, but dropped and counted per message id once it is complete.
+ * Messages are sent from the radio interrupts and the main loop, so the interrupts are
+ * disabled until the frame is published to keep it a single producer.
+ */
+int pprzlink_check_free_space(struct pprzlink_t *link, long *fd __attribute__((unused)), uint16_t len) {
+	link->tx_irq = mcu_irq_save();
+	link->tx_size = len;
+	link->tx_len = 0;
+	link->tx_msg_id = 0;
+	link->tx_drop = (fifo_free(link->r_tx) < len);
+	return true;
 }
 
 void pprzlink_put_byte(struct pprzlink_t *link, long fd __attribute__((unused)), uint8_t data) {
-	ring_write_ch(link->r_tx, data);
+	pprzlink_frame_write(link, &data, 1);
 }
 
 void pprzlink_put_buffer(struct pprzlink_t *link, long fd __attribute__((unused)), const uint8_t *data, uint16_t len) {
-	ring_write(link->r_tx, data, len);
+	pprzlink_frame_write(link, data, len);
 }
 
-void pprzlink_send_message(struct pprzlink_t *link __attribute__((unused)), long fd __attribute__((unused))) {
+/**
+ * Publish or drop the finished frame
+ */
+void pprzlink_send_message(struct pprzlink_t *link, long fd __attribute__((unused))) {
+	if(link->tx_drop || link->tx_len > link->tx_size) {
+		link->tx_dropped++;
+		if(link->tx_msg_id < PPRZLINK_STATS_IDS)
+			link->tx_drops[link->tx_msg_id]++;
+	} else {
+		fifo_write_commit(link->r_tx, link->tx_len);
+		link->tx_msgs++;
+		sched_event(SCHED_EV_USB_TX);
+	}
+	link->tx_size = 0;
+	mcu_irq_restore(link->tx_irq);
+}
+
+/**
+ * Write into the reserved frame, noting the message id (STX, length, sender id, message id)
+ */
+static void pprzlink_frame_write(struct pprzlink_t *link, const uint8_t *data, uint16_t len) {
+	if(link->tx_len <= 3 && link->tx_len + len > 3)
+		link->tx_msg_id = data[3 - link->tx_len];
+
+	if(!link->tx_drop && link->tx_len + len <= link->tx_size)
+		fifo_write_at(link->r_tx, link->tx_len, data, len);
+	link->tx_len += len;
+}
 
+/**
+ * Print the transmit statistics
+ */
+static void pprzlink_cmd_stats(char *cmdLine __attribute__((unused))) {
+	console_print("\r\nLink sent %u, dropped %u, raw dropped %u", pprzlink.tx_msgs, pprzlink.tx_dropped, cdcacm_vendor_dropped);
+	for(uint8_t i = 0; i < PPRZLINK_STATS_IDS; i++) {
+		if(pprzlink.tx_drops[i] != 0)
+			console_print("\r\n\tid %u: %u", i, pprzlink.tx_drops[i]);
+	}
 }
 
-bool pprzlink_char_available(struct pprzlink_t *link) {
-	return !RING_EMPTY(link->r_rx);
+int pprzlink_char_available(struct pprzlink_t *link) {
+	return !fifo_empty(link->r_rx);
 }
 
 uint8_t pprzlink_get_byte(struct pprzlink_t *link) {
-	return ring_read_ch(link->r_rx, NULL);
+	uint8_t data = 0;
+	fifo_read_ch(link->r_rx, &data);
+	return data;
 }
\ No newline at end of file
@@ -26,15 +26,54 @@
 
 typedef void (*msg_cb_t)(uint8_t *data);
 
+/* The STATS, RECV_DATA_BATCH, TX_FILTER, PROF_STATS, TRACE and TRACE_CTRL messages are not yet part of the generated usbrf messages */
+#ifndef PPRZ_MSG_ID_STATS
+#define PPRZ_MSG_ID_STATS 6
+#endif
+#ifndef PPRZ_MSG_ID_RECV_DATA_BATCH
+#define PPRZ_MSG_ID_RECV_DATA_BATCH 7
+#endif
+#ifndef PPRZ_MSG_ID_TX_FILTER
+#define PPRZ_MSG_ID_TX_FILTER 8
+#define DL_TX_FILTER_action(_payload) (*((uint8_t*)((uint8_t*)_payload+2)))
+#define DL_TX_FILTER_chip_id(_payload) (*((uint8_t*)((uint8_t*)_payload+3)))
+#define DL_TX_FILTER_ids_length(_payload) (*((uint8_t*)((uint8_t*)_payload+4)))
+#define DL_TX_FILTER_ids(_payload) ((uint16_t*)(_payload+5))
+#endif
+#ifndef PPRZ_MSG_ID_PROF_STATS
+#define PPRZ_MSG_ID_PROF_STATS 9
+#endif
+#ifndef PPRZ_MSG_ID_TRACE
+#define PPRZ_MSG_ID_TRACE 10
+#endif
+#ifndef PPRZ_MSG_ID_TRACE_CTRL
+#define PPRZ_MSG_ID_TRACE_CTRL 11
+#define DL_TRACE_CTRL_stream(_payload) (*((uint8_t*)((uint8_t*)_payload+2)))
+#endif
+#define PPRZLINK_STATS_IDS 32		///< Message ids with a drop counter in the STATS message
+#define PPRZLINK_BATCH_SIZE 240	///< Maximum size of the packets in one RECV_DATA_BATCH message
+
 /* Main paparazzi link variables */
 struct pprzlink_t {
 	struct link_device dev;		///< The communication device
 	struct pprz_transport tp;	///< The transport layer state
 	uint8_t recv_buf[256];		///< The receive message buffer
 	bool msg_received;				///< Whether a message is received or not
-	struct ring *r_rx;				///< The receive ring buffer
-	struct ring *r_tx;				///< The transmit ring buffer
+	struct fifo_t *r_rx;			///< The receive FIFO
+	struct fifo_t *r_tx;			///< The transmit FIFO
 	msg_cb_t msg_cb[256];			///< The callback functions for the received messages
+	uint16_t tx_size;					///< The reserved length of the frame being written
+	uint16_t tx_len;					///< The written length of the frame being written
+	uint8_t tx_msg_id;				///< The message id of the frame being written
+	bool tx_drop;							///< Whether the frame being written does not fit and is dropped
+	uint32_t tx_irq;					///< The interrupt mask from before the frame being written
+	uint32_t tx_msgs;					///< The amount of messages sent
+	uint32_t tx_dropped;			///< The amount of messages dropped
+	uint32_t tx_drops[PPRZLINK_STATS_IDS];	///< The dropped messages per message id
+	uint8_t batch[PPRZLINK_BATCH_SIZE];	///< The packets waiting for a RECV_DATA_BATCH message
+	uint8_t batch_len;				///< The used length of the batch
+	uint8_t batch_cnt;				///< The amount of packets in the batch
+	uint32_t batch_start;			///< The counter ticks when the first packet was added to the batch
 };
 
 /* Extern variables and functions */
@@ -42,5 +81,8 @@ extern struct pprzlink_t pprzlink;
 void pprzlink_init(void);
 void pprzlink_run(void);
 void pprzlink_register_cb(uint8_t msg_id, msg_cb_t cb);
+void pprzlink_send_stats(void);
+void pprzlink_batch_run(void);
+void pprzlink_send_recv_data(uint8_t chip_id, uint32_t rx_time, uint8_t len, uint8_t *data);
 
 #endif /* MODULES_PPRZLINK_H_ */
@@ -0,0 +1,143 @@
+/*
+ * This file is part of the superbitrf project.
+ *
+ * Copyright (C) 2018 Freek van Tienen <freek.v.tienen@gmail.com>
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+
+#include "prof.h"
+#include "modules/console.h"
+#include "modules/pprzlink.h"
+
+/* Main variables */
+static struct prof_stats_t prof_stats[PROF_SITES];			/**< The statistics per site */
+static const char *prof_names[PROF_SITES] = {
+	"timer irq", "timer ch1", "timer ch2", "timer ch3", "timer ch4", "cyrf irq", "cc irq", "usb irq", "protocol"
+};
+
+/* Internal functions */
+static void prof_reset(void);
+static void prof_cmd(char *cmdLine);
+
+/**
+ * Start the cycle counter and clear the statistics
+ */
+void prof_init(void) {
+	prof_arch_init();
+	prof_reset();
+	console_cmd_add("prof", "[reset]", prof_cmd);
+}
+
+/**
+ * Add a sample to a site, this is called from the interrupts
+ * @param[in] site The measured site
+ * @param[in] cycles The CPU cycles the site took
+ */
+void prof_add(enum prof_site_t site, uint32_t cycles) {
+	struct prof_stats_t *stats = &prof_stats[site];
+
+	stats->count++;
+	stats->sum += cycles;
+	if(cycles < stats->min)
+		stats->min = cycles;
+	if(cycles > stats->max)
+		stats->max = cycles;
+	stats->hist[31 - __builtin_clz(cycles | 1)]++;
+}
+
+/**
+ * Send the statistics of every measured site
+ * <message name="PROF_STATS" id="9">
+ *   <field name="site" type="uint8">The measured site</field>
+ *   <field name="count" type="uint32">The amount of samples</field>
+ *   <field name="min" type="uint32" unit="cycles"/>
+ *   <field name="max" type="uint32" unit="cycles"/>
+ *   <field name="mean" type="uint32" unit="cycles"/>
+ *   <field name="hist" type="uint32[]">Samples per log2 bucket of the cycles</field>
+ * </message>
+ */
+void prof_send_stats(void) {
+	struct transport_tx *trans = &pprzlink.tp.trans_tx;
+	struct link_device *dev = &pprzlink.dev;
+	uint8_t ac_id = 1;
+
+	for(uint8_t site = 0; site < PROF_SITES; site++) {
+		struct prof_stats_t *stats = &prof_stats[site];
+		uint32_t count = stats->count, min = stats->min, max = stats->max;
+		uint32_t mean = (count > 0)? stats->sum / count : 0;
+		uint8_t nb_hist = PROF_HIST_SIZE;
+
+		if(count == 0)
+			continue;
+
+		// Only send the buckets up to the highest used one
+		while(nb_hist > 0 && stats->hist[nb_hist-1] == 0)
+			nb_hist--;
+
+		long fd = 0; uint8_t size = trans->size_of(trans->impl, 0+1+4+4+4+4+1+nb_hist*4+2);
+		if (trans->check_available_space(trans->impl, dev, &fd, size)) {
+			trans->count_bytes(trans->impl, dev, size);
+			trans->start_message(trans->impl, dev, fd, 0+1+4+4+4+4+1+nb_hist*4+2);
+			trans->put_bytes(trans->impl, dev, fd, DL_TYPE_UINT8, DL_FORMAT_SCALAR, &ac_id, 1);
+			trans->put_named_byte(trans->impl, dev, fd, DL_TYPE_UINT8, DL_FORMAT_SCALAR, PPRZ_MSG_ID_PROF_STATS, "PROF_STATS");
+			trans->put_bytes(trans->impl, dev, fd, DL_TYPE_UINT8, DL_FORMAT_SCALAR, (void *) &site, 1);
+			trans->put_bytes(trans->impl, dev, fd, DL_TYPE_UINT32, DL_FORMAT_SCALAR, (void *) &count, 4);
+			trans->put_bytes(trans->impl, dev, fd, DL_TYPE_UINT32, DL_FORMAT_SCALAR, (void *) &min, 4);
+			trans->put_bytes(trans->impl, dev, fd, DL_TYPE_UINT32, DL_FORMAT_SCALAR, (void *) &max, 4);
+			trans->put_bytes(trans->impl, dev, fd, DL_TYPE_UINT32, DL_FORMAT_SCALAR, (void *) &mean, 4);
+			trans->put_bytes(trans->impl, dev, fd, DL_TYPE_ARRAY_LENGTH, DL_FORMAT_SCALAR, (void *) &nb_hist, 1);
+			trans->put_bytes(trans->impl, dev, fd, DL_TYPE_UINT32, DL_FORMAT_ARRAY, (void *) stats->hist, nb_hist*4);
+			trans->end_message(trans->impl, dev, fd);
+		} else trans->overrun(trans->impl, dev);
+	}
+}
+
+/**
+ * Clear the statistics of all sites
+ */
+static void prof_reset(void) {
+	memset(prof_stats, 0, sizeof(prof_stats));
+	for(uint8_t i = 0; i < PROF_SITES; i++)
+		prof_stats[i].min = UINT32_MAX;
+}
+
+/**
+ * Print the statistics or reset them
+ */
+static void prof_cmd(char *cmdLine) {
+	uint32_t cycles_us = prof_get_cycles_per_us();
+
+	if(strstr(cmdLine, "reset") != NULL) {
+		prof_reset();
+		return;
+	}
+
+	console_print("\r\nSite: count, min/mean/max cycles (max us)");
+	for(uint8_t i = 0; i < PROF_SITES; i++) {
+		struct prof_stats_t *stats = &prof_stats[i];
+		if(stats->count == 0)
+			continue;
+
+		console_print("\r\n%s: %u, %u/%u/%u (%u)", prof_names[i], stats->count, stats->min,
+			(uint32_t)(stats->sum / stats->count), stats->max, stats->max / cycles_us);
+		console_print("\r\n\t");
+		for(uint8_t j = 0; j < PROF_HIST_SIZE; j++) {
+			if(stats->hist[j] != 0)
+				console_print(" 2^%u:%u", j, stats->hist[j]);
+		}
+	}
+}
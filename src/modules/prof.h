@@ -0,0 +1,69 @@
+/*
+ * This file is part of the superbitrf project.
+ *
+ * Copyright (C) 2018 Freek van Tienen <freek.v.tienen@gmail.com>
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MODULES_PROF_H_
+#define MODULES_PROF_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Measures the execution time of the interrupts and callbacks in CPU cycles.
+ * Only compiled in when building with PROF=1, otherwise the macros are empty.
+ * Wrap a site with PROF_START(var) and PROF_END(site, var).
+ */
+enum prof_site_t {
+	PROF_TIMER_IRQ = 0,					/**< The timer interrupt including the callbacks */
+	PROF_TIMER_CH1,							/**< The timer channel 1 callback (timer1 of the protocols) */
+	PROF_TIMER_CH2,							/**< The timer channel 2 callback (timer2 of the protocols) */
+	PROF_TIMER_CH3,							/**< The timer channel 3 callback */
+	PROF_TIMER_CH4,							/**< The timer channel 4 callback */
+	PROF_CYRF_IRQ,							/**< The CYRF6936 interrupt (or poll) including the callbacks */
+	PROF_CC_IRQ,								/**< The CC2500 interrupt (or poll) including the callbacks */
+	PROF_USB_IRQ,								/**< The USB interrupt */
+	PROF_PROTOCOL,							/**< The run function of the protocols */
+	PROF_SITES									/**< The amount of sites */
+};
+
+#define PROF_HIST_SIZE 32				/**< The log2 histogram buckets, bucket i counts 2^i up to 2^(i+1)-1 cycles */
+
+/* The statistics of one site */
+struct prof_stats_t {
+	uint32_t count;							/**< The amount of samples */
+	uint32_t min;								/**< The minimum cycles */
+	uint32_t max;								/**< The maximum cycles */
+	uint64_t sum;								/**< The total cycles, for the mean */
+	uint32_t hist[PROF_HIST_SIZE];	/**< The log2 histogram of the cycles */
+};
+
+#ifdef PROF
+#include "prof_arch.h"
+
+#define PROF_START(var) uint32_t var = prof_get_cycles()
+#define PROF_END(site, var) prof_add(site, prof_get_cycles() - var)
+
+/* External functions */
+void prof_init(void);
+void prof_add(enum prof_site_t site, uint32_t cycles);
+void prof_send_stats(void);
+#else
+#define PROF_START(var)
+#define PROF_END(site, var)
+#endif
+
+#endif /* MODULES_PROF_H_ */
@@ -25,6 +25,9 @@
 #include "protocol.h"
 #include "modules/console.h"
 #include "modules/pprzlink.h"
+#include "modules/prof.h"
+#include "modules/cyrf6936.h"
+#include "modules/cc2500.h"
 #include "protocol/cyrf_scanner.h"
 #include "protocol/dsm_hack.h"
 #include "protocol/cc_scanner.h"
@@ -42,8 +45,9 @@ static struct protocol_t *protocols[] = {
 	&protocol_frsky_transmitter,
 };
 static const int protocols_nb = sizeof(protocols) / sizeof(protocols[0]);
-static int protocol_cur_idx;
-static bool protocol_running;
+static int protocol_cur_idx[PROTOCOL_RADIO_NB];		/**< The protocol selected on each radio chip */
+static bool protocol_running[PROTOCOL_RADIO_NB];	/**< Whether the protocol of each radio chip is running */
+static enum protocol_radio_t protocol_sel;				/**< The radio chip the console commands apply to */
 uint16_t protocol_rc_chan[16];					//*< The received rc channels */
 uint8_t protocol_rc_chan_nb;						//*< The amount of received rc channels */ 
 
@@ -53,6 +57,10 @@ static void protocol_cmd_set(char *cmdLine);
 static void protocol_cmd_start(char *cmdLine);
 static void protocol_cmd_stop(char *cmdLine);
 static void protocol_cmd_status(char *cmdLine);
+static void protocol_cmd_arg(char *cmdLine);
+
+/* Internal functions */
+static void protocol_change(enum protocol_radio_t radio, int idx);
 
 /* PPRZ bindings */
 static void protocol_pprz_exec(uint8_t *data);
@@ -63,8 +71,12 @@ static void protocol_pprz_rc_data(uint8_t *data);
  */
 void protocol_init(void) {
   // Set the current protocol
-  protocol_cur_idx = -1;
-  protocol_running = false;
+  uint8_t i;
+  for(i = 0; i < PROTOCOL_RADIO_NB; i++) {
+    protocol_cur_idx[i] = -1;
+    protocol_running[i] = false;
+  }
+  protocol_sel = PROTOCOL_RADIO_CYRF;
   protocol_rc_chan_nb = 0;
 
   // Add console commands
@@ -73,6 +85,7 @@ void protocol_init(void) {
   console_cmd_add("start", "", protocol_cmd_start);
   console_cmd_add("stop", "", protocol_cmd_stop);
   console_cmd_add("status", "", protocol_cmd_status);
+  console_cmd_add("parg", "[type] [hex arguments]", protocol_cmd_arg);
 
   // Add PPRZ bindings
   pprzlink_register_cb(PPRZ_MSG_ID_PROT_EXEC, protocol_pprz_exec);
@@ -80,11 +93,54 @@ void protocol_init(void) {
 }
 
 /**
- * Run the protocol
+ * Run the protocols of both radio chips
  */
 void protocol_run(void) {
-  if(protocol_cur_idx >= 0 && protocol_running)
-    protocols[protocol_cur_idx]->run();
+  uint8_t i;
+  PROF_START(start);
+  for(i = 0; i < PROTOCOL_RADIO_NB; i++) {
+    if(protocol_cur_idx[i] >= 0 && protocol_running[i])
+      protocols[protocol_cur_idx[i]]->run();
+  }
+  PROF_END(PROF_PROTOCOL, start);
+}
+
+/**
+ * Check if a protocol is running on one of the radio chips
+ */
+bool protocol_is_running(void) {
+  uint8_t i;
+  for(i = 0; i < PROTOCOL_RADIO_NB; i++) {
+    if(protocol_cur_idx[i] >= 0 && protocol_running[i])
+      return true;
+  }
+  return false;
+}
+
+/**
+ * Change the protocol of a radio chip, stopping the previous one
+ * @param[in] radio The radio chip to change the protocol of
+ * @param[in] idx The new protocol or -1 for none
+ */
+static void protocol_change(enum protocol_radio_t radio, int idx) {
+	if(protocol_cur_idx[radio] >= 0) {
+		if(protocol_running[radio])
+			protocols[protocol_cur_idx[radio]]->stop();
+
+		protocols[protocol_cur_idx[radio]]->deinit();
+	}
+
+	protocol_cur_idx[radio] = idx;
+	protocol_running[radio] = false;
+	if(idx < 0)
+		return;
+
+	// The radio chips reset in the background after boot, only wait when a protocol is selected that early
+	if(radio == PROTOCOL_RADIO_CYRF)
+		cyrf_wait_ready();
+	else
+		cc_wait_ready();
+	protocols[idx]->init();
 }
 
 /**
@@ -103,25 +159,25 @@ static void protocol_cmd_list(char *cmdLine __attribute__((unused))) {
  */
 static void protocol_cmd_set(char *cmdLine) {
 	int value = -1;
+	enum protocol_radio_t radio = protocol_sel;
+
+	// Parse the set command, a protocol only replaces the one on the same radio chip
+	if(sscanf(cmdLine, "%d", &value) == 1 && value >= 0 && value < protocols_nb)
+		radio = protocols[value]->radio;
 
 	// Check if we were not running
-	if(protocol_running) {
+	if(protocol_running[radio]) {
 		console_print("\r\nCan't change the protocol because the current protocol is running");
 		return;
 	}
 
-	// Parse the set command
-	if(sscanf(cmdLine, "%d", &value) != 1) {
-		if(protocol_cur_idx >= 0)
-			protocols[protocol_cur_idx]->deinit();
-		protocol_cur_idx = -1;
+	if(value < 0) {
+		protocol_change(radio, -1);
 		console_print("\r\nThe current protocol is changed to NONE");
 	}
-	else if(value >= 0 && value < protocols_nb) {
-		if(protocol_cur_idx >= 0)
-			protocols[protocol_cur_idx]->deinit();
-		protocol_cur_idx = value;
-		protocols[protocol_cur_idx]->init();
+	else if(value < protocols_nb) {
+		protocol_change(radio, value);
+		protocol_sel = radio;
 		console_print("\r\nThe current protocol is changed to %s", protocols[value]->name);
 	}
 	else{
@@ -133,11 +189,12 @@ static void protocol_cmd_set(char *cmdLine) {
  * Start the current protocol
  */
 static void protocol_cmd_start(char *cmdLine __attribute__((unused))) {
-	if(protocol_cur_idx >= 0 && !protocol_running) {
-		protocols[protocol_cur_idx]->start();
-		protocol_running = true;
-		console_print("\r\nStarted protocol %s.", protocols[protocol_cur_idx]->name);
-	} else if(protocol_running) {
+	int idx = protocol_cur_idx[protocol_sel];
+	if(idx >= 0 && !protocol_running[protocol_sel]) {
+		protocols[idx]->start();
+		protocol_running[protocol_sel] = true;
+		console_print("\r\nStarted protocol %s.", protocols[idx]->name);
+	} else if(protocol_running[protocol_sel]) {
 		console_print("\r\nProtocol already started");
 	} else {
 		console_print("\r\nNo protocol selected.");
@@ -148,11 +205,12 @@ static void protocol_cmd_start(char *cmdLine __attribute__((unused))) {
  * Stop the current protocol
  */
 static void protocol_cmd_stop(char *cmdLine __attribute__((unused))) {
-	if(protocol_cur_idx >= 0 && protocol_running) {
-		protocols[protocol_cur_idx]->stop();
-		protocol_running = false;
-		console_print("\r\nStopped protocol %s.", protocols[protocol_cur_idx]->name);
-	} else if(!protocol_running) {
+	int idx = protocol_cur_idx[protocol_sel];
+	if(idx >= 0 && protocol_running[protocol_sel]) {
+		protocols[idx]->stop();
+		protocol_running[protocol_sel] = false;
+		console_print("\r\nStopped protocol %s.", protocols[idx]->name);
+	} else if(!protocol_running[protocol_sel]) {
 		console_print("\r\nProtocol already stopped");
 	} else {
 		console_print("\r\nNo protocol selected.");
@@ -160,62 +218,94 @@ static void protocol_cmd_stop(char *cmdLine __attribute__((unused))) {
 }
 
 /**
- * Status of the current protocol
+ * Status of the current protocol and the one on the other radio chip
  */
 static void protocol_cmd_status(char *cmdLine __attribute__((unused))) {
-	if(protocol_cur_idx >= 0) {
+	int idx = protocol_cur_idx[protocol_sel];
+	enum protocol_radio_t other = (protocol_sel == PROTOCOL_RADIO_CYRF)? PROTOCOL_RADIO_CC : PROTOCOL_RADIO_CYRF;
+	if(idx >= 0) {
 	  console_print("\r\nProtocol");
-	  console_print("\r\n\tCurrent: %s", protocols[protocol_cur_idx]->name);
-	  console_print("\r\n\tRunning: %s", protocol_running? "yes":"no");
-	  protocols[protocol_cur_idx]->status();
+	  console_print("\r\n\tCurrent: %s", protocols[idx]->name);
+	  console_print("\r\n\tRunning: %s", protocol_running[protocol_sel]? "yes":"no");
+	  if(protocol_cur_idx[other] >= 0)
+	    console_print("\r\n\tOther: %s (%s)", protocols[protocol_cur_idx[other]]->name, protocol_running[other]? "running":"stopped");
+	  protocols[idx]->status();
 	} else {
 		console_print("\r\nNo protocol selected.");
 	}
 }
 
 /**
- * Execute a protocol command through pprzlink
+ * Give arguments to the current protocol like PROT_EXEC does, but from the console
  */
-static void protocol_pprz_exec(uint8_t *data) {
-	// Check if we need to change protocol
-	int8_t prot_id = DL_PROT_EXEC_id(data);
-	if(prot_id != protocol_cur_idx) {
-		if(protocol_cur_idx >= 0) {
-			if(protocol_running)
-				protocols[protocol_cur_idx]->stop();
+static void protocol_cmd_arg(char *cmdLine) {
+	uint8_t args[64];
+	unsigned int type, byte;
+	int len = 0, pos;
+	int idx = protocol_cur_idx[protocol_sel];
 
-			protocols[protocol_cur_idx]->deinit();
-		}
+	if(idx < 0) {
+		console_print("\r\nNo protocol selected.");
+		return;
+	}
 
-		if(prot_id < protocols_nb)
-			protocol_cur_idx = prot_id;
+	// Parse the type and the hex encoded arguments
+	if(sscanf(cmdLine, "%u%n", &type, &pos) != 1) {
+		console_print("\r\nThe type needs to be given");
+		return;
+	}
+	cmdLine += pos;
+	while(len < (int)sizeof(args) && sscanf(cmdLine, " %2x%n", &byte, &pos) == 1) {
+		args[len++] = byte;
+		cmdLine += pos;
+	}
 
-		// Return if we change to inactive
-		if(prot_id < 0)
-			return;
+	if(len > 0 && protocols[idx]->parse_arg != NULL)
+		protocols[idx]->parse_arg(type, args, len, 0, len);
+	console_print("\r\nGave %d bytes of arguments to %s", len, protocols[idx]->name);
+}
 
-		protocols[protocol_cur_idx]->init();
-		protocol_running = false;
+/**
+ * Execute a protocol command through pprzlink
+ */
+static void protocol_pprz_exec(uint8_t *data) {
+	enum protocol_radio_t radio;
+	uint8_t i;
+
+	// Changing to inactive stops the protocols on both radio chips
+	int8_t prot_id = DL_PROT_EXEC_id(data);
+	if(prot_id < 0) {
+		for(i = 0; i < PROTOCOL_RADIO_NB; i++)
+			protocol_change(i, -1);
+		return;
 	}
+	else if(prot_id >= protocols_nb)
+		return;
+
+	// Check if we need to change protocol, the other radio chip keeps running
+	radio = protocols[prot_id]->radio;
+	if(prot_id != protocol_cur_idx[radio])
+		protocol_change(radio, prot_id);
+	protocol_sel = radio;
 
 	// Check if the protocol is running
 	uint8_t type = DL_PROT_EXEC_type(data);
-	if((type == PROTOCOL_START || type == PROTOCOL_STOP) && protocol_running) {
-		protocols[protocol_cur_idx]->stop();
-		protocol_running = false;
+	if((type == PROTOCOL_START || type == PROTOCOL_STOP) && protocol_running[radio]) {
+		protocols[prot_id]->stop();
+		protocol_running[radio] = false;
 	}
 
 	// Parse the arguments
 	uint16_t arg_offset = DL_PROT_EXEC_arg_offset(data);
 	uint16_t arg_size = DL_PROT_EXEC_arg_size(data);
 	uint8_t arg_len = DL_PROT_EXEC_arg_data_length(data);
-	if((arg_size-arg_offset) > 0 && protocols[protocol_cur_idx]->parse_arg != NULL)
-		protocols[protocol_cur_idx]->parse_arg(type, DL_PROT_EXEC_arg_data(data), arg_len, arg_offset, arg_size);
+	if((arg_size-arg_offset) > 0 && protocols[prot_id]->parse_arg != NULL)
+		protocols[prot_id]->parse_arg(type, DL_PROT_EXEC_arg_data(data), arg_len, arg_offset, arg_size);
 
 	// Start the protocol if the arguments are succesfully received
 	if(type == PROTOCOL_START && arg_offset+arg_len >= arg_size) {
-		protocols[protocol_cur_idx]->start();
-		protocol_running = true;
+		protocols[prot_id]->start();
+		protocol_running[radio] = true;
 	}
 }
 
@@ -20,8 +20,19 @@
 #ifndef MODULES_PROTOCOL_H_
 #define MODULES_PROTOCOL_H_
 
+#include <stdint.h>
+#include <stdbool.h>
+
+/* The radio chips which can each run one protocol at the same time */
+enum protocol_radio_t {
+	PROTOCOL_RADIO_CYRF = 0,
+	PROTOCOL_RADIO_CC,
+	PROTOCOL_RADIO_NB,
+};
+
 struct protocol_t {
   char *name;
+  enum protocol_radio_t radio;
   void (*init)(void);
   void (*deinit)(void);
   void (*start)(void);
@@ -41,5 +52,6 @@ extern uint8_t protocol_rc_chan_nb;
 
 void protocol_init(void);
 void protocol_run(void);
+bool protocol_is_running(void);
 
 #endif /* MODULES_PROTOCOL_H_ */
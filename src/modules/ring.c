@@ -163,9 +163,9 @@ int32_t ring_read(struct ring * ring, uint8_t * data, ring_size_t size)
 
 	for (i = 0; i < size; i++) {
 		if (ring_read_ch(ring, data + i) < 0) {
-			return i;
+			return -i;
 		}
 	}
 
-	return -i;
+	return i;
 }
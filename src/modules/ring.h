@@ -19,6 +19,9 @@
 
  /* This ring buffer implementation is based on the libgovernor implementation
   * from the open-bldc project.
+  *
+  * The USB ports use the lock-free FIFO in fifo.h instead, this ring is kept as
+  * reference for test/ring_bench.
   */
 
 #ifndef MODULES_RING_H
@@ -40,7 +43,7 @@ struct ring {
 #define RING_EMPTY(RING) ((RING)->begin == (RING)->end)
 #define RING_FULL(RING) ((((RING)->end + 1) % (RING)->size) == (RING)->begin)
 #define RING_USED_SPACE(RING) (((RING)->end - (RING)->begin + (RING)->size) % (RING)->size)
-#define RING_FREE_SPACE(RING) ((RING)->size - RING_USED_SPACE(RING))
+#define RING_FREE_SPACE(RING) (RING_SIZE(RING) - RING_USED_SPACE(RING))
 
 void ring_init(struct ring *ring, uint8_t * buf, ring_size_t size);
 int32_t ring_write_ch(struct ring *ring, const uint8_t ch);
@@ -0,0 +1,175 @@
+/*
+ * This file is part of the superbitrf project.
+ *
+ * Copyright (C) 2018 Freek van Tienen <freek.v.tienen@gmail.com>
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * A small cooperative scheduler. Tasks run to completion in order of priority
+ * when their period expired or when one of their events is raised from an
+ * interrupt. The latency of a task is thus bounded by the longest task with a
+ * lower priority. When nothing is ready the CPU sleeps until the next interrupt.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "sched.h"
+#include "modules/mcu.h"
+#include "modules/counter.h"
+#include "modules/console.h"
+
+/* A registered task */
+struct sched_task_t {
+	const char *name;						/**< The name of the task */
+	sched_task_cb cb;						/**< The function which is called */
+	uint8_t prio;								/**< The priority (lower runs first) */
+	uint32_t period;						/**< The period in counter ticks (0 is only on events) */
+	uint32_t events;						/**< The events which wake up the task */
+	uint32_t next;							/**< The deadline of the next periodic run */
+	volatile bool ready;				/**< An event was raised for the task */
+	volatile uint32_t ready_ticks;	/**< When the task became ready */
+	uint32_t runs;							/**< The amount of runs */
+	uint32_t max_latency;				/**< The maximum ticks between ready and run */
+};
+
+static struct sched_task_t sched_tasks[SCHED_MAX_TASKS];		/**< The tasks ordered by priority */
+static uint8_t sched_tasks_nb = 0;													/**< The amount of registered tasks */
+static uint32_t sched_sleeps;																/**< The amount of times the CPU went to sleep */
+
+static struct sched_task_t *sched_next(uint32_t now);
+static void sched_cmd_tasks(char *cmdLine);
+
+/**
+ * Initialize the scheduler
+ */
+void sched_init(void) {
+	sched_tasks_nb = 0;
+	sched_sleeps = 0;
+	console_cmd_add("tasks", "", sched_cmd_tasks);
+}
+
+/**
+ * Register a task, which runs once when the scheduler starts
+ * @param[in] name The name of the task
+ * @param[in] cb The function which is called when the task runs
+ * @param[in] prio The priority of the task (lower runs first)
+ * @param[in] period The period in counter ticks (0 to only run on events)
+ * @param[in] events The events which wake up the task
+ * @return The task index or -1 when there is no space left
+ */
+int8_t sched_add(const char *name, sched_task_cb cb, uint8_t prio, uint32_t period, uint32_t events) {
+	if(sched_tasks_nb >= SCHED_MAX_TASKS)
+		return -1;
+
+	// Keep the tasks ordered by priority
+	uint8_t i = sched_tasks_nb++;
+	for(; i > 0 && sched_tasks[i-1].prio > prio; i--)
+		sched_tasks[i] = sched_tasks[i-1];
+
+	struct sched_task_t *task = &sched_tasks[i];
+	task->name = name;
+	task->cb = cb;
+	task->prio = prio;
+	task->period = period;
+	task->events = events;
+	task->next = counter_get_ticks() + period;
+
+	// Run once at start to handle the events which were raised before registering
+	task->ready = true;
+	task->ready_ticks = counter_get_ticks();
+	task->runs = 0;
+	task->max_latency = 0;
+	return i;
+}
+
+/**
+ * Raise events and wake up the tasks waiting for them (can be called from interrupts)
+ * @param[in] events The events which happened
+ */
+void sched_event(uint32_t events) {
+	uint32_t now = counter_status.ticks;
+	for(uint8_t i = 0; i < sched_tasks_nb; i++) {
+		struct sched_task_t *task = &sched_tasks[i];
+		if((task->events & events) && !task->ready) {
+			task->ready_ticks = now;
+			task->ready = true;
+		}
+	}
+}
+
+/**
+ * Run the tasks forever and sleep when there is nothing to do
+ */
+void sched_run(void) {
+	while(true) {
+		uint32_t now = counter_get_ticks();
+
+		// Sleep when nothing is ready, an interrupt between the check and the sleep still wakes us up
+		mcu_irq_disable();
+		struct sched_task_t *task = sched_next(now);
+		if(task == NULL) {
+			sched_sleeps++;
+			mcu_sleep();
+		}
+		else
+			task->ready = false;
+		mcu_irq_enable();
+
+		if(task == NULL)
+			continue;
+
+		// Keep track of the latency and the next deadline
+		uint32_t latency;
+		if(task->period != 0 && (int32_t)(now - task->next) >= 0) {
+			latency = now - task->next;
+			task->next += task->period;
+			if((int32_t)(now - task->next) >= 0)
+				task->next = now + task->period;
+		}
+		else
+			latency = now - task->ready_ticks;
+
+		if(latency > task->max_latency)
+			task->max_latency = latency;
+		task->runs++;
+		task->cb();
+	}
+}
+
+/**
+ * Find the highest priority task which is ready to run
+ * @param[in] now The current counter ticks
+ * @return The task or NULL when nothing needs to run
+ */
+static struct sched_task_t *sched_next(uint32_t now) {
+	for(uint8_t i = 0; i < sched_tasks_nb; i++) {
+		struct sched_task_t *task = &sched_tasks[i];
+		if(task->ready || (task->period != 0 && (int32_t)(now - task->next) >= 0))
+			return task;
+	}
+	return NULL;
+}
+
+/**
+ * Print the task statistics
+ */
+static void sched_cmd_tasks(char *cmdLine __attribute__((unused))) {
+	console_print("\r\nTasks (runs/max latency in ticks, %u sleeps)", sched_sleeps);
+	for(uint8_t i = 0; i < sched_tasks_nb; i++)
+		console_print("\r\n\t%s: %u/%u", sched_tasks[i].name, sched_tasks[i].runs, sched_tasks[i].max_latency);
+}
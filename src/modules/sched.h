@@ -0,0 +1,49 @@
+/*
+ * This file is part of the superbitrf project.
+ *
+ * Copyright (C) 2018 Freek van Tienen <freek.v.tienen@gmail.com>
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MODULES_SCHED_H_
+#define MODULES_SCHED_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Maximum amount of tasks */
+#define SCHED_MAX_TASKS					12
+
+/* Task priorities (lower runs first) */
+#define SCHED_PRIO_RADIO				0					/**< Polling of the radio chips */
+#define SCHED_PRIO_PROTOCOL			1					/**< The running protocol */
+#define SCHED_PRIO_USB					2					/**< Sending out the USB rings */
+#define SCHED_PRIO_LINK					3					/**< Parsing the pprzlink messages */
+#define SCHED_PRIO_CONSOLE			4					/**< Parsing the console commands */
+
+/* Events which wake up the tasks, these can be raised from interrupts */
+#define SCHED_EV_DATA_RX				(1<<0)		/**< Data received on the USB data port */
+#define SCHED_EV_CONSOLE_RX			(1<<1)		/**< Data received on the USB console port */
+#define SCHED_EV_USB_TX					(1<<2)		/**< Data ready to send or a USB endpoint became free */
+#define SCHED_EV_CONSOLE_LOG		(1<<3)		/**< A deferred log entry is waiting to be printed */
+
+/* External functions */
+typedef void (*sched_task_cb)(void);
+void sched_init(void);
+int8_t sched_add(const char *name, sched_task_cb cb, uint8_t prio, uint32_t period, uint32_t events);
+void sched_event(uint32_t events);
+void sched_run(void) __attribute__((noreturn));
+
+#endif /* MODULES_SCHED_H_ */
@@ -1,104 +0,0 @@
-/*
- * This file is part of the superbitrf project.
- *
- * Copyright (C) 2018 Freek van Tienen <freek.v.tienen@gmail.com>
- *
- * This library is free software: you can redistribute it and/or modify
- * it under the terms of the GNU Lesser General Public License as published by
- * the Free Software Foundation, either version 3 of the License, or
- * (at your option) any later version.
- *
- * This library is distributed in the hope that it will be useful,
- * but WITHOUT ANY WARRANTY; without even the implied warranty of
- * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
- * GNU Lesser General Public License for more details.
- *
- * You should have received a copy of the GNU Lesser General Public License
- * along with this library.  If not, see <http://www.gnu.org/licenses/>.
- */
-
-#include "spi.h"
-
-#ifdef USE_SPI1
-/**
- * Initialize the first SPI bus
- */
-static void spi1_init(void) {
-	/* Initialize the clock */
-	rcc_periph_clock_enable(RCC_SPI1);
-
-	/* Initialize the GPIO */                  
-	gpio_set_mode(GPIO_BANK_SPI1_MISO, GPIO_MODE_INPUT, GPIO_CNF_INPUT_FLOAT, GPIO_SPI1_MISO);
-	gpio_set_mode(GPIO_BANK_SPI1_MOSI, GPIO_MODE_OUTPUT_50_MHZ, GPIO_CNF_OUTPUT_ALTFN_PUSHPULL, GPIO_SPI1_MOSI);
-	gpio_set_mode(GPIO_BANK_SPI1_SCK, GPIO_MODE_OUTPUT_50_MHZ, GPIO_CNF_OUTPUT_ALTFN_PUSHPULL, GPIO_SPI1_SCK);
-
-	/* Reset SPI, SPI_CR1 register cleared, SPI is disabled */
-	spi_reset(SPI1);
-
-	/* Set up SPI in Master mode with:
-	 * Clock baud rate: 1/64 of peripheral clock frequency
-	 * Clock polarity: Idle High
-	 * Clock phase: Data valid on 2nd clock pulse
-	 * Data frame format: 8-bit
-	 * Frame format: MSB First
-	 */
-	spi_init_master(SPI1, SPI_CR1_BAUDRATE_FPCLK_DIV_64,
-			SPI_CR1_CPOL_CLK_TO_0_WHEN_IDLE, SPI_CR1_CPHA_CLK_TRANSITION_1,
-			SPI_CR1_DFF_8BIT, SPI_CR1_MSBFIRST);
-
-	/* Set NSS management to software. */
-	spi_enable_software_slave_management(SPI1);
-	spi_set_nss_high(SPI1);
-
-	/* Enable SPI periph. */
-	spi_enable(SPI1);
-}
-#endif
-
-#ifdef USE_SPI2
-/**
- * Initialize the second SPI bus
- */
-static void spi2_init(void) {
-	/* Initialize the clock */
-	rcc_periph_clock_enable(RCC_SPI2);
-
-	/* Initialize the GPIO */
-	gpio_set_mode(GPIO_BANK_SPI2_MISO, GPIO_MODE_INPUT, GPIO_CNF_INPUT_FLOAT, GPIO_SPI2_MISO);
-	gpio_set_mode(GPIO_BANK_SPI2_MOSI, GPIO_MODE_OUTPUT_50_MHZ, GPIO_CNF_OUTPUT_ALTFN_PUSHPULL, GPIO_SPI2_MOSI);
-	gpio_set_mode(GPIO_BANK_SPI2_SCK, GPIO_MODE_OUTPUT_50_MHZ, GPIO_CNF_OUTPUT_ALTFN_PUSHPULL, GPIO_SPI2_SCK);
-
-	/* Reset SPI, SPI_CR1 register cleared, SPI is disabled */
-	spi_reset(SPI2);
-
-	/* Set up SPI in Master mode with:
-	 * Clock baud rate: 1/64 of peripheral clock frequency
-	 * Clock polarity: Idle High
-	 * Clock phase: Data valid on 2nd clock pulse
-	 * Data frame format: 8-bit
-	 * Frame format: MSB First
-	 */
-	spi_init_master(SPI2, SPI_CR1_BAUDRATE_FPCLK_DIV_64,
-			SPI_CR1_CPOL_CLK_TO_0_WHEN_IDLE, SPI_CR1_CPHA_CLK_TRANSITION_1,
-			SPI_CR1_DFF_8BIT, SPI_CR1_MSBFIRST);
-
-	/* Set NSS management to software. */
-	spi_enable_software_slave_management(SPI2);
-	spi_set_nss_high(SPI2);
-
-	/* Enable SPI periph. */
-	spi_enable(SPI2);
-}
-#endif
-
-/**
- * Initialize the SPI busses
- */
-void spi_init(void) {
-#ifdef USE_SPI1
-	spi1_init();
-#endif
-#ifdef USE_SPI2
-	spi2_init();
-#endif
-}
\ No newline at end of file
@@ -20,14 +20,31 @@
 #ifndef MODULES_SPI_H_
 #define MODULES_SPI_H_
 
-#include <libopencm3/stm32/rcc.h>
-#include <libopencm3/stm32/gpio.h>
-#include <libopencm3/stm32/spi.h>
+#include <stdint.h>
+#include <stdbool.h>
 
 // Include the board specifications for the spi busses
 #include "board.h"
 
+/* The devices connected to the SPI busses */
+enum spi_dev_t {
+	SPI_DEV_CYRF = 0,						/**< The CYRF6936 radio chip */
+	SPI_DEV_CC,									/**< The CC2500 radio chip */
+	SPI_DEV_NB									/**< The amount of SPI devices */
+};
+
+/* Callback when an asynchronous transfer is done or the interrupt line of a device fires */
+typedef void (*spi_dev_cb)(enum spi_dev_t dev);
+
 /* External functions for the spi busses */
 void spi_init(void);
+void spi_dev_init(enum spi_dev_t dev);
+void spi_dev_select(enum spi_dev_t dev);
+void spi_dev_deselect(enum spi_dev_t dev);
+uint8_t spi_dev_xfer(enum spi_dev_t dev, uint8_t data);
+void spi_dev_reset(enum spi_dev_t dev, bool active);
+bool spi_dev_irq_init(enum spi_dev_t dev, spi_dev_cb cb);
+uint8_t spi_dev_transfer(enum spi_dev_t dev, uint8_t header, const uint8_t *tx, uint8_t *rx, uint16_t len, spi_dev_cb cb);
+void spi_dev_wait(enum spi_dev_t dev);
 
 #endif /* MODULES_SPI_H_ */
@@ -1,7 +1,7 @@
 /*
  * This file is part of the superbitrf project.
  *
- * Copyright (C) 2013 Freek van Tienen <freek.v.tienen@gmail.com>
+ * Copyright (C) 2018 Freek van Tienen <freek.v.tienen@gmail.com>
  *
  * This library is free software: you can redistribute it and/or modify
  * it under the terms of the GNU Lesser General Public License as published by
@@ -17,90 +17,107 @@
  * along with this library.  If not, see <http://www.gnu.org/licenses/>.
  */
 
-#include <unistd.h>
-#include <libopencm3/cm3/nvic.h>
-#include <libopencm3/stm32/timer.h>
-#include <libopencm3/stm32/gpio.h>
-#include <libopencm3/stm32/rcc.h>
+#include "modules/timer.h"
+#include "modules/counter.h"
+#include "modules/trace.h"
 
-#include "timer.h"
+static uint32_t timer_start[TIMER_CH_NB];		/**< The time base ticks each one-shot timer was last armed from */
 
-/* The timer callbacks */
-timer_on_event timer1_on_event = NULL;
-uint16_t timer1_value;
+static void timer_oneshot_set(enum timer_ch_t ch, uint16_t us);
+static void timer_oneshot_set_next(enum timer_ch_t ch, uint16_t us);
+static void timer_oneshot_set_at_us(enum timer_ch_t ch, uint32_t time);
+static uint16_t timer_oneshot_get_time(enum timer_ch_t ch);
 
 /**
- * Initialize timer1
+ * Set a one-shot timer to interrupt relative to now
+ * @param[in] ch The compare channel of the timer
+ * @param[in] us The time in microseconds times 10
  */
-static void timer1_init(void) {
-	rcc_peripheral_enable_clock(&RCC_APB1ENR, RCC_APB1ENR_TIM2EN);
-
-	// Enable the timer NVIC
-	nvic_enable_irq(TIMER1_NVIC);
-	nvic_set_priority(TIMER1_NVIC, 1);
-
-	// Setup the timer
-	timer_disable_counter(TIMER1);
-	timer_reset(TIMER1);
-	timer_set_mode(TIMER1, TIM_CR1_CKD_CK_INT, TIM_CR1_CMS_EDGE, TIM_CR1_DIR_UP);
-	timer_disable_preload(TIMER1);
-	timer_continuous_mode(TIMER1);
-
-	// Disable interrupts on Compare 1
-	timer_disable_irq(TIMER1, TIM_DIER_CC1IE);
+static void timer_oneshot_set(enum timer_ch_t ch, uint16_t us) {
+	timer_start[ch] = timer_get_ticks();
+	timer_ch_set_at(ch, timer_start[ch] + us);
+	trace_add(TRACE_TIMER_SET, ch, us);
+}
 
-	// Clear the Output Compare of OC1
-	timer_disable_oc_clear(TIMER1, TIM_OC1);
-	timer_disable_oc_preload(TIMER1, TIM_OC1);
-	timer_set_oc_slow_mode(TIMER1, TIM_OC1);
-	timer_set_oc_mode(TIMER1, TIM_OC1, TIM_OCM_FROZEN);
+/**
+ * Set a one-shot timer to interrupt relative to its previous deadline
+ * This keeps a periodic schedule free of the interrupt and handler latency.
+ * When the new deadline already passed (the handler got stalled) the missed
+ * periods are skipped instead of fired back to back.
+ * @param[in] ch The compare channel of the timer
+ * @param[in] us The time in microseconds times 10
+ */
+static void timer_oneshot_set_next(enum timer_ch_t ch, uint16_t us) {
+	uint32_t now = timer_get_ticks();
+	timer_start[ch] = timer_ch_get_deadline(ch);
+	if((int32_t)(now - (timer_start[ch] + us)) >= 0)
+		timer_start[ch] = now;
+
+	timer_ch_set_at(ch, timer_start[ch] + us);
+	trace_add(TRACE_TIMER_SET, ch, us);
+}
 
-	// Set timer updates each 10 microseconds
-	timer_set_prescaler(TIMER1, 720 - 1);
-	timer_set_period(TIMER1, 65535);
+/**
+ * Set a one-shot timer to interrupt at a moment of the microsecond counter
+ * The radio receive times are taken from the counter, so a schedule predicted from them
+ * doesn't need to be converted to ticks by the caller. A moment which already passed
+ * interrupts immediately.
+ * @param[in] ch The compare channel of the timer
+ * @param[in] time The moment in microseconds (counter_get_us)
+ */
+static void timer_oneshot_set_at_us(enum timer_ch_t ch, uint32_t time) {
+	int32_t delay = time - counter_get_us();
+	uint32_t ticks = (delay > 0)? (delay + 5) / 10 : 0;
 
-	// Start the timer
-	timer_enable_counter(TIMER1);
+	timer_start[ch] = timer_get_ticks();
+	timer_ch_set_at(ch, timer_start[ch] + ticks);
+	trace_add(TRACE_TIMER_SET, ch, ticks);
 }
 
 /**
- * Initialize the timers
+ * Get the time since the start of the last one-shot timer period
+ * @param[in] ch The compare channel of the timer
  */
-void timer_init(void) {
-	// Initialize the DSM timer
-	timer1_init();
+static uint16_t timer_oneshot_get_time(enum timer_ch_t ch) {
+	return timer_get_ticks() - timer_start[ch];
 }
 
 /**
- * Set the timer1 to interrupt
+ * Set the timer1 to interrupt relative to now
  * @param[in] us The time in microseconds times 10
  */
 void timer1_set(uint16_t us) {
-	timer_set_counter(TIMER1, 0);
-	timer1_value = 0;
+	timer_oneshot_set(TIMER1_CH, us);
+}
 
-	// Update the timer compare value 1
-	timer_set_oc_value(TIMER1, TIM_OC1, us);
+/**
+ * Set the timer1 to interrupt relative to its previous deadline
+ * @param[in] us The time in microseconds times 10
+ */
+void timer1_set_next(uint16_t us) {
+	timer_oneshot_set_next(TIMER1_CH, us);
+}
 
-	// Clear the interrupt flag and enable the interrupt of compare 1
-	timer_clear_flag(TIMER1, TIM_SR_CC1IF);
-	timer_enable_irq(TIMER1, TIM_DIER_CC1IE);
+/**
+ * Set the timer1 to interrupt at a moment of the microsecond counter
+ * @param[in] time The moment in microseconds (counter_get_us)
+ */
+void timer1_set_at_us(uint32_t time) {
+	timer_oneshot_set_at_us(TIMER1_CH, time);
 }
 
 /**
- * Get the time since last set timer1
+ * Get the time since the start of the last timer1 period
  */
 uint16_t timer1_get_time(void) {
-	return timer_get_counter(TIMER1);
+	return timer_oneshot_get_time(TIMER1_CH);
 }
 
 /**
  * Stop the timer1 interrupts
  */
 void timer1_stop(void) {
-	// Clear the interrupt flag and disable the interrupt of compare 1
-	timer_clear_flag(TIMER1, TIM_SR_CC1IF);
-	timer_disable_irq(TIMER1, TIM_DIER_CC1IE);
+	timer_ch_stop(TIMER1_CH);
 }
 
 /**
@@ -108,16 +125,51 @@ void timer1_stop(void) {
  * @param[in] callback The callback function when an interrupt occurs
  */
 void timer1_register_callback(timer_on_event callback) {
-	timer1_on_event = callback;
+	timer_ch_register_callback(TIMER1_CH, callback);
+}
+
+/**
+ * Set the timer2 to interrupt relative to now
+ * @param[in] us The time in microseconds times 10
+ */
+void timer2_set(uint16_t us) {
+	timer_oneshot_set(TIMER2_CH, us);
+}
+
+/**
+ * Set the timer2 to interrupt relative to its previous deadline
+ * @param[in] us The time in microseconds times 10
+ */
+void timer2_set_next(uint16_t us) {
+	timer_oneshot_set_next(TIMER2_CH, us);
+}
+
+/**
+ * Set the timer2 to interrupt at a moment of the microsecond counter
+ * @param[in] time The moment in microseconds (counter_get_us)
+ */
+void timer2_set_at_us(uint32_t time) {
+	timer_oneshot_set_at_us(TIMER2_CH, time);
+}
+
+/**
+ * Get the time since the start of the last timer2 period
+ */
+uint16_t timer2_get_time(void) {
+	return timer_oneshot_get_time(TIMER2_CH);
 }
 
 /**
- * The timer interrupt handler
+ * Stop the timer2 interrupts
  */
-void TIMER1_IRQ(void) {
-	// Stop the timer
-	timer1_stop();
+void timer2_stop(void) {
+	timer_ch_stop(TIMER2_CH);
+}
 
-	// Callback
-	timer1_on_event();
+/**
+ * Register timer2 callback
+ * @param[in] callback The callback function when an interrupt occurs
+ */
+void timer2_register_callback(timer_on_event callback) {
+	timer_ch_register_callback(TIMER2_CH, callback);
 }
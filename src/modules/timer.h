@@ -22,17 +22,46 @@
 
 // Include the board specifications for the timers
 #include "board.h"
+#include <stdint.h>
 #include <stdbool.h>
 
+/* The compare channels of the radio timer, which all share one 32-bit time base of 10 microsecond ticks */
+enum timer_ch_t {
+	TIMER_CH1 = 0,						/**< Compare channel 1, used by the timer1 functions */
+	TIMER_CH2,								/**< Compare channel 2, used by the timer2 functions */
+	TIMER_CH3,								/**< Compare channel 3 */
+	TIMER_CH4,								/**< Compare channel 4 */
+	TIMER_CH_NB								/**< The amount of compare channels */
+};
+
 typedef void (*timer_on_event) (void);
 
 /* External functions */
 void timer_init(void);
+uint32_t timer_get_ticks(void);
+void timer_ch_set_at(enum timer_ch_t ch, uint32_t deadline);
+void timer_ch_set(enum timer_ch_t ch, uint32_t ticks);
+uint32_t timer_ch_get_deadline(enum timer_ch_t ch);
+void timer_ch_stop(enum timer_ch_t ch);
+void timer_ch_register_callback(enum timer_ch_t ch, timer_on_event callback);
+
+/* The one-shot timers of the protocols, one for each radio chip */
+#define TIMER1_CH		TIMER_CH1		/**< The one-shot timer of the CYRF6936 protocols */
+#define TIMER2_CH		TIMER_CH2		/**< The one-shot timer of the CC2500 protocols */
 
 void timer1_set(uint16_t us);
+void timer1_set_next(uint16_t us);
+void timer1_set_at_us(uint32_t time);
 uint16_t timer1_get_time(void);
 void timer1_stop(void);
 void timer1_wait(bool wait);
 void timer1_register_callback(timer_on_event callback);
 
+void timer2_set(uint16_t us);
+void timer2_set_next(uint16_t us);
+void timer2_set_at_us(uint32_t time);
+uint16_t timer2_get_time(void);
+void timer2_stop(void);
+void timer2_register_callback(timer_on_event callback);
+
 #endif /* MODULES_TIMER_H_ */
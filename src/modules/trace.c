@@ -0,0 +1,200 @@
+/*
+ * This file is part of the superbitrf project.
+ *
+ * Copyright (C) 2018 Freek van Tienen <freek.v.tienen@gmail.com>
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "trace.h"
+#include "modules/mcu.h"
+#include "modules/cdcacm.h"
+#include "modules/counter.h"
+#include "modules/console.h"
+#include "modules/fifo.h"
+#include "modules/pprzlink.h"
+
+#define TRACE_PROTS 8							/**< The amount of protocol ids with a traced state */
+
+/* Main variables */
+static struct trace_entry_t trace_ring[TRACE_SIZE];	/**< The event ring */
+static volatile uint32_t trace_head = 0;			/**< The write index, only changed with interrupts disabled */
+static volatile uint32_t trace_tail = 0;			/**< The read index, only changed with interrupts disabled */
+static uint32_t trace_dropped = 0;						/**< The amount of events dropped while streaming */
+static bool trace_streaming = false;					/**< Whether the events are sent to the host */
+static uint8_t trace_states[TRACE_PROTS];			/**< The last traced state per protocol */
+
+/* Internal functions */
+static void trace_set_streaming(bool streaming);
+static uint8_t trace_read(struct trace_entry_t *entries, uint8_t max);
+static void trace_send(struct trace_entry_t *entries, uint8_t nb);
+static void trace_pprz_msg(uint8_t *data);
+static void trace_cmd(char *cmdLine);
+
+/**
+ * Initialize the trace ring
+ */
+void trace_init(void) {
+	trace_set_streaming(false);
+
+	pprzlink_register_cb(PPRZ_MSG_ID_TRACE_CTRL, trace_pprz_msg);
+	console_cmd_add("trace", "[on|off]", trace_cmd);
+}
+
+/**
+ * Add an event to the trace ring, can be called from any interrupt
+ * @param[in] event The event
+ * @param[in] arg The radio chip, timer channel or protocol
+ * @param[in] val The event value
+ */
+void trace_add(enum trace_event_t event, uint8_t arg, uint16_t val) {
+	uint32_t time = counter_get_us();
+
+	uint32_t irq = mcu_irq_save();
+	if(trace_head - trace_tail >= TRACE_SIZE) {
+		// Keep the streamed timeline complete, otherwise keep the latest events
+		if(trace_streaming) {
+			trace_dropped++;
+			mcu_irq_restore(irq);
+			return;
+		}
+		trace_tail++;
+	}
+
+	struct trace_entry_t *entry = &trace_ring[trace_head & (TRACE_SIZE - 1)];
+	entry->time = time;
+	entry->event = event;
+	entry->arg = arg;
+	entry->val = val;
+	trace_head++;
+	mcu_irq_restore(irq);
+}
+
+/**
+ * Trace the state of a protocol state machine when it changed
+ * @param[in] prot The protocol
+ * @param[in] state The current state
+ */
+void trace_state(enum trace_prot_t prot, uint8_t state) {
+	if(prot >= TRACE_PROTS || trace_states[prot] == state)
+		return;
+
+	trace_states[prot] = state;
+	trace_add(TRACE_STATE, prot, state);
+}
+
+/**
+ * Send the events while streaming, as long as the messages fit in the data port
+ */
+void trace_run(void) {
+	struct trace_entry_t entries[TRACE_MSG_EVENTS];
+
+	while(trace_streaming && trace_head != trace_tail &&
+			fifo_free(pprzlink.r_tx) >= sizeof(entries) + 16) {
+		uint8_t nb = trace_read(entries, TRACE_MSG_EVENTS);
+		trace_send(entries, nb);
+	}
+}
+
+/**
+ * Start or stop streaming, the ring starts empty and every protocol state is
+ * traced again so the host can follow the state machines from the start
+ */
+static void trace_set_streaming(bool streaming) {
+	uint32_t irq = mcu_irq_save();
+	trace_tail = trace_head;
+	trace_dropped = 0;
+	trace_streaming = streaming;
+	memset(trace_states, 0xFF, sizeof(trace_states));
+	mcu_irq_restore(irq);
+}
+
+/**
+ * Take the oldest events from the ring
+ * @param[out] entries The events
+ * @param[in] max The maximum amount of events
+ * @return The amount of events
+ */
+static uint8_t trace_read(struct trace_entry_t *entries, uint8_t max) {
+	uint8_t nb = 0;
+
+	uint32_t irq = mcu_irq_save();
+	while(nb < max && trace_tail != trace_head)
+		entries[nb++] = trace_ring[trace_tail++ & (TRACE_SIZE - 1)];
+	mcu_irq_restore(irq);
+	return nb;
+}
+
+/**
+ * Send events to the host
+ * <message name="TRACE" id="10">
+ *   <field name="dropped" type="uint32">Events dropped since streaming started</field>
+ *   <field name="events" type="uint8[]">Events of 8 bytes: uint32 time in microseconds, uint8 event, uint8 arg and uint16 value</field>
+ * </message>
+ */
+static void trace_send(struct trace_entry_t *entries, uint8_t nb) {
+	struct transport_tx *trans = &pprzlink.tp.trans_tx;
+	struct link_device *dev = &pprzlink.dev;
+	uint8_t ac_id = 1;
+	uint8_t nb_events = nb * sizeof(struct trace_entry_t);
+	uint32_t dropped = trace_dropped;
+
+	long fd = 0; uint8_t size = trans->size_of(trans->impl, 0+4+1+nb_events+2);
+	if (trans->check_available_space(trans->impl, dev, &fd, size)) {
+		trans->count_bytes(trans->impl, dev, size);
+		trans->start_message(trans->impl, dev, fd, 0+4+1+nb_events+2);
+		trans->put_bytes(trans->impl, dev, fd, DL_TYPE_UINT8, DL_FORMAT_SCALAR, &ac_id, 1);
+		trans->put_named_byte(trans->impl, dev, fd, DL_TYPE_UINT8, DL_FORMAT_SCALAR, PPRZ_MSG_ID_TRACE, "TRACE");
+		trans->put_bytes(trans->impl, dev, fd, DL_TYPE_UINT32, DL_FORMAT_SCALAR, (void *) &dropped, 4);
+		trans->put_bytes(trans->impl, dev, fd, DL_TYPE_ARRAY_LENGTH, DL_FORMAT_SCALAR, (void *) &nb_events, 1);
+		trans->put_bytes(trans->impl, dev, fd, DL_TYPE_UINT8, DL_FORMAT_ARRAY, (void *) entries, nb_events);
+		trans->end_message(trans->impl, dev, fd);
+	} else trans->overrun(trans->impl, dev);
+}
+
+/**
+ * Start or stop streaming from the host
+ * <message name="TRACE_CTRL" id="11">
+ *   <field name="stream" type="uint8">1 to start and 0 to stop streaming</field>
+ * </message>
+ */
+static void trace_pprz_msg(uint8_t *data) {
+	trace_set_streaming(DL_TRACE_CTRL_stream(data) != 0);
+}
+
+/**
+ * Start or stop streaming, or print the latest events
+ */
+static void trace_cmd(char *cmdLine) {
+	static const char *events[] = {"", "hop", "rx start", "rx", "tx", "tx done", "timer set", "timeout", "state"};
+	struct trace_entry_t entry;
+
+	if(strstr(cmdLine, "on") != NULL) {
+		trace_set_streaming(true);
+		return;
+	}
+	else if(strstr(cmdLine, "off") != NULL) {
+		trace_set_streaming(false);
+		return;
+	}
+
+	// Print the events as long as they fit in the console FIFO
+	while(fifo_free(&cdcacm_console_tx) >= 64 && trace_read(&entry, 1) == 1) {
+		console_print("\r\n%10u %s %u %u", entry.time,
+			(entry.event < sizeof(events) / sizeof(events[0]))? events[entry.event] : "?", entry.arg, entry.val);
+	}
+}
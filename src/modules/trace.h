@@ -0,0 +1,78 @@
+/*
+ * This file is part of the superbitrf project.
+ *
+ * Copyright (C) 2018 Freek van Tienen <freek.v.tienen@gmail.com>
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MODULES_TRACE_H_
+#define MODULES_TRACE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* A fixed size ring of timestamped events from the radio drivers and protocol
+ * state machines. Adding an event only copies 8 bytes with the interrupts
+ * disabled, so it can be used in every interrupt without changing the timing.
+ * While streaming the ring is sent as TRACE messages, otherwise the oldest
+ * events are overwritten so the console can show the latest history.
+ * Only compiled in when building with TRACE=1 (the default for the main program).
+ */
+#define TRACE_SIZE 128						/**< The amount of events in the ring (power of two) */
+#define TRACE_MSG_EVENTS 16				/**< The maximum amount of events in one TRACE message */
+
+#define TRACE_CHIP_CYRF 0					/**< The CYRF6936 as radio chip argument */
+#define TRACE_CHIP_CC 1						/**< The CC2500 as radio chip argument */
+
+/* The traced events, arg is the radio chip for the driver events */
+enum trace_event_t {
+	TRACE_HOP = 1,							/**< Changed channel, val is the channel */
+	TRACE_RX_START,							/**< Started receiving */
+	TRACE_RX,										/**< Received a packet, val is the length (or the error flag on the CYRF6936) */
+	TRACE_TX,										/**< Started sending a packet, val is the length */
+	TRACE_TX_DONE,							/**< Finished sending a packet */
+	TRACE_TIMER_SET,						/**< Armed a timer channel (arg), val is the time in 10 microseconds */
+	TRACE_TIMEOUT,							/**< A timer channel (arg) expired */
+	TRACE_STATE,								/**< A protocol (arg) changed its state, val is the new state */
+};
+
+/* The protocol ids of TRACE_STATE, the same as the ground station uses */
+enum trace_prot_t {
+	TRACE_PROT_DSM_HACK = 1,
+	TRACE_PROT_FRSKY_HACK = 3,
+	TRACE_PROT_FRSKY_RECEIVER = 4,
+	TRACE_PROT_FRSKY_TRANSMITTER = 5,
+};
+
+/* A traced event */
+struct trace_entry_t {
+	uint32_t time;							/**< The time in microseconds */
+	uint8_t event;							/**< The event from enum trace_event_t */
+	uint8_t arg;								/**< The radio chip, timer channel or protocol */
+	uint16_t val;								/**< The event value */
+};
+
+#ifdef TRACE
+/* External functions */
+void trace_init(void);
+void trace_add(enum trace_event_t event, uint8_t arg, uint16_t val);
+void trace_state(enum trace_prot_t prot, uint8_t state);
+void trace_run(void);
+#else
+#define trace_add(event, arg, val) do {} while(0)
+#define trace_state(prot, state) do {} while(0)
+#endif
+
+#endif /* MODULES_TRACE_H_ */
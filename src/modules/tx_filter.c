@@ -0,0 +1,275 @@
+/*
+ * This file is part of the superbitrf project.
+ *
+ * Copyright (C) 2018 Freek van Tienen <freek.v.tienen@gmail.com>
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "tx_filter.h"
+#include "modules/config.h"
+#include "modules/console.h"
+#include "modules/mcu.h"
+#include "modules/pprzlink.h"
+
+/* Main variables */
+static struct tx_filter_entry_t tx_filter_table[TX_FILTER_SIZE];		/**< The allow and deny lists */
+static struct tx_filter_bucket_t tx_filter_buckets[TX_FILTER_BUCKETS];	/**< The token buckets of the latest transmitters */
+static uint32_t tx_filter_denied[TX_FILTER_CHIPS];									/**< The packets dropped by the filter table per chip */
+static uint32_t tx_filter_limited[TX_FILTER_CHIPS];								/**< The packets dropped by the rate limit per chip */
+
+/* Internal functions */
+static bool tx_filter_match(struct tx_filter_entry_t *entry, uint8_t chip_id, uint16_t id);
+static bool tx_filter_table_pass(uint8_t chip_id, uint16_t id);
+static bool tx_filter_table_set(uint8_t action, uint8_t chip_id, uint16_t id);
+static bool tx_filter_take(uint8_t chip_id, uint16_t id, uint32_t rx_time);
+static void tx_filter_pprz_msg(uint8_t *data);
+static void tx_filter_cmd(char *cmdLine);
+
+/**
+ * Clear the filter table and the token buckets
+ */
+void tx_filter_init(void) {
+	memset(tx_filter_table, 0, sizeof(tx_filter_table));
+	memset(tx_filter_buckets, 0, sizeof(tx_filter_buckets));
+	memset(tx_filter_denied, 0, sizeof(tx_filter_denied));
+	memset(tx_filter_limited, 0, sizeof(tx_filter_limited));
+
+	pprzlink_register_cb(PPRZ_MSG_ID_TX_FILTER, tx_filter_pprz_msg);
+	console_cmd_add("filter", "[clear|allow|deny|remove] [chip] [id]", tx_filter_cmd);
+}
+
+/**
+ * Change the filter table
+ * The radio interrupts read the table, so it is changed with the interrupts disabled.
+ * @param[in] action The action from enum tx_filter_action_t
+ * @param[in] chip_id The radio chip
+ * @param[in] id The transmitter ID, unused when clearing
+ * @return Whether the table was changed, false when it is full
+ */
+bool tx_filter_set(uint8_t action, uint8_t chip_id, uint16_t id) {
+	if(chip_id >= TX_FILTER_CHIPS)
+		return false;
+
+	uint32_t irq = mcu_irq_save();
+	bool ret = tx_filter_table_set(action, chip_id, id);
+	mcu_irq_restore(irq);
+	return ret;
+}
+
+/**
+ * Change the filter table, an entry is filled before it is marked as used
+ */
+static bool tx_filter_table_set(uint8_t action, uint8_t chip_id, uint16_t id) {
+	struct tx_filter_entry_t *free_entry = NULL;
+
+	for(uint8_t i = 0; i < TX_FILTER_SIZE; i++) {
+		struct tx_filter_entry_t *entry = &tx_filter_table[i];
+
+		if(!entry->used) {
+			if(free_entry == NULL)
+				free_entry = entry;
+		}
+		else if(action == TX_FILTER_CLEAR && entry->chip_id == chip_id)
+			entry->used = false;
+		else if(entry->chip_id == chip_id && entry->id == id) {
+			// Either remove the ID or switch between the lists
+			if(action == TX_FILTER_REMOVE)
+				entry->used = false;
+			else
+				entry->allow = (action == TX_FILTER_ALLOW);
+			return true;
+		}
+	}
+
+	if(action == TX_FILTER_CLEAR || action == TX_FILTER_REMOVE)
+		return true;
+	if(free_entry == NULL || (action != TX_FILTER_ALLOW && action != TX_FILTER_DENY))
+		return false;
+
+	free_entry->allow = (action == TX_FILTER_ALLOW);
+	free_entry->chip_id = chip_id;
+	free_entry->id = id;
+	free_entry->used = true;
+	return true;
+}
+
+/**
+ * Whether a received packet should be sent to the host
+ * @param[in] chip_id The radio chip which received the packet
+ * @param[in] id The ID bytes at the start of the packet
+ * @param[in] rx_time The time in microseconds the packet was received
+ * @return True when the transmitter is not filtered and within its rate limit
+ */
+bool tx_filter_pass(uint8_t chip_id, uint16_t id, uint32_t rx_time) {
+	uint32_t irq = mcu_irq_save();
+	bool ret = tx_filter_table_pass(chip_id, id);
+	if(!ret && chip_id < TX_FILTER_CHIPS)
+		tx_filter_denied[chip_id]++;
+	else if(ret)
+		ret = tx_filter_take(chip_id, id, rx_time);
+	mcu_irq_restore(irq);
+	return ret;
+}
+
+/**
+ * Take a token from the bucket of the transmitter
+ * The buckets hold filter_burst packets and are filled with filter_rate packets
+ * per second. Unknown transmitters take over the bucket of the transmitter which
+ * was not seen for the longest time and start with a full bucket.
+ * @param[in] chip_id The radio chip which received the packet
+ * @param[in] id The ID bytes at the start of the packet
+ * @param[in] rx_time The time in microseconds the packet was received
+ * @return True when a token was available
+ */
+bool tx_filter_rate(uint8_t chip_id, uint16_t id, uint32_t rx_time) {
+	uint32_t irq = mcu_irq_save();
+	bool ret = tx_filter_take(chip_id, id, rx_time);
+	mcu_irq_restore(irq);
+	return ret;
+}
+
+/**
+ * Take a token from the bucket of the transmitter, with the interrupts disabled as
+ * the chips can be handled from their interrupt and from the main loop
+ */
+static bool tx_filter_take(uint8_t chip_id, uint16_t id, uint32_t rx_time) {
+	struct tx_filter_bucket_t *bucket = NULL;
+	uint32_t full = (config.filter_burst? config.filter_burst : 1) * 1000000UL;
+
+	if(config.filter_rate == 0)
+		return true;
+
+	for(uint8_t i = 0; i < TX_FILTER_BUCKETS; i++) {
+		struct tx_filter_bucket_t *b = &tx_filter_buckets[i];
+		if(b->used && b->chip_id == chip_id && b->id == id) {
+			bucket = b;
+			break;
+		}
+		if(bucket == NULL || (bucket->used && (!b->used || rx_time - b->last > rx_time - bucket->last)))
+			bucket = b;
+	}
+
+	if(!bucket->used || bucket->chip_id != chip_id || bucket->id != id) {
+		bucket->used = true;
+		bucket->chip_id = chip_id;
+		bucket->id = id;
+		bucket->tokens = full;
+	} else {
+		// Refill for the elapsed time, which can not overflow once it fills the bucket
+		uint32_t elapsed = rx_time - bucket->last;
+		if(elapsed >= full / config.filter_rate)
+			bucket->tokens = full;
+		else
+			bucket->tokens += elapsed * config.filter_rate;
+		if(bucket->tokens > full)
+			bucket->tokens = full;
+	}
+	bucket->last = rx_time;
+
+	if(bucket->tokens < 1000000UL) {
+		if(chip_id < TX_FILTER_CHIPS)
+			tx_filter_limited[chip_id]++;
+		return false;
+	}
+
+	bucket->tokens -= 1000000UL;
+	return true;
+}
+
+/**
+ * Whether the table entry is for this transmitter, DSM2 transmitters send the
+ * inverted ID bytes so those also match on the CYRF6936
+ */
+static bool tx_filter_match(struct tx_filter_entry_t *entry, uint8_t chip_id, uint16_t id) {
+	uint16_t inv_id = ~id;
+	if(!entry->used || entry->chip_id != chip_id)
+		return false;
+	return (entry->id == id || (chip_id == 0 && entry->id == inv_id));
+}
+
+/**
+ * Check the transmitter against the allow and deny lists
+ */
+static bool tx_filter_table_pass(uint8_t chip_id, uint16_t id) {
+	bool has_allow = false, allowed = false;
+
+	for(uint8_t i = 0; i < TX_FILTER_SIZE; i++) {
+		struct tx_filter_entry_t *entry = &tx_filter_table[i];
+		if(entry->used && entry->chip_id == chip_id && entry->allow)
+			has_allow = true;
+
+		if(tx_filter_match(entry, chip_id, id)) {
+			if(!entry->allow)
+				return false;
+			allowed = true;
+		}
+	}
+
+	return (!has_allow || allowed);
+}
+
+/**
+ * Change the filter table from the host
+ * <message name="TX_FILTER" id="8">
+ *   <field name="action" type="uint8">0 clear, 1 allow, 2 deny or 3 remove</field>
+ *   <field name="chip_id" type="uint8">The radio chip</field>
+ *   <field name="ids" type="uint16[]">The transmitter IDs</field>
+ * </message>
+ */
+static void tx_filter_pprz_msg(uint8_t *data) {
+	uint8_t action = DL_TX_FILTER_action(data);
+	uint8_t chip_id = DL_TX_FILTER_chip_id(data);
+	uint8_t ids_nb = DL_TX_FILTER_ids_length(data);
+	uint16_t *ids = DL_TX_FILTER_ids(data);
+
+	if(action == TX_FILTER_CLEAR)
+		tx_filter_set(action, chip_id, 0);
+
+	for(uint8_t i = 0; i < ids_nb && action != TX_FILTER_CLEAR; i++) {
+		if(!tx_filter_set(action, chip_id, ids[i]))
+			console_print("\r\nFilter table full, ignored 0x%04X", ids[i]);
+	}
+}
+
+/**
+ * Print or change the filter table
+ */
+static void tx_filter_cmd(char *cmdLine) {
+	static const char *actions[] = {"clear", "allow", "deny", "remove"};
+	char action[8];
+	unsigned int chip_id = 0, id = 0;
+	int args = sscanf(cmdLine, "%7s %u %x", action, &chip_id, &id);
+
+	if(args >= 2) {
+		for(uint8_t i = 0; i < sizeof(actions) / sizeof(actions[0]); i++) {
+			if(strcmp(action, actions[i]) != 0)
+				continue;
+
+			if((i != TX_FILTER_CLEAR && args != 3) || !tx_filter_set(i, chip_id, id))
+				console_print("\r\nCould not %s the ID", actions[i]);
+			break;
+		}
+	}
+
+	for(uint8_t i = 0; i < TX_FILTER_SIZE; i++) {
+		if(tx_filter_table[i].used)
+			console_print("\r\n\tchip %u: 0x%04X %s", tx_filter_table[i].chip_id, tx_filter_table[i].id, tx_filter_table[i].allow? "allow" : "deny");
+	}
+	for(uint8_t i = 0; i < TX_FILTER_CHIPS; i++)
+		console_print("\r\nChip %u denied %u, rate limited %u", i, tx_filter_denied[i], tx_filter_limited[i]);
+}
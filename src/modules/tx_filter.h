@@ -0,0 +1,69 @@
+/*
+ * This file is part of the superbitrf project.
+ *
+ * Copyright (C) 2018 Freek van Tienen <freek.v.tienen@gmail.com>
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MODULES_TX_FILTER_H_
+#define MODULES_TX_FILTER_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Filters the received radio packets per transmitter before they are sent to
+ * the host. A transmitter is identified by the radio chip and the two ID bytes
+ * which start every packet, the lower DSM TX ID bytes (also when inverted for
+ * DSM2) or the FrSky bind ID. Denied IDs are always dropped and when a chip has
+ * allowed IDs only those pass. Every transmitter which passes gets its own
+ * token bucket, so the host bandwidth grows with the amount of transmitters
+ * instead of with their packet rate.
+ */
+#define TX_FILTER_SIZE 16				/**< The amount of IDs in the filter table */
+#define TX_FILTER_BUCKETS 16		/**< The amount of transmitters with their own rate limit */
+#define TX_FILTER_CHIPS 2				/**< The amount of radio chips (CYRF6936 and CC2500) */
+
+/* The filter table actions */
+enum tx_filter_action_t {
+	TX_FILTER_CLEAR = 0,					/**< Remove all IDs of the chip */
+	TX_FILTER_ALLOW = 1,					/**< Add IDs to the allow list */
+	TX_FILTER_DENY = 2,						/**< Add IDs to the deny list */
+	TX_FILTER_REMOVE = 3,					/**< Remove IDs from the table */
+};
+
+/* A filter table entry */
+struct tx_filter_entry_t {
+	bool used;										/**< Whether the entry is used */
+	bool allow;										/**< Whether the ID is allowed or denied */
+	uint8_t chip_id;							/**< The radio chip */
+	uint16_t id;									/**< The transmitter ID */
+};
+
+/* A token bucket of one transmitter */
+struct tx_filter_bucket_t {
+	bool used;										/**< Whether the bucket is used */
+	uint8_t chip_id;							/**< The radio chip */
+	uint16_t id;									/**< The transmitter ID */
+	uint32_t tokens;							/**< The tokens in millionths of a packet */
+	uint32_t last;								/**< The last time in microseconds the bucket was filled */
+};
+
+/* External functions */
+void tx_filter_init(void);
+bool tx_filter_set(uint8_t action, uint8_t chip_id, uint16_t id);
+bool tx_filter_pass(uint8_t chip_id, uint16_t id, uint32_t rx_time);
+bool tx_filter_rate(uint8_t chip_id, uint16_t id, uint32_t rx_time);
+
+#endif /* MODULES_TX_FILTER_H_ */
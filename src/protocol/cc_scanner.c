@@ -28,6 +28,7 @@
 #include "modules/ant_switch.h"
 #include "modules/cc2500.h"
 #include "modules/pprzlink.h"
+#include "modules/tx_filter.h"
 #include "modules/console.h"
 #include "helper/frsky.h"
 
@@ -43,6 +44,7 @@ static void protocol_cc_scanner_parse_arg(uint8_t type, uint8_t *arg, uint16_t l
 /* Main protocol structure */
 struct protocol_t protocol_cc_scanner = {
 	.name = "CC2500 Scanner",
+	.radio = PROTOCOL_RADIO_CC,
 	.init = protocol_cc_scanner_init,
 	.deinit = protocol_cc_scanner_deinit,
 	.start = protocol_cc_scanner_start,
@@ -70,16 +72,16 @@ static uint8_t last_chan_num = 0;
 static void protocol_cc_scanner_init(void) {
 	uint8_t mfg_id[2];
 	// Stop the timer
-	timer1_stop();
+	timer2_stop();
 
 #ifdef CC_DEV_ANT
-	// Switch the antenna to the CC2500
+	// Claim the antenna for the CC2500
 	bool ant_state[] = CC_DEV_ANT;
 #ifdef CLOSEBY_SCAN
 	ant_state[0] = !ant_state[0];
 	ant_state[1] = !ant_state[1];
 #endif
-	ant_switch(ant_state);
+	ant_switch_claim(ANT_SWITCH_CC, ant_state, false);
 #endif
 
 	// Read the CC2500 MFG and copy from the config
@@ -89,7 +91,7 @@ static void protocol_cc_scanner_init(void) {
 	last_chan_num = cc_read_register(CC2500_CHANNR);
 
 	// Set the callbacks
-	timer1_register_callback(protocol_cc_scanner_timer);
+	timer2_register_callback(protocol_cc_scanner_timer);
 	cc_register_recv_callback(protocol_cc_scanner_receive);
 	cc_register_send_callback(NULL);
 
@@ -100,7 +102,8 @@ static void protocol_cc_scanner_init(void) {
  * Deinitialize the variables
  */
 static void protocol_cc_scanner_deinit(void) {
-	timer1_register_callback(NULL);
+	timer2_register_callback(NULL);
+	ant_switch_release(ANT_SWITCH_CC);
 	cc_register_recv_callback(NULL);
 
 	if(cc_scan_args != NULL) {
@@ -115,6 +118,12 @@ static void protocol_cc_scanner_deinit(void) {
  * Configure the CC2500 and start scanning
  */
 static void protocol_cc_scanner_start(void) {
+	// Check if we received the channels to scan
+	if(cc_scan_args_len < 2) {
+		console_print("\r\nCC Scanner has no channels to scan");
+		return;
+	}
+
 	cc_scan_idx = 0;
 	
 	cc_strobe(CC2500_SIDLE);
@@ -125,7 +134,7 @@ static void protocol_cc_scanner_start(void) {
 	cc_write_register(CC2500_FSCTRL0, config.cc_fsctrl0 + cc_scan_args[1]);
 	cc_strobe(CC2500_SFRX);
 	cc_strobe(CC2500_SRX);
-	timer1_set(FRSKY_SEND_TIME * (FRSKYX_USED_CHAN+1));
+	timer2_set(FRSKY_SEND_TIME * (FRSKYX_USED_CHAN+1));
 
 	console_print("\r\nCC Scanner started %d...", frsky_protocol);
 }
@@ -136,7 +145,7 @@ static void protocol_cc_scanner_start(void) {
 static void protocol_cc_scanner_stop(void) {
 	// Stop the timer
 	cc_strobe(CC2500_SIDLE);
-	timer1_stop();
+	timer2_stop();
 	console_print("\r\nCC Scanner stopped...");
 }
 
@@ -151,6 +160,11 @@ static void protocol_cc_scanner_run(void) {
  * Print the status of the scanner
  */
 static void protocol_cc_scanner_status(void) {
+	if(cc_scan_args_len < 2) {
+		console_print("\r\n\tNo channels to scan");
+		return;
+	}
+
 	console_print("\r\n\tScanning at index %d at channel %d [%d]", cc_scan_idx, cc_scan_args[cc_scan_idx*2], cc_scan_args[cc_scan_idx*2+1]);
 }
 
@@ -189,7 +203,7 @@ static void protocol_cc_scanner_parse_arg(uint8_t type, uint8_t *arg, uint16_t l
 
 static void protocol_cc_scanner_timer(void) {
 	protocol_cc_scanner_next();
-	timer1_set(FRSKY_SEND_TIME * (FRSKYX_USED_CHAN+1));
+	timer2_set(FRSKY_SEND_TIME * (FRSKYX_USED_CHAN+1));
 }
 
 static void protocol_cc_scanner_receive(uint8_t len) {
@@ -214,11 +228,14 @@ static void protocol_cc_scanner_receive(uint8_t len) {
 	packet[packet_len+3] = cc_scan_args[cc_scan_idx*2];
 	packet[packet_len+4] = cc_scan_args[cc_scan_idx*2 + 1];
 
+	// Only forward the transmitters which pass the filter and their rate limit
 	uint8_t chip_id = 1;
-	pprz_msg_send_RECV_DATA(&pprzlink.tp.trans_tx, &pprzlink.dev, 1, &chip_id, packet_len+5, packet);
+	if(packet_len < 2 || tx_filter_pass(chip_id, (packet[1] << 8) | packet[2], cc_get_rx_time())) {
+		pprzlink_send_recv_data(chip_id, cc_get_rx_time(), packet_len+5, packet);
+		LED_TOGGLE(LED_RX);
+	}
 
 	packet_len = 0;
-	LED_TOGGLE(LED_RX);
 	cc_strobe(CC2500_SIDLE);
 	cc_strobe(CC2500_SFRX);
 	cc_strobe(CC2500_SRX);
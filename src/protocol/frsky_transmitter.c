@@ -27,6 +27,7 @@
 #include "modules/ant_switch.h"
 #include "modules/cc2500.h"
 #include "modules/pprzlink.h"
+#include "modules/trace.h"
 #include "modules/console.h"
 #include "modules/counter.h"
 #include "helper/frsky.h"
@@ -43,6 +44,7 @@ static void protocol_frsky_transmitter_parse_arg(uint8_t type, uint8_t *arg, uin
 /* Main protocol structure */
 struct protocol_t protocol_frsky_transmitter = {
 	.name = "FrSky Transmitter",
+	.radio = PROTOCOL_RADIO_CC,
 	.init = protocol_frsky_transmitter_init,
 	.deinit = protocol_frsky_transmitter_deinit,
 	.start = protocol_frsky_transmitter_start,
@@ -57,6 +59,7 @@ static void protocol_frsky_transmitter_timer(void);
 static void protocol_frsky_transmitter_receive(uint8_t len);
 static void protocol_frsky_transmitter_send(uint8_t len);
 static void protocol_frsky_transmitter_next(void);
+static void protocol_frsky_transmitter_tuned(void);
 static bool protocol_frsky_parse_telem(uint8_t *packet);
 static void protocol_frsky_build_packet(void);
 
@@ -76,12 +79,12 @@ static uint8_t rx_num = 1;
  */
 static void protocol_frsky_transmitter_init(void) {
 	// Stop the timer
-	timer1_stop();
+	timer2_stop();
 
 #ifdef CC_DEV_ANT
-	// Switch the antenna to the CC2500
+	// Claim the antenna for the CC2500
 	bool ant_state[] = CC_DEV_ANT;
-	ant_switch(ant_state);
+	ant_switch_claim(ANT_SWITCH_CC, ant_state, true);
 #endif
 
 	// Configure the CC2500
@@ -90,7 +93,7 @@ static void protocol_frsky_transmitter_init(void) {
 	cc_set_mode(CC2500_TXRX_TX);
 
 	// Set the callbacks
-	timer1_register_callback(protocol_frsky_transmitter_timer);
+	timer2_register_callback(protocol_frsky_transmitter_timer);
 	cc_register_recv_callback(protocol_frsky_transmitter_receive);
 	cc_register_send_callback(protocol_frsky_transmitter_send);
 
@@ -101,7 +104,8 @@ static void protocol_frsky_transmitter_init(void) {
  * Deinitialize the variables
  */
 static void protocol_frsky_transmitter_deinit(void) {
-	timer1_register_callback(NULL);
+	timer2_register_callback(NULL);
+	ant_switch_release(ANT_SWITCH_CC);
 	cc_register_recv_callback(NULL);
 	cc_register_send_callback(NULL);
 
@@ -123,23 +127,32 @@ static void protocol_frsky_transmitter_start(void) {
 	cc_write_register(CC2500_FSCTRL0, config.cc_fsctrl0);
 	cc_write_register(CC2500_ADDR, config.frsky_bind_id[0]);
 
-  // Calibrate all channels
-	frsky_tune_channels(config.frsky_hop_table, FRSKY_HOP_TABLE_LENGTH, frsky_fscal1, &frsky_fscal2, &frsky_fscal3);
-
 	// Set the correct packet length
 	if(frsky_protocol == FRSKYX_EU)
 		frsky_packet_length = FRSKY_PACKET_LENGTH_EU;
 	else
 		frsky_packet_length = FRSKY_PACKET_LENGTH;
 
+  // Calibrate all channels in the background
+	frsky_tune_channels(config.frsky_hop_table, FRSKY_HOP_TABLE_LENGTH, protocol_frsky_transmitter_tuned);
+}
+
+/**
+ * Start transmitting when all channels are calibrated
+ */
+static void protocol_frsky_transmitter_tuned(void) {
+	frsky_init_hops(config.frsky_hop_table);
+
 	// Go to the first channel
 	frsky_hop_idx = FRSKY_HOP_TABLE_LENGTH-1;
 	protocol_frsky_transmitter_next();
 
 	// Start transmitting
 	frsky_transmitter_state = FRSKY_TRX_SEND;
-	timer1_set(FRSKY_SEND_TIME);
+	timer2_set(FRSKY_SEND_TIME);
 	console_print("\r\nFrSky Transmitter started...");
+
+	trace_state(TRACE_PROT_FRSKY_TRANSMITTER, frsky_transmitter_state);
 }
 
 /**
@@ -148,7 +161,8 @@ static void protocol_frsky_transmitter_start(void) {
 static void protocol_frsky_transmitter_stop(void) {
 	// Stop the timer and put the CC2500 to idle
 	cc_strobe(CC2500_SIDLE);
-	timer1_stop();
+	timer2_stop();
+	frsky_tune_abort();
 	console_print("\r\nFrSky Transmitter stopped...");
 }
 
@@ -185,7 +199,7 @@ static void protocol_frsky_transmitter_timer(void) {
 	ticks = counter_status.ticks;
 	switch(frsky_transmitter_state) {
 		case FRSKY_TRX_SEND:
-			timer1_set(FRSKY_SEND_TIME);
+			timer2_set_next(FRSKY_SEND_TIME);
 			cc_set_mode(CC2500_TXRX_TX+10);
 			protocol_frsky_transmitter_next();
 			cc_set_power(7);
@@ -194,11 +208,12 @@ static void protocol_frsky_transmitter_timer(void) {
 			protocol_frsky_build_packet();
 			cc_strobe(CC2500_SIDLE);
 			cc_write_data(frsky_packet, frsky_packet[0]+1);	
-			console_print("\r\nS %d", ticks-old_ticks);
+			console_log("\r\nS %d", ticks-old_ticks);
 			old_ticks = ticks;
 			break;
 	}
-	
+
+	trace_state(TRACE_PROT_FRSKY_TRANSMITTER, frsky_transmitter_state);
 }
 
 static void protocol_frsky_transmitter_receive(uint8_t len) {
@@ -223,7 +238,7 @@ static void protocol_frsky_transmitter_receive(uint8_t len) {
 
 	/* Parse the packet */
 	if(protocol_frsky_parse_telem(data)) {
-		console_print("\r\nT %d %d", ticks-old_ticks, timer1_get_time());
+		console_log("\r\nT %d %d", ticks-old_ticks, timer2_get_time());
 		old_ticks = ticks;
 	}
 	cc_strobe(CC2500_SIDLE);
@@ -236,7 +251,7 @@ static void protocol_frsky_transmitter_send(uint8_t len __attribute__((unused)))
 	cc_set_mode(CC2500_TXRX_RX);
 	cc_strobe(CC2500_SIDLE);
 	cc_strobe(CC2500_SRX);
-	console_print("\r\nD %d", ticks-old_ticks);
+	console_log("\r\nD %d", ticks-old_ticks);
 	old_ticks = ticks;
 }
 
@@ -245,12 +260,7 @@ static void protocol_frsky_transmitter_send(uint8_t len __attribute__((unused)))
  */
 static void protocol_frsky_transmitter_next(void) {
 	frsky_hop_idx = (frsky_hop_idx + frsky_chanskip) % FRSKY_HOP_TABLE_LENGTH;
-	cc_strobe(CC2500_SIDLE);
-
-	cc_write_register(CC2500_FSCAL1, frsky_fscal1[frsky_hop_idx]);
-	cc_write_register(CC2500_FSCAL2, frsky_fscal2);
-	cc_write_register(CC2500_FSCAL3, frsky_fscal3);
-	cc_write_register(CC2500_CHANNR, config.frsky_hop_table[frsky_hop_idx]);
+	cc_hop(&frsky_hops[frsky_hop_idx]);
 }
 
 /**
@@ -281,7 +291,7 @@ static bool protocol_frsky_parse_telem(uint8_t *packet) {
 	packet[FRSKY_TELEM_LENGTH+3] = config.frsky_hop_table[frsky_hop_idx];
 	packet[FRSKY_TELEM_LENGTH+4] = 0;
 	uint8_t chip_id = 1;
-	pprz_msg_send_RECV_DATA(&pprzlink.tp.trans_tx, &pprzlink.dev, 1, &chip_id, FRSKY_TELEM_LENGTH+5, packet);
+	pprzlink_send_recv_data(chip_id, cc_get_rx_time(), FRSKY_TELEM_LENGTH+5, packet);
 
 	// Update the telemetry sequence based on the received data
 	if((packet[5] & 0xF) == 0x8 || (packet[5] >> 4) == 0x8) {
@@ -339,5 +349,5 @@ static void protocol_frsky_build_packet(void) {
 	frsky_packet[frsky_packet_length+4] = 0;
 	//send_part2 = !send_part2;
 	//uint8_t chip_id = 1;
-	//pprz_msg_send_RECV_DATA(&pprzlink.tp.trans_tx, &pprzlink.dev, 1, &chip_id, frsky_packet_length+2, frsky_packet);
+	//pprzlink_send_recv_data(chip_id, cc_get_rx_time(), frsky_packet_length+2, frsky_packet);
 }
\ No newline at end of file
@@ -17,11 +17,10 @@
  * along with this library.  If not, see <http://www.gnu.org/licenses/>.
  */
 
-#include <libopencm3/stm32/rcc.h>
-#include <libopencm3/stm32/desig.h>
-#define SW_VERSION 1000
+#define SW_VERSION 1001
 
 /* Load the modules */
+#include "modules/mcu.h"
 #include "modules/config.h"
 #include "modules/led.h"
 #include "modules/spi.h"
@@ -34,17 +33,17 @@
 #include "modules/cc2500.h"
 #include "modules/console.h"
 #include "modules/pprzlink.h"
+#include "modules/tx_filter.h"
 #include "modules/protocol.h"
+#include "modules/sched.h"
+#include "modules/prof.h"
+#include "modules/trace.h"
 
 static void msg_req_info_cb(uint8_t *data);
 
 int main(void) {
 	// Setup the clock
-#ifndef BOARD_V2_0
-	rcc_clock_setup_in_hse_12mhz_out_72mhz();
-#else
-	rcc_clock_setup_in_hse_8mhz_out_72mhz();
-#endif
+	mcu_init();
 
 	// Initialize the modules
 	config_init();
@@ -58,28 +57,39 @@ int main(void) {
 	cyrf_init();
 	cc_init();
 	console_init();
+	sched_init();
 	pprzlink_init();
+	tx_filter_init();
 	protocol_init();
+#ifdef TRACE
+	trace_init();
+#endif
+#ifdef PROF
+	prof_init();
+#endif
 
 	// Bind INFO callback
 	pprzlink_register_cb(PPRZ_MSG_ID_REQ_INFO, msg_req_info_cb);
 
-	/* The main loop */
-	uint32_t start_ticks = 0;
-	while (1) {
-		if(start_ticks + 10 <= counter_get_ticks()) {
-			start_ticks = counter_get_ticks();
-			cyrf_run();
-			cc_run();
-			protocol_run();
-		}
-		else if(start_ticks + 8 >= counter_get_ticks()) {
-			cdcacm_run();
-			pprzlink_run();
-			console_run();
-		}
-	}
+	// Radio polling runs every 10 ticks, the USB side only when there is something to do
+	sched_add("cyrf", cyrf_run, SCHED_PRIO_RADIO, 10, 0);
+	sched_add("cc", cc_run, SCHED_PRIO_RADIO, 10, 0);
+	sched_add("protocol", protocol_run, SCHED_PRIO_PROTOCOL, 10, 0);
+	sched_add("usb", cdcacm_run, SCHED_PRIO_USB, counter_get_ticks_of_ms(1), SCHED_EV_USB_TX);
+	sched_add("pprzlink", pprzlink_run, SCHED_PRIO_LINK, 0, SCHED_EV_DATA_RX);
+	sched_add("console", console_run, SCHED_PRIO_CONSOLE, counter_get_ticks_of_ms(10), SCHED_EV_CONSOLE_RX | SCHED_EV_CONSOLE_LOG);
+	sched_add("stats", pprzlink_send_stats, SCHED_PRIO_CONSOLE, counter_get_ticks_of_ms(1000), 0);
+	sched_add("batch", pprzlink_batch_run, SCHED_PRIO_LINK, counter_get_ticks_of_ms(1), 0);
+	sched_add("config", config_run, SCHED_PRIO_CONSOLE, counter_get_ticks_of_ms(10), 0);
+#ifdef TRACE
+	sched_add("trace", trace_run, SCHED_PRIO_CONSOLE, counter_get_ticks_of_ms(10), 0);
+#endif
+#ifdef PROF
+	sched_add("prof", prof_send_stats, SCHED_PRIO_CONSOLE, counter_get_ticks_of_ms(1000), 0);
+#endif
 
+	/* The main loop */
+	sched_run();
 	return 0;
 }
 
@@ -90,7 +100,7 @@ static void msg_req_info_cb(uint8_t *data) {
 	uint32_t hw_id[3];
 	uint32_t board = BOARD_ID;
 	uint32_t sw_version = SW_VERSION;
-	desig_get_unique_id(hw_id);
+	mcu_get_unique_id(hw_id);
 	console_print("\r\nPPRZLINK connected (version: %d)", DL_REQ_INFO_version(data));
 
 	// Send the information back
@@ -22,7 +22,7 @@
 /* Load the modules */
 #include "modules/led.h"
 #include "modules/cdcacm.h"
-#include "modules/ring.h"
+#include "modules/fifo.h"
 
 void our_relay_process(void);
 
@@ -33,15 +33,13 @@ void our_relay_process(void)
 	/* Copy over byte by byte from the incoming buffer to the outgoing buffer
 	 * until either the incoming buffer is empty or the outgoing buffer is full.
 	 */
-	while ((!RING_EMPTY(&cdcacm_data_rx)) && (!RING_FULL(&cdcacm_console_tx))) {
-		ring_read_ch(&cdcacm_data_rx, &buffer);
+	while ((fifo_free(&cdcacm_console_tx) > 0) && fifo_read_ch(&cdcacm_data_rx, &buffer)) {
 		LED_TOGGLE(1);
-		ring_write_ch(&cdcacm_console_tx, buffer);
+		fifo_write_ch(&cdcacm_console_tx, buffer);
 	}
-	while ((!RING_EMPTY(&cdcacm_console_rx)) && (!RING_FULL(&cdcacm_data_tx))) {
-		ring_read_ch(&cdcacm_console_rx, &buffer);
+	while ((fifo_free(&cdcacm_data_tx) > 0) && fifo_read_ch(&cdcacm_console_rx, &buffer)) {
 		LED_TOGGLE(2);
-		ring_write_ch(&cdcacm_data_tx, buffer);
+		fifo_write_ch(&cdcacm_data_tx, buffer);
 	}
 }
 
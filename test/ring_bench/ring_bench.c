@@ -0,0 +1,145 @@
+/*
+ * This file is part of the superbitrf project.
+ *
+ * Copyright (C) 2018 Freek van Tienen <freek.v.tienen@gmail.com>
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "modules/ring.h"
+#include "modules/fifo.h"
+
+#define BENCH_BUF_SIZE 256					/**< The buffer size like the USB FIFOs */
+#define BENCH_PACKET 64							/**< The USB bulk packet size */
+#define BENCH_BYTES (64UL << 20)		/**< The amount of bytes moved per benchmark */
+
+static uint8_t bench_buf[BENCH_BUF_SIZE];
+static uint8_t bench_pkt[BENCH_PACKET];
+static volatile uint32_t bench_sink;	/**< Keeps the compiler from removing the reads */
+
+/**
+ * Get the monotonic time in seconds
+ */
+static double bench_time(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * Print the throughput of one benchmark
+ */
+static void bench_print(const char *name, double start) {
+	double dt = bench_time() - start;
+	printf("%-28s %8.1f MB/s %6.2f ns/byte\n", name, BENCH_BYTES / dt / 1e6, dt * 1e9 / BENCH_BYTES);
+}
+
+static void bench_ring_bytes(void) {
+	struct ring ring;
+	uint8_t ch = 0;
+	unsigned long i;
+	ring_init(&ring, bench_buf, BENCH_BUF_SIZE);
+
+	double start = bench_time();
+	for(i = 0; i < BENCH_BYTES; i++) {
+		ring_write_ch(&ring, i);
+		ring_read_ch(&ring, &ch);
+		bench_sink += ch;
+	}
+	bench_print("ring byte", start);
+}
+
+static void bench_fifo_bytes(void) {
+	struct fifo_t fifo;
+	uint8_t ch = 0;
+	unsigned long i;
+	fifo_init(&fifo, bench_buf, BENCH_BUF_SIZE);
+
+	double start = bench_time();
+	for(i = 0; i < BENCH_BYTES; i++) {
+		fifo_write_ch(&fifo, i);
+		fifo_read_ch(&fifo, &ch);
+		bench_sink += ch;
+	}
+	bench_print("fifo byte", start);
+}
+
+static void bench_ring_packets(void) {
+	struct ring ring;
+	unsigned long i;
+	ring_init(&ring, bench_buf, BENCH_BUF_SIZE);
+
+	// Offset by a few bytes so packets wrap around the end like in use
+	ring_write(&ring, bench_pkt, 5);
+	double start = bench_time();
+	for(i = 0; i < BENCH_BYTES; i += BENCH_PACKET) {
+		ring_write(&ring, bench_pkt, BENCH_PACKET);
+		ring_read(&ring, bench_pkt, BENCH_PACKET);
+		bench_sink += bench_pkt[0];
+	}
+	bench_print("ring 64B packet", start);
+}
+
+static void bench_fifo_packets(void) {
+	struct fifo_t fifo;
+	unsigned long i;
+	fifo_init(&fifo, bench_buf, BENCH_BUF_SIZE);
+
+	// Offset by a few bytes so packets wrap around the end like in use
+	fifo_write(&fifo, bench_pkt, 5);
+	double start = bench_time();
+	for(i = 0; i < BENCH_BYTES; i += BENCH_PACKET) {
+		fifo_write(&fifo, bench_pkt, BENCH_PACKET);
+		fifo_read(&fifo, bench_pkt, BENCH_PACKET);
+		bench_sink += bench_pkt[0];
+	}
+	bench_print("fifo 64B packet", start);
+}
+
+static void bench_fifo_spans(void) {
+	struct fifo_t fifo;
+	const uint8_t *rptr;
+	uint8_t *wptr;
+	uint32_t len;
+	unsigned long i;
+	fifo_init(&fifo, bench_buf, BENCH_BUF_SIZE);
+
+	// The producer copies in, the consumer hands out the span like usbd_ep_write_packet
+	double start = bench_time();
+	for(i = 0; i < BENCH_BYTES; i += len) {
+		len = fifo_write_span(&fifo, &wptr);
+		if(len > BENCH_PACKET)
+			len = BENCH_PACKET;
+		memcpy(wptr, bench_pkt, len);
+		fifo_write_commit(&fifo, len);
+
+		len = fifo_read_span(&fifo, &rptr);
+		bench_sink += rptr[0];
+		fifo_read_commit(&fifo, len);
+	}
+	bench_print("fifo 64B zero-copy span", start);
+}
+
+int main(void) {
+	bench_ring_bytes();
+	bench_fifo_bytes();
+	bench_ring_packets();
+	bench_fifo_packets();
+	bench_fifo_spans();
+	return 0;
+}
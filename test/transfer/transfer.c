@@ -29,7 +29,7 @@
 #include "modules/spi.h"
 #include "modules/timer.h"
 #include "modules/cdcacm.h"
-#include "modules/ring.h"
+#include "modules/fifo.h"
 #include "modules/cyrf6936.h"
 
 /* The packet that it sended */
@@ -89,8 +89,8 @@ void on_receive(bool error __attribute__((unused))) {
 				packet_buf[0], packet_buf[1], packet_buf[2], packet_buf[3], packet_buf[4], packet_buf[5],
 				packet_buf[6], packet_buf[7], packet_buf[8], packet_buf[9], packet_buf[10], packet_buf[11],
 				packet_buf[12], packet_buf[13], packet_buf[14], packet_buf[15]);
-	ring_write(&cdcacm_data_tx, packet_buf, 15);
-	ring_write(&cdcacm_console_tx, (uint8_t*)cdc_msg, strlen(cdc_msg));
+	fifo_write(&cdcacm_data_tx, packet_buf, 15);
+	fifo_write(&cdcacm_console_tx, (uint8_t*)cdc_msg, strlen(cdc_msg));
 
 	// Compare with packet
 	count = 0;
@@ -126,6 +126,7 @@ int main(void)
 	cdcacm_init();
 	spi_init();
 	cyrf_init();
+	cyrf_wait_ready();
 
 	// Register callbacks
 	timer1_register_callback(on_timer);